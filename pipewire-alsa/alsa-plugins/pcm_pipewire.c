@@ -1103,6 +1103,10 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp, const char *name,
 	pw->io.private_data = pw;
 	pw->io.poll_fd = pw->fd;
 	pw->io.poll_events = POLLIN;
+	/* The ioplug allocates the mmap ring of the application itself, there
+	 * is no way to back it with the (shared) memory of the pw_stream
+	 * buffers. Samples are copied between the ring and the dequeued
+	 * buffer in snd_pcm_pipewire_process(). */
 	pw->io.mmap_rw = 1;
 #ifdef SND_PCM_IOPLUG_FLAG_BOUNDARY_WA
 	pw->io.flags = SND_PCM_IOPLUG_FLAG_BOUNDARY_WA;
@@ -54,6 +54,8 @@
 #include "pipewire/extensions/metadata.h"
 #include "pipewire-jack-extensions.h"
 
+#include "../../spa/plugins/audiomixer/mix-ops.h"
+
 #define JACK_DEFAULT_VIDEO_TYPE	"32 bit float RGBA video"
 
 /* use 512KB stack per thread - the default is way too high to be feasible
@@ -71,10 +73,11 @@
 
 #define MAX_BUFFER_FRAMES		8192
 
-#define MAX_ALIGN			16
+#define MAX_ALIGN			32
 #define MAX_PORTS			1024
 #define MAX_BUFFERS			2
 #define MAX_BUFFER_DATAS		1u
+#define MAX_MIX				128
 
 #define REAL_JACK_PORT_NAME_SIZE (JACK_CLIENT_NAME_SIZE + JACK_PORT_NAME_SIZE)
 
@@ -108,9 +111,27 @@ static bool mlock_warned = false;
 #define OBJECT_CHUNK		8
 #define RECYCLE_THRESHOLD	128
 
-typedef void (*mix2_func) (float *dst, float *src1, float *src2, int n_samples);
+/* the names a port can be found with */
+#define PORT_NAME_NAME		0
+#define PORT_NAME_ALIAS1	1
+#define PORT_NAME_ALIAS2	2
+#define PORT_NAME_SYSTEM	3
+#define N_PORT_NAMES		4
+
+struct object;
+
+struct name_entry {
+	struct spa_list link;
+	struct object *object;		/* NULL when not in the index */
+	const char *name;
+	uint32_t hash;
+};
 
-static mix2_func mix2;
+struct name_index {
+	struct spa_list *buckets;
+	uint32_t mask;
+	uint32_t count;
+};
 
 struct object {
 	struct spa_list link;
@@ -157,6 +178,7 @@ struct object {
 			bool is_monitor;
 			struct object *node;
 			struct spa_latency_info latency[2];
+			struct name_entry names[N_PORT_NAMES];
 		} port;
 	};
 	struct pw_proxy *proxy;
@@ -258,6 +280,18 @@ struct link {
 	int signalfd;
 };
 
+/* the sorted result of a previous jack_get_ports() call */
+#define PORT_CACHE_SIZE		4
+struct port_cache {
+	char *port_pattern;
+	char *type_pattern;
+	unsigned long flags;
+	uint32_t node_id;
+	uint32_t version;
+	uint32_t count;
+	struct object **ports;
+};
+
 struct context {
 	struct pw_loop *l;
 	struct pw_thread_loop *loop;	/* thread_lock protects all below */
@@ -266,6 +300,10 @@ struct context {
 	pthread_mutex_t lock;		/* protects map and lists below, in addition to thread_lock */
 	struct spa_list objects;
 	uint32_t free_count;
+	struct name_index port_names;	/* ports on name, aliases and system name */
+	uint32_t ports_version;		/* changes when the jack_get_ports() result can change */
+	struct port_cache port_cache[PORT_CACHE_SIZE];
+	uint32_t port_cache_next;
 };
 
 #define GET_DIRECTION(f)	((f) & JackPortIsInput ? SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT)
@@ -359,6 +397,8 @@ struct client {
 
 	struct spa_list mix;
 	struct spa_list free_mix;
+	struct mix_ops mix_ops;
+	float mix_tmp[MAX_BUFFER_FRAMES];
 
 	struct spa_list free_ports;
 	struct pw_map ports[2];
@@ -409,6 +449,98 @@ int pw_jack_match_rules(const char *rules, size_t size, const struct spa_dict *p
 		int (*matched) (void *data, const char *action, const char *val, int len),
 		void *data);
 
+static inline uint32_t name_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	while (*name)
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	return hash;
+}
+
+static int name_index_init(struct name_index *idx, uint32_t n_buckets)
+{
+	uint32_t i;
+
+	idx->buckets = malloc(n_buckets * sizeof(struct spa_list));
+	if (idx->buckets == NULL)
+		return -errno;
+	for (i = 0; i < n_buckets; i++)
+		spa_list_init(&idx->buckets[i]);
+	idx->mask = n_buckets - 1;
+	idx->count = 0;
+	return 0;
+}
+
+static void name_index_clear(struct name_index *idx)
+{
+	free(idx->buckets);
+	spa_zero(*idx);
+}
+
+static void name_index_grow(struct name_index *idx)
+{
+	struct name_index tmp;
+	struct name_entry *e;
+	uint32_t i;
+
+	/* when this fails we keep the old table with longer chains */
+	if (name_index_init(&tmp, (idx->mask + 1) * 2) < 0)
+		return;
+
+	for (i = 0; i <= idx->mask; i++) {
+		spa_list_consume(e, &idx->buckets[i], link) {
+			spa_list_remove(&e->link);
+			spa_list_append(&tmp.buckets[e->hash & tmp.mask], &e->link);
+		}
+	}
+	tmp.count = idx->count;
+	free(idx->buckets);
+	*idx = tmp;
+}
+
+/* (re)index the names of a port after one of them changed and invalidate
+ * the jack_get_ports() cache. Call with the context lock. */
+static void port_names_update(struct client *c, struct object *o)
+{
+	struct name_index *idx = &c->context.port_names;
+	const char *names[N_PORT_NAMES] = {
+		[PORT_NAME_NAME] = o->port.name,
+		[PORT_NAME_ALIAS1] = o->port.alias1,
+		[PORT_NAME_ALIAS2] = o->port.alias2,
+		[PORT_NAME_SYSTEM] = o->port.system,
+	};
+	uint32_t i;
+
+	for (i = 0; i < N_PORT_NAMES; i++) {
+		struct name_entry *e = &o->port.names[i];
+
+		if (e->object != NULL) {
+			spa_list_remove(&e->link);
+			idx->count--;
+			e->object = NULL;
+		}
+		if (o->removed || names[i][0] == '\0')
+			continue;
+
+		if (idx->count > idx->mask)
+			name_index_grow(idx);
+		e->object = o;
+		e->name = names[i];
+		e->hash = name_hash(names[i]);
+		spa_list_append(&idx->buckets[e->hash & idx->mask], &e->link);
+		idx->count++;
+	}
+	c->context.ports_version++;
+}
+
+static void port_cache_clear(struct port_cache *pc)
+{
+	free(pc->port_pattern);
+	free(pc->type_pattern);
+	free(pc->ports);
+	spa_zero(*pc);
+}
+
 static struct object * alloc_object(struct client *c, int type)
 {
 	struct object *o;
@@ -464,6 +596,10 @@ static void free_object(struct client *c, struct object *o)
 	spa_list_remove(&o->link);
 	o->removed = true;
 	o->id = SPA_ID_INVALID;
+	if (o->type == INTERFACE_Port)
+		port_names_update(c, o);
+	else
+		c->context.ports_version++;
 	spa_list_append(&c->context.objects, &o->link);
 	if (++c->context.free_count > RECYCLE_THRESHOLD)
 		recycle_objects(c, RECYCLE_THRESHOLD / 2);
@@ -647,19 +783,23 @@ static bool is_port_default(struct client *c, struct object *o)
 
 static struct object *find_port_by_name(struct client *c, const char *name)
 {
-	struct object *o;
+	struct name_index *idx = &c->context.port_names;
+	struct name_entry *e;
+	struct object *o, *system = NULL;
+	uint32_t hash = name_hash(name);
 
-	spa_list_for_each(o, &c->context.objects, link) {
-		if (o->type != INTERFACE_Port || o->removed)
+	spa_list_for_each(e, &idx->buckets[hash & idx->mask], link) {
+		if (e->hash != hash || !spa_streq(e->name, name))
 			continue;
-		if (spa_streq(o->port.name, name) ||
-		    spa_streq(o->port.alias1, name) ||
-		    spa_streq(o->port.alias2, name))
-			return o;
-		if (is_port_default(c, o) && spa_streq(o->port.system, name))
+		o = e->object;
+		/* the system name only matches the ports of the default devices
+		 * and is only used when there is no port with the real name */
+		if (e != &o->port.names[PORT_NAME_SYSTEM])
 			return o;
+		if (system == NULL && is_port_default(c, o))
+			system = o;
 	}
-	return NULL;
+	return system;
 }
 
 static struct object *find_by_id(struct client *c, uint32_t id)
@@ -731,42 +871,6 @@ static struct buffer *dequeue_buffer(struct client *c, struct mix *mix)
 	return b;
 }
 
-#if defined (__SSE__)
-#include <xmmintrin.h>
-static void mix2_sse(float *dst, float *src1, float *src2, int n_samples)
-{
-	int n, unrolled;
-	__m128 in[2];
-
-	if (SPA_IS_ALIGNED(src1, 16) &&
-	    SPA_IS_ALIGNED(src2, 16) &&
-	    SPA_IS_ALIGNED(dst, 16))
-		unrolled = n_samples / 4;
-	else
-		unrolled = 0;
-
-	for (n = 0; unrolled--; n += 4) {
-		in[0] = _mm_load_ps(&src1[n]),
-		in[1] = _mm_load_ps(&src2[n]),
-		in[0] = _mm_add_ps(in[0], in[1]);
-		_mm_store_ps(&dst[n], in[0]);
-	}
-	for (; n < n_samples; n++) {
-		in[0] = _mm_load_ss(&src1[n]),
-		in[1] = _mm_load_ss(&src2[n]),
-		in[0] = _mm_add_ss(in[0], in[1]);
-		_mm_store_ss(&dst[n], in[0]);
-	}
-}
-#endif
-
-static void mix2_c(float *dst, float *src1, float *src2, int n_samples)
-{
-	int i;
-	for (i = 0; i < n_samples; i++)
-		dst[i] = src1[i] + src2[i];
-}
-
 SPA_EXPORT
 void jack_get_version(int *major_ptr, int *minor_ptr, int *micro_ptr, int *proto_ptr)
 {
@@ -2569,6 +2673,10 @@ static int metadata_property(void *object, uint32_t id,
 			if (value == NULL)
 				c->metadata->default_audio_source[0] = '\0';
 		}
+		/* the default devices change the order of jack_get_ports() */
+		pthread_mutex_lock(&c->context.lock);
+		c->context.ports_version++;
+		pthread_mutex_unlock(&c->context.lock);
 	} else {
 		if ((o = find_id(c, id, true)) == NULL)
 			return -EINVAL;
@@ -2785,7 +2893,9 @@ static void registry_event_global(void *data, uint32_t id,
 		o = NULL;
 		if (node_id == c->node_id) {
 			snprintf(tmp, sizeof(tmp), "%s:%s", c->name, str);
+			pthread_mutex_lock(&c->context.lock);
 			o = find_port_by_name(c, tmp);
+			pthread_mutex_unlock(&c->context.lock);
 			if (o != NULL)
 				pw_log_info("%p: %s found our port %p", c, tmp, o);
 		}
@@ -2830,7 +2940,9 @@ static void registry_event_global(void *data, uint32_t id,
 			if (c->filter_name)
 				filter_name(tmp, FILTER_PORT);
 
+			pthread_mutex_lock(&c->context.lock);
 			op = find_port_by_name(c, tmp);
+			pthread_mutex_unlock(&c->context.lock);
 			if (op != NULL)
 				snprintf(o->port.name, sizeof(o->port.name), "%.*s-%u",
 						(int)(sizeof(tmp)-11), tmp, serial);
@@ -2857,6 +2969,10 @@ static void registry_event_global(void *data, uint32_t id,
 		o->port.node_id = node_id;
 		o->port.is_monitor = is_monitor;
 
+		pthread_mutex_lock(&c->context.lock);
+		port_names_update(c, o);
+		pthread_mutex_unlock(&c->context.lock);
+
 		pw_log_debug("%p: %p add port %d name:%s %d", c, o, id,
 				o->port.name, type_id);
 	}
@@ -3165,18 +3281,20 @@ jack_client_t * jack_client_open (const char *client_name,
 	pthread_mutex_init(&client->context.lock, NULL);
 	pthread_mutex_init(&client->rt_lock, NULL);
 	spa_list_init(&client->context.objects);
+	if (name_index_init(&client->context.port_names, 64) < 0)
+		goto no_props;
+	/* an unused port_cache entry has version 0 */
+	client->context.ports_version = 1;
 
 	support = pw_context_get_support(client->context.context, &n_support);
 
-	mix2 = mix2_c;
 	cpu_iface = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
-	if (cpu_iface) {
-#if defined (__SSE__)
-		uint32_t flags = spa_cpu_get_flags(cpu_iface);
-		if (flags & SPA_CPU_FLAG_SSE)
-			mix2 = mix2_sse;
-#endif
-	}
+	client->mix_ops.fmt = SPA_AUDIO_FORMAT_F32;
+	client->mix_ops.n_channels = 1;
+	client->mix_ops.cpu_flags = cpu_iface ? spa_cpu_get_flags(cpu_iface) : 0;
+	if (mix_ops_init(&client->mix_ops) < 0)
+		goto no_props;
+
 	client->loop = client->context.context->data_loop_impl;
 
 	spa_list_init(&client->links);
@@ -3339,6 +3457,7 @@ int jack_client_close (jack_client_t *client)
 {
 	struct client *c = (struct client *) client;
 	struct object *o;
+	uint32_t i;
 	int res;
 
 	spa_return_val_if_fail(c != NULL, -EINVAL);
@@ -3367,9 +3486,15 @@ int jack_client_close (jack_client_t *client)
 		free_object(c, o);
 	recycle_objects(c, 0);
 
+	for (i = 0; i < PORT_CACHE_SIZE; i++)
+		port_cache_clear(&c->context.port_cache[i]);
+	name_index_clear(&c->context.port_names);
+
 	pw_map_clear(&c->ports[SPA_DIRECTION_INPUT]);
 	pw_map_clear(&c->ports[SPA_DIRECTION_OUTPUT]);
 
+	mix_ops_free(&c->mix_ops);
+
 	pthread_mutex_destroy(&c->context.lock);
 	pthread_mutex_destroy(&c->rt_lock);
 	pw_properties_free(c->props);
@@ -4113,6 +4238,10 @@ jack_port_t * jack_port_register (jack_client_t *client,
 	snprintf(o->port.name, sizeof(o->port.name), "%s:%s", c->name, port_name);
 	o->port.type_id = type_id;
 
+	pthread_mutex_lock(&c->context.lock);
+	port_names_update(c, o);
+	pthread_mutex_unlock(&c->context.lock);
+
 	init_buffer(p);
 
 	if (direction == SPA_DIRECTION_INPUT) {
@@ -4261,10 +4390,12 @@ static struct buffer *get_mix_buffer(struct mix *mix, jack_nframes_t frames)
 
 static void *get_buffer_input_float(struct port *p, jack_nframes_t frames)
 {
+	struct client *c = p->client;
 	struct mix *mix;
 	struct buffer *b;
-	int layer = 0;
-	void *ptr = NULL;
+	const void *src[MAX_MIX];
+	uint32_t n_src = 0;
+	float *dst;
 
 	spa_list_for_each(mix, &p->mix, port_link) {
 		struct spa_data *d;
@@ -4284,17 +4415,29 @@ static void *get_buffer_input_float(struct port *p, jack_nframes_t frames)
 			continue;
 
 		np = SPA_PTROFF(d->data, offset, void);
-		if (layer++ == 0) {
-			ptr = np;
-		} else {
-			mix2(p->emptyptr, ptr, np, frames);
-			ptr = p->emptyptr;
-			p->zeroed = false;
+		if (n_src == MAX_MIX) {
+			/* too many peers, mix what we have and continue
+			 * adding to the result. The output of the mix can't
+			 * be one of the sources, switch between two buffers */
+			dst = src[0] == p->emptyptr ? c->mix_tmp : p->emptyptr;
+			mix_ops_process(&c->mix_ops, dst, src, n_src, frames);
+			src[0] = dst;
+			n_src = 1;
 		}
-	}
-	if (ptr == NULL)
-		ptr = init_buffer(p);
-	return ptr;
+		src[n_src++] = np;
+	}
+	if (n_src == 0)
+		return init_buffer(p);
+	if (n_src == 1)
+		return (void*)src[0];
+
+	/* add all peers in one pass over the buffer */
+	dst = src[0] == p->emptyptr ? c->mix_tmp : p->emptyptr;
+	mix_ops_process(&c->mix_ops, dst, src, n_src, frames);
+	if (dst != p->emptyptr)
+		memcpy(p->emptyptr, dst, frames * sizeof(float));
+	p->zeroed = false;
+	return p->emptyptr;
 }
 
 static void *get_buffer_input_midi(struct port *p, jack_nframes_t frames)
@@ -4630,7 +4773,11 @@ int jack_port_rename (jack_client_t* client, jack_port_t *port, const char *port
 	}
 
 	pw_properties_set(p->props, PW_KEY_PORT_NAME, port_name);
+
+	pthread_mutex_lock(&c->context.lock);
 	snprintf(o->port.name, sizeof(o->port.name), "%s:%s", c->name, port_name);
+	port_names_update(c, o);
+	pthread_mutex_unlock(&c->context.lock);
 
 	p->info.change_mask |= SPA_PORT_CHANGE_MASK_PROPS;
 	p->info.props = &p->props->dict;
@@ -4673,6 +4820,7 @@ int jack_port_set_alias (jack_port_t *port, const char *alias)
 		goto done;
 	}
 
+	pthread_mutex_lock(&c->context.lock);
 	if (o->port.alias1[0] == '\0') {
 		key = PW_KEY_OBJECT_PATH;
 		snprintf(o->port.alias1, sizeof(o->port.alias1), "%s", alias);
@@ -4682,9 +4830,12 @@ int jack_port_set_alias (jack_port_t *port, const char *alias)
 		snprintf(o->port.alias2, sizeof(o->port.alias2), "%s", alias);
 	}
 	else {
+		pthread_mutex_unlock(&c->context.lock);
 		res = -1;
 		goto done;
 	}
+	port_names_update(c, o);
+	pthread_mutex_unlock(&c->context.lock);
 
 	pw_properties_set(p->props, key, alias);
 
@@ -4903,8 +5054,10 @@ int jack_connect (jack_client_t *client,
 
 	pw_thread_loop_lock(c->context.loop);
 
+	pthread_mutex_lock(&c->context.lock);
 	src = find_port_by_name(c, source_port);
 	dst = find_port_by_name(c, destination_port);
+	pthread_mutex_unlock(&c->context.lock);
 
 	if (src == NULL || dst == NULL ||
 	    !(src->port.flags & JackPortIsOutput) ||
@@ -4977,8 +5130,10 @@ int jack_disconnect (jack_client_t *client,
 
 	pw_thread_loop_lock(c->context.loop);
 
+	pthread_mutex_lock(&c->context.lock);
 	src = find_port_by_name(c, source_port);
 	dst = find_port_by_name(c, destination_port);
+	pthread_mutex_unlock(&c->context.lock);
 
 	pw_log_debug("%p: %d %d", client, src->id, dst->id);
 
@@ -5298,6 +5453,72 @@ static int port_compare_func(const void *v1, const void *v2)
 	return res;
 }
 
+static struct port_cache *find_port_cache(struct client *c, const char *port_pattern,
+		const char *type_pattern, unsigned long flags, uint32_t node_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < PORT_CACHE_SIZE; i++) {
+		struct port_cache *pc = &c->context.port_cache[i];
+		if (pc->version == c->context.ports_version &&
+		    pc->flags == flags && pc->node_id == node_id &&
+		    spa_streq(pc->port_pattern, port_pattern) &&
+		    spa_streq(pc->type_pattern, type_pattern))
+			return pc;
+	}
+	return NULL;
+}
+
+static void add_port_cache(struct client *c, const char *port_pattern,
+		const char *type_pattern, unsigned long flags, uint32_t node_id,
+		uint32_t version, struct object **ports, uint32_t count)
+{
+	struct port_cache *pc;
+
+	/* the ports changed while we were sorting */
+	if (version != c->context.ports_version)
+		return;
+
+	pc = &c->context.port_cache[c->context.port_cache_next];
+	c->context.port_cache_next = (c->context.port_cache_next + 1) % PORT_CACHE_SIZE;
+
+	port_cache_clear(pc);
+	if (port_pattern && (pc->port_pattern = strdup(port_pattern)) == NULL)
+		goto error;
+	if (type_pattern && (pc->type_pattern = strdup(type_pattern)) == NULL)
+		goto error;
+	if (count > 0) {
+		if ((pc->ports = malloc(sizeof(struct object *) * count)) == NULL)
+			goto error;
+		memcpy(pc->ports, ports, sizeof(struct object *) * count);
+	}
+	pc->flags = flags;
+	pc->node_id = node_id;
+	pc->count = count;
+	/* only valid once everything is filled in */
+	pc->version = version;
+	return;
+error:
+	port_cache_clear(pc);
+}
+
+static const char **port_names(struct object **ports, uint32_t count)
+{
+	const char **res;
+	uint32_t i;
+
+	if (count == 0)
+		return NULL;
+
+	res = malloc(sizeof(char*) * (count + 1));
+	if (res == NULL)
+		return NULL;
+	for (i = 0; i < count; i++)
+		res[i] = ports[i]->port.name;
+	res[count] = NULL;
+	return res;
+}
+
 SPA_EXPORT
 const char ** jack_get_ports (jack_client_t *client,
                               const char *port_name_pattern,
@@ -5308,8 +5529,9 @@ const char ** jack_get_ports (jack_client_t *client,
 	const char **res;
 	struct object *o;
 	struct object *tmp[JACK_PORT_MAX];
+	struct port_cache *pc;
 	const char *str;
-	uint32_t i, count, id;
+	uint32_t count, id, version;
 	int r;
 	regex_t port_regex, type_regex;
 
@@ -5320,23 +5542,41 @@ const char ** jack_get_ports (jack_client_t *client,
 	else
 		id = SPA_ID_INVALID;
 
-	if (port_name_pattern && port_name_pattern[0]) {
+	if (port_name_pattern && !port_name_pattern[0])
+		port_name_pattern = NULL;
+	if (type_name_pattern && !type_name_pattern[0])
+		type_name_pattern = NULL;
+
+	pw_log_debug("%p: ports id:%d name:\"%s\" type:\"%s\" flags:%08lx", c, id,
+			port_name_pattern, type_name_pattern, flags);
+
+	/* session managers ask the same thing over and over, reuse the result
+	 * until a port, name or the default device changes */
+	pthread_mutex_lock(&c->context.lock);
+	if ((pc = find_port_cache(c, port_name_pattern, type_name_pattern, flags, id)) != NULL) {
+		res = port_names(pc->ports, pc->count);
+		pthread_mutex_unlock(&c->context.lock);
+		return res;
+	}
+	pthread_mutex_unlock(&c->context.lock);
+
+	if (port_name_pattern) {
 		if ((r = regcomp(&port_regex, port_name_pattern, REG_EXTENDED | REG_NOSUB)) != 0) {
 			pw_log_error("cant compile regex %s: %d", port_name_pattern, r);
 			return NULL;
 		}
 	}
-	if (type_name_pattern && type_name_pattern[0]) {
+	if (type_name_pattern) {
 		if ((r = regcomp(&type_regex, type_name_pattern, REG_EXTENDED | REG_NOSUB)) != 0) {
 			pw_log_error("cant compile regex %s: %d", type_name_pattern, r);
+			if (port_name_pattern)
+				regfree(&port_regex);
 			return NULL;
 		}
 	}
 
-	pw_log_debug("%p: ports id:%d name:\"%s\" type:\"%s\" flags:%08lx", c, id,
-			port_name_pattern, type_name_pattern, flags);
-
 	pthread_mutex_lock(&c->context.lock);
+	version = c->context.ports_version;
 	count = 0;
 	spa_list_for_each(o, &c->context.objects, link) {
 		if (o->type != INTERFACE_Port || o->removed)
@@ -5352,7 +5592,7 @@ const char ** jack_get_ports (jack_client_t *client,
 		if (id != SPA_ID_INVALID && o->port.node_id != id)
 			continue;
 
-		if (port_name_pattern && port_name_pattern[0]) {
+		if (port_name_pattern) {
 			bool match;
 			match = regexec(&port_regex, o->port.name, 0, NULL, 0) == 0;
 			if (!match && is_port_default(c, o))
@@ -5360,7 +5600,7 @@ const char ** jack_get_ports (jack_client_t *client,
 			if (!match)
 				continue;
 		}
-		if (type_name_pattern && type_name_pattern[0]) {
+		if (type_name_pattern) {
 			if (regexec(&type_regex, type_to_string(o->port.type_id),
 						0, NULL, 0) == REG_NOMATCH)
 				continue;
@@ -5372,20 +5612,18 @@ const char ** jack_get_ports (jack_client_t *client,
 	}
 	pthread_mutex_unlock(&c->context.lock);
 
-	if (count > 0) {
+	if (count > 0)
 		qsort(tmp, count, sizeof(struct object *), port_compare_func);
 
-		res = malloc(sizeof(char*) * (count + 1));
-		for (i = 0; i < count; i++)
-			res[i] = tmp[i]->port.name;
-		res[count] = NULL;
-	} else {
-		res = NULL;
-	}
+	pthread_mutex_lock(&c->context.lock);
+	add_port_cache(c, port_name_pattern, type_name_pattern, flags, id, version, tmp, count);
+	pthread_mutex_unlock(&c->context.lock);
+
+	res = port_names(tmp, count);
 
-	if (port_name_pattern && port_name_pattern[0])
+	if (port_name_pattern)
 		regfree(&port_regex);
-	if (type_name_pattern && type_name_pattern[0])
+	if (type_name_pattern)
 		regfree(&type_regex);
 
 	return res;
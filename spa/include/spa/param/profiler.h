@@ -70,6 +70,14 @@ enum spa_profiler {
 							  *      Long : driver finish,
 							  *      Int : driver status),
 							  *      Fraction : latency))  */
+	SPA_PROFILER_driverXrun,			/**< the node that was still pending when the
+							  *  driver started a new cycle
+							  *  (Struct(
+							  *      Int : number of incomplete cycles,
+							  *      Long : time of last incomplete cycle,
+							  *      Int : id of the pending node,
+							  *      String : name of the pending node,
+							  *      Int : status of the pending node)) */
 
 	SPA_PROFILER_START_Follower	= 0x20000,	/**< follower related profiler properties */
 	SPA_PROFILER_followerBlock,			/**< generic follower info block
@@ -82,10 +90,46 @@ enum spa_profiler {
 							  *      Long : finish,
 							  *      Int : status,
 							  *      Fraction : latency))  */
+	SPA_PROFILER_followerHistogram,			/**< timing histograms of a node, see
+							  *  spa_profiler_histogram_bucket()
+							  *  (Struct(
+							  *      Int : id,
+							  *      Int : times the node was pending at the end
+							  *            of a cycle,
+							  *      Long : max wait time,
+							  *      Long : max busy time,
+							  *      Array<Int> : wait time histogram,
+							  *      Array<Int> : busy time histogram)) */
 
 	SPA_PROFILER_START_CUSTOM	= 0x1000000,
 };
 
+/** Histograms have log-scale buckets. Bucket 0 holds times below 1024
+ * nanoseconds, after that each power of 2 is split into 4 buckets. The last
+ * bucket also holds all larger times. */
+#define SPA_PROFILER_HISTOGRAM_BUCKETS	64
+
+/** Get the histogram bucket for a time in nanoseconds */
+static inline uint32_t spa_profiler_histogram_bucket(uint64_t nsec)
+{
+	uint32_t e, bucket;
+	if (nsec < 1024)
+		return 0;
+	e = 63 - __builtin_clzll(nsec);
+	bucket = 1 + (e - 10) * 4 + ((nsec >> (e - 2)) & 3);
+	return SPA_MIN(bucket, SPA_PROFILER_HISTOGRAM_BUCKETS - 1u);
+}
+
+/** Get the upper bound in nanoseconds of the times in a histogram bucket */
+static inline uint64_t spa_profiler_histogram_bucket_max(uint32_t bucket)
+{
+	uint32_t e;
+	if (bucket == 0)
+		return 1024;
+	e = (bucket - 1) / 4 + 10;
+	return (uint64_t)(5 + (bucket - 1) % 4) << (e - 2);
+}
+
 /**
  * \}
  */
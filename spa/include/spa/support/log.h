@@ -303,6 +303,11 @@ do {								\
 #define SPA_KEY_LOG_TIMESTAMP		"log.timestamp"		/**< log timestamps */
 #define SPA_KEY_LOG_LINE		"log.line"		/**< log file and line numbers */
 #define SPA_KEY_LOG_PATTERNS		"log.patterns"		/**< Spa:String:JSON array of [ {"pattern" : level}, ... ] */
+#define SPA_KEY_LOG_BINARY_TRACE	"log.binary-trace"	/**< store trace messages in binary form
+								  *  and format them in a separate thread */
+#define SPA_KEY_LOG_BINARY_TRACE_THREADS "log.binary-trace.threads" /**< the expected number of threads
+								  *  that log, a ringbuffer is made for each
+								  *  of them in advance */
 
 /**
  * \}
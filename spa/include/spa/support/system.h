@@ -60,6 +60,7 @@ struct spa_system { struct spa_interface iface; };
 #define SPA_IO_OUT	(1 << 2)
 #define SPA_IO_ERR	(1 << 3)
 #define SPA_IO_HUP	(1 << 4)
+#define SPA_IO_ET	(1u << 31)	/**< edge triggered, not supported by all systems */
 
 /* flags */
 #define SPA_FD_CLOEXEC			(1<<0)
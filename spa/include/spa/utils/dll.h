@@ -1,4 +1,4 @@
-/* Simple DLL
+/* Simple Plugin API
  *
  * Copyright © 2019 Wim Taymans
  *
@@ -29,9 +29,21 @@
 extern "C" {
 #endif
 
+/**
+ * \defgroup spa_dll DLL
+ * Delay-locked loop, used to track the rate of a remote clock
+ */
+
+/**
+ * \addtogroup spa_dll
+ * \{
+ */
+
 #include <stddef.h>
 #include <math.h>
 
+#include <spa/utils/defs.h>
+
 #define SPA_DLL_BW_MAX		0.128
 #define SPA_DLL_BW_MIN		0.016
 
@@ -64,6 +76,10 @@ static inline double spa_dll_update(struct spa_dll *dll, double err)
 	return 1.0 - (dll->z2 + dll->z3);
 }
 
+/**
+ * \}
+ */
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -50,7 +50,7 @@ extern "C" {
 
 #include "alsa.h"
 
-#include "dll.h"
+#include <spa/utils/dll.h>
 
 #define MAX_RATES	16
 
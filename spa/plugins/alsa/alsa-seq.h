@@ -47,7 +47,7 @@ extern "C" {
 
 #include "alsa.h"
 
-#include "dll.h"
+#include <spa/utils/dll.h>
 
 struct props {
 	char device[64];
@@ -0,0 +1,237 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "test-helper.h"
+#include "channelmix-ops.h"
+
+static uint32_t cpu_flags;
+
+typedef void (*channelmix_func_t) (struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+			uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples);
+
+struct stats {
+	uint32_t n_samples;
+	uint32_t n_src;
+	uint32_t n_dst;
+	uint64_t perf;
+	const char *name;
+	const char *impl;
+};
+
+#define MAX_SAMPLES	4096
+#define MAX_CHANNELS	12
+
+#define MAX_COUNT 100
+
+static float samp_in[MAX_CHANNELS][MAX_SAMPLES] SPA_ALIGNED(32);
+static float samp_out[MAX_CHANNELS][MAX_SAMPLES] SPA_ALIGNED(32);
+
+static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
+
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * 70
+
+static uint32_t n_results = 0;
+static struct stats results[MAX_RESULTS];
+
+static void run_test1(const char *name, const char *impl, channelmix_func_t func,
+		uint32_t n_src, uint32_t n_dst, int n_samples)
+{
+	uint32_t i, j;
+	const void *ip[n_src];
+	void *op[n_dst];
+	struct timespec ts;
+	uint64_t count, t1, t2;
+	struct channelmix mix;
+
+	spa_zero(mix);
+	mix.src_chan = n_src;
+	mix.dst_chan = n_dst;
+	for (i = 0; i < n_dst; i++)
+		for (j = 0; j < n_src; j++)
+			mix.matrix[i][j] = (i + j) % 3 ? 0.5f : 0.0f;
+
+	for (j = 0; j < n_src; j++)
+		ip[j] = samp_in[j];
+	for (j = 0; j < n_dst; j++)
+		op[j] = samp_out[j];
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	count = 0;
+	for (i = 0; i < MAX_COUNT; i++) {
+		func(&mix, n_dst, op, n_src, ip, n_samples);
+		count++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	spa_assert(n_results < MAX_RESULTS);
+
+	results[n_results++] = (struct stats) {
+		.n_samples = n_samples,
+		.n_src = n_src,
+		.n_dst = n_dst,
+		.perf = count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
+		.name = name,
+		.impl = impl
+	};
+}
+
+static void run_test(const char *name, const char *impl, channelmix_func_t func,
+		uint32_t n_src, uint32_t n_dst)
+{
+	size_t i;
+	for (i = 0; i < SPA_N_ELEMENTS(sample_sizes); i++)
+		run_test1(name, impl, func, n_src, n_dst, sample_sizes[i]);
+}
+
+static void test_copy(void)
+{
+	run_test("test_copy", "c", channelmix_copy_c, 2, 2);
+#if defined (HAVE_SSE)
+	if (cpu_flags & SPA_CPU_FLAG_SSE)
+		run_test("test_copy", "sse", channelmix_copy_sse, 2, 2);
+#endif
+#if defined (HAVE_AVX)
+	if (cpu_flags & SPA_CPU_FLAG_AVX)
+		run_test("test_copy", "avx", channelmix_copy_avx, 2, 2);
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON)
+		run_test("test_copy", "neon", channelmix_copy_neon, 2, 2);
+#endif
+}
+
+static void test_n_m(void)
+{
+	run_test("test_n_m", "c", channelmix_f32_n_m_c, 12, 8);
+#if defined (HAVE_AVX)
+	if (cpu_flags & SPA_CPU_FLAG_AVX)
+		run_test("test_n_m", "avx", channelmix_f32_n_m_avx, 12, 8);
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON)
+		run_test("test_n_m", "neon", channelmix_f32_n_m_neon, 12, 8);
+#endif
+}
+
+static void test_2_5p1(void)
+{
+	run_test("test_2_5p1", "c", channelmix_f32_2_5p1_c, 2, 6);
+#if defined (HAVE_AVX)
+	if (cpu_flags & SPA_CPU_FLAG_AVX)
+		run_test("test_2_5p1", "avx", channelmix_f32_2_5p1_avx, 2, 6);
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON)
+		run_test("test_2_5p1", "neon", channelmix_f32_2_5p1_neon, 2, 6);
+#endif
+}
+
+static void test_5p1_2(void)
+{
+	run_test("test_5p1_2", "c", channelmix_f32_5p1_2_c, 6, 2);
+#if defined (HAVE_SSE)
+	if (cpu_flags & SPA_CPU_FLAG_SSE)
+		run_test("test_5p1_2", "sse", channelmix_f32_5p1_2_sse, 6, 2);
+#endif
+#if defined (HAVE_AVX)
+	if (cpu_flags & SPA_CPU_FLAG_AVX)
+		run_test("test_5p1_2", "avx", channelmix_f32_5p1_2_avx, 6, 2);
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON)
+		run_test("test_5p1_2", "neon", channelmix_f32_5p1_2_neon, 6, 2);
+#endif
+}
+
+static void test_7p1_2(void)
+{
+	run_test("test_7p1_2", "c", channelmix_f32_7p1_2_c, 8, 2);
+#if defined (HAVE_AVX)
+	if (cpu_flags & SPA_CPU_FLAG_AVX)
+		run_test("test_7p1_2", "avx", channelmix_f32_7p1_2_avx, 8, 2);
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON)
+		run_test("test_7p1_2", "neon", channelmix_f32_7p1_2_neon, 8, 2);
+#endif
+}
+
+static void test_7p1_4(void)
+{
+	run_test("test_7p1_4", "c", channelmix_f32_7p1_4_c, 8, 4);
+#if defined (HAVE_AVX)
+	if (cpu_flags & SPA_CPU_FLAG_AVX)
+		run_test("test_7p1_4", "avx", channelmix_f32_7p1_4_avx, 8, 4);
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON)
+		run_test("test_7p1_4", "neon", channelmix_f32_7p1_4_neon, 8, 4);
+#endif
+}
+
+static int compare_func(const void *_a, const void *_b)
+{
+	const struct stats *a = _a, *b = _b;
+	int diff;
+	if ((diff = strcmp(a->name, b->name)) != 0) return diff;
+	if ((diff = a->n_samples - b->n_samples) != 0) return diff;
+	if ((diff = b->perf - a->perf) != 0) return diff;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i;
+
+	cpu_flags = get_cpu_flags();
+	printf("got get CPU flags %d\n", cpu_flags);
+
+	test_copy();
+	test_n_m();
+	test_2_5p1();
+	test_5p1_2();
+	test_7p1_2();
+	test_7p1_4();
+
+	qsort(results, n_results, sizeof(struct stats), compare_func);
+
+	for (i = 0; i < n_results; i++) {
+		struct stats *s = &results[i];
+		fprintf(stderr, "%-12."PRIu64" \t%-32.32s %s \t samples %d, channels %d->%d\n",
+				s->perf, s->name, s->impl, s->n_samples, s->n_src, s->n_dst);
+	}
+	return 0;
+}
@@ -194,6 +194,11 @@ static void test_f32_s32(void)
 	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
 		run_test("test_f32d_s32", "avx2", false, true, conv_f32d_to_s32_avx2);
 	}
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_f32d_s32", "neon", false, true, conv_f32d_to_s32_neon);
+	}
 #endif
 	run_test("test_f32_s32d", "c", true, false, conv_f32_to_s32d_c);
 	run_test("test_f32d_s32d", "c", false, false, conv_f32d_to_s32d_c);
@@ -212,6 +217,11 @@ static void test_s32_f32(void)
 	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
 		run_test("test_s32_f32d", "avx2", true, false, conv_s32_to_f32d_avx2);
 	}
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_s32_f32d", "neon", true, false, conv_s32_to_f32d_neon);
+	}
 #endif
 	run_test("test_s32_f32d", "c", true, false, conv_s32_to_f32d_c);
 	run_test("test_s32d_f32d", "c", false, false, conv_s32d_to_f32d_c);
@@ -257,6 +267,16 @@ static void test_f32_s24_32(void)
 {
 	run_test("test_f32_s24_32", "c", true, true, conv_f32_to_s24_32_c);
 	run_test("test_f32d_s24_32", "c", false, true, conv_f32d_to_s24_32_c);
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_f32d_s24_32", "avx2", false, true, conv_f32d_to_s24_32_avx2);
+	}
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_f32d_s24_32", "neon", false, true, conv_f32d_to_s24_32_neon);
+	}
+#endif
 	run_test("test_f32_s24_32d", "c", true, false, conv_f32_to_s24_32d_c);
 	run_test("test_f32d_s24_32d", "c", false, false, conv_f32d_to_s24_32d_c);
 }
@@ -266,6 +286,16 @@ static void test_s24_32_f32(void)
 	run_test("test_s24_32_f32", "c", true, true, conv_s24_32_to_f32_c);
 	run_test("test_s24_32d_f32", "c", false, true, conv_s24_32d_to_f32_c);
 	run_test("test_s24_32_f32d", "c", true, false, conv_s24_32_to_f32d_c);
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_s24_32_f32d", "avx2", true, false, conv_s24_32_to_f32d_avx2);
+	}
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_s24_32_f32d", "neon", true, false, conv_s24_32_to_f32d_neon);
+	}
+#endif
 	run_test("test_s24_32d_f32d", "c", false, false, conv_s24_32d_to_f32d_c);
 }
 
@@ -275,6 +305,16 @@ static void test_interleave(void)
 	run_test("test_interleave_16", "c", false, true, conv_interleave_16_c);
 	run_test("test_interleave_24", "c", false, true, conv_interleave_24_c);
 	run_test("test_interleave_32", "c", false, true, conv_interleave_32_c);
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_interleave_32", "avx2", false, true, conv_interleave_32_avx2);
+	}
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_interleave_32", "neon", false, true, conv_interleave_32_neon);
+	}
+#endif
 }
 
 static void test_deinterleave(void)
@@ -283,6 +323,16 @@ static void test_deinterleave(void)
 	run_test("test_deinterleave_16", "c", true, false, conv_deinterleave_16_c);
 	run_test("test_deinterleave_24", "c", true, false, conv_deinterleave_24_c);
 	run_test("test_deinterleave_32", "c", true, false, conv_deinterleave_32_c);
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_deinterleave_32", "avx2", true, false, conv_deinterleave_32_avx2);
+	}
+#endif
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_deinterleave_32", "neon", true, false, conv_deinterleave_32_neon);
+	}
+#endif
 }
 
 static int compare_func(const void *_a, const void *_b)
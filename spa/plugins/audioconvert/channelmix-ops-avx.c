@@ -0,0 +1,771 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "channelmix-ops.h"
+
+#include <immintrin.h>
+
+/* The kernels in this file do the same operations in the same order as the
+ * C versions and don't use FMA so that the results are bit exact. */
+
+static inline bool is_aligned(uint32_t n_dst, float **d, uint32_t n_src, const float **s)
+{
+	uint32_t i;
+	for (i = 0; i < n_dst; i++)
+		if (!SPA_IS_ALIGNED(d[i], 32))
+			return false;
+	for (i = 0; i < n_src; i++)
+		if (!SPA_IS_ALIGNED(s[i], 32))
+			return false;
+	return true;
+}
+
+static inline void clear_avx(float *d, uint32_t n_samples)
+{
+	memset(d, 0, n_samples * sizeof(float));
+}
+
+static inline void vol_avx(float *d, const float *s, float vol, uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	const __m256 v = _mm256_set1_ps(vol);
+
+	if (vol == 1.0f) {
+		spa_memcpy(d, s, n_samples * sizeof(float));
+	} else {
+		if (SPA_IS_ALIGNED(d, 32) && SPA_IS_ALIGNED(s, 32))
+			unrolled = n_samples & ~15;
+		else
+			unrolled = 0;
+
+		for (n = 0; n < unrolled; n += 16) {
+			_mm256_store_ps(&d[n], _mm256_mul_ps(_mm256_load_ps(&s[n]), v));
+			_mm256_store_ps(&d[n+8], _mm256_mul_ps(_mm256_load_ps(&s[n+8]), v));
+		}
+		for (; n < n_samples; n++)
+			d[n] = s[n] * vol;
+	}
+}
+
+void channelmix_copy_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i;
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+	}
+	else if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_IDENTITY)) {
+		for (i = 0; i < n_dst; i++)
+			spa_memcpy(d[i], s[i], n_samples * sizeof(float));
+	}
+	else {
+		for (i = 0; i < n_dst; i++) {
+			float *di = d[i];
+			const float *si = s[i];
+			const float vol = mix->matrix[i][i];
+			uint32_t n, unrolled;
+			const __m256 v = _mm256_set1_ps(vol);
+
+			if (SPA_IS_ALIGNED(di, 32) &&
+			    SPA_IS_ALIGNED(si, 32))
+				unrolled = n_samples & ~15;
+			else
+				unrolled = 0;
+
+			for (n = 0; n < unrolled; n += 16) {
+				_mm256_store_ps(&di[n], _mm256_mul_ps(_mm256_load_ps(&si[n]), v));
+				_mm256_store_ps(&di[n+8], _mm256_mul_ps(_mm256_load_ps(&si[n+8]), v));
+			}
+			for (; n < n_samples; n++)
+				di[n] = si[n] * vol;
+		}
+	}
+}
+
+void
+channelmix_f32_n_m_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, j, k, n, unrolled, n_active;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float *as[n_src];
+	float am[n_src];
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+		return;
+	}
+	else if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_COPY)) {
+		uint32_t copy = SPA_MIN(n_dst, n_src);
+		for (i = 0; i < copy; i++)
+			spa_memcpy(d[i], s[i], n_samples * sizeof(float));
+		for (; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+		return;
+	}
+
+	if (is_aligned(n_dst, d, n_src, s))
+		unrolled = n_samples & ~15;
+	else
+		unrolled = 0;
+
+	for (i = 0; i < n_dst; i++) {
+		float *di = d[i];
+
+		/* only mix the sources that contribute to this channel, the
+		 * result is the same for all finite samples */
+		for (j = 0, n_active = 0; j < n_src; j++) {
+			if (mix->matrix[i][j] != 0.0f) {
+				as[n_active] = s[j];
+				am[n_active++] = mix->matrix[i][j];
+			}
+		}
+
+		if (n_active == 0) {
+			clear_avx(di, n_samples);
+		} else {
+			for (n = 0; n < unrolled; n += 16) {
+				__m256 sum[2], v;
+
+				sum[0] = _mm256_setzero_ps();
+				sum[1] = _mm256_setzero_ps();
+				for (k = 0; k < n_active; k++) {
+					v = _mm256_set1_ps(am[k]);
+					sum[0] = _mm256_add_ps(sum[0],
+							_mm256_mul_ps(_mm256_load_ps(&as[k][n]), v));
+					sum[1] = _mm256_add_ps(sum[1],
+							_mm256_mul_ps(_mm256_load_ps(&as[k][n+8]), v));
+				}
+				_mm256_store_ps(&di[n], sum[0]);
+				_mm256_store_ps(&di[n+8], sum[1]);
+			}
+			for (; n < n_samples; n++) {
+				float sum = 0.0f;
+				for (k = 0; k < n_active; k++)
+					sum += as[k][n] * am[k];
+				di[n] = sum;
+			}
+		}
+		if (mix->lr4_info[i] > 0)
+			lr4_process(&mix->lr4[i], di, n_samples);
+	}
+}
+
+void
+channelmix_f32_1_2_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		clear_avx(d[0], n_samples);
+		clear_avx(d[1], n_samples);
+	} else {
+		vol_avx(d[0], s[0], mix->matrix[0][0], n_samples);
+		vol_avx(d[1], s[0], mix->matrix[1][0], n_samples);
+	}
+}
+
+void
+channelmix_f32_2_1_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[0][1];
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const float *s0 = s[0], *s1 = s[1];
+	float *d0 = d[0];
+
+	if (is_aligned(1, d, 2, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		clear_avx(d0, n_samples);
+	}
+	else if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_EQUAL)) {
+		for (n = 0; n < unrolled; n += 8) {
+			_mm256_store_ps(&d0[n], _mm256_mul_ps(_mm256_add_ps(
+					_mm256_load_ps(&s0[n]),
+					_mm256_load_ps(&s1[n])), v0));
+		}
+		for (; n < n_samples; n++)
+			d0[n] = (s0[n] + s1[n]) * m0;
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			_mm256_store_ps(&d0[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&s0[n]), v0),
+					_mm256_mul_ps(_mm256_load_ps(&s1[n]), v1)));
+		}
+		for (; n < n_samples; n++)
+			d0[n] = s0[n] * m0 + s1[n] * m1;
+	}
+}
+
+/* FL+FR+RL+RR -> MONO, n_use is 3 for FL+FR+FC+LFE -> MONO */
+static inline void
+mix_4_1_avx(struct channelmix *mix, uint32_t n_use, float *d0, const float **s,
+		uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[0][1];
+	const float m2 = mix->matrix[0][2];
+	const float m3 = mix->matrix[0][3];
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const __m256 v2 = _mm256_set1_ps(m2);
+	const __m256 v3 = _mm256_set1_ps(m3);
+	const float *s0 = s[0], *s1 = s[1], *s2 = s[2], *s3 = s[3];
+	__m256 t;
+
+	if (is_aligned(1, &d0, 4, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_EQUAL)) {
+		for (n = 0; n < unrolled; n += 8) {
+			t = _mm256_add_ps(_mm256_load_ps(&s0[n]), _mm256_load_ps(&s1[n]));
+			t = _mm256_add_ps(t, _mm256_load_ps(&s2[n]));
+			t = _mm256_add_ps(t, _mm256_load_ps(&s3[n]));
+			_mm256_store_ps(&d0[n], _mm256_mul_ps(t, v0));
+		}
+		for (; n < n_samples; n++)
+			d0[n] = (s0[n] + s1[n] + s2[n] + s3[n]) * m0;
+	}
+	else if (n_use == 3) {
+		for (n = 0; n < unrolled; n += 8) {
+			t = _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&s0[n]), v0),
+					_mm256_mul_ps(_mm256_load_ps(&s1[n]), v1));
+			t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_load_ps(&s2[n]), v2));
+			_mm256_store_ps(&d0[n], t);
+		}
+		for (; n < n_samples; n++)
+			d0[n] = s0[n] * m0 + s1[n] * m1 + s2[n] * m2;
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			t = _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&s0[n]), v0),
+					_mm256_mul_ps(_mm256_load_ps(&s1[n]), v1));
+			t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_load_ps(&s2[n]), v2));
+			t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_load_ps(&s3[n]), v3));
+			_mm256_store_ps(&d0[n], t);
+		}
+		for (; n < n_samples; n++)
+			d0[n] = s0[n] * m0 + s1[n] * m1 + s2[n] * m2 + s3[n] * m3;
+	}
+}
+
+void
+channelmix_f32_4_1_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO))
+		clear_avx(d[0], n_samples);
+	else
+		mix_4_1_avx(mix, 4, d[0], s, n_samples);
+}
+
+void
+channelmix_f32_3p1_1_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO))
+		clear_avx(d[0], n_samples);
+	else
+		mix_4_1_avx(mix, 3, d[0], s, n_samples);
+}
+
+void
+channelmix_f32_2_4_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[1][1];
+	const float m2 = mix->matrix[2][0];
+	const float m3 = mix->matrix[3][1];
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const __m256 v2 = _mm256_set1_ps(m2);
+	const __m256 v3 = _mm256_set1_ps(m3);
+	const float *sFL = s[0], *sFR = s[1];
+	float *dFL = d[0], *dFR = d[1], *dRL = d[2], *dRR = d[3];
+	__m256 l, r;
+
+	if (is_aligned(4, d, 2, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+	}
+	else if (m0 == m2 && m1 == m3) {
+		vol_avx(dFL, sFL, m0, n_samples);
+		vol_avx(dFR, sFR, m1, n_samples);
+		spa_memcpy(dRL, dFL, n_samples * sizeof(float));
+		spa_memcpy(dRR, dFR, n_samples * sizeof(float));
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			l = _mm256_load_ps(&sFL[n]);
+			r = _mm256_load_ps(&sFR[n]);
+			_mm256_store_ps(&dFL[n], _mm256_mul_ps(l, v0));
+			_mm256_store_ps(&dFR[n], _mm256_mul_ps(r, v1));
+			_mm256_store_ps(&dRL[n], _mm256_mul_ps(l, v2));
+			_mm256_store_ps(&dRR[n], _mm256_mul_ps(r, v3));
+		}
+		for (; n < n_samples; n++) {
+			dFL[n] = sFL[n] * m0;
+			dFR[n] = sFR[n] * m1;
+			dRL[n] = sFL[n] * m2;
+			dRR[n] = sFR[n] * m3;
+		}
+	}
+}
+
+/* FL+FR -> FL+FR+FC+LFE+SL+SR, also used for FL+FR -> FL+FR+FC+LFE */
+static inline void
+mix_2_ctr_avx(struct channelmix *mix, uint32_t n_dst, float **d, const float **s,
+		uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[1][1];
+	const float m2 = (mix->matrix[2][0] + mix->matrix[2][1]) * 0.5f;
+	const float m3 = (mix->matrix[3][0] + mix->matrix[3][1]) * 0.5f;
+	const __m256 v2 = _mm256_set1_ps(m2);
+	const __m256 v3 = _mm256_set1_ps(m3);
+	const float *sFL = s[0], *sFR = s[1];
+	float *dFC = d[2], *dLFE = d[3];
+	__m256 c;
+
+	vol_avx(d[0], sFL, m0, n_samples);
+	vol_avx(d[1], sFR, m1, n_samples);
+	if (n_dst > 4) {
+		vol_avx(d[4], sFL, mix->matrix[4][0], n_samples);
+		vol_avx(d[5], sFR, mix->matrix[5][1], n_samples);
+	}
+
+	if (is_aligned(2, &d[2], 2, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	for (n = 0; n < unrolled; n += 8) {
+		c = _mm256_add_ps(_mm256_load_ps(&sFL[n]), _mm256_load_ps(&sFR[n]));
+		_mm256_store_ps(&dFC[n], _mm256_mul_ps(c, v2));
+		_mm256_store_ps(&dLFE[n], _mm256_mul_ps(c, v3));
+	}
+	for (; n < n_samples; n++) {
+		float c = sFL[n] + sFR[n];
+		dFC[n] = c * m2;
+		dLFE[n] = c * m3;
+	}
+	if (m3 > 0.0f)
+		lr4_process(&mix->lr4[3], dLFE, n_samples);
+}
+
+void
+channelmix_f32_2_3p1_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i;
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+	} else {
+		mix_2_ctr_avx(mix, 4, d, s, n_samples);
+	}
+}
+
+void
+channelmix_f32_2_5p1_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i;
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+	} else {
+		mix_2_ctr_avx(mix, 6, d, s, n_samples);
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR -> FL+FR */
+void
+channelmix_f32_5p1_2_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[1][1];
+	const float clev = (mix->matrix[0][2] + mix->matrix[1][2]) * 0.5f;
+	const float llev = (mix->matrix[0][3] + mix->matrix[1][3]) * 0.5f;
+	const float slev0 = mix->matrix[0][4];
+	const float slev1 = mix->matrix[1][5];
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const __m256 vc = _mm256_set1_ps(clev);
+	const __m256 vl = _mm256_set1_ps(llev);
+	const __m256 vs0 = _mm256_set1_ps(slev0);
+	const __m256 vs1 = _mm256_set1_ps(slev1);
+	const float *sFL = s[0], *sFR = s[1], *sFC = s[2], *sLFE = s[3], *sSL = s[4], *sSR = s[5];
+	float *dFL = d[0], *dFR = d[1];
+	__m256 ctr, l, r;
+
+	if (is_aligned(2, d, 6, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		clear_avx(dFL, n_samples);
+		clear_avx(dFR, n_samples);
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			ctr = _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFC[n]), vc),
+					_mm256_mul_ps(_mm256_load_ps(&sLFE[n]), vl));
+			l = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(&sFL[n]), v0), ctr);
+			l = _mm256_add_ps(l, _mm256_mul_ps(_mm256_load_ps(&sSL[n]), vs0));
+			r = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(&sFR[n]), v1), ctr);
+			r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_load_ps(&sSR[n]), vs1));
+			_mm256_store_ps(&dFL[n], l);
+			_mm256_store_ps(&dFR[n], r);
+		}
+		for (; n < n_samples; n++) {
+			const float c = clev * sFC[n] + llev * sLFE[n];
+			dFL[n] = sFL[n] * m0 + c + (slev0 * sSL[n]);
+			dFR[n] = sFR[n] * m1 + c + (slev1 * sSR[n]);
+		}
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR -> FL+FR+FC+LFE*/
+void
+channelmix_f32_5p1_3p1_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[1][1];
+	const float m4 = mix->matrix[0][4];
+	const float m5 = mix->matrix[1][5];
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const __m256 v4 = _mm256_set1_ps(m4);
+	const __m256 v5 = _mm256_set1_ps(m5);
+	const float *sFL = s[0], *sFR = s[1], *sSL = s[4], *sSR = s[5];
+	float *dFL = d[0], *dFR = d[1];
+
+	if (is_aligned(2, d, 6, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			_mm256_store_ps(&dFL[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFL[n]), v0),
+					_mm256_mul_ps(_mm256_load_ps(&sSL[n]), v4)));
+			_mm256_store_ps(&dFR[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFR[n]), v1),
+					_mm256_mul_ps(_mm256_load_ps(&sSR[n]), v5)));
+		}
+		for (; n < n_samples; n++) {
+			dFL[n] = sFL[n] * m0 + sSL[n] * m4;
+			dFR[n] = sFR[n] * m1 + sSR[n] * m5;
+		}
+		vol_avx(d[2], s[2], mix->matrix[2][2], n_samples);
+		vol_avx(d[3], s[3], mix->matrix[3][3], n_samples);
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR -> FL+FR+RL+RR*/
+void
+channelmix_f32_5p1_4_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float clev = mix->matrix[0][2];
+	const float llev = mix->matrix[0][3];
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[1][1];
+	const __m256 vc = _mm256_set1_ps(clev);
+	const __m256 vl = _mm256_set1_ps(llev);
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const float *sFL = s[0], *sFR = s[1], *sFC = s[2], *sLFE = s[3];
+	float *dFL = d[0], *dFR = d[1];
+	__m256 ctr;
+
+	if (is_aligned(2, d, 4, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			ctr = _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFC[n]), vc),
+					_mm256_mul_ps(_mm256_load_ps(&sLFE[n]), vl));
+			_mm256_store_ps(&dFL[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFL[n]), v0), ctr));
+			_mm256_store_ps(&dFR[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFR[n]), v1), ctr));
+		}
+		for (; n < n_samples; n++) {
+			const float c = sFC[n] * clev + sLFE[n] * llev;
+			dFL[n] = sFL[n] * m0 + c;
+			dFR[n] = sFR[n] * m1 + c;
+		}
+		vol_avx(d[2], s[4], mix->matrix[2][4], n_samples);
+		vol_avx(d[3], s[5], mix->matrix[3][5], n_samples);
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR+RL+RR -> FL+FR */
+void
+channelmix_f32_7p1_2_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[1][1];
+	const float clev = (mix->matrix[0][2] + mix->matrix[1][2]) * 0.5f;
+	const float llev = (mix->matrix[0][3] + mix->matrix[1][3]) * 0.5f;
+	const float slev0 = mix->matrix[0][4];
+	const float slev1 = mix->matrix[1][5];
+	const float rlev0 = mix->matrix[0][6];
+	const float rlev1 = mix->matrix[1][7];
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const __m256 vc = _mm256_set1_ps(clev);
+	const __m256 vl = _mm256_set1_ps(llev);
+	const __m256 vs0 = _mm256_set1_ps(slev0);
+	const __m256 vs1 = _mm256_set1_ps(slev1);
+	const __m256 vr0 = _mm256_set1_ps(rlev0);
+	const __m256 vr1 = _mm256_set1_ps(rlev1);
+	const float *sFL = s[0], *sFR = s[1], *sFC = s[2], *sLFE = s[3];
+	const float *sSL = s[4], *sSR = s[5], *sRL = s[6], *sRR = s[7];
+	float *dFL = d[0], *dFR = d[1];
+	__m256 ctr, l, r;
+
+	if (is_aligned(2, d, 8, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		clear_avx(dFL, n_samples);
+		clear_avx(dFR, n_samples);
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			ctr = _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFC[n]), vc),
+					_mm256_mul_ps(_mm256_load_ps(&sLFE[n]), vl));
+			l = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(&sFL[n]), v0), ctr);
+			l = _mm256_add_ps(l, _mm256_mul_ps(_mm256_load_ps(&sSL[n]), vs0));
+			l = _mm256_add_ps(l, _mm256_mul_ps(_mm256_load_ps(&sRL[n]), vr0));
+			r = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(&sFR[n]), v1), ctr);
+			r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_load_ps(&sSR[n]), vs1));
+			r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_load_ps(&sRR[n]), vr1));
+			_mm256_store_ps(&dFL[n], l);
+			_mm256_store_ps(&dFR[n], r);
+		}
+		for (; n < n_samples; n++) {
+			const float c = clev * sFC[n] + llev * sLFE[n];
+			dFL[n] = sFL[n] * m0 + c + sSL[n] * slev0 + sRL[n] * rlev0;
+			dFR[n] = sFR[n] * m1 + c + sSR[n] * slev1 + sRR[n] * rlev1;
+		}
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR+RL+RR -> FL+FR+FC+LFE*/
+void
+channelmix_f32_7p1_3p1_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[1][1];
+	const float m4 = (mix->matrix[0][4] + mix->matrix[0][6]) * 0.5f;
+	const float m5 = (mix->matrix[1][5] + mix->matrix[1][7]) * 0.5f;
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const __m256 v4 = _mm256_set1_ps(m4);
+	const __m256 v5 = _mm256_set1_ps(m5);
+	const float *sFL = s[0], *sFR = s[1], *sSL = s[4], *sSR = s[5], *sRL = s[6], *sRR = s[7];
+	float *dFL = d[0], *dFR = d[1];
+
+	if (is_aligned(2, d, 8, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			_mm256_store_ps(&dFL[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFL[n]), v0),
+					_mm256_mul_ps(_mm256_add_ps(
+						_mm256_load_ps(&sSL[n]),
+						_mm256_load_ps(&sRL[n])), v4)));
+			_mm256_store_ps(&dFR[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFR[n]), v1),
+					_mm256_mul_ps(_mm256_add_ps(
+						_mm256_load_ps(&sSR[n]),
+						_mm256_load_ps(&sRR[n])), v5)));
+		}
+		for (; n < n_samples; n++) {
+			dFL[n] = sFL[n] * m0 + (sSL[n] + sRL[n]) * m4;
+			dFR[n] = sFR[n] * m1 + (sSR[n] + sRR[n]) * m5;
+		}
+		vol_avx(d[2], s[2], mix->matrix[2][2], n_samples);
+		vol_avx(d[3], s[3], mix->matrix[3][3], n_samples);
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR+RL+RR -> FL+FR+RL+RR*/
+void
+channelmix_f32_7p1_4_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float m0 = mix->matrix[0][0];
+	const float m1 = mix->matrix[1][1];
+	const float clev = (mix->matrix[0][2] + mix->matrix[1][2]) * 0.5f;
+	const float llev = (mix->matrix[0][3] + mix->matrix[1][3]) * 0.5f;
+	const float slev0 = mix->matrix[2][4];
+	const float slev1 = mix->matrix[3][5];
+	const float rlev0 = mix->matrix[2][6];
+	const float rlev1 = mix->matrix[3][7];
+	const __m256 v0 = _mm256_set1_ps(m0);
+	const __m256 v1 = _mm256_set1_ps(m1);
+	const __m256 vc = _mm256_set1_ps(clev);
+	const __m256 vl = _mm256_set1_ps(llev);
+	const __m256 vs0 = _mm256_set1_ps(slev0);
+	const __m256 vs1 = _mm256_set1_ps(slev1);
+	const __m256 vr0 = _mm256_set1_ps(rlev0);
+	const __m256 vr1 = _mm256_set1_ps(rlev1);
+	const float *sFL = s[0], *sFR = s[1], *sFC = s[2], *sLFE = s[3];
+	const float *sSL = s[4], *sSR = s[5], *sRL = s[6], *sRR = s[7];
+	float *dFL = d[0], *dFR = d[1], *dRL = d[2], *dRR = d[3];
+	__m256 ctr, sl, sr;
+
+	if (is_aligned(4, d, 8, s))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			clear_avx(d[i], n_samples);
+	}
+	else {
+		for (n = 0; n < unrolled; n += 8) {
+			ctr = _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFC[n]), vc),
+					_mm256_mul_ps(_mm256_load_ps(&sLFE[n]), vl));
+			sl = _mm256_mul_ps(_mm256_load_ps(&sSL[n]), vs0);
+			sr = _mm256_mul_ps(_mm256_load_ps(&sSR[n]), vs1);
+			_mm256_store_ps(&dFL[n], _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFL[n]), v0), ctr), sl));
+			_mm256_store_ps(&dFR[n], _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sFR[n]), v1), ctr), sr));
+			_mm256_store_ps(&dRL[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sRL[n]), vr0), sl));
+			_mm256_store_ps(&dRR[n], _mm256_add_ps(
+					_mm256_mul_ps(_mm256_load_ps(&sRR[n]), vr1), sr));
+		}
+		for (; n < n_samples; n++) {
+			const float c = sFC[n] * clev + sLFE[n] * llev;
+			const float l = sSL[n] * slev0;
+			const float r = sSR[n] * slev1;
+			dFL[n] = sFL[n] * m0 + c + l;
+			dFR[n] = sFR[n] * m1 + c + r;
+			dRL[n] = sRL[n] * rlev0 + l;
+			dRR[n] = sRR[n] * rlev1 + r;
+		}
+	}
+}
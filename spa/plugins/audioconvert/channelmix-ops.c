@@ -65,6 +65,16 @@ static const struct channelmix_info {
 	const char *name;
 } channelmix_table[] =
 {
+#if defined (HAVE_AVX)
+	{ 2, MASK_MONO, 2, MASK_MONO, channelmix_copy_avx, SPA_CPU_FLAG_AVX, "copy_avx" },
+	{ 2, MASK_STEREO, 2, MASK_STEREO, channelmix_copy_avx, SPA_CPU_FLAG_AVX, "copy_avx" },
+	{ EQ, 0, EQ, 0, channelmix_copy_avx, SPA_CPU_FLAG_AVX, "copy_avx" },
+#endif
+#if defined (HAVE_NEON)
+	{ 2, MASK_MONO, 2, MASK_MONO, channelmix_copy_neon, SPA_CPU_FLAG_NEON, "copy_neon" },
+	{ 2, MASK_STEREO, 2, MASK_STEREO, channelmix_copy_neon, SPA_CPU_FLAG_NEON, "copy_neon" },
+	{ EQ, 0, EQ, 0, channelmix_copy_neon, SPA_CPU_FLAG_NEON, "copy_neon" },
+#endif
 #if defined (HAVE_SSE)
 	{ 2, MASK_MONO, 2, MASK_MONO, channelmix_copy_sse, SPA_CPU_FLAG_SSE, "copy_sse" },
 	{ 2, MASK_STEREO, 2, MASK_STEREO, channelmix_copy_sse, SPA_CPU_FLAG_SSE, "copy_sse" },
@@ -72,36 +82,81 @@ static const struct channelmix_info {
 #endif
 	{ 2, MASK_MONO, 2, MASK_MONO, channelmix_copy_c, 0, "copy_c" },
 	{ 2, MASK_STEREO, 2, MASK_STEREO, channelmix_copy_c, 0, "copy_c" },
-	{ EQ, 0, EQ, 0, channelmix_copy_c, 0 },
+	{ EQ, 0, EQ, 0, channelmix_copy_c, 0, "copy_c" },
 
+#if defined (HAVE_AVX)
+	{ 1, MASK_MONO, 2, MASK_STEREO, channelmix_f32_1_2_avx, SPA_CPU_FLAG_AVX, "f32_1_2_avx" },
+	{ 2, MASK_STEREO, 1, MASK_MONO, channelmix_f32_2_1_avx, SPA_CPU_FLAG_AVX, "f32_2_1_avx" },
+	{ 4, MASK_QUAD, 1, MASK_MONO, channelmix_f32_4_1_avx, SPA_CPU_FLAG_AVX, "f32_4_1_avx" },
+	{ 4, MASK_3_1, 1, MASK_MONO, channelmix_f32_3p1_1_avx, SPA_CPU_FLAG_AVX, "f32_3p1_1_avx" },
+#endif
+#if defined (HAVE_NEON)
+	{ 1, MASK_MONO, 2, MASK_STEREO, channelmix_f32_1_2_neon, SPA_CPU_FLAG_NEON, "f32_1_2_neon" },
+	{ 2, MASK_STEREO, 1, MASK_MONO, channelmix_f32_2_1_neon, SPA_CPU_FLAG_NEON, "f32_2_1_neon" },
+	{ 4, MASK_QUAD, 1, MASK_MONO, channelmix_f32_4_1_neon, SPA_CPU_FLAG_NEON, "f32_4_1_neon" },
+	{ 4, MASK_3_1, 1, MASK_MONO, channelmix_f32_3p1_1_neon, SPA_CPU_FLAG_NEON, "f32_3p1_1_neon" },
+#endif
 	{ 1, MASK_MONO, 2, MASK_STEREO, channelmix_f32_1_2_c, 0, "f32_1_2_c" },
 	{ 2, MASK_STEREO, 1, MASK_MONO, channelmix_f32_2_1_c, 0, "f32_2_1_c" },
 	{ 4, MASK_QUAD, 1, MASK_MONO, channelmix_f32_4_1_c, 0, "f32_4_1_c" },
 	{ 4, MASK_3_1, 1, MASK_MONO, channelmix_f32_3p1_1_c, 0, "f32_3p1_1_c" },
+
+#if defined (HAVE_AVX)
+	{ 2, MASK_STEREO, 4, MASK_QUAD, channelmix_f32_2_4_avx, SPA_CPU_FLAG_AVX, "f32_2_4_avx" },
+	{ 2, MASK_STEREO, 4, MASK_3_1, channelmix_f32_2_3p1_avx, SPA_CPU_FLAG_AVX, "f32_2_3p1_avx" },
+	{ 2, MASK_STEREO, 6, MASK_5_1, channelmix_f32_2_5p1_avx, SPA_CPU_FLAG_AVX, "f32_2_5p1_avx" },
+#endif
+#if defined (HAVE_NEON)
+	{ 2, MASK_STEREO, 4, MASK_QUAD, channelmix_f32_2_4_neon, SPA_CPU_FLAG_NEON, "f32_2_4_neon" },
+	{ 2, MASK_STEREO, 4, MASK_3_1, channelmix_f32_2_3p1_neon, SPA_CPU_FLAG_NEON, "f32_2_3p1_neon" },
+	{ 2, MASK_STEREO, 6, MASK_5_1, channelmix_f32_2_5p1_neon, SPA_CPU_FLAG_NEON, "f32_2_5p1_neon" },
+#endif
 #if defined (HAVE_SSE)
 	{ 2, MASK_STEREO, 4, MASK_QUAD, channelmix_f32_2_4_sse, SPA_CPU_FLAG_SSE, "f32_2_4_sse" },
 #endif
 	{ 2, MASK_STEREO, 4, MASK_QUAD, channelmix_f32_2_4_c, 0, "f32_2_4_c" },
 	{ 2, MASK_STEREO, 4, MASK_3_1, channelmix_f32_2_3p1_c, 0, "f32_2_3p1_c" },
 	{ 2, MASK_STEREO, 6, MASK_5_1, channelmix_f32_2_5p1_c, 0, "f32_2_5p1_c" },
-#if defined (HAVE_SSE)
-	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_sse, SPA_CPU_FLAG_SSE, "f32_5p1_2_sse" },
+
+#if defined (HAVE_AVX)
+	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_avx, SPA_CPU_FLAG_AVX, "f32_5p1_2_avx" },
+	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_avx, SPA_CPU_FLAG_AVX, "f32_5p1_4_avx" },
+	{ 6, MASK_5_1, 4, MASK_3_1, channelmix_f32_5p1_3p1_avx, SPA_CPU_FLAG_AVX, "f32_5p1_3p1_avx" },
 #endif
-	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_c, 0, "f32_5p1_2_c" },
-#if defined (HAVE_SSE)
-	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_sse, SPA_CPU_FLAG_SSE, "f32_5p1_4_sse" },
+#if defined (HAVE_NEON)
+	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_neon, SPA_CPU_FLAG_NEON, "f32_5p1_2_neon" },
+	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_neon, SPA_CPU_FLAG_NEON, "f32_5p1_4_neon" },
+	{ 6, MASK_5_1, 4, MASK_3_1, channelmix_f32_5p1_3p1_neon, SPA_CPU_FLAG_NEON, "f32_5p1_3p1_neon" },
 #endif
-	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_c, 0, "f32_5p1_4_c" },
-
 #if defined (HAVE_SSE)
+	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_sse, SPA_CPU_FLAG_SSE, "f32_5p1_2_sse" },
+	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_sse, SPA_CPU_FLAG_SSE, "f32_5p1_4_sse" },
 	{ 6, MASK_5_1, 4, MASK_3_1, channelmix_f32_5p1_3p1_sse, SPA_CPU_FLAG_SSE, "f32_5p1_3p1_sse" },
 #endif
+	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_c, 0, "f32_5p1_2_c" },
+	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_c, 0, "f32_5p1_4_c" },
 	{ 6, MASK_5_1, 4, MASK_3_1, channelmix_f32_5p1_3p1_c, 0, "f32_5p1_3p1_c" },
 
+#if defined (HAVE_AVX)
+	{ 8, MASK_7_1, 2, MASK_STEREO, channelmix_f32_7p1_2_avx, SPA_CPU_FLAG_AVX, "f32_7p1_2_avx" },
+	{ 8, MASK_7_1, 4, MASK_QUAD, channelmix_f32_7p1_4_avx, SPA_CPU_FLAG_AVX, "f32_7p1_4_avx" },
+	{ 8, MASK_7_1, 4, MASK_3_1, channelmix_f32_7p1_3p1_avx, SPA_CPU_FLAG_AVX, "f32_7p1_3p1_avx" },
+#endif
+#if defined (HAVE_NEON)
+	{ 8, MASK_7_1, 2, MASK_STEREO, channelmix_f32_7p1_2_neon, SPA_CPU_FLAG_NEON, "f32_7p1_2_neon" },
+	{ 8, MASK_7_1, 4, MASK_QUAD, channelmix_f32_7p1_4_neon, SPA_CPU_FLAG_NEON, "f32_7p1_4_neon" },
+	{ 8, MASK_7_1, 4, MASK_3_1, channelmix_f32_7p1_3p1_neon, SPA_CPU_FLAG_NEON, "f32_7p1_3p1_neon" },
+#endif
 	{ 8, MASK_7_1, 2, MASK_STEREO, channelmix_f32_7p1_2_c, 0, "f32_7p1_2_c" },
 	{ 8, MASK_7_1, 4, MASK_QUAD, channelmix_f32_7p1_4_c, 0, "f32_7p1_4_c" },
 	{ 8, MASK_7_1, 4, MASK_3_1, channelmix_f32_7p1_3p1_c, 0, "f32_7p1_3p1_c" },
 
+#if defined (HAVE_AVX)
+	{ ANY, 0, ANY, 0, channelmix_f32_n_m_avx, SPA_CPU_FLAG_AVX, "f32_n_m_avx" },
+#endif
+#if defined (HAVE_NEON)
+	{ ANY, 0, ANY, 0, channelmix_f32_n_m_neon, SPA_CPU_FLAG_NEON, "f32_n_m_neon" },
+#endif
 	{ ANY, 0, ANY, 0, channelmix_f32_n_m_c, 0, "f32_n_m_c" },
 };
 
@@ -1060,3 +1060,361 @@ conv_f32d_to_s16_2_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const v
 		d += 2;
 	}
 }
+
+/* load 8 frames of 4 channels and transpose them so that each register
+ * holds 8 samples of one channel */
+static inline void
+load_4x8_avx2(const uint32_t *s, uint32_t n_channels, __m256i out[4])
+{
+	__m256i in[4], t[4];
+
+	in[0] = _mm256_setr_m128i(
+			_mm_loadu_si128((__m128i*)&s[0*n_channels]),
+			_mm_loadu_si128((__m128i*)&s[4*n_channels])); /* a0 b0 c0 d0 a4 b4 c4 d4 */
+	in[1] = _mm256_setr_m128i(
+			_mm_loadu_si128((__m128i*)&s[1*n_channels]),
+			_mm_loadu_si128((__m128i*)&s[5*n_channels])); /* a1 b1 c1 d1 a5 b5 c5 d5 */
+	in[2] = _mm256_setr_m128i(
+			_mm_loadu_si128((__m128i*)&s[2*n_channels]),
+			_mm_loadu_si128((__m128i*)&s[6*n_channels])); /* a2 b2 c2 d2 a6 b6 c6 d6 */
+	in[3] = _mm256_setr_m128i(
+			_mm_loadu_si128((__m128i*)&s[3*n_channels]),
+			_mm_loadu_si128((__m128i*)&s[7*n_channels])); /* a3 b3 c3 d3 a7 b7 c7 d7 */
+
+	t[0] = _mm256_unpacklo_epi32(in[0], in[1]);   /* a0 a1 b0 b1 a4 a5 b4 b5 */
+	t[1] = _mm256_unpackhi_epi32(in[0], in[1]);   /* c0 c1 d0 d1 c4 c5 d4 d5 */
+	t[2] = _mm256_unpacklo_epi32(in[2], in[3]);   /* a2 a3 b2 b3 a6 a7 b6 b7 */
+	t[3] = _mm256_unpackhi_epi32(in[2], in[3]);   /* c2 c3 d2 d3 c6 c7 d6 d7 */
+
+	out[0] = _mm256_unpacklo_epi64(t[0], t[2]);   /* a0 a1 a2 a3 a4 a5 a6 a7 */
+	out[1] = _mm256_unpackhi_epi64(t[0], t[2]);   /* b0 b1 b2 b3 b4 b5 b6 b7 */
+	out[2] = _mm256_unpacklo_epi64(t[1], t[3]);   /* c0 c1 c2 c3 c4 c5 c6 c7 */
+	out[3] = _mm256_unpackhi_epi64(t[1], t[3]);   /* d0 d1 d2 d3 d4 d5 d6 d7 */
+}
+
+/* the reverse of load_4x8_avx2, transpose 8 samples of 4 channels and
+ * store them as 8 frames */
+static inline void
+store_4x8_avx2(uint32_t *d, uint32_t n_channels, __m256i in[4])
+{
+	__m256i t[4], out[4];
+
+	t[0] = _mm256_unpacklo_epi32(in[0], in[1]); /* a0 b0 a1 b1 a4 b4 a5 b5 */
+	t[1] = _mm256_unpackhi_epi32(in[0], in[1]); /* a2 b2 a3 b3 a6 b6 a7 b7 */
+	t[2] = _mm256_unpacklo_epi32(in[2], in[3]); /* c0 d0 c1 d1 c4 d4 c5 d5 */
+	t[3] = _mm256_unpackhi_epi32(in[2], in[3]); /* c2 d2 c3 d3 c6 d6 c7 d7 */
+
+	out[0] = _mm256_unpacklo_epi64(t[0], t[2]);   /* a0 b0 c0 d0 a4 b4 c4 d4 */
+	out[1] = _mm256_unpackhi_epi64(t[0], t[2]);   /* a1 b1 c1 d1 a5 b5 c5 d5 */
+	out[2] = _mm256_unpacklo_epi64(t[1], t[3]);   /* a2 b2 c2 d2 a6 b6 c6 d6 */
+	out[3] = _mm256_unpackhi_epi64(t[1], t[3]);   /* a3 b3 c3 d3 a7 b7 c7 d7 */
+
+	_mm_storeu_si128((__m128i*)(d + 0*n_channels), _mm256_extracti128_si256(out[0], 0));
+	_mm_storeu_si128((__m128i*)(d + 1*n_channels), _mm256_extracti128_si256(out[1], 0));
+	_mm_storeu_si128((__m128i*)(d + 2*n_channels), _mm256_extracti128_si256(out[2], 0));
+	_mm_storeu_si128((__m128i*)(d + 3*n_channels), _mm256_extracti128_si256(out[3], 0));
+	_mm_storeu_si128((__m128i*)(d + 4*n_channels), _mm256_extracti128_si256(out[0], 1));
+	_mm_storeu_si128((__m128i*)(d + 5*n_channels), _mm256_extracti128_si256(out[1], 1));
+	_mm_storeu_si128((__m128i*)(d + 6*n_channels), _mm256_extracti128_si256(out[2], 1));
+	_mm_storeu_si128((__m128i*)(d + 7*n_channels), _mm256_extracti128_si256(out[3], 1));
+}
+
+static void
+conv_deinterleave_32_4s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const uint32_t *s = src;
+	uint32_t *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];
+	uint32_t n, unrolled;
+	__m256i out[4];
+
+	if (SPA_IS_ALIGNED(d0, 32) &&
+	    SPA_IS_ALIGNED(d1, 32) &&
+	    SPA_IS_ALIGNED(d2, 32) &&
+	    SPA_IS_ALIGNED(d3, 32))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 8) {
+		load_4x8_avx2(s, n_channels, out);
+
+		_mm256_store_si256((__m256i*)&d0[n], out[0]);
+		_mm256_store_si256((__m256i*)&d1[n], out[1]);
+		_mm256_store_si256((__m256i*)&d2[n], out[2]);
+		_mm256_store_si256((__m256i*)&d3[n], out[3]);
+
+		s += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = s[0];
+		d1[n] = s[1];
+		d2[n] = s[2];
+		d3[n] = s[3];
+		s += n_channels;
+	}
+}
+
+static void
+conv_deinterleave_32_1s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int32_t *s = src;
+	int32_t *d0 = dst[0];
+	uint32_t n, unrolled;
+	__m256i in[2];
+	__m256i mask1 = _mm256_setr_epi64x(0*n_channels, 1*n_channels, 2*n_channels, 3*n_channels);
+	__m256i mask2 = _mm256_setr_epi64x(4*n_channels, 5*n_channels, 6*n_channels, 7*n_channels);
+
+	if (SPA_IS_ALIGNED(d0, 32))
+		unrolled = n_samples & ~15;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in[0] = _mm256_setr_m128i(
+				_mm256_i64gather_epi32(&s[ 0*n_channels], mask1, 4),
+				_mm256_i64gather_epi32(&s[ 0*n_channels], mask2, 4));
+		in[1] = _mm256_setr_m128i(
+				_mm256_i64gather_epi32(&s[ 8*n_channels], mask1, 4),
+				_mm256_i64gather_epi32(&s[ 8*n_channels], mask2, 4));
+
+		_mm256_store_si256((__m256i*)&d0[n+0], in[0]);
+		_mm256_store_si256((__m256i*)&d0[n+8], in[1]);
+
+		s += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = s[0];
+		s += n_channels;
+	}
+}
+
+void
+conv_deinterleave_32_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_deinterleave_32_4s_avx2(conv, &dst[i], &s[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_deinterleave_32_1s_avx2(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_interleave_32_4s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const uint32_t *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+	uint32_t *d = dst;
+	uint32_t n, unrolled;
+	__m256i in[4];
+
+	if (SPA_IS_ALIGNED(s0, 32) &&
+	    SPA_IS_ALIGNED(s1, 32) &&
+	    SPA_IS_ALIGNED(s2, 32) &&
+	    SPA_IS_ALIGNED(s3, 32))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_load_si256((__m256i*)&s0[n]);
+		in[1] = _mm256_load_si256((__m256i*)&s1[n]);
+		in[2] = _mm256_load_si256((__m256i*)&s2[n]);
+		in[3] = _mm256_load_si256((__m256i*)&s3[n]);
+
+		store_4x8_avx2(d, n_channels, in);
+
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d[0] = s0[n];
+		d[1] = s1[n];
+		d[2] = s2[n];
+		d[3] = s3[n];
+		d += n_channels;
+	}
+}
+
+void
+conv_interleave_32_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t *d = dst[0];
+	uint32_t i = 0, j, n, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_interleave_32_4s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+	for(; i < n_channels; i++) {
+		const uint32_t *s = src[i];
+		for (n = 0, j = i; n < n_samples; n++, j += n_channels)
+			d[j] = s[n];
+	}
+}
+
+static void
+conv_s24_32_to_f32d_4s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const uint32_t *s = src;
+	float *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];
+	uint32_t n, unrolled;
+	__m256i in[4];
+	__m256 out[4], factor = _mm256_set1_ps(1.0f / S24_SCALE);
+
+	if (SPA_IS_ALIGNED(d0, 32) &&
+	    SPA_IS_ALIGNED(d1, 32) &&
+	    SPA_IS_ALIGNED(d2, 32) &&
+	    SPA_IS_ALIGNED(d3, 32))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 8) {
+		load_4x8_avx2(s, n_channels, in);
+
+		/* sign extend the lower 24 bits */
+		in[0] = _mm256_srai_epi32(_mm256_slli_epi32(in[0], 8), 8);
+		in[1] = _mm256_srai_epi32(_mm256_slli_epi32(in[1], 8), 8);
+		in[2] = _mm256_srai_epi32(_mm256_slli_epi32(in[2], 8), 8);
+		in[3] = _mm256_srai_epi32(_mm256_slli_epi32(in[3], 8), 8);
+
+		out[0] = _mm256_mul_ps(_mm256_cvtepi32_ps(in[0]), factor);
+		out[1] = _mm256_mul_ps(_mm256_cvtepi32_ps(in[1]), factor);
+		out[2] = _mm256_mul_ps(_mm256_cvtepi32_ps(in[2]), factor);
+		out[3] = _mm256_mul_ps(_mm256_cvtepi32_ps(in[3]), factor);
+
+		_mm256_store_ps(&d0[n], out[0]);
+		_mm256_store_ps(&d1[n], out[1]);
+		_mm256_store_ps(&d2[n], out[2]);
+		_mm256_store_ps(&d3[n], out[3]);
+
+		s += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S24_32_TO_F32(s[0]);
+		d1[n] = S24_32_TO_F32(s[1]);
+		d2[n] = S24_32_TO_F32(s[2]);
+		d3[n] = S24_32_TO_F32(s[3]);
+		s += n_channels;
+	}
+}
+
+static void
+conv_s24_32_to_f32d_1s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int32_t *s = src;
+	float *d0 = dst[0];
+	uint32_t n, unrolled;
+	__m256i in[2];
+	__m256 out[2], factor = _mm256_set1_ps(1.0f / S24_SCALE);
+	__m256i mask1 = _mm256_setr_epi64x(0*n_channels, 1*n_channels, 2*n_channels, 3*n_channels);
+	__m256i mask2 = _mm256_setr_epi64x(4*n_channels, 5*n_channels, 6*n_channels, 7*n_channels);
+
+	if (SPA_IS_ALIGNED(d0, 32))
+		unrolled = n_samples & ~15;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in[0] = _mm256_setr_m128i(
+				_mm256_i64gather_epi32(&s[ 0*n_channels], mask1, 4),
+				_mm256_i64gather_epi32(&s[ 0*n_channels], mask2, 4));
+		in[1] = _mm256_setr_m128i(
+				_mm256_i64gather_epi32(&s[ 8*n_channels], mask1, 4),
+				_mm256_i64gather_epi32(&s[ 8*n_channels], mask2, 4));
+
+		in[0] = _mm256_srai_epi32(_mm256_slli_epi32(in[0], 8), 8);
+		in[1] = _mm256_srai_epi32(_mm256_slli_epi32(in[1], 8), 8);
+
+		out[0] = _mm256_mul_ps(_mm256_cvtepi32_ps(in[0]), factor);
+		out[1] = _mm256_mul_ps(_mm256_cvtepi32_ps(in[1]), factor);
+
+		_mm256_store_ps(&d0[n+0], out[0]);
+		_mm256_store_ps(&d0[n+8], out[1]);
+
+		s += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S24_32_TO_F32(s[0]);
+		s += n_channels;
+	}
+}
+
+void
+conv_s24_32_to_f32d_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_s24_32_to_f32d_4s_avx2(conv, &dst[i], &s[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_s24_32_to_f32d_1s_avx2(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s24_32_4s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+	int32_t *d = dst;
+	uint32_t n, unrolled;
+	__m256 in[4];
+	__m256i out[4];
+	__m256 scale = _mm256_set1_ps(S24_SCALE);
+	__m256 min = _mm256_set1_ps(-1.0f), max = _mm256_set1_ps(1.0f);
+
+	if (SPA_IS_ALIGNED(s0, 32) &&
+	    SPA_IS_ALIGNED(s1, 32) &&
+	    SPA_IS_ALIGNED(s2, 32) &&
+	    SPA_IS_ALIGNED(s3, 32))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(&s0[n]), min), max);
+		in[1] = _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(&s1[n]), min), max);
+		in[2] = _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(&s2[n]), min), max);
+		in[3] = _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(&s3[n]), min), max);
+
+		/* truncate like the C version */
+		out[0] = _mm256_cvttps_epi32(_mm256_mul_ps(in[0], scale));
+		out[1] = _mm256_cvttps_epi32(_mm256_mul_ps(in[1], scale));
+		out[2] = _mm256_cvttps_epi32(_mm256_mul_ps(in[2], scale));
+		out[3] = _mm256_cvttps_epi32(_mm256_mul_ps(in[3], scale));
+
+		store_4x8_avx2((uint32_t*)d, n_channels, out);
+
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d[0] = F32_TO_S24_32(s0[n]);
+		d[1] = F32_TO_S24_32(s1[n]);
+		d[2] = F32_TO_S24_32(s2[n]);
+		d[3] = F32_TO_S24_32(s3[n]);
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s24_32_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int32_t *d = dst[0];
+	uint32_t i = 0, j, n, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_f32d_to_s24_32_4s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+	for(; i < n_channels; i++) {
+		const float *s = src[i];
+		for (n = 0, j = i; n < n_samples; n++, j += n_channels)
+			d[j] = F32_TO_S24_32(s[n]);
+	}
+}
@@ -28,6 +28,8 @@
 
 #include "fmt-ops.h"
 
+#include <arm_neon.h>
+
 void
 conv_s16_to_f32d_2_neon(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
 		uint32_t n_samples)
@@ -443,3 +445,270 @@ conv_f32d_to_s16_neon(struct convert *conv, void * SPA_RESTRICT dst[], const voi
 	for(; i < n_channels; i++)
 		conv_f32d_to_s16_1s_neon(conv, &d[i], &src[i], n_channels, n_samples);
 }
+
+/* load 4 frames of 4 channels and transpose them so that each register
+ * holds 4 samples of one channel. The transpose is its own inverse so
+ * the same is used for storing. */
+static inline void
+transpose_4x4_neon(uint32x4_t v[4])
+{
+	uint32x4x2_t t[2], r[2];
+
+	t[0] = vzipq_u32(v[0], v[2]);			/* a0 a2 b0 b2, c0 c2 d0 d2 */
+	t[1] = vzipq_u32(v[1], v[3]);			/* a1 a3 b1 b3, c1 c3 d1 d3 */
+	r[0] = vzipq_u32(t[0].val[0], t[1].val[0]);	/* a0 a1 a2 a3, b0 b1 b2 b3 */
+	r[1] = vzipq_u32(t[0].val[1], t[1].val[1]);	/* c0 c1 c2 c3, d0 d1 d2 d3 */
+
+	v[0] = r[0].val[0];
+	v[1] = r[0].val[1];
+	v[2] = r[1].val[0];
+	v[3] = r[1].val[1];
+}
+
+static inline void
+load_4x4_neon(const uint32_t *s, uint32_t n_channels, uint32x4_t v[4])
+{
+	v[0] = vld1q_u32(&s[0*n_channels]);
+	v[1] = vld1q_u32(&s[1*n_channels]);
+	v[2] = vld1q_u32(&s[2*n_channels]);
+	v[3] = vld1q_u32(&s[3*n_channels]);
+	transpose_4x4_neon(v);
+}
+
+static inline void
+store_4x4_neon(uint32_t *d, uint32_t n_channels, uint32x4_t v[4])
+{
+	transpose_4x4_neon(v);
+	vst1q_u32(&d[0*n_channels], v[0]);
+	vst1q_u32(&d[1*n_channels], v[1]);
+	vst1q_u32(&d[2*n_channels], v[2]);
+	vst1q_u32(&d[3*n_channels], v[3]);
+}
+
+void
+conv_deinterleave_32_neon(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	uint32_t i = 0, j, n, n_channels = conv->n_channels;
+	uint32_t unrolled = n_samples & ~3;
+	uint32x4_t v[4];
+
+	for(; i + 3 < n_channels; i += 4) {
+		uint32_t *d0 = dst[i], *d1 = dst[i+1], *d2 = dst[i+2], *d3 = dst[i+3];
+
+		for(n = 0, j = i; n < unrolled; n += 4, j += 4*n_channels) {
+			load_4x4_neon(&s[j], n_channels, v);
+			vst1q_u32(&d0[n], v[0]);
+			vst1q_u32(&d1[n], v[1]);
+			vst1q_u32(&d2[n], v[2]);
+			vst1q_u32(&d3[n], v[3]);
+		}
+		for(; n < n_samples; n++, j += n_channels) {
+			d0[n] = s[j];
+			d1[n] = s[j+1];
+			d2[n] = s[j+2];
+			d3[n] = s[j+3];
+		}
+	}
+	for(; i < n_channels; i++) {
+		uint32_t *d0 = dst[i];
+		for(n = 0, j = i; n < n_samples; n++, j += n_channels)
+			d0[n] = s[j];
+	}
+}
+
+void
+conv_interleave_32_neon(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t *d = dst[0];
+	uint32_t i = 0, j, n, n_channels = conv->n_channels;
+	uint32_t unrolled = n_samples & ~3;
+	uint32x4_t v[4];
+
+	for(; i + 3 < n_channels; i += 4) {
+		const uint32_t *s0 = src[i], *s1 = src[i+1], *s2 = src[i+2], *s3 = src[i+3];
+
+		for(n = 0, j = i; n < unrolled; n += 4, j += 4*n_channels) {
+			v[0] = vld1q_u32(&s0[n]);
+			v[1] = vld1q_u32(&s1[n]);
+			v[2] = vld1q_u32(&s2[n]);
+			v[3] = vld1q_u32(&s3[n]);
+			store_4x4_neon(&d[j], n_channels, v);
+		}
+		for(; n < n_samples; n++, j += n_channels) {
+			d[j] = s0[n];
+			d[j+1] = s1[n];
+			d[j+2] = s2[n];
+			d[j+3] = s3[n];
+		}
+	}
+	for(; i < n_channels; i++) {
+		const uint32_t *s0 = src[i];
+		for(n = 0, j = i; n < n_samples; n++, j += n_channels)
+			d[j] = s0[n];
+	}
+}
+
+/* the conversions do the same operations as the C macros so that the
+ * results are the same */
+static inline float32x4_t s32_to_f32_neon(uint32x4_t v)
+{
+	int32x4_t t = vshrq_n_s32(vreinterpretq_s32_u32(v), 8);
+	return vmulq_n_f32(vcvtq_f32_s32(t), 1.0f / S24_SCALE);
+}
+
+static inline float32x4_t s24_32_to_f32_neon(uint32x4_t v)
+{
+	int32x4_t t = vshrq_n_s32(vshlq_n_s32(vreinterpretq_s32_u32(v), 8), 8);
+	return vmulq_n_f32(vcvtq_f32_s32(t), 1.0f / S24_SCALE);
+}
+
+static inline int32x4_t f32_to_s24_neon(float32x4_t v)
+{
+	v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(-1.0f)), vdupq_n_f32(1.0f));
+	return vcvtq_s32_f32(vmulq_n_f32(v, S24_SCALE));
+}
+
+static inline uint32x4_t f32_to_s32_neon(float32x4_t v)
+{
+	return vreinterpretq_u32_s32(vshlq_n_s32(f32_to_s24_neon(v), 8));
+}
+
+static inline uint32x4_t f32_to_s24_32_neon(float32x4_t v)
+{
+	return vreinterpretq_u32_s32(f32_to_s24_neon(v));
+}
+
+void
+conv_s32_to_f32d_neon(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	uint32_t i = 0, j, n, n_channels = conv->n_channels;
+	uint32_t unrolled = n_samples & ~3;
+	uint32x4_t v[4];
+
+	for(; i + 3 < n_channels; i += 4) {
+		float *d0 = dst[i], *d1 = dst[i+1], *d2 = dst[i+2], *d3 = dst[i+3];
+
+		for(n = 0, j = i; n < unrolled; n += 4, j += 4*n_channels) {
+			load_4x4_neon(&s[j], n_channels, v);
+			vst1q_f32(&d0[n], s32_to_f32_neon(v[0]));
+			vst1q_f32(&d1[n], s32_to_f32_neon(v[1]));
+			vst1q_f32(&d2[n], s32_to_f32_neon(v[2]));
+			vst1q_f32(&d3[n], s32_to_f32_neon(v[3]));
+		}
+		for(; n < n_samples; n++, j += n_channels) {
+			d0[n] = S32_TO_F32(s[j]);
+			d1[n] = S32_TO_F32(s[j+1]);
+			d2[n] = S32_TO_F32(s[j+2]);
+			d3[n] = S32_TO_F32(s[j+3]);
+		}
+	}
+	for(; i < n_channels; i++) {
+		float *d0 = dst[i];
+		for(n = 0, j = i; n < n_samples; n++, j += n_channels)
+			d0[n] = S32_TO_F32(s[j]);
+	}
+}
+
+void
+conv_s24_32_to_f32d_neon(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	uint32_t i = 0, j, n, n_channels = conv->n_channels;
+	uint32_t unrolled = n_samples & ~3;
+	uint32x4_t v[4];
+
+	for(; i + 3 < n_channels; i += 4) {
+		float *d0 = dst[i], *d1 = dst[i+1], *d2 = dst[i+2], *d3 = dst[i+3];
+
+		for(n = 0, j = i; n < unrolled; n += 4, j += 4*n_channels) {
+			load_4x4_neon(&s[j], n_channels, v);
+			vst1q_f32(&d0[n], s24_32_to_f32_neon(v[0]));
+			vst1q_f32(&d1[n], s24_32_to_f32_neon(v[1]));
+			vst1q_f32(&d2[n], s24_32_to_f32_neon(v[2]));
+			vst1q_f32(&d3[n], s24_32_to_f32_neon(v[3]));
+		}
+		for(; n < n_samples; n++, j += n_channels) {
+			d0[n] = S24_32_TO_F32(s[j]);
+			d1[n] = S24_32_TO_F32(s[j+1]);
+			d2[n] = S24_32_TO_F32(s[j+2]);
+			d3[n] = S24_32_TO_F32(s[j+3]);
+		}
+	}
+	for(; i < n_channels; i++) {
+		float *d0 = dst[i];
+		for(n = 0, j = i; n < n_samples; n++, j += n_channels)
+			d0[n] = S24_32_TO_F32(s[j]);
+	}
+}
+
+void
+conv_f32d_to_s32_neon(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t *d = dst[0];
+	uint32_t i = 0, j, n, n_channels = conv->n_channels;
+	uint32_t unrolled = n_samples & ~3;
+	uint32x4_t v[4];
+
+	for(; i + 3 < n_channels; i += 4) {
+		const float *s0 = src[i], *s1 = src[i+1], *s2 = src[i+2], *s3 = src[i+3];
+
+		for(n = 0, j = i; n < unrolled; n += 4, j += 4*n_channels) {
+			v[0] = f32_to_s32_neon(vld1q_f32(&s0[n]));
+			v[1] = f32_to_s32_neon(vld1q_f32(&s1[n]));
+			v[2] = f32_to_s32_neon(vld1q_f32(&s2[n]));
+			v[3] = f32_to_s32_neon(vld1q_f32(&s3[n]));
+			store_4x4_neon(&d[j], n_channels, v);
+		}
+		for(; n < n_samples; n++, j += n_channels) {
+			d[j] = F32_TO_S32(s0[n]);
+			d[j+1] = F32_TO_S32(s1[n]);
+			d[j+2] = F32_TO_S32(s2[n]);
+			d[j+3] = F32_TO_S32(s3[n]);
+		}
+	}
+	for(; i < n_channels; i++) {
+		const float *s0 = src[i];
+		for(n = 0, j = i; n < n_samples; n++, j += n_channels)
+			d[j] = F32_TO_S32(s0[n]);
+	}
+}
+
+void
+conv_f32d_to_s24_32_neon(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t *d = dst[0];
+	uint32_t i = 0, j, n, n_channels = conv->n_channels;
+	uint32_t unrolled = n_samples & ~3;
+	uint32x4_t v[4];
+
+	for(; i + 3 < n_channels; i += 4) {
+		const float *s0 = src[i], *s1 = src[i+1], *s2 = src[i+2], *s3 = src[i+3];
+
+		for(n = 0, j = i; n < unrolled; n += 4, j += 4*n_channels) {
+			v[0] = f32_to_s24_32_neon(vld1q_f32(&s0[n]));
+			v[1] = f32_to_s24_32_neon(vld1q_f32(&s1[n]));
+			v[2] = f32_to_s24_32_neon(vld1q_f32(&s2[n]));
+			v[3] = f32_to_s24_32_neon(vld1q_f32(&s3[n]));
+			store_4x4_neon(&d[j], n_channels, v);
+		}
+		for(; n < n_samples; n++, j += n_channels) {
+			d[j] = F32_TO_S24_32(s0[n]);
+			d[j+1] = F32_TO_S24_32(s1[n]);
+			d[j+2] = F32_TO_S24_32(s2[n]);
+			d[j+3] = F32_TO_S24_32(s3[n]);
+		}
+	}
+	for(; i < n_channels; i++) {
+		const float *s0 = src[i];
+		for(n = 0, j = i; n < n_samples; n++, j += n_channels)
+			d[j] = F32_TO_S24_32(s0[n]);
+	}
+}
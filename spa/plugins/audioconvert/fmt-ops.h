@@ -314,6 +314,12 @@ DEFINE_FUNCTION(interleave_64s, c);
 DEFINE_FUNCTION(s16_to_f32d_2, neon);
 DEFINE_FUNCTION(s16_to_f32d, neon);
 DEFINE_FUNCTION(f32d_to_s16, neon);
+DEFINE_FUNCTION(s32_to_f32d, neon);
+DEFINE_FUNCTION(f32d_to_s32, neon);
+DEFINE_FUNCTION(s24_32_to_f32d, neon);
+DEFINE_FUNCTION(f32d_to_s24_32, neon);
+DEFINE_FUNCTION(deinterleave_32, neon);
+DEFINE_FUNCTION(interleave_32, neon);
 #endif
 #if defined(HAVE_SSE2)
 DEFINE_FUNCTION(s16_to_f32d_2, sse2);
@@ -341,6 +347,10 @@ DEFINE_FUNCTION(f32d_to_s32, avx2);
 DEFINE_FUNCTION(f32d_to_s16_4, avx2);
 DEFINE_FUNCTION(f32d_to_s16_2, avx2);
 DEFINE_FUNCTION(f32d_to_s16, avx2);
+DEFINE_FUNCTION(s24_32_to_f32d, avx2);
+DEFINE_FUNCTION(f32d_to_s24_32, avx2);
+DEFINE_FUNCTION(deinterleave_32, avx2);
+DEFINE_FUNCTION(interleave_32, avx2);
 #endif
 
 #undef DEFINE_FUNCTION
@@ -54,9 +54,10 @@ struct native_data {
 	uint32_t hist;
 	float **history;
 	resample_func_t func;
-	float *filter;
+	const float *filter;
 	float *hist_mem;
 	const struct resample_info *info;
+	struct filter *shared;
 };
 
 #define DEFINE_RESAMPLER(type,arch)						\
@@ -23,8 +23,10 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 
 #include <spa/param/audio/format.h>
+#include <spa/utils/list.h>
 
 #include "resample-native-impl.h"
 
@@ -83,6 +85,69 @@ static int build_filter(float *taps, uint32_t stride, uint32_t n_taps, uint32_t
 	return 0;
 }
 
+/* Filters only depend on the reduced rates and the quality so they are
+ * shared read-only between all resamplers with the same parameters. */
+struct filter {
+	struct spa_list link;
+	int ref;
+	uint32_t in_rate;
+	uint32_t out_rate;
+	int quality;
+	uint32_t n_taps;
+	uint32_t n_phases;
+	uint32_t stride;
+	float *taps;
+};
+
+static pthread_mutex_t filter_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spa_list filter_list = SPA_LIST_INIT(&filter_list);
+
+static struct filter *filter_acquire(uint32_t in_rate, uint32_t out_rate, int quality,
+		uint32_t n_taps, uint32_t n_phases, uint32_t stride, double cutoff)
+{
+	struct filter *f;
+
+	pthread_mutex_lock(&filter_lock);
+	spa_list_for_each(f, &filter_list, link) {
+		if (f->in_rate == in_rate && f->out_rate == out_rate &&
+		    f->quality == quality && f->n_taps == n_taps &&
+		    f->n_phases == n_phases && f->stride == stride) {
+			f->ref++;
+			goto done;
+		}
+	}
+
+	f = calloc(1, sizeof(struct filter) + stride * sizeof(float) * (n_phases + 1) + 64);
+	if (f == NULL)
+		goto done;
+
+	f->ref = 1;
+	f->in_rate = in_rate;
+	f->out_rate = out_rate;
+	f->quality = quality;
+	f->n_taps = n_taps;
+	f->n_phases = n_phases;
+	f->stride = stride;
+	f->taps = SPA_PTROFF_ALIGN(f, sizeof(struct filter), 64, float);
+
+	build_filter(f->taps, stride, n_taps, n_phases, cutoff);
+
+	spa_list_append(&filter_list, &f->link);
+done:
+	pthread_mutex_unlock(&filter_lock);
+	return f;
+}
+
+static void filter_release(struct filter *f)
+{
+	pthread_mutex_lock(&filter_lock);
+	if (--f->ref == 0) {
+		spa_list_remove(&f->link);
+		free(f);
+	}
+	pthread_mutex_unlock(&filter_lock);
+}
+
 static void inner_product_c(float *d, const float * SPA_RESTRICT s,
 		const float * SPA_RESTRICT taps, uint32_t n_taps)
 {
@@ -160,7 +225,13 @@ static const struct resample_info *find_resample_info(uint32_t format, uint32_t
 
 static void impl_native_free(struct resample *r)
 {
+	struct native_data *d = r->data;
+
 	spa_log_debug(r->log, "native %p: free", r);
+	if (d == NULL)
+		return;
+	if (d->shared)
+		filter_release(d->shared);
 	free(r->data);
 	r->data = NULL;
 }
@@ -337,7 +408,7 @@ int resample_native_init(struct resample *r)
 	struct native_data *d;
 	const struct quality *q;
 	double scale;
-	uint32_t c, n_taps, n_phases, filter_size, in_rate, out_rate, gcd, filter_stride;
+	uint32_t c, n_taps, n_phases, in_rate, out_rate, gcd, filter_stride;
 	uint32_t history_stride, history_size, oversample;
 
 	r->quality = SPA_CLAMP(r->quality, 0, (int) SPA_N_ELEMENTS(blackman_qualities) - 1);
@@ -367,12 +438,10 @@ int resample_native_init(struct resample *r)
 	n_phases *= oversample;
 
 	filter_stride = SPA_ROUND_UP_N(n_taps * sizeof(float), 64);
-	filter_size = filter_stride * (n_phases + 1);
 	history_stride = SPA_ROUND_UP_N(2 * n_taps * sizeof(float), 64);
 	history_size = r->channels * history_stride;
 
 	d = calloc(1, sizeof(struct native_data) +
-			filter_size +
 			history_size +
 			(r->channels * sizeof(float*)) +
 			64);
@@ -380,21 +449,27 @@ int resample_native_init(struct resample *r)
 	if (d == NULL)
 		return -errno;
 
+	d->shared = filter_acquire(in_rate, out_rate, r->quality, n_taps, n_phases,
+			filter_stride / sizeof(float), scale);
+	if (d->shared == NULL) {
+		int res = -errno;
+		free(d);
+		return res;
+	}
+
 	r->data = d;
 	d->n_taps = n_taps;
 	d->n_phases = n_phases;
 	d->in_rate = in_rate;
 	d->out_rate = out_rate;
-	d->filter = SPA_PTROFF_ALIGN(d, sizeof(struct native_data), 64, float);
-	d->hist_mem = SPA_PTROFF_ALIGN(d->filter, filter_size, 64, float);
+	d->filter = d->shared->taps;
+	d->hist_mem = SPA_PTROFF_ALIGN(d, sizeof(struct native_data), 64, float);
 	d->history = SPA_PTROFF(d->hist_mem, history_size, float*);
 	d->filter_stride = filter_stride / sizeof(float);
 	d->filter_stride_os = d->filter_stride * oversample;
 	for (c = 0; c < r->channels; c++)
 		d->history[c] = SPA_PTROFF(d->hist_mem, c * history_stride, float);
 
-	build_filter(d->filter, d->filter_stride, n_taps, n_phases, scale);
-
 	d->info = find_resample_info(SPA_AUDIO_FORMAT_F32, r->cpu_flags);
 	if (SPA_UNLIKELY(!d->info))
 	{
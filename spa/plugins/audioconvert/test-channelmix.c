@@ -22,6 +22,8 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include "config.h"
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,7 +38,17 @@ SPA_LOG_IMPL(logger);
 
 #define MATRIX(...) (float[]) { __VA_ARGS__ }
 
+#include "test-helper.h"
 #include "channelmix-ops.c"
+
+#define N_SAMPLES	256
+#define N_CHANNELS	12
+
+static uint32_t cpu_flags;
+
+static float samp_in[N_CHANNELS][N_SAMPLES + 8] SPA_ALIGNED(32);
+static float samp_out[N_CHANNELS][N_SAMPLES + 8] SPA_ALIGNED(32);
+static float samp_ref[N_CHANNELS][N_SAMPLES + 8] SPA_ALIGNED(32);
 static void dump_matrix(struct channelmix *mix, float *coeff)
 {
 	uint32_t i, j;
@@ -214,10 +226,135 @@ static void test_7p1_N(void)
 			       0.0, 1.0, 0.707107, 0.0, 0.0, 0.707107, 0.0, 0.707107));
 }
 
+static bool compare_samples(const float *a, const float *b, uint32_t n_samples)
+{
+#if defined (__arm__) || defined (__aarch64__)
+	uint32_t n;
+	/* the compiler is free to use fused multiply-add for both the C and
+	 * NEON versions here, only require the results to be close */
+	for (n = 0; n < n_samples; n++) {
+		if (fabsf(a[n] - b[n]) > 1e-5f)
+			return false;
+	}
+	return true;
+#else
+	return memcmp(a, b, n_samples * sizeof(float)) == 0;
+#endif
+}
+
+static void run_simd_test1(const struct channelmix_info *info, const struct channelmix_info *ref,
+		uint32_t src_chan, uint32_t dst_chan, uint32_t flags, uint32_t offset,
+		uint32_t n_samples)
+{
+	struct channelmix mix, mix_ref;
+	const void *s[src_chan];
+	void *d[dst_chan], *r[dst_chan];
+	uint32_t i, j;
+
+	spa_zero(mix);
+	mix.src_chan = src_chan;
+	mix.dst_chan = dst_chan;
+	mix.flags = flags;
+	mix.log = &logger.log;
+
+	for (i = 0; i < dst_chan; i++) {
+		for (j = 0; j < src_chan; j++) {
+			if (SPA_FLAG_IS_SET(flags, CHANNELMIX_FLAG_EQUAL))
+				mix.matrix[i][j] = 0.5f;
+			else if (drand48() < 0.25)
+				mix.matrix[i][j] = 0.0f;
+			else
+				mix.matrix[i][j] = drand48() * 2.0 - 1.0;
+		}
+		lr4_set(&mix.lr4[i], BQ_LOWPASS, 150.0f / 48000.0f);
+		mix.lr4_info[i] = i == 3 ? 1 : 0;
+	}
+	mix_ref = mix;
+
+	for (j = 0; j < src_chan; j++)
+		s[j] = &samp_in[j][offset];
+	for (i = 0; i < dst_chan; i++) {
+		d[i] = &samp_out[i][offset];
+		r[i] = &samp_ref[i][offset];
+	}
+	ref->process(&mix_ref, dst_chan, r, src_chan, s, n_samples);
+	info->process(&mix, dst_chan, d, src_chan, s, n_samples);
+
+	for (i = 0; i < dst_chan; i++) {
+		if (!compare_samples(d[i], r[i], n_samples)) {
+			spa_log_error(&logger.log, "%s differs from %s: %d->%d flags:%08x offset:%d samples:%d channel:%d",
+					info->name, ref->name, src_chan, dst_chan, flags, offset, n_samples, i);
+			spa_assert_not_reached();
+		}
+	}
+}
+
+static void run_simd_test(const struct channelmix_info *info, const struct channelmix_info *ref,
+		uint32_t src_chan, uint32_t dst_chan)
+{
+	static const uint32_t flags[] = { 0, CHANNELMIX_FLAG_ZERO, CHANNELMIX_FLAG_EQUAL,
+		CHANNELMIX_FLAG_IDENTITY, CHANNELMIX_FLAG_COPY };
+	static const uint32_t sample_sizes[] = { 1, 7, 8, 31, 253, 256 };
+	size_t i, j, k;
+
+	for (i = 0; i < SPA_N_ELEMENTS(flags); i++)
+		for (j = 0; j < SPA_N_ELEMENTS(sample_sizes); j++)
+			for (k = 0; k < 2; k++)
+				run_simd_test1(info, ref, src_chan, dst_chan, flags[i], k,
+						sample_sizes[j]);
+}
+
+static void test_simd(void)
+{
+	size_t i, j;
+	uint32_t n, c;
+
+	for (c = 0; c < N_CHANNELS; c++)
+		for (n = 0; n < N_SAMPLES + 8; n++)
+			samp_in[c][n] = drand48() * 2.0 - 1.0;
+
+	for (i = 0; i < SPA_N_ELEMENTS(channelmix_table); i++) {
+		const struct channelmix_info *info = &channelmix_table[i], *ref = NULL;
+
+		/* the SSE versions are not exact copies of the C versions,
+		 * f32_2_4_sse only looks at the diagonal, for example */
+		if ((info->cpu_flags & (SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_NEON)) == 0 ||
+		    !MATCH_CPU_FLAGS(info->cpu_flags, cpu_flags))
+			continue;
+
+		for (j = i + 1; j < SPA_N_ELEMENTS(channelmix_table); j++) {
+			const struct channelmix_info *t = &channelmix_table[j];
+			if (t->cpu_flags == 0 &&
+			    t->src_chan == info->src_chan && t->src_mask == info->src_mask &&
+			    t->dst_chan == info->dst_chan && t->dst_mask == info->dst_mask) {
+				ref = t;
+				break;
+			}
+		}
+		spa_assert_se(ref != NULL);
+
+		spa_log_debug(&logger.log, "test %s against %s", info->name, ref->name);
+
+		if (info->src_chan == EQ) {
+			run_simd_test(info, ref, 1, 1);
+			run_simd_test(info, ref, 6, 6);
+		} else if (info->src_chan == ANY) {
+			run_simd_test(info, ref, 12, 5);
+			run_simd_test(info, ref, 3, 8);
+			run_simd_test(info, ref, 2, 2);
+		} else {
+			run_simd_test(info, ref, info->src_chan, info->dst_chan);
+		}
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	logger.log.level = SPA_LOG_LEVEL_TRACE;
 
+	cpu_flags = get_cpu_flags();
+	printf("got get CPU flags %d\n", cpu_flags);
+
 	test_1_N_MONO();
 	test_1_N_FC();
 	test_N_1();
@@ -225,6 +362,7 @@ int main(int argc, char *argv[])
 	test_4_N();
 	test_5p1_N();
 	test_7p1_N();
+	test_simd();
 
 	return 0;
 }
@@ -32,6 +32,7 @@
 #include <time.h>
 
 #include <spa/debug/mem.h>
+#include <spa/utils/string.h>
 
 #include "test-helper.h"
 #include "fmt-ops.c"
@@ -262,6 +263,12 @@ static void test_f32_s32(void)
 			false, true, conv_f32d_to_s32_sse2);
 	}
 #endif
+#if defined(HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_f32d_s32_neon", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_s32_neon);
+	}
+#endif
 }
 
 static void test_s32_f32(void)
@@ -283,6 +290,12 @@ static void test_s32_f32(void)
 			true, false, conv_s32_to_f32d_sse2);
 	}
 #endif
+#if defined(HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_s32_f32d_neon", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s32_to_f32d_neon);
+	}
+#endif
 }
 
 static void test_f32_u24(void)
@@ -416,6 +429,18 @@ static void test_f32_s24_32(void)
 			true, false, conv_f32_to_s24_32d_c);
 	run_test("test_f32d_s24_32d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
 			false, false, conv_f32d_to_s24_32d_c);
+#if defined(HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_f32d_s24_32_avx2", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_s24_32_avx2);
+	}
+#endif
+#if defined(HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_f32d_s24_32_neon", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_s24_32_neon);
+	}
+#endif
 }
 
 static void test_s24_32_f32(void)
@@ -431,6 +456,18 @@ static void test_s24_32_f32(void)
 			true, true, conv_s24_32_to_f32_c);
 	run_test("test_s24_32d_f32d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
 			false, false, conv_s24_32d_to_f32d_c);
+#if defined(HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_s24_32_f32d_avx2", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s24_32_to_f32d_avx2);
+	}
+#endif
+#if defined(HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_s24_32_f32d_neon", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s24_32_to_f32d_neon);
+	}
+#endif
 }
 
 static void test_f64_f32(void)
@@ -462,6 +499,194 @@ static void test_f32_f64(void)
 	run_test("test_f32d_f64d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
 			false, false, conv_f32d_to_f64d_c);
 }
+#define N_SAMPLES_32	67
+#define MAX_CHANNELS_32	37
+#define GUARD_32	0xdeadbeefu
+
+/* the channels that don't fill a vector are done by the scalar loop */
+static const uint32_t channel_counts_32[] = { 1, 3, 5, 37 };
+static const uint32_t sample_counts_32[] = { 1, 8, 67 };
+
+static const struct {
+	uint32_t packed;
+	uint32_t planar;
+	const char *name;
+} formats_32[] = {
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, "f32" },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, "s32" },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, "s24_32" },
+};
+
+/* the SIMD functions only use the vector loop when all planar channels are
+ * aligned, keep a guard sample after each channel and align the rows */
+#define STRIDE_32	SPA_ROUND_UP_N(N_SAMPLES_32 + 1, 8)
+
+static uint32_t packed_in_32[MAX_CHANNELS_32 * N_SAMPLES_32] SPA_ALIGNED(32);
+static uint32_t planar_in_32[MAX_CHANNELS_32][STRIDE_32] SPA_ALIGNED(32);
+static uint32_t packed_out_32[2][MAX_CHANNELS_32 * N_SAMPLES_32 + 1] SPA_ALIGNED(32);
+static uint32_t planar_out_32[2][MAX_CHANNELS_32][STRIDE_32] SPA_ALIGNED(32);
+
+static uint32_t random_32(bool is_float)
+{
+	static uint32_t seed = 1;
+	uint32_t v;
+	float f;
+
+	seed = seed * 1103515245u + 12345u;
+	if (!is_float)
+		return seed;
+	/* samples from -1.5 to 1.5 so that the clipping is tested */
+	f = (float)(seed >> 8) / (1u << 24) * 3.0f - 1.5f;
+	memcpy(&v, &f, sizeof(v));
+	return v;
+}
+
+static void fill_32(bool is_float)
+{
+	uint32_t c, n;
+
+	for (n = 0; n < SPA_N_ELEMENTS(packed_in_32); n++)
+		packed_in_32[n] = random_32(is_float);
+	for (c = 0; c < MAX_CHANNELS_32; c++) {
+		for (n = 0; n < N_SAMPLES_32; n++)
+			planar_in_32[c][n] = random_32(is_float);
+	}
+	for (c = 0; c < 2; c++) {
+		for (n = 0; n < SPA_N_ELEMENTS(packed_out_32[c]); n++)
+			packed_out_32[c][n] = GUARD_32;
+		for (n = 0; n < MAX_CHANNELS_32 * STRIDE_32; n++)
+			planar_out_32[c][n / STRIDE_32][n % STRIDE_32] = GUARD_32;
+	}
+}
+
+/* compare a SIMD function that converts between 32 bit formats with the C
+ * version for channel counts that are not a multiple of the vector size */
+static void run_test_32(const char *name, uint32_t src_fmt, uint32_t dst_fmt,
+		uint32_t flags, convert_func_t func, convert_func_t func_c)
+{
+	bool deinterleave = !SPA_AUDIO_FORMAT_IS_PLANAR(src_fmt);
+	bool copy = func_c == conv_deinterleave_32_c || func_c == conv_interleave_32_c;
+	size_t i, j;
+
+	fprintf(stderr, "test %s:\n", name);
+
+	for (i = 0; i < SPA_N_ELEMENTS(channel_counts_32); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(sample_counts_32); j++) {
+			uint32_t c, n, n_channels = channel_counts_32[i];
+			uint32_t n_samples = sample_counts_32[j];
+			const void *sp[MAX_CHANNELS_32];
+			void *dp[2][MAX_CHANNELS_32];
+			struct convert conv, conv_c;
+
+			spa_zero(conv);
+			conv.src_fmt = src_fmt;
+			conv.dst_fmt = dst_fmt;
+			conv.n_channels = n_channels;
+			conv.cpu_flags = flags;
+			spa_assert_se(convert_init(&conv) == 0);
+			spa_assert_se(conv.process == func);
+
+			conv_c = conv;
+			conv_c.cpu_flags = 0;
+			spa_assert_se(convert_init(&conv_c) == 0);
+			spa_assert_se(conv_c.process == func_c);
+
+			fill_32(src_fmt == SPA_AUDIO_FORMAT_F32P);
+			for (c = 0; c < n_channels; c++) {
+				sp[c] = deinterleave ? (const void*)packed_in_32 : planar_in_32[c];
+				dp[0][c] = deinterleave ? (void*)planar_out_32[0][c] : packed_out_32[0];
+				dp[1][c] = deinterleave ? (void*)planar_out_32[1][c] : packed_out_32[1];
+			}
+			convert_process(&conv, dp[0], sp, n_samples);
+			convert_process(&conv_c, dp[1], sp, n_samples);
+
+			spa_assert_se(memcmp(packed_out_32[0], packed_out_32[1],
+						sizeof(packed_out_32[0])) == 0);
+			spa_assert_se(memcmp(planar_out_32[0], planar_out_32[1],
+						sizeof(planar_out_32[0])) == 0);
+
+			for (c = 0; c < n_channels; c++) {
+				for (n = 0; copy && n < n_samples; n++) {
+					if (deinterleave)
+						spa_assert_se(planar_out_32[0][c][n] ==
+								packed_in_32[n * n_channels + c]);
+					else
+						spa_assert_se(packed_out_32[0][n * n_channels + c] ==
+								planar_in_32[c][n]);
+				}
+				spa_assert_se(planar_out_32[0][c][n_samples] == GUARD_32);
+			}
+			spa_assert_se(packed_out_32[0][n_channels * n_samples] == GUARD_32);
+		}
+	}
+}
+
+static void test_interleave_32(void)
+{
+	char name[64];
+	size_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats_32); i++) {
+		const char *f = formats_32[i].name;
+		uint32_t packed = formats_32[i].packed, planar = formats_32[i].planar;
+
+		spa_scnprintf(name, sizeof(name), "test_%s_%sd_c", f, f);
+		run_test_32(name, packed, planar, 0,
+				conv_deinterleave_32_c, conv_deinterleave_32_c);
+		spa_scnprintf(name, sizeof(name), "test_%sd_%s_c", f, f);
+		run_test_32(name, planar, packed, 0,
+				conv_interleave_32_c, conv_interleave_32_c);
+#if defined(HAVE_AVX2)
+		if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+			spa_scnprintf(name, sizeof(name), "test_%s_%sd_avx2", f, f);
+			run_test_32(name, packed, planar, SPA_CPU_FLAG_AVX2,
+					conv_deinterleave_32_avx2, conv_deinterleave_32_c);
+			spa_scnprintf(name, sizeof(name), "test_%sd_%s_avx2", f, f);
+			run_test_32(name, planar, packed, SPA_CPU_FLAG_AVX2,
+					conv_interleave_32_avx2, conv_interleave_32_c);
+		}
+#endif
+#if defined(HAVE_NEON)
+		if (cpu_flags & SPA_CPU_FLAG_NEON) {
+			spa_scnprintf(name, sizeof(name), "test_%s_%sd_neon", f, f);
+			run_test_32(name, packed, planar, SPA_CPU_FLAG_NEON,
+					conv_deinterleave_32_neon, conv_deinterleave_32_c);
+			spa_scnprintf(name, sizeof(name), "test_%sd_%s_neon", f, f);
+			run_test_32(name, planar, packed, SPA_CPU_FLAG_NEON,
+					conv_interleave_32_neon, conv_interleave_32_c);
+		}
+#endif
+	}
+}
+
+static void test_convert_32(void)
+{
+	run_test_32("test_s24_32_f32d_c", SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32P, 0,
+			conv_s24_32_to_f32d_c, conv_s24_32_to_f32d_c);
+	run_test_32("test_f32d_s24_32_c", SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32, 0,
+			conv_f32d_to_s24_32_c, conv_f32d_to_s24_32_c);
+#if defined(HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test_32("test_s24_32_f32d_avx2", SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32P,
+				SPA_CPU_FLAG_AVX2, conv_s24_32_to_f32d_avx2, conv_s24_32_to_f32d_c);
+		run_test_32("test_f32d_s24_32_avx2", SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32,
+				SPA_CPU_FLAG_AVX2, conv_f32d_to_s24_32_avx2, conv_f32d_to_s24_32_c);
+	}
+#endif
+#if defined(HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test_32("test_s24_32_f32d_neon", SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32P,
+				SPA_CPU_FLAG_NEON, conv_s24_32_to_f32d_neon, conv_s24_32_to_f32d_c);
+		run_test_32("test_f32d_s24_32_neon", SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32,
+				SPA_CPU_FLAG_NEON, conv_f32d_to_s24_32_neon, conv_f32d_to_s24_32_c);
+		run_test_32("test_s32_f32d_neon", SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P,
+				SPA_CPU_FLAG_NEON, conv_s32_to_f32d_neon, conv_s32_to_f32d_c);
+		run_test_32("test_f32d_s32_neon", SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32,
+				SPA_CPU_FLAG_NEON, conv_f32d_to_s32_neon, conv_f32d_to_s32_c);
+	}
+#endif
+}
+
 int main(int argc, char *argv[])
 {
 	cpu_flags = get_cpu_flags();
@@ -487,5 +712,7 @@ int main(int argc, char *argv[])
 	test_s24_32_f32();
 	test_f32_f64();
 	test_f64_f32();
+	test_interleave_32();
+	test_convert_32();
 	return 0;
 }
@@ -35,6 +35,7 @@
 SPA_LOG_IMPL(logger);
 
 #include "resample.h"
+#include "resample-native-impl.h"
 
 #define N_SAMPLES	253
 #define N_CHANNELS	11
@@ -166,12 +167,57 @@ static void test_in_len(void)
 	resample_free(&r);
 }
 
+static void init_resample(struct resample *r, uint32_t i_rate, uint32_t o_rate, int quality)
+{
+	spa_zero(*r);
+	r->log = &logger.log;
+	r->channels = 1;
+	r->i_rate = i_rate;
+	r->o_rate = o_rate;
+	r->quality = quality;
+	spa_assert_se(resample_native_init(r) == 0);
+}
+
+static void test_shared_filter(void)
+{
+	struct resample r1, r2, r3, r4;
+	struct native_data *d1, *d2, *d3, *d4;
+	float taps[64];
+
+	init_resample(&r1, 44100, 48000, RESAMPLE_DEFAULT_QUALITY);
+	init_resample(&r2, 88200, 96000, RESAMPLE_DEFAULT_QUALITY);
+	init_resample(&r3, 44100, 48000, RESAMPLE_DEFAULT_QUALITY + 1);
+	init_resample(&r4, 48000, 44100, RESAMPLE_DEFAULT_QUALITY);
+	d1 = r1.data;
+	d2 = r2.data;
+	d3 = r3.data;
+	d4 = r4.data;
+
+	/* same reduced rates and quality share the filter */
+	spa_assert_se(d1->filter == d2->filter);
+	spa_assert_se(d1->filter != d3->filter);
+	spa_assert_se(d1->filter != d4->filter);
+
+	spa_assert_se(d1->n_taps <= SPA_N_ELEMENTS(taps));
+	memcpy(taps, d1->filter, d1->n_taps * sizeof(float));
+
+	/* the filter stays valid as long as one user is left */
+	resample_free(&r1);
+	spa_assert_se(memcmp(taps, d2->filter, d2->n_taps * sizeof(float)) == 0);
+	feed_1(&r2);
+
+	resample_free(&r2);
+	resample_free(&r3);
+	resample_free(&r4);
+}
+
 int main(int argc, char *argv[])
 {
 	logger.log.level = SPA_LOG_LEVEL_TRACE;
 
 	test_native();
 	test_in_len();
+	test_shared_filter();
 
 	return 0;
 }
@@ -0,0 +1,66 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "volume-ops.h"
+
+#include <immintrin.h>
+
+void
+volume_f32_avx(struct volume *vol, void * SPA_RESTRICT dst,
+		const void * SPA_RESTRICT src, float volume, uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	float *d = (float*)dst;
+	const float *s = (const float*)src;
+
+	if (volume == VOLUME_MIN) {
+		memset(d, 0, n_samples * sizeof(float));
+	}
+	else if (volume == VOLUME_NORM) {
+		spa_memcpy(d, s, n_samples * sizeof(float));
+	}
+	else {
+		__m256 t[4];
+		const __m256 vol = _mm256_set1_ps(volume);
+
+		if (SPA_IS_ALIGNED(d, 32) &&
+		    SPA_IS_ALIGNED(s, 32))
+			unrolled = n_samples & ~31;
+		else
+			unrolled = 0;
+
+		for(n = 0; n < unrolled; n += 32) {
+			t[0] = _mm256_load_ps(&s[n]);
+			t[1] = _mm256_load_ps(&s[n+8]);
+			t[2] = _mm256_load_ps(&s[n+16]);
+			t[3] = _mm256_load_ps(&s[n+24]);
+			_mm256_store_ps(&d[n], _mm256_mul_ps(t[0], vol));
+			_mm256_store_ps(&d[n+8], _mm256_mul_ps(t[1], vol));
+			_mm256_store_ps(&d[n+16], _mm256_mul_ps(t[2], vol));
+			_mm256_store_ps(&d[n+24], _mm256_mul_ps(t[3], vol));
+		}
+		for(; n < n_samples; n++)
+			_mm_store_ss(&d[n], _mm_mul_ss(_mm_load_ss(&s[n]), _mm256_castps256_ps128(vol)));
+	}
+}
@@ -41,8 +41,14 @@ static const struct volume_info {
 	uint32_t cpu_flags;
 } volume_table[] =
 {
+#if defined (HAVE_AVX)
+	{ volume_f32_avx, SPA_CPU_FLAG_AVX },
+#endif
 #if defined (HAVE_SSE)
 	{ volume_f32_sse, SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_NEON)
+	{ volume_f32_neon, SPA_CPU_FLAG_NEON },
 #endif
 	{ volume_f32_c, 0 },
 };
@@ -61,5 +61,11 @@ DEFINE_FUNCTION(f32, c);
 #if defined (HAVE_SSE)
 DEFINE_FUNCTION(f32, sse);
 #endif
+#if defined (HAVE_AVX)
+DEFINE_FUNCTION(f32, avx);
+#endif
+#if defined (HAVE_NEON)
+DEFINE_FUNCTION(f32, neon);
+#endif
 
 #undef DEFINE_FUNCTION
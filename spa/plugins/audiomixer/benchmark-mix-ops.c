@@ -0,0 +1,274 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <spa/param/audio/format-utils.h>
+
+#include "../audioconvert/test-helper.h"
+#include "mix-ops.h"
+
+static uint32_t cpu_flags;
+
+struct stats {
+	uint32_t n_samples;
+	uint32_t n_src;
+	uint64_t perf;
+	char name[32];
+	const char *impl;
+};
+
+#define MAX_SAMPLES	4096
+#define MAX_SOURCES	64
+#define MAX_STRIDE	8
+
+#define MAX_COUNT 100
+
+static uint8_t samp_in[MAX_SAMPLES * MAX_SOURCES * MAX_STRIDE] SPA_ALIGNED(32);
+static uint8_t samp_tmp[MAX_SAMPLES * MAX_SOURCES * MAX_STRIDE] SPA_ALIGNED(32);
+static uint8_t samp_out[MAX_SAMPLES * MAX_STRIDE] SPA_ALIGNED(32);
+static float gains[MAX_SOURCES];
+
+static const int sample_sizes[] = { 64, 256, 1024, 4096 };
+static const int source_counts[] = { 2, 8, 32, 64 };
+
+static const struct format {
+	uint32_t format;
+	uint32_t stride;
+	const char *name;
+} formats[] = {
+	{ SPA_AUDIO_FORMAT_F32, 4, "f32" },
+	{ SPA_AUDIO_FORMAT_F64, 8, "f64" },
+	{ SPA_AUDIO_FORMAT_S16, 2, "s16" },
+	{ SPA_AUDIO_FORMAT_S32, 4, "s32" },
+	{ SPA_AUDIO_FORMAT_S24_32, 4, "s24_32" },
+};
+
+/* the flags to try, the table in mix-ops.c picks the best implementation that
+ * is allowed by them */
+static const uint32_t impl_flags[] = {
+	SPA_CPU_FLAG_AVX2,
+	SPA_CPU_FLAG_AVX,
+	SPA_CPU_FLAG_SSE2,
+	SPA_CPU_FLAG_SSE,
+	SPA_CPU_FLAG_NEON,
+	0,
+};
+
+static const char *impl_name(uint32_t flags)
+{
+	if (flags & SPA_CPU_FLAG_AVX2)
+		return "avx2";
+	if (flags & SPA_CPU_FLAG_AVX)
+		return "avx";
+	if (flags & SPA_CPU_FLAG_SSE2)
+		return "sse2";
+	if (flags & SPA_CPU_FLAG_SSE)
+		return "sse";
+	if (flags & SPA_CPU_FLAG_NEON)
+		return "neon";
+	return "c";
+}
+
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(source_counts) * \
+			SPA_N_ELEMENTS(formats) * SPA_N_ELEMENTS(impl_flags) * 4
+
+static uint32_t n_results = 0;
+static struct stats results[MAX_RESULTS];
+
+enum mode {
+	MODE_MIX,
+	MODE_MIX_PAIRWISE,
+	MODE_VOLUME_MIX,
+	MODE_MIX_GAIN,
+};
+
+static const char *mode_names[] = { "mix", "mix_pairwise", "volume+mix", "mix_gain" };
+
+/* apply the gain in a separate pass like audioconvert does before the
+ * mixer gets the data */
+static void apply_gain(const struct format *f, void *dst, const void *src, float gain,
+		uint32_t n_samples)
+{
+	uint32_t n;
+
+	switch (f->format) {
+	case SPA_AUDIO_FORMAT_F32:
+		for (n = 0; n < n_samples; n++)
+			((float*)dst)[n] = ((const float*)src)[n] * gain;
+		break;
+	case SPA_AUDIO_FORMAT_F64:
+		for (n = 0; n < n_samples; n++)
+			((double*)dst)[n] = ((const double*)src)[n] * gain;
+		break;
+	case SPA_AUDIO_FORMAT_S16:
+		for (n = 0; n < n_samples; n++)
+			((int16_t*)dst)[n] = (int16_t)(((const int16_t*)src)[n] * gain);
+		break;
+	default:
+		for (n = 0; n < n_samples; n++)
+			((int32_t*)dst)[n] = (int32_t)(((const int32_t*)src)[n] * gain);
+		break;
+	}
+}
+
+static void run_test1(const struct format *f, const char *impl, enum mode mode,
+		struct mix_ops *mix, uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, j;
+	const void *ip[n_src], *tp[n_src], *pp[2];
+	struct timespec ts;
+	uint64_t count, t1, t2;
+	struct stats *st;
+
+	for (j = 0; j < n_src; j++) {
+		ip[j] = &samp_in[j * n_samples * f->stride];
+		tp[j] = &samp_tmp[j * n_samples * f->stride];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	count = 0;
+	for (i = 0; i < MAX_COUNT; i++) {
+		switch (mode) {
+		case MODE_MIX:
+			mix_ops_process(mix, samp_out, ip, n_src, n_samples);
+			break;
+		case MODE_MIX_PAIRWISE:
+			/* add one source at a time to the output, like the
+			 * JACK client used to do. The output can't be one of
+			 * the sources, switch between two buffers */
+			mix_ops_process(mix, samp_out, ip, SPA_MIN(n_src, 2u), n_samples);
+			for (j = 2; j < n_src; j++) {
+				pp[0] = j & 1 ? samp_tmp : samp_out;
+				pp[1] = ip[j];
+				mix_ops_process(mix, j & 1 ? samp_out : samp_tmp, pp, 2, n_samples);
+			}
+			break;
+		case MODE_VOLUME_MIX:
+			for (j = 0; j < n_src; j++)
+				apply_gain(f, (void*)tp[j], ip[j], gains[j], n_samples);
+			mix_ops_process(mix, samp_out, tp, n_src, n_samples);
+			break;
+		case MODE_MIX_GAIN:
+			mix_ops_process_gain(mix, samp_out, ip, gains, n_src, n_samples);
+			break;
+		}
+		count++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	spa_assert(n_results < MAX_RESULTS);
+
+	st = &results[n_results++];
+	st->n_samples = n_samples;
+	st->n_src = n_src;
+	st->perf = count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1);
+	snprintf(st->name, sizeof(st->name), "%s_%s", mode_names[mode], f->name);
+	st->impl = impl;
+}
+
+static void run_test(const struct format *f)
+{
+	size_t i, j, k, m, n_done = 0;
+	uint32_t done[SPA_N_ELEMENTS(impl_flags)];
+
+	for (k = 0; k < SPA_N_ELEMENTS(impl_flags); k++) {
+		struct mix_ops mix;
+
+		spa_zero(mix);
+		mix.fmt = f->format;
+		mix.n_channels = 1;
+		/* only allow the flag and everything below it, the AVX
+		 * functions also need FMA3 */
+		mix.cpu_flags = impl_flags[k] ? cpu_flags &
+			(((impl_flags[k] << 1) - 1) | SPA_CPU_FLAG_FMA3) : 0;
+		if (mix_ops_init(&mix) < 0)
+			continue;
+
+		/* skip the flags that end up with the same implementation */
+		for (i = 0; i < n_done; i++)
+			if (done[i] == mix.cpu_flags)
+				break;
+		if (i < n_done) {
+			mix_ops_free(&mix);
+			continue;
+		}
+		done[n_done++] = mix.cpu_flags;
+
+		for (i = 0; i < SPA_N_ELEMENTS(sample_sizes); i++) {
+			for (j = 0; j < SPA_N_ELEMENTS(source_counts); j++) {
+				for (m = 0; m < SPA_N_ELEMENTS(mode_names); m++)
+					run_test1(f, impl_name(mix.cpu_flags), m, &mix,
+							source_counts[j], sample_sizes[i]);
+			}
+		}
+		mix_ops_free(&mix);
+	}
+}
+
+static int compare_func(const void *_a, const void *_b)
+{
+	const struct stats *a = _a, *b = _b;
+	int diff;
+	if ((diff = strcmp(a->name, b->name)) != 0)
+		return diff;
+	if ((diff = a->n_samples - b->n_samples) != 0)
+		return diff;
+	if ((diff = a->n_src - b->n_src) != 0)
+		return diff;
+	return b->perf - a->perf;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i;
+
+	cpu_flags = get_cpu_flags();
+	printf("got get CPU flags %d\n", cpu_flags);
+
+	for (i = 0; i < MAX_SOURCES; i++)
+		gains[i] = 0.5f + i / (2.0f * MAX_SOURCES);
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++)
+		run_test(&formats[i]);
+
+	qsort(results, n_results, sizeof(struct stats), compare_func);
+
+	for (i = 0; i < n_results; i++) {
+		struct stats *s = &results[i];
+		fprintf(stderr, "%-12."PRIu64" \t%-32.32s %s \t samples %d, sources %d\n",
+				s->perf, s->name, s->impl, s->n_samples, s->n_src);
+	}
+	return 0;
+}
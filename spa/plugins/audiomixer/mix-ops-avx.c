@@ -32,104 +32,204 @@
 
 #include <immintrin.h>
 
-static inline void mix_4(float * dst,
-		const float * SPA_RESTRICT src0,
-		const float * SPA_RESTRICT src1,
-		const float * SPA_RESTRICT src2,
-		uint32_t n_samples)
+void
+mix_f32_avx(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
 {
-	uint32_t n, unrolled;
-
-	if (SPA_IS_ALIGNED(src0, 32) &&
-	    SPA_IS_ALIGNED(src1, 32) &&
-	    SPA_IS_ALIGNED(src2, 32) &&
-	    SPA_IS_ALIGNED(dst, 32))
-		unrolled = n_samples & ~15;
-	else
-		unrolled = 0;
+	uint32_t i, n, unrolled;
+	float *d = dst;
+	const float *s;
+	__m256 acc[4];
+	__m128 in;
+	bool aligned = SPA_IS_ALIGNED(dst, 32);
+
+	n_samples *= ops->n_channels;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	} else if (n_src == 1) {
+		memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	}
 
-	for (n = 0; n < unrolled; n += 16) {
-		__m256 in1[4], in2[4];
-
-		in1[0] = _mm256_load_ps(&dst[n + 0]);
-		in2[0] = _mm256_load_ps(&dst[n + 8]);
-		in1[1] = _mm256_load_ps(&src0[n + 0]);
-		in2[1] = _mm256_load_ps(&src0[n + 8]);
-		in1[2] = _mm256_load_ps(&src1[n + 0]);
-		in2[2] = _mm256_load_ps(&src1[n + 8]);
-		in1[3] = _mm256_load_ps(&src2[n + 0]);
-		in2[3] = _mm256_load_ps(&src2[n + 8]);
-
-		in1[0] = _mm256_add_ps(in1[0], in1[1]);
-		in2[0] = _mm256_add_ps(in2[0], in2[1]);
-		in1[2] = _mm256_add_ps(in1[2], in1[3]);
-		in2[2] = _mm256_add_ps(in2[2], in2[3]);
-		in1[0] = _mm256_add_ps(in1[0], in1[2]);
-		in2[0] = _mm256_add_ps(in2[0], in2[2]);
-
-		_mm256_store_ps(&dst[n + 0], in1[0]);
-		_mm256_store_ps(&dst[n + 8], in2[0]);
+	for (i = 0; i < n_src; i++)
+		aligned &= SPA_IS_ALIGNED(src[i], 32);
+
+	unrolled = n_samples & ~31;
+
+	/* add all the sources to a block of the output in registers, the
+	 * destination is only written once */
+	if (SPA_LIKELY(aligned)) {
+		for (n = 0; n < unrolled; n += 32) {
+			s = src[0];
+			acc[0] = _mm256_load_ps(&s[n+ 0]);
+			acc[1] = _mm256_load_ps(&s[n+ 8]);
+			acc[2] = _mm256_load_ps(&s[n+16]);
+			acc[3] = _mm256_load_ps(&s[n+24]);
+			for (i = 1; i < n_src; i++) {
+				s = src[i];
+				acc[0] = _mm256_add_ps(acc[0], _mm256_load_ps(&s[n+ 0]));
+				acc[1] = _mm256_add_ps(acc[1], _mm256_load_ps(&s[n+ 8]));
+				acc[2] = _mm256_add_ps(acc[2], _mm256_load_ps(&s[n+16]));
+				acc[3] = _mm256_add_ps(acc[3], _mm256_load_ps(&s[n+24]));
+			}
+			_mm256_store_ps(&d[n+ 0], acc[0]);
+			_mm256_store_ps(&d[n+ 8], acc[1]);
+			_mm256_store_ps(&d[n+16], acc[2]);
+			_mm256_store_ps(&d[n+24], acc[3]);
+		}
+	} else {
+		for (n = 0; n < unrolled; n += 32) {
+			s = src[0];
+			acc[0] = _mm256_loadu_ps(&s[n+ 0]);
+			acc[1] = _mm256_loadu_ps(&s[n+ 8]);
+			acc[2] = _mm256_loadu_ps(&s[n+16]);
+			acc[3] = _mm256_loadu_ps(&s[n+24]);
+			for (i = 1; i < n_src; i++) {
+				s = src[i];
+				acc[0] = _mm256_add_ps(acc[0], _mm256_loadu_ps(&s[n+ 0]));
+				acc[1] = _mm256_add_ps(acc[1], _mm256_loadu_ps(&s[n+ 8]));
+				acc[2] = _mm256_add_ps(acc[2], _mm256_loadu_ps(&s[n+16]));
+				acc[3] = _mm256_add_ps(acc[3], _mm256_loadu_ps(&s[n+24]));
+			}
+			_mm256_storeu_ps(&d[n+ 0], acc[0]);
+			_mm256_storeu_ps(&d[n+ 8], acc[1]);
+			_mm256_storeu_ps(&d[n+16], acc[2]);
+			_mm256_storeu_ps(&d[n+24], acc[3]);
+		}
 	}
 	for (; n < n_samples; n++) {
-		__m128 in[4];
-		in[0] = _mm_load_ss(&dst[n]),
-		in[1] = _mm_load_ss(&src0[n]),
-		in[2] = _mm_load_ss(&src1[n]),
-		in[3] = _mm_load_ss(&src2[n]),
-		in[0] = _mm_add_ss(in[0], in[1]);
-		in[2] = _mm_add_ss(in[2], in[3]);
-		in[0] = _mm_add_ss(in[0], in[2]);
-		_mm_store_ss(&dst[n], in[0]);
+		s = src[0];
+		in = _mm_load_ss(&s[n]);
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			in = _mm_add_ss(in, _mm_load_ss(&s[n]));
+		}
+		_mm_store_ss(&d[n], in);
 	}
 }
 
-
-static inline void mix_2(float * dst, const float * SPA_RESTRICT src, uint32_t n_samples)
+static inline void mix_2_f64(double * dst, const double * SPA_RESTRICT src, uint32_t n_samples)
 {
 	uint32_t n, unrolled;
 
 	if (SPA_IS_ALIGNED(src, 32) &&
 	    SPA_IS_ALIGNED(dst, 32))
-		unrolled = n_samples & ~15;
+		unrolled = n_samples & ~7;
 	else
 		unrolled = 0;
 
-	for (n = 0; n < unrolled; n += 16) {
-		__m256 in1[2], in2[2];
+	for (n = 0; n < unrolled; n += 8) {
+		__m256d in1[2], in2[2];
 
-		in1[0] = _mm256_load_ps(&dst[n + 0]);
-		in1[1] = _mm256_load_ps(&dst[n + 8]);
-		in2[0] = _mm256_load_ps(&src[n + 0]);
-		in2[1] = _mm256_load_ps(&src[n + 8]);
+		in1[0] = _mm256_load_pd(&dst[n + 0]);
+		in1[1] = _mm256_load_pd(&dst[n + 4]);
+		in2[0] = _mm256_load_pd(&src[n + 0]);
+		in2[1] = _mm256_load_pd(&src[n + 4]);
 
-		in1[0] = _mm256_add_ps(in1[0], in2[0]);
-		in1[1] = _mm256_add_ps(in1[1], in2[1]);
+		in1[0] = _mm256_add_pd(in1[0], in2[0]);
+		in1[1] = _mm256_add_pd(in1[1], in2[1]);
 
-		_mm256_store_ps(&dst[n + 0], in1[0]);
-		_mm256_store_ps(&dst[n + 8], in1[1]);
+		_mm256_store_pd(&dst[n + 0], in1[0]);
+		_mm256_store_pd(&dst[n + 4], in1[1]);
 	}
 	for (; n < n_samples; n++) {
-		__m128 in1[1], in2[1];
-		in1[0] = _mm_load_ss(&dst[n]),
-		in2[0] = _mm_load_ss(&src[n]),
-		in1[0] = _mm_add_ss(in1[0], in2[0]);
-		_mm_store_ss(&dst[n], in1[0]);
+		__m128d in1[1], in2[1];
+		in1[0] = _mm_load_sd(&dst[n]),
+		in2[0] = _mm_load_sd(&src[n]),
+		in1[0] = _mm_add_sd(in1[0], in2[0]);
+		_mm_store_sd(&dst[n], in1[0]);
 	}
 }
 
 void
-mix_f32_avx(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+mix_f64_avx(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
 		uint32_t n_src, uint32_t n_samples)
 {
 	uint32_t i;
 
 	if (n_src == 0)
-		memset(dst, 0, n_samples * ops->n_channels * sizeof(float));
-	else if (dst != src[0])
-		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(float));
-
-	for (i = 1; i + 2 < n_src; i += 3)
-		mix_4(dst, src[i], src[i + 1], src[i + 2], n_samples);
-	for (; i < n_src; i++)
-		mix_2(dst, src[i], n_samples * ops->n_channels);
+		memset(dst, 0, n_samples * ops->n_channels * sizeof(double));
+	else
+		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(double));
+
+	for (i = 1; i < n_src; i++)
+		mix_2_f64(dst, src[i], n_samples * ops->n_channels);
+}
+
+void
+mix_gain_f32_avx(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	float *d = dst;
+	__m256 acc[4], g;
+
+	n_samples *= ops->n_channels;
+	unrolled = n_samples & ~31;
+
+	/* keep a block of the output in registers while all the sources are
+	 * added to it, the destination is only written once */
+	for (n = 0; n < unrolled; n += 32) {
+		acc[0] = acc[1] = acc[2] = acc[3] = _mm256_setzero_ps();
+
+		for (i = 0; i < n_src; i++) {
+			const float *s = src[i];
+			g = _mm256_set1_ps(gain[i]);
+			acc[0] = _mm256_add_ps(acc[0], _mm256_mul_ps(_mm256_loadu_ps(&s[n+ 0]), g));
+			acc[1] = _mm256_add_ps(acc[1], _mm256_mul_ps(_mm256_loadu_ps(&s[n+ 8]), g));
+			acc[2] = _mm256_add_ps(acc[2], _mm256_mul_ps(_mm256_loadu_ps(&s[n+16]), g));
+			acc[3] = _mm256_add_ps(acc[3], _mm256_mul_ps(_mm256_loadu_ps(&s[n+24]), g));
+		}
+		_mm256_storeu_ps(&d[n+ 0], acc[0]);
+		_mm256_storeu_ps(&d[n+ 8], acc[1]);
+		_mm256_storeu_ps(&d[n+16], acc[2]);
+		_mm256_storeu_ps(&d[n+24], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		__m128 a = _mm_setzero_ps();
+		for (i = 0; i < n_src; i++) {
+			const float *s = src[i];
+			a = _mm_add_ss(a, _mm_mul_ss(_mm_load_ss(&s[n]), _mm_set_ss(gain[i])));
+		}
+		_mm_store_ss(&d[n], a);
+	}
+}
+
+void
+mix_gain_f64_avx(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	double *d = dst;
+	__m256d acc[4], g;
+
+	n_samples *= ops->n_channels;
+	unrolled = n_samples & ~15;
+
+	for (n = 0; n < unrolled; n += 16) {
+		acc[0] = acc[1] = acc[2] = acc[3] = _mm256_setzero_pd();
+
+		for (i = 0; i < n_src; i++) {
+			const double *s = src[i];
+			g = _mm256_set1_pd(gain[i]);
+			acc[0] = _mm256_add_pd(acc[0], _mm256_mul_pd(_mm256_loadu_pd(&s[n+ 0]), g));
+			acc[1] = _mm256_add_pd(acc[1], _mm256_mul_pd(_mm256_loadu_pd(&s[n+ 4]), g));
+			acc[2] = _mm256_add_pd(acc[2], _mm256_mul_pd(_mm256_loadu_pd(&s[n+ 8]), g));
+			acc[3] = _mm256_add_pd(acc[3], _mm256_mul_pd(_mm256_loadu_pd(&s[n+12]), g));
+		}
+		_mm256_storeu_pd(&d[n+ 0], acc[0]);
+		_mm256_storeu_pd(&d[n+ 4], acc[1]);
+		_mm256_storeu_pd(&d[n+ 8], acc[2]);
+		_mm256_storeu_pd(&d[n+12], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		__m128d a = _mm_setzero_pd();
+		for (i = 0; i < n_src; i++) {
+			const double *s = src[i];
+			a = _mm_add_sd(a, _mm_mul_sd(_mm_load_sd(&s[n]), _mm_set_sd(gain[i])));
+		}
+		_mm_store_sd(&d[n], a);
+	}
 }
@@ -0,0 +1,311 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "mix-ops.h"
+
+#include <immintrin.h>
+
+static inline void mix_2_s16(int16_t * dst, const int16_t * SPA_RESTRICT src, uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	const __m256i min = _mm256_set1_epi16(S16_MIN);
+
+	unrolled = n_samples & ~31;
+
+	for (n = 0; n < unrolled; n += 32) {
+		__m256i in1[2], in2[2];
+
+		in1[0] = _mm256_loadu_si256((__m256i*)&dst[n + 0]);
+		in1[1] = _mm256_loadu_si256((__m256i*)&dst[n + 16]);
+		in2[0] = _mm256_loadu_si256((__m256i*)&src[n + 0]);
+		in2[1] = _mm256_loadu_si256((__m256i*)&src[n + 16]);
+
+		/* the saturating add clamps to -32768, S16_MIN is one more */
+		in1[0] = _mm256_max_epi16(_mm256_adds_epi16(in1[0], in2[0]), min);
+		in1[1] = _mm256_max_epi16(_mm256_adds_epi16(in1[1], in2[1]), min);
+
+		_mm256_storeu_si256((__m256i*)&dst[n + 0], in1[0]);
+		_mm256_storeu_si256((__m256i*)&dst[n + 16], in1[1]);
+	}
+	for (; n < n_samples; n++)
+		dst[n] = S16_MIX(dst[n], src[n]);
+}
+
+void
+mix_s16_avx2(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i;
+
+	if (n_src == 0)
+		memset(dst, 0, n_samples * ops->n_channels * sizeof(int16_t));
+	else
+		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(int16_t));
+
+	for (i = 1; i < n_src; i++)
+		mix_2_s16(dst, src[i], n_samples * ops->n_channels);
+}
+
+static inline __m256i adds_epi32(__m256i a, __m256i b)
+{
+	__m256i sum, ovf, sat;
+
+	/* on overflow the sign of the sum differs from the sign of both
+	 * inputs, replace it with the limit that has the sign of a */
+	sum = _mm256_add_epi32(a, b);
+	ovf = _mm256_and_si256(_mm256_xor_si256(sum, a), _mm256_xor_si256(sum, b));
+	sat = _mm256_xor_si256(_mm256_srai_epi32(a, 31), _mm256_set1_epi32(S32_MAX));
+	sum = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(sum),
+				_mm256_castsi256_ps(sat), _mm256_castsi256_ps(ovf)));
+	return _mm256_max_epi32(sum, _mm256_set1_epi32(S32_MIN));
+}
+
+static inline void mix_2_s32(int32_t * dst, const int32_t * SPA_RESTRICT src, uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+
+	unrolled = n_samples & ~15;
+
+	for (n = 0; n < unrolled; n += 16) {
+		__m256i in1[2], in2[2];
+
+		in1[0] = _mm256_loadu_si256((__m256i*)&dst[n + 0]);
+		in1[1] = _mm256_loadu_si256((__m256i*)&dst[n + 8]);
+		in2[0] = _mm256_loadu_si256((__m256i*)&src[n + 0]);
+		in2[1] = _mm256_loadu_si256((__m256i*)&src[n + 8]);
+
+		in1[0] = adds_epi32(in1[0], in2[0]);
+		in1[1] = adds_epi32(in1[1], in2[1]);
+
+		_mm256_storeu_si256((__m256i*)&dst[n + 0], in1[0]);
+		_mm256_storeu_si256((__m256i*)&dst[n + 8], in1[1]);
+	}
+	for (; n < n_samples; n++)
+		dst[n] = S32_MIX(dst[n], src[n]);
+}
+
+void
+mix_s32_avx2(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i;
+
+	if (n_src == 0)
+		memset(dst, 0, n_samples * ops->n_channels * sizeof(int32_t));
+	else
+		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(int32_t));
+
+	for (i = 1; i < n_src; i++)
+		mix_2_s32(dst, src[i], n_samples * ops->n_channels);
+}
+
+static inline void mix_2_s24_32(int32_t * dst, const int32_t * SPA_RESTRICT src, uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+	const __m256i min = _mm256_set1_epi32(S24_MIN);
+	const __m256i max = _mm256_set1_epi32(S24_MAX);
+
+	unrolled = n_samples & ~15;
+
+	/* two 24 bit samples can't overflow the 32 bit sum */
+	for (n = 0; n < unrolled; n += 16) {
+		__m256i in1[2], in2[2];
+
+		in1[0] = _mm256_loadu_si256((__m256i*)&dst[n + 0]);
+		in1[1] = _mm256_loadu_si256((__m256i*)&dst[n + 8]);
+		in2[0] = _mm256_loadu_si256((__m256i*)&src[n + 0]);
+		in2[1] = _mm256_loadu_si256((__m256i*)&src[n + 8]);
+
+		in1[0] = _mm256_add_epi32(in1[0], in2[0]);
+		in1[1] = _mm256_add_epi32(in1[1], in2[1]);
+		in1[0] = _mm256_min_epi32(_mm256_max_epi32(in1[0], min), max);
+		in1[1] = _mm256_min_epi32(_mm256_max_epi32(in1[1], min), max);
+
+		_mm256_storeu_si256((__m256i*)&dst[n + 0], in1[0]);
+		_mm256_storeu_si256((__m256i*)&dst[n + 8], in1[1]);
+	}
+	for (; n < n_samples; n++)
+		dst[n] = S24_32_MIX(dst[n], src[n]);
+}
+
+void
+mix_s24_32_avx2(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i;
+
+	if (n_src == 0)
+		memset(dst, 0, n_samples * ops->n_channels * sizeof(int32_t));
+	else
+		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(int32_t));
+
+	for (i = 1; i < n_src; i++)
+		mix_2_s24_32(dst, src[i], n_samples * ops->n_channels);
+}
+
+void
+mix_gain_s16_avx2(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	int16_t *d = dst;
+	const __m256 min = _mm256_set1_ps(S16_MIN);
+	const __m256 max = _mm256_set1_ps(S16_MAX);
+	__m256 acc[4], g;
+	__m256i in[2];
+
+	n_samples *= ops->n_channels;
+	unrolled = n_samples & ~31;
+
+	/* samples are accumulated as floats and only clamped once at the end,
+	 * like the C version */
+	for (n = 0; n < unrolled; n += 32) {
+		acc[0] = acc[1] = acc[2] = acc[3] = _mm256_setzero_ps();
+
+		for (i = 0; i < n_src; i++) {
+			const int16_t *s = src[i];
+			g = _mm256_set1_ps(gain[i]);
+			in[0] = _mm256_loadu_si256((__m256i*)&s[n + 0]);
+			in[1] = _mm256_loadu_si256((__m256i*)&s[n + 16]);
+			acc[0] = _mm256_add_ps(acc[0], _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+						_mm256_cvtepi16_epi32(_mm256_castsi256_si128(in[0])))));
+			acc[1] = _mm256_add_ps(acc[1], _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+						_mm256_cvtepi16_epi32(_mm256_extracti128_si256(in[0], 1)))));
+			acc[2] = _mm256_add_ps(acc[2], _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+						_mm256_cvtepi16_epi32(_mm256_castsi256_si128(in[1])))));
+			acc[3] = _mm256_add_ps(acc[3], _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+						_mm256_cvtepi16_epi32(_mm256_extracti128_si256(in[1], 1)))));
+		}
+		acc[0] = _mm256_min_ps(_mm256_max_ps(acc[0], min), max);
+		acc[1] = _mm256_min_ps(_mm256_max_ps(acc[1], min), max);
+		acc[2] = _mm256_min_ps(_mm256_max_ps(acc[2], min), max);
+		acc[3] = _mm256_min_ps(_mm256_max_ps(acc[3], min), max);
+
+		/* packs works per 128 bit lane, put the 64 bit halves back in order */
+		in[0] = _mm256_packs_epi32(_mm256_cvttps_epi32(acc[0]), _mm256_cvttps_epi32(acc[1]));
+		in[1] = _mm256_packs_epi32(_mm256_cvttps_epi32(acc[2]), _mm256_cvttps_epi32(acc[3]));
+		in[0] = _mm256_permute4x64_epi64(in[0], _MM_SHUFFLE(3, 1, 2, 0));
+		in[1] = _mm256_permute4x64_epi64(in[1], _MM_SHUFFLE(3, 1, 2, 0));
+
+		_mm256_storeu_si256((__m256i*)&d[n + 0], in[0]);
+		_mm256_storeu_si256((__m256i*)&d[n + 16], in[1]);
+	}
+	for (; n < n_samples; n++) {
+		float t = 0.0f;
+		for (i = 0; i < n_src; i++)
+			t += ((const int16_t*)src[i])[n] * gain[i];
+		d[n] = (int16_t)SPA_CLAMP(t, S16_MIN, S16_MAX);
+	}
+}
+
+void
+mix_gain_s32_avx2(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	int32_t *d = dst;
+	const __m256d min = _mm256_set1_pd(S32_MIN);
+	const __m256d max = _mm256_set1_pd(S32_MAX);
+	__m256d acc[4], g;
+
+	n_samples *= ops->n_channels;
+	unrolled = n_samples & ~15;
+
+	/* 32 bit samples need doubles to not lose precision */
+	for (n = 0; n < unrolled; n += 16) {
+		acc[0] = acc[1] = acc[2] = acc[3] = _mm256_setzero_pd();
+
+		for (i = 0; i < n_src; i++) {
+			const int32_t *s = src[i];
+			g = _mm256_set1_pd(gain[i]);
+			acc[0] = _mm256_add_pd(acc[0], _mm256_mul_pd(g, _mm256_cvtepi32_pd(
+						_mm_loadu_si128((__m128i*)&s[n + 0]))));
+			acc[1] = _mm256_add_pd(acc[1], _mm256_mul_pd(g, _mm256_cvtepi32_pd(
+						_mm_loadu_si128((__m128i*)&s[n + 4]))));
+			acc[2] = _mm256_add_pd(acc[2], _mm256_mul_pd(g, _mm256_cvtepi32_pd(
+						_mm_loadu_si128((__m128i*)&s[n + 8]))));
+			acc[3] = _mm256_add_pd(acc[3], _mm256_mul_pd(g, _mm256_cvtepi32_pd(
+						_mm_loadu_si128((__m128i*)&s[n + 12]))));
+		}
+		_mm_storeu_si128((__m128i*)&d[n + 0],
+				_mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(acc[0], min), max)));
+		_mm_storeu_si128((__m128i*)&d[n + 4],
+				_mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(acc[1], min), max)));
+		_mm_storeu_si128((__m128i*)&d[n + 8],
+				_mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(acc[2], min), max)));
+		_mm_storeu_si128((__m128i*)&d[n + 12],
+				_mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(acc[3], min), max)));
+	}
+	for (; n < n_samples; n++) {
+		double t = 0.0;
+		for (i = 0; i < n_src; i++)
+			t += ((const int32_t*)src[i])[n] * (double)gain[i];
+		d[n] = (int32_t)SPA_CLAMP(t, S32_MIN, S32_MAX);
+	}
+}
+
+void
+mix_gain_s24_32_avx2(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	int32_t *d = dst;
+	const __m256 min = _mm256_set1_ps(S24_MIN);
+	const __m256 max = _mm256_set1_ps(S24_MAX);
+	__m256 acc[2], g;
+
+	n_samples *= ops->n_channels;
+	unrolled = n_samples & ~15;
+
+	/* 24 bit samples fit in the float mantissa, accumulate as floats like
+	 * the C version */
+	for (n = 0; n < unrolled; n += 16) {
+		acc[0] = acc[1] = _mm256_setzero_ps();
+
+		for (i = 0; i < n_src; i++) {
+			const int32_t *s = src[i];
+			g = _mm256_set1_ps(gain[i]);
+			acc[0] = _mm256_add_ps(acc[0], _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+						_mm256_loadu_si256((__m256i*)&s[n + 0]))));
+			acc[1] = _mm256_add_ps(acc[1], _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+						_mm256_loadu_si256((__m256i*)&s[n + 8]))));
+		}
+		_mm256_storeu_si256((__m256i*)&d[n + 0],
+				_mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(acc[0], min), max)));
+		_mm256_storeu_si256((__m256i*)&d[n + 8],
+				_mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(acc[1], min), max)));
+	}
+	for (; n < n_samples; n++) {
+		float t = 0.0f;
+		for (i = 0; i < n_src; i++)
+			t += ((const int32_t*)src[i])[n] * gain[i];
+		d[n] = (int32_t)SPA_CLAMP(t, S24_MIN, S24_MAX);
+	}
+}
@@ -39,7 +39,7 @@ mix_s8_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(int8_t));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(int8_t));
 
 	for (i = 1; i < n_src; i++) {
@@ -58,7 +58,7 @@ mix_u8_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(uint8_t));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(uint8_t));
 
 	for (i = 1; i < n_src; i++) {
@@ -77,7 +77,7 @@ mix_s16_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(int16_t));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(int16_t));
 
 	for (i = 1; i < n_src; i++) {
@@ -96,7 +96,7 @@ mix_u16_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(uint16_t));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(uint16_t));
 
 	for (i = 1; i < n_src; i++) {
@@ -111,14 +111,14 @@ mix_s24_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 		uint32_t n_src, uint32_t n_samples)
 {
 	uint32_t i, n;
-	uint8_t *d = dst;
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(uint8_t) * 3);
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(uint8_t) * 3);
 
 	for (i = 1; i < n_src; i++) {
+		uint8_t *d = dst;
 		const uint8_t *s = src[i];
 		for (n = 0; n < n_samples * ops->n_channels; n++) {
 			write_s24(d, S24_MIX(read_s24(d), read_s24(s)));
@@ -133,14 +133,14 @@ mix_u24_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 		uint32_t n_src, uint32_t n_samples)
 {
 	uint32_t i, n;
-	uint8_t *d = dst;
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(uint8_t) * 3);
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(uint8_t) * 3);
 
 	for (i = 1; i < n_src; i++) {
+		uint8_t *d = dst;
 		const uint8_t *s = src[i];
 		for (n = 0; n < n_samples * ops->n_channels; n++) {
 			write_u24(d, U24_MIX(read_u24(d), read_u24(s)));
@@ -159,7 +159,7 @@ mix_s32_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(int32_t));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(int32_t));
 
 	for (i = 1; i < n_src; i++) {
@@ -178,7 +178,7 @@ mix_u32_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(uint32_t));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(uint32_t));
 
 	for (i = 1; i < n_src; i++) {
@@ -197,7 +197,7 @@ mix_s24_32_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_REST
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(int32_t));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(int32_t));
 
 	for (i = 1; i < n_src; i++) {
@@ -216,7 +216,7 @@ mix_u24_32_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_REST
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(uint32_t));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(uint32_t));
 
 	for (i = 1; i < n_src; i++) {
@@ -235,7 +235,7 @@ mix_f32_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(float));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(float));
 
 	for (i = 1; i < n_src; i++) {
@@ -254,7 +254,7 @@ mix_f64_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(double));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(double));
 
 	for (i = 1; i < n_src; i++) {
@@ -263,3 +263,75 @@ mix_f64_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 			d[n] = F64_MIX(d[n], s[n]);
 	}
 }
+
+/* The gain functions accumulate a block of samples of all sources in a
+ * small buffer that stays in cache and then convert and clamp it once, so
+ * that the destination is written only once. */
+#define MIX_GAIN_BLOCK	256u
+
+#define MAKE_GAIN_FUNCTION(name,acc_t,read,write)				\
+void										\
+mix_gain_##name##_c(struct mix_ops *ops, void * SPA_RESTRICT dst,		\
+		const void * SPA_RESTRICT src[], const float gain[],		\
+		uint32_t n_src, uint32_t n_samples)				\
+{										\
+	acc_t acc[MIX_GAIN_BLOCK];						\
+	uint32_t i, n, o, chunk;						\
+										\
+	n_samples *= ops->n_channels;						\
+										\
+	for (o = 0; o < n_samples; o += chunk) {				\
+		chunk = SPA_MIN(n_samples - o, MIX_GAIN_BLOCK);			\
+		memset(acc, 0, chunk * sizeof(acc_t));				\
+										\
+		for (i = 0; i < n_src; i++) {					\
+			const void *s = src[i];					\
+			const acc_t g = gain[i];				\
+			if (g == 0.0f)						\
+				continue;					\
+			for (n = 0; n < chunk; n++)				\
+				acc[n] += read(s, o + n) * g;			\
+		}								\
+		for (n = 0; n < chunk; n++)					\
+			write(dst, o + n, acc[n]);				\
+	}									\
+}
+
+/* the unsigned formats use the same offsets as the U*_MIX macros */
+#define READ_S8(s,n)		(float)((const int8_t*)(s))[n]
+#define WRITE_S8(d,n,v)		((int8_t*)(d))[n] = (int8_t)SPA_CLAMP(v, S8_MIN, S8_MAX)
+#define READ_U8(s,n)		(float)((int16_t)((const uint8_t*)(s))[n] - S8_MAX)
+#define WRITE_U8(d,n,v)		((uint8_t*)(d))[n] = (uint8_t)(SPA_CLAMP(v, S8_MIN, S8_MAX) + S8_MAX)
+#define READ_S16(s,n)		(float)((const int16_t*)(s))[n]
+#define WRITE_S16(d,n,v)	((int16_t*)(d))[n] = (int16_t)SPA_CLAMP(v, S16_MIN, S16_MAX)
+#define READ_U16(s,n)		(float)((int32_t)((const uint16_t*)(s))[n] - S16_MAX)
+#define WRITE_U16(d,n,v)	((uint16_t*)(d))[n] = (uint16_t)(SPA_CLAMP(v, S16_MIN, S16_MAX) + S16_MAX)
+#define READ_S24(s,n)		(float)read_s24((const uint8_t*)(s) + (n) * 3)
+#define WRITE_S24(d,n,v)	write_s24((uint8_t*)(d) + (n) * 3, (int32_t)SPA_CLAMP(v, S24_MIN, S24_MAX))
+#define READ_U24(s,n)		(float)((int32_t)read_u24((const uint8_t*)(s) + (n) * 3) - S24_MAX)
+#define WRITE_U24(d,n,v)	write_u24((uint8_t*)(d) + (n) * 3, (uint32_t)(SPA_CLAMP(v, S24_MIN, S24_MAX) + S24_MAX))
+#define READ_S32(s,n)		(double)((const int32_t*)(s))[n]
+#define WRITE_S32(d,n,v)	((int32_t*)(d))[n] = (int32_t)SPA_CLAMP(v, S32_MIN, S32_MAX)
+#define READ_U32(s,n)		(double)((int64_t)((const uint32_t*)(s))[n] - S32_MAX)
+#define WRITE_U32(d,n,v)	((uint32_t*)(d))[n] = (uint32_t)(SPA_CLAMP(v, S32_MIN, S32_MAX) + S32_MAX)
+#define READ_S24_32(s,n)	(float)((const int32_t*)(s))[n]
+#define WRITE_S24_32(d,n,v)	((int32_t*)(d))[n] = (int32_t)SPA_CLAMP(v, S24_MIN, S24_MAX)
+#define READ_U24_32(s,n)	(float)((int32_t)((const uint32_t*)(s))[n] - S24_MAX)
+#define WRITE_U24_32(d,n,v)	((uint32_t*)(d))[n] = (uint32_t)(SPA_CLAMP(v, S24_MIN, S24_MAX) + S24_MAX)
+#define READ_F32(s,n)		((const float*)(s))[n]
+#define WRITE_F32(d,n,v)	((float*)(d))[n] = (v)
+#define READ_F64(s,n)		((const double*)(s))[n]
+#define WRITE_F64(d,n,v)	((double*)(d))[n] = (v)
+
+MAKE_GAIN_FUNCTION(s8, float, READ_S8, WRITE_S8);
+MAKE_GAIN_FUNCTION(u8, float, READ_U8, WRITE_U8);
+MAKE_GAIN_FUNCTION(s16, float, READ_S16, WRITE_S16);
+MAKE_GAIN_FUNCTION(u16, float, READ_U16, WRITE_U16);
+MAKE_GAIN_FUNCTION(s24, float, READ_S24, WRITE_S24);
+MAKE_GAIN_FUNCTION(u24, float, READ_U24, WRITE_U24);
+MAKE_GAIN_FUNCTION(s32, double, READ_S32, WRITE_S32);
+MAKE_GAIN_FUNCTION(u32, double, READ_U32, WRITE_U32);
+MAKE_GAIN_FUNCTION(s24_32, float, READ_S24_32, WRITE_S24_32);
+MAKE_GAIN_FUNCTION(u24_32, float, READ_U24_32, WRITE_U24_32);
+MAKE_GAIN_FUNCTION(f32, float, READ_F32, WRITE_F32);
+MAKE_GAIN_FUNCTION(f64, double, READ_F64, WRITE_F64);
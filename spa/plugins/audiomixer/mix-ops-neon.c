@@ -0,0 +1,123 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "mix-ops.h"
+
+#include <arm_neon.h>
+
+void
+mix_f32_neon(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	float *d = dst;
+	const float *s;
+	float32x4_t acc[4];
+
+	n_samples *= ops->n_channels;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	} else if (n_src == 1) {
+		memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	}
+
+	unrolled = n_samples & ~15;
+
+	/* add all the sources to a block of the output in registers, the
+	 * destination is only written once */
+	for (n = 0; n < unrolled; n += 16) {
+		s = src[0];
+		acc[0] = vld1q_f32(&s[n+ 0]);
+		acc[1] = vld1q_f32(&s[n+ 4]);
+		acc[2] = vld1q_f32(&s[n+ 8]);
+		acc[3] = vld1q_f32(&s[n+12]);
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			acc[0] = vaddq_f32(acc[0], vld1q_f32(&s[n+ 0]));
+			acc[1] = vaddq_f32(acc[1], vld1q_f32(&s[n+ 4]));
+			acc[2] = vaddq_f32(acc[2], vld1q_f32(&s[n+ 8]));
+			acc[3] = vaddq_f32(acc[3], vld1q_f32(&s[n+12]));
+		}
+		vst1q_f32(&d[n+ 0], acc[0]);
+		vst1q_f32(&d[n+ 4], acc[1]);
+		vst1q_f32(&d[n+ 8], acc[2]);
+		vst1q_f32(&d[n+12], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		float t;
+		s = src[0];
+		t = s[n];
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			t = F32_MIX(t, s[n]);
+		}
+		d[n] = t;
+	}
+}
+
+void
+mix_gain_f32_neon(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	float *d = dst;
+	float32x4_t acc[4], g;
+
+	n_samples *= ops->n_channels;
+	unrolled = n_samples & ~15;
+
+	/* keep a block of the output in registers while all the sources are
+	 * added to it, the destination is only written once */
+	for (n = 0; n < unrolled; n += 16) {
+		acc[0] = acc[1] = acc[2] = acc[3] = vdupq_n_f32(0.0f);
+
+		for (i = 0; i < n_src; i++) {
+			const float *s = src[i];
+			g = vdupq_n_f32(gain[i]);
+			acc[0] = vmlaq_f32(acc[0], vld1q_f32(&s[n+ 0]), g);
+			acc[1] = vmlaq_f32(acc[1], vld1q_f32(&s[n+ 4]), g);
+			acc[2] = vmlaq_f32(acc[2], vld1q_f32(&s[n+ 8]), g);
+			acc[3] = vmlaq_f32(acc[3], vld1q_f32(&s[n+12]), g);
+		}
+		vst1q_f32(&d[n+ 0], acc[0]);
+		vst1q_f32(&d[n+ 4], acc[1]);
+		vst1q_f32(&d[n+ 8], acc[2]);
+		vst1q_f32(&d[n+12], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		float t = 0.0f;
+		for (i = 0; i < n_src; i++)
+			t += ((const float*)src[i])[n] * gain[i];
+		d[n] = t;
+	}
+}
@@ -32,58 +32,118 @@
 
 #include <xmmintrin.h>
 
-static inline void mix_2(float * dst, const float * SPA_RESTRICT src, uint32_t n_samples)
+void
+mix_f32_sse(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
 {
-	uint32_t n, unrolled;
-	__m128 in1[4], in2[4];
+	uint32_t i, n, unrolled;
+	float *d = dst;
+	const float *s;
+	__m128 acc[4];
+	bool aligned = SPA_IS_ALIGNED(dst, 16);
 
-	if (SPA_LIKELY(SPA_IS_ALIGNED(src, 16) &&
-	    SPA_IS_ALIGNED(dst, 16)))
-		unrolled = n_samples & ~15;
-	else
-		unrolled = 0;
+	n_samples *= ops->n_channels;
 
-	for (n = 0; n < unrolled; n += 16) {
-		in1[0] = _mm_load_ps(&dst[n+ 0]);
-		in1[1] = _mm_load_ps(&dst[n+ 4]);
-		in1[2] = _mm_load_ps(&dst[n+ 8]);
-		in1[3] = _mm_load_ps(&dst[n+12]);
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	} else if (n_src == 1) {
+		memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	}
 
-		in2[0] = _mm_load_ps(&src[n+ 0]);
-		in2[1] = _mm_load_ps(&src[n+ 4]);
-		in2[2] = _mm_load_ps(&src[n+ 8]);
-		in2[3] = _mm_load_ps(&src[n+12]);
+	for (i = 0; i < n_src; i++)
+		aligned &= SPA_IS_ALIGNED(src[i], 16);
 
-		in1[0] = _mm_add_ps(in1[0], in2[0]);
-		in1[1] = _mm_add_ps(in1[1], in2[1]);
-		in1[2] = _mm_add_ps(in1[2], in2[2]);
-		in1[3] = _mm_add_ps(in1[3], in2[3]);
+	unrolled = n_samples & ~15;
 
-		_mm_store_ps(&dst[n+ 0], in1[0]);
-		_mm_store_ps(&dst[n+ 4], in1[1]);
-		_mm_store_ps(&dst[n+ 8], in1[2]);
-		_mm_store_ps(&dst[n+12], in1[3]);
+	/* add all the sources to a block of the output in registers, the
+	 * destination is only written once */
+	if (SPA_LIKELY(aligned)) {
+		for (n = 0; n < unrolled; n += 16) {
+			s = src[0];
+			acc[0] = _mm_load_ps(&s[n+ 0]);
+			acc[1] = _mm_load_ps(&s[n+ 4]);
+			acc[2] = _mm_load_ps(&s[n+ 8]);
+			acc[3] = _mm_load_ps(&s[n+12]);
+			for (i = 1; i < n_src; i++) {
+				s = src[i];
+				acc[0] = _mm_add_ps(acc[0], _mm_load_ps(&s[n+ 0]));
+				acc[1] = _mm_add_ps(acc[1], _mm_load_ps(&s[n+ 4]));
+				acc[2] = _mm_add_ps(acc[2], _mm_load_ps(&s[n+ 8]));
+				acc[3] = _mm_add_ps(acc[3], _mm_load_ps(&s[n+12]));
+			}
+			_mm_store_ps(&d[n+ 0], acc[0]);
+			_mm_store_ps(&d[n+ 4], acc[1]);
+			_mm_store_ps(&d[n+ 8], acc[2]);
+			_mm_store_ps(&d[n+12], acc[3]);
+		}
+	} else {
+		for (n = 0; n < unrolled; n += 16) {
+			s = src[0];
+			acc[0] = _mm_loadu_ps(&s[n+ 0]);
+			acc[1] = _mm_loadu_ps(&s[n+ 4]);
+			acc[2] = _mm_loadu_ps(&s[n+ 8]);
+			acc[3] = _mm_loadu_ps(&s[n+12]);
+			for (i = 1; i < n_src; i++) {
+				s = src[i];
+				acc[0] = _mm_add_ps(acc[0], _mm_loadu_ps(&s[n+ 0]));
+				acc[1] = _mm_add_ps(acc[1], _mm_loadu_ps(&s[n+ 4]));
+				acc[2] = _mm_add_ps(acc[2], _mm_loadu_ps(&s[n+ 8]));
+				acc[3] = _mm_add_ps(acc[3], _mm_loadu_ps(&s[n+12]));
+			}
+			_mm_storeu_ps(&d[n+ 0], acc[0]);
+			_mm_storeu_ps(&d[n+ 4], acc[1]);
+			_mm_storeu_ps(&d[n+ 8], acc[2]);
+			_mm_storeu_ps(&d[n+12], acc[3]);
+		}
 	}
 	for (; n < n_samples; n++) {
-		in1[0] = _mm_load_ss(&dst[n]),
-		in2[0] = _mm_load_ss(&src[n]),
-		in1[0] = _mm_add_ss(in1[0], in2[0]);
-		_mm_store_ss(&dst[n], in1[0]);
+		s = src[0];
+		acc[0] = _mm_load_ss(&s[n]);
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			acc[0] = _mm_add_ss(acc[0], _mm_load_ss(&s[n]));
+		}
+		_mm_store_ss(&d[n], acc[0]);
 	}
 }
 
 void
-mix_f32_sse(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
-		uint32_t n_src, uint32_t n_samples)
+mix_gain_f32_sse(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
 {
-	uint32_t i;
+	uint32_t i, n, unrolled;
+	float *d = dst;
+	__m128 acc[4], g;
+
+	n_samples *= ops->n_channels;
+	unrolled = n_samples & ~15;
 
-	if (n_src == 0)
-		memset(dst, 0, n_samples * ops->n_channels * sizeof(float));
-	else if (dst != src[0])
-		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(float));
+	/* keep a block of the output in registers while all the sources are
+	 * added to it, the destination is only written once */
+	for (n = 0; n < unrolled; n += 16) {
+		acc[0] = acc[1] = acc[2] = acc[3] = _mm_setzero_ps();
 
-	for (i = 1; i < n_src; i++) {
-		mix_2(dst, src[i], n_samples * ops->n_channels);
+		for (i = 0; i < n_src; i++) {
+			const float *s = src[i];
+			g = _mm_set1_ps(gain[i]);
+			acc[0] = _mm_add_ps(acc[0], _mm_mul_ps(_mm_loadu_ps(&s[n+ 0]), g));
+			acc[1] = _mm_add_ps(acc[1], _mm_mul_ps(_mm_loadu_ps(&s[n+ 4]), g));
+			acc[2] = _mm_add_ps(acc[2], _mm_mul_ps(_mm_loadu_ps(&s[n+ 8]), g));
+			acc[3] = _mm_add_ps(acc[3], _mm_mul_ps(_mm_loadu_ps(&s[n+12]), g));
+		}
+		_mm_storeu_ps(&d[n+ 0], acc[0]);
+		_mm_storeu_ps(&d[n+ 4], acc[1]);
+		_mm_storeu_ps(&d[n+ 8], acc[2]);
+		_mm_storeu_ps(&d[n+12], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		acc[0] = _mm_setzero_ps();
+		for (i = 0; i < n_src; i++) {
+			const float *s = src[i];
+			acc[0] = _mm_add_ss(acc[0], _mm_mul_ss(_mm_load_ss(&s[n]), _mm_set_ss(gain[i])));
+		}
+		_mm_store_ss(&d[n], acc[0]);
 	}
 }
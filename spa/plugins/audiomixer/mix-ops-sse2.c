@@ -80,10 +80,47 @@ mix_f64_sse2(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_REST
 
 	if (n_src == 0)
 		memset(dst, 0, n_samples * ops->n_channels * sizeof(double));
-	else if (dst != src[0])
+	else
 		memcpy(dst, src[0], n_samples * ops->n_channels * sizeof(double));
 
 	for (i = 1; i < n_src; i++) {
 		mix_2(dst, src[i], n_samples * ops->n_channels);
 	}
 }
+
+void
+mix_gain_f64_sse2(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled;
+	double *d = dst;
+	__m128d acc[4], g;
+
+	n_samples *= ops->n_channels;
+	unrolled = n_samples & ~7;
+
+	for (n = 0; n < unrolled; n += 8) {
+		acc[0] = acc[1] = acc[2] = acc[3] = _mm_setzero_pd();
+
+		for (i = 0; i < n_src; i++) {
+			const double *s = src[i];
+			g = _mm_set1_pd(gain[i]);
+			acc[0] = _mm_add_pd(acc[0], _mm_mul_pd(_mm_loadu_pd(&s[n+0]), g));
+			acc[1] = _mm_add_pd(acc[1], _mm_mul_pd(_mm_loadu_pd(&s[n+2]), g));
+			acc[2] = _mm_add_pd(acc[2], _mm_mul_pd(_mm_loadu_pd(&s[n+4]), g));
+			acc[3] = _mm_add_pd(acc[3], _mm_mul_pd(_mm_loadu_pd(&s[n+6]), g));
+		}
+		_mm_storeu_pd(&d[n+0], acc[0]);
+		_mm_storeu_pd(&d[n+2], acc[1]);
+		_mm_storeu_pd(&d[n+4], acc[2]);
+		_mm_storeu_pd(&d[n+6], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		acc[0] = _mm_setzero_pd();
+		for (i = 0; i < n_src; i++) {
+			const double *s = src[i];
+			acc[0] = _mm_add_sd(acc[0], _mm_mul_sd(_mm_load_sd(&s[n]), _mm_set_sd(gain[i])));
+		}
+		_mm_store_sd(&d[n], acc[0]);
+	}
+}
@@ -34,6 +34,9 @@
 
 typedef void (*mix_func_t) (struct mix_ops *ops, void * SPA_RESTRICT dst,
 		const void * SPA_RESTRICT src[], uint32_t n_src, uint32_t n_samples);
+typedef void (*mix_gain_func_t) (struct mix_ops *ops, void * SPA_RESTRICT dst,
+		const void * SPA_RESTRICT src[], const float gain[],
+		uint32_t n_src, uint32_t n_samples);
 
 struct mix_info {
 	uint32_t fmt;
@@ -41,55 +44,76 @@ struct mix_info {
 	uint32_t cpu_flags;
 	uint32_t stride;
 	mix_func_t process;
+	mix_gain_func_t process_gain;
 };
 
 static struct mix_info mix_table[] =
 {
-	/* f32 */
+	/* f32, the AVX functions are compiled with FMA */
 #if defined(HAVE_AVX)
-	{ SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_AVX, 4, mix_f32_avx },
-	{ SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX, 4, mix_f32_avx },
+	{ SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3, 4, mix_f32_avx, mix_gain_f32_avx },
+	{ SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3, 4, mix_f32_avx, mix_gain_f32_avx },
 #endif
 #if defined (HAVE_SSE)
-	{ SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_SSE, 4, mix_f32_sse },
-	{ SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE, 4, mix_f32_sse },
+	{ SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_SSE, 4, mix_f32_sse, mix_gain_f32_sse },
+	{ SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE, 4, mix_f32_sse, mix_gain_f32_sse },
 #endif
-	{ SPA_AUDIO_FORMAT_F32, 0, 0, 4, mix_f32_c },
-	{ SPA_AUDIO_FORMAT_F32P, 0, 0, 4, mix_f32_c },
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_NEON, 4, mix_f32_neon, mix_gain_f32_neon },
+	{ SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, 4, mix_f32_neon, mix_gain_f32_neon },
+#endif
+	{ SPA_AUDIO_FORMAT_F32, 0, 0, 4, mix_f32_c, mix_gain_f32_c },
+	{ SPA_AUDIO_FORMAT_F32P, 0, 0, 4, mix_f32_c, mix_gain_f32_c },
 
 	/* f64 */
+#if defined(HAVE_AVX)
+	{ SPA_AUDIO_FORMAT_F64, 0, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3, 8, mix_f64_avx, mix_gain_f64_avx },
+	{ SPA_AUDIO_FORMAT_F64P, 0, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3, 8, mix_f64_avx, mix_gain_f64_avx },
+#endif
 #if defined (HAVE_SSE2)
-	{ SPA_AUDIO_FORMAT_F64, 0, SPA_CPU_FLAG_SSE2, 8, mix_f64_sse2 },
-	{ SPA_AUDIO_FORMAT_F64P, 0, SPA_CPU_FLAG_SSE2, 8, mix_f64_sse2 },
+	{ SPA_AUDIO_FORMAT_F64, 0, SPA_CPU_FLAG_SSE2, 8, mix_f64_sse2, mix_gain_f64_sse2 },
+	{ SPA_AUDIO_FORMAT_F64P, 0, SPA_CPU_FLAG_SSE2, 8, mix_f64_sse2, mix_gain_f64_sse2 },
 #endif
-	{ SPA_AUDIO_FORMAT_F64, 0, 0, 8, mix_f64_c },
-	{ SPA_AUDIO_FORMAT_F64P, 0, 0, 8, mix_f64_c },
+	{ SPA_AUDIO_FORMAT_F64, 0, 0, 8, mix_f64_c, mix_gain_f64_c },
+	{ SPA_AUDIO_FORMAT_F64P, 0, 0, 8, mix_f64_c, mix_gain_f64_c },
 
 	/* s8 */
-	{ SPA_AUDIO_FORMAT_S8, 0, 0, 1, mix_s8_c },
-	{ SPA_AUDIO_FORMAT_S8P, 0, 0, 1, mix_s8_c },
-	{ SPA_AUDIO_FORMAT_U8, 0, 0, 1, mix_u8_c },
-	{ SPA_AUDIO_FORMAT_U8P, 0, 0, 1, mix_u8_c },
+	{ SPA_AUDIO_FORMAT_S8, 0, 0, 1, mix_s8_c, mix_gain_s8_c },
+	{ SPA_AUDIO_FORMAT_S8P, 0, 0, 1, mix_s8_c, mix_gain_s8_c },
+	{ SPA_AUDIO_FORMAT_U8, 0, 0, 1, mix_u8_c, mix_gain_u8_c },
+	{ SPA_AUDIO_FORMAT_U8P, 0, 0, 1, mix_u8_c, mix_gain_u8_c },
 
 	/* s16 */
-	{ SPA_AUDIO_FORMAT_S16, 0, 0, 2, mix_s16_c },
-	{ SPA_AUDIO_FORMAT_S16P, 0, 0, 2, mix_s16_c },
-	{ SPA_AUDIO_FORMAT_U16, 0, 0, 2, mix_u16_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_AVX2, 2, mix_s16_avx2, mix_gain_s16_avx2 },
+	{ SPA_AUDIO_FORMAT_S16P, 0, SPA_CPU_FLAG_AVX2, 2, mix_s16_avx2, mix_gain_s16_avx2 },
+#endif
+	{ SPA_AUDIO_FORMAT_S16, 0, 0, 2, mix_s16_c, mix_gain_s16_c },
+	{ SPA_AUDIO_FORMAT_S16P, 0, 0, 2, mix_s16_c, mix_gain_s16_c },
+	{ SPA_AUDIO_FORMAT_U16, 0, 0, 2, mix_u16_c, mix_gain_u16_c },
 
 	/* s24 */
-	{ SPA_AUDIO_FORMAT_S24, 0, 0, 3, mix_s24_c },
-	{ SPA_AUDIO_FORMAT_S24P, 0, 0, 3, mix_s24_c },
-	{ SPA_AUDIO_FORMAT_U24, 0, 0, 3, mix_u24_c },
+	{ SPA_AUDIO_FORMAT_S24, 0, 0, 3, mix_s24_c, mix_gain_s24_c },
+	{ SPA_AUDIO_FORMAT_S24P, 0, 0, 3, mix_s24_c, mix_gain_s24_c },
+	{ SPA_AUDIO_FORMAT_U24, 0, 0, 3, mix_u24_c, mix_gain_u24_c },
 
 	/* s32 */
-	{ SPA_AUDIO_FORMAT_S32, 0, 0, 4, mix_s32_c },
-	{ SPA_AUDIO_FORMAT_S32P, 0, 0, 4, mix_s32_c },
-	{ SPA_AUDIO_FORMAT_U32, 0, 0, 4, mix_u32_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_AVX2, 4, mix_s32_avx2, mix_gain_s32_avx2 },
+	{ SPA_AUDIO_FORMAT_S32P, 0, SPA_CPU_FLAG_AVX2, 4, mix_s32_avx2, mix_gain_s32_avx2 },
+#endif
+	{ SPA_AUDIO_FORMAT_S32, 0, 0, 4, mix_s32_c, mix_gain_s32_c },
+	{ SPA_AUDIO_FORMAT_S32P, 0, 0, 4, mix_s32_c, mix_gain_s32_c },
+	{ SPA_AUDIO_FORMAT_U32, 0, 0, 4, mix_u32_c, mix_gain_u32_c },
 
 	/* s24_32 */
-	{ SPA_AUDIO_FORMAT_S24_32, 0, 0, 4, mix_s24_32_c },
-	{ SPA_AUDIO_FORMAT_S24_32P, 0, 0, 4, mix_s24_32_c },
-	{ SPA_AUDIO_FORMAT_U24_32, 0, 0, 4, mix_u24_32_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S24_32, 0, SPA_CPU_FLAG_AVX2, 4, mix_s24_32_avx2, mix_gain_s24_32_avx2 },
+	{ SPA_AUDIO_FORMAT_S24_32P, 0, SPA_CPU_FLAG_AVX2, 4, mix_s24_32_avx2, mix_gain_s24_32_avx2 },
+#endif
+	{ SPA_AUDIO_FORMAT_S24_32, 0, 0, 4, mix_s24_32_c, mix_gain_s24_32_c },
+	{ SPA_AUDIO_FORMAT_S24_32P, 0, 0, 4, mix_s24_32_c, mix_gain_s24_32_c },
+	{ SPA_AUDIO_FORMAT_U24_32, 0, 0, 4, mix_u24_32_c, mix_gain_u24_32_c },
 };
 
 #define MATCH_CHAN(a,b)		((a) == 0 || (a) == (b))
@@ -132,6 +156,7 @@ int mix_ops_init(struct mix_ops *ops)
 	ops->cpu_flags = info->cpu_flags;
 	ops->clear = impl_mix_ops_clear;
 	ops->process = info->process;
+	ops->process_gain = info->process_gain;
 	ops->free = impl_mix_ops_free;
 
 	return 0;
@@ -105,10 +105,18 @@ struct mix_ops {
 	uint32_t cpu_flags;
 
 	void (*clear) (struct mix_ops *ops, void * SPA_RESTRICT dst, uint32_t n_samples);
+	/* write the sum of the sources to dst, dst is not read and can't
+	 * be one of the sources */
 	void (*process) (struct mix_ops *ops,
 			void * SPA_RESTRICT dst,
 			const void * SPA_RESTRICT src[], uint32_t n_src,
 			uint32_t n_samples);
+	/* like process but scales every source with its own gain, in the
+	 * same pass over the data */
+	void (*process_gain) (struct mix_ops *ops,
+			void * SPA_RESTRICT dst,
+			const void * SPA_RESTRICT src[], const float gain[],
+			uint32_t n_src, uint32_t n_samples);
 	void (*free) (struct mix_ops *ops);
 
 	const void *priv;
@@ -118,6 +126,7 @@ int mix_ops_init(struct mix_ops *ops);
 
 #define mix_ops_clear(ops,...)		(ops)->clear(ops, __VA_ARGS__)
 #define mix_ops_process(ops,...)	(ops)->process(ops, __VA_ARGS__)
+#define mix_ops_process_gain(ops,...)	(ops)->process_gain(ops, __VA_ARGS__)
 #define mix_ops_free(ops)		(ops)->free(ops)
 
 #define DEFINE_FUNCTION(name,arch) \
@@ -125,6 +134,11 @@ void mix_##name##_##arch(struct mix_ops *ops, void * SPA_RESTRICT dst,	\
 		const void * SPA_RESTRICT src[], uint32_t n_src,		\
 		uint32_t n_samples)						\
 
+#define DEFINE_GAIN_FUNCTION(name,arch) \
+void mix_gain_##name##_##arch(struct mix_ops *ops, void * SPA_RESTRICT dst,	\
+		const void * SPA_RESTRICT src[], const float gain[],		\
+		uint32_t n_src, uint32_t n_samples)				\
+
 DEFINE_FUNCTION(s8, c);
 DEFINE_FUNCTION(u8, c);
 DEFINE_FUNCTION(s16, c);
@@ -138,12 +152,42 @@ DEFINE_FUNCTION(u24_32, c);
 DEFINE_FUNCTION(f32, c);
 DEFINE_FUNCTION(f64, c);
 
+DEFINE_GAIN_FUNCTION(s8, c);
+DEFINE_GAIN_FUNCTION(u8, c);
+DEFINE_GAIN_FUNCTION(s16, c);
+DEFINE_GAIN_FUNCTION(u16, c);
+DEFINE_GAIN_FUNCTION(s24, c);
+DEFINE_GAIN_FUNCTION(u24, c);
+DEFINE_GAIN_FUNCTION(s32, c);
+DEFINE_GAIN_FUNCTION(u32, c);
+DEFINE_GAIN_FUNCTION(s24_32, c);
+DEFINE_GAIN_FUNCTION(u24_32, c);
+DEFINE_GAIN_FUNCTION(f32, c);
+DEFINE_GAIN_FUNCTION(f64, c);
+
 #if defined(HAVE_SSE)
 DEFINE_FUNCTION(f32, sse);
+DEFINE_GAIN_FUNCTION(f32, sse);
 #endif
 #if defined(HAVE_SSE2)
 DEFINE_FUNCTION(f64, sse2);
+DEFINE_GAIN_FUNCTION(f64, sse2);
 #endif
 #if defined(HAVE_AVX)
 DEFINE_FUNCTION(f32, avx);
+DEFINE_FUNCTION(f64, avx);
+DEFINE_GAIN_FUNCTION(f32, avx);
+DEFINE_GAIN_FUNCTION(f64, avx);
+#endif
+#if defined(HAVE_AVX2)
+DEFINE_FUNCTION(s16, avx2);
+DEFINE_FUNCTION(s32, avx2);
+DEFINE_FUNCTION(s24_32, avx2);
+DEFINE_GAIN_FUNCTION(s16, avx2);
+DEFINE_GAIN_FUNCTION(s32, avx2);
+DEFINE_GAIN_FUNCTION(s24_32, avx2);
+#endif
+#if defined(HAVE_NEON)
+DEFINE_FUNCTION(f32, neon);
+DEFINE_GAIN_FUNCTION(f32, neon);
 #endif
@@ -0,0 +1,410 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <spa/param/audio/format-utils.h>
+
+#include "../audioconvert/test-helper.h"
+#include "mix-ops.h"
+
+#define N_CHANNELS	2
+#define MAX_SAMPLES	600
+#define MAX_SOURCES	8
+#define MAX_STRIDE	8
+
+static uint32_t cpu_flags;
+static uint32_t seed;
+
+static uint8_t samp_in[MAX_SOURCES][MAX_SAMPLES * N_CHANNELS * MAX_STRIDE];
+static uint8_t samp_out[(MAX_SAMPLES * N_CHANNELS + 1) * MAX_STRIDE];
+static uint8_t samp_ref[(MAX_SAMPLES * N_CHANNELS + 1) * MAX_STRIDE];
+static uint8_t samp_copy[MAX_SOURCES][MAX_SAMPLES * N_CHANNELS * MAX_STRIDE];
+static float gains[MAX_SOURCES];
+
+/* the rows are padded so that they all start aligned and can be offset
+ * by a sample to make them unaligned */
+#define F32_SIZE	(MAX_SAMPLES * N_CHANNELS + 8)
+
+static float f32_in[MAX_SOURCES][F32_SIZE] SPA_ALIGNED(32);
+static float f32_out[F32_SIZE] SPA_ALIGNED(32);
+static float f32_ref[F32_SIZE] SPA_ALIGNED(32);
+
+/* the sizes exercise the SIMD tails and the block size of the C version */
+static const uint32_t sample_sizes[] = { 1, 15, 33, 128, 256, 257, 600 };
+static const uint32_t source_counts[] = { 1, 2, 3, 8 };
+
+/* the unsigned formats store the signed value plus the offset, like the
+ * U*_MIX macros. The 24 bit formats are accumulated as floats, which
+ * don't have enough precision for the products of large samples. */
+static const struct format {
+	uint32_t format;
+	uint32_t stride;
+	const char *name;
+	double min, max, offset;
+	double tolerance;
+} formats[] = {
+	{ SPA_AUDIO_FORMAT_F32, 4, "f32", -2.0, 2.0, 0, 1e-4 },
+	{ SPA_AUDIO_FORMAT_F64, 8, "f64", -2.0, 2.0, 0, 1e-12 },
+	{ SPA_AUDIO_FORMAT_S8, 1, "s8", S8_MIN, S8_MAX, 0, 1 },
+	{ SPA_AUDIO_FORMAT_U8, 1, "u8", S8_MIN, S8_MAX, S8_MAX, 1 },
+	{ SPA_AUDIO_FORMAT_S16, 2, "s16", S16_MIN, S16_MAX, 0, 1 },
+	{ SPA_AUDIO_FORMAT_U16, 2, "u16", S16_MIN, S16_MAX, S16_MAX, 1 },
+	{ SPA_AUDIO_FORMAT_S24, 3, "s24", S24_MIN, S24_MAX, 0, 16 },
+	{ SPA_AUDIO_FORMAT_U24, 3, "u24", S24_MIN, S24_MAX, S24_MAX, 16 },
+	{ SPA_AUDIO_FORMAT_S32, 4, "s32", S32_MIN, S32_MAX, 0, 1 },
+	{ SPA_AUDIO_FORMAT_U32, 4, "u32", S32_MIN, S32_MAX, S32_MAX, 1 },
+	{ SPA_AUDIO_FORMAT_S24_32, 4, "s24_32", S24_MIN, S24_MAX, 0, 16 },
+	{ SPA_AUDIO_FORMAT_U24_32, 4, "u24_32", S24_MIN, S24_MAX, S24_MAX, 16 },
+};
+
+/* the flags to try, the table in mix-ops.c picks the best implementation that
+ * is allowed by them */
+static const uint32_t impl_flags[] = {
+	SPA_CPU_FLAG_AVX2,
+	SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3,
+	SPA_CPU_FLAG_SSE2,
+	SPA_CPU_FLAG_SSE,
+	SPA_CPU_FLAG_NEON,
+	0,
+};
+
+static double random_unit(void)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (double)(seed >> 8) / (1u << 24);
+}
+
+static double read_sample(const struct format *f, const void *data, uint32_t n)
+{
+	switch (f->format) {
+	case SPA_AUDIO_FORMAT_F32:
+		return ((const float*)data)[n];
+	case SPA_AUDIO_FORMAT_F64:
+		return ((const double*)data)[n];
+	case SPA_AUDIO_FORMAT_S8:
+		return ((const int8_t*)data)[n];
+	case SPA_AUDIO_FORMAT_U8:
+		return ((const uint8_t*)data)[n] - f->offset;
+	case SPA_AUDIO_FORMAT_S16:
+		return ((const int16_t*)data)[n];
+	case SPA_AUDIO_FORMAT_U16:
+		return ((const uint16_t*)data)[n] - f->offset;
+	case SPA_AUDIO_FORMAT_S24:
+		return read_s24((const uint8_t*)data + n * 3);
+	case SPA_AUDIO_FORMAT_U24:
+		return read_u24((const uint8_t*)data + n * 3) - f->offset;
+	case SPA_AUDIO_FORMAT_S32:
+	case SPA_AUDIO_FORMAT_S24_32:
+		return ((const int32_t*)data)[n];
+	case SPA_AUDIO_FORMAT_U32:
+	case SPA_AUDIO_FORMAT_U24_32:
+		return ((const uint32_t*)data)[n] - f->offset;
+	}
+	spa_assert_not_reached();
+}
+
+static void write_sample(const struct format *f, void *data, uint32_t n, double v)
+{
+	switch (f->format) {
+	case SPA_AUDIO_FORMAT_F32:
+		((float*)data)[n] = (float)v;
+		break;
+	case SPA_AUDIO_FORMAT_F64:
+		((double*)data)[n] = v;
+		break;
+	case SPA_AUDIO_FORMAT_S8:
+		((int8_t*)data)[n] = (int8_t)v;
+		break;
+	case SPA_AUDIO_FORMAT_U8:
+		((uint8_t*)data)[n] = (uint8_t)(v + f->offset);
+		break;
+	case SPA_AUDIO_FORMAT_S16:
+		((int16_t*)data)[n] = (int16_t)v;
+		break;
+	case SPA_AUDIO_FORMAT_U16:
+		((uint16_t*)data)[n] = (uint16_t)(v + f->offset);
+		break;
+	case SPA_AUDIO_FORMAT_S24:
+		write_s24((uint8_t*)data + n * 3, (int32_t)v);
+		break;
+	case SPA_AUDIO_FORMAT_U24:
+		write_u24((uint8_t*)data + n * 3, (uint32_t)(v + f->offset));
+		break;
+	case SPA_AUDIO_FORMAT_S32:
+	case SPA_AUDIO_FORMAT_S24_32:
+		((int32_t*)data)[n] = (int32_t)v;
+		break;
+	case SPA_AUDIO_FORMAT_U32:
+	case SPA_AUDIO_FORMAT_U24_32:
+		((uint32_t*)data)[n] = (uint32_t)(v + f->offset);
+		break;
+	default:
+		spa_assert_not_reached();
+	}
+}
+
+static bool is_float(const struct format *f)
+{
+	return f->format == SPA_AUDIO_FORMAT_F32 || f->format == SPA_AUDIO_FORMAT_F64;
+}
+
+static void fill_sources(const struct format *f, uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n;
+
+	for (i = 0; i < n_src; i++) {
+		for (n = 0; n < n_samples; n++) {
+			double v = f->min + random_unit() * (f->max - f->min);
+			write_sample(f, samp_in[i], n, is_float(f) ? v : round(v));
+		}
+		/* unity, muted and boosting sources */
+		switch (i % 4) {
+		case 0:
+			gains[i] = 1.0f;
+			break;
+		case 1:
+			gains[i] = 0.0f;
+			break;
+		default:
+			gains[i] = (float)(random_unit() * 1.5);
+			break;
+		}
+	}
+}
+
+static double expected(const struct format *f, uint32_t n_src, uint32_t n)
+{
+	double v = 0.0;
+	uint32_t i;
+
+	for (i = 0; i < n_src; i++)
+		v += read_sample(f, samp_in[i], n) * gains[i];
+	if (is_float(f))
+		return v;
+	return trunc(SPA_CLAMP(v, f->min, f->max));
+}
+
+static void test_gain(const struct format *f, uint32_t flags, uint32_t n_src, uint32_t n_samples)
+{
+	struct mix_ops ops;
+	const void *src[MAX_SOURCES];
+	uint32_t i, n, n_total = n_samples * N_CHANNELS;
+
+	spa_zero(ops);
+	ops.fmt = f->format;
+	ops.n_channels = N_CHANNELS;
+	ops.cpu_flags = flags;
+	spa_assert_se(mix_ops_init(&ops) == 0);
+
+	fill_sources(f, n_src, n_total);
+	for (i = 0; i < n_src; i++)
+		src[i] = samp_in[i];
+	memset(samp_out, 0xaa, sizeof(samp_out));
+
+	mix_ops_process_gain(&ops, samp_out, src, gains, n_src, n_samples);
+
+	for (n = 0; n < n_total; n++) {
+		double v = read_sample(f, samp_out, n), e = expected(f, n_src, n);
+		double tolerance = f->tolerance * (is_float(f) ? SPA_MAX(1.0, fabs(e)) : 1.0);
+
+		if (fabs(v - e) > tolerance) {
+			fprintf(stderr, "%s %08x sources:%u samples:%u sample %u: %f != %f\n",
+					f->name, ops.cpu_flags, n_src, n_samples, n, v, e);
+			spa_assert_not_reached();
+		}
+	}
+	/* nothing is written after the last sample */
+	spa_assert_se(samp_out[n_total * f->stride] == 0xaa);
+
+	mix_ops_free(&ops);
+}
+
+static void test_mix_gain(void)
+{
+	size_t i, j, k, l;
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(impl_flags); j++) {
+			uint32_t flags = impl_flags[j];
+
+			if ((cpu_flags & flags) != flags)
+				continue;
+
+			for (k = 0; k < SPA_N_ELEMENTS(source_counts); k++)
+				for (l = 0; l < SPA_N_ELEMENTS(sample_sizes); l++)
+					test_gain(&formats[i], flags,
+							source_counts[k], sample_sizes[l]);
+		}
+	}
+}
+
+static void run_process(struct mix_ops *ops, uint8_t *out, uint8_t fill,
+		uint32_t n_src, uint32_t n_samples)
+{
+	const void *src[MAX_SOURCES];
+	uint32_t i;
+
+	memset(out, fill, sizeof(samp_out));
+	for (i = 0; i < n_src; i++)
+		src[i] = samp_in[i];
+	mix_ops_process(ops, out, src, n_src, n_samples);
+}
+
+/* dst can't be one of the sources: process only writes dst, the result
+ * doesn't depend on what was in it before and the sources are unchanged */
+static void test_process(const struct format *f, uint32_t flags, uint32_t n_src,
+		uint32_t n_samples)
+{
+	struct mix_ops ops;
+	uint32_t i, n_total = n_samples * N_CHANNELS, size = n_total * f->stride;
+
+	spa_zero(ops);
+	ops.fmt = f->format;
+	ops.n_channels = N_CHANNELS;
+	ops.cpu_flags = flags;
+	spa_assert_se(mix_ops_init(&ops) == 0);
+
+	fill_sources(f, n_src, n_total);
+	for (i = 0; i < n_src; i++)
+		memcpy(samp_copy[i], samp_in[i], size);
+
+	run_process(&ops, samp_ref, 0x00, n_src, n_samples);
+	run_process(&ops, samp_out, 0x7f, n_src, n_samples);
+
+	if (memcmp(samp_out, samp_ref, size) != 0) {
+		fprintf(stderr, "%s %08x sources:%u samples:%u depends on dst\n",
+				f->name, ops.cpu_flags, n_src, n_samples);
+		spa_assert_not_reached();
+	}
+	if (n_src == 1)
+		spa_assert_se(memcmp(samp_out, samp_in[0], size) == 0);
+	for (i = 0; i < n_src; i++)
+		spa_assert_se(memcmp(samp_copy[i], samp_in[i], size) == 0);
+	/* nothing is written after the last sample */
+	spa_assert_se(samp_out[size] == 0x7f);
+
+	mix_ops_free(&ops);
+}
+
+static void test_mix_process(void)
+{
+	static const uint32_t counts[] = { 0, 1, 2, 3, 8 };
+	size_t i, j, k, l;
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(impl_flags); j++) {
+			uint32_t flags = impl_flags[j];
+
+			if ((cpu_flags & flags) != flags)
+				continue;
+
+			for (k = 0; k < SPA_N_ELEMENTS(counts); k++)
+				for (l = 0; l < SPA_N_ELEMENTS(sample_sizes); l++)
+					test_process(&formats[i], flags,
+							counts[k], sample_sizes[l]);
+		}
+	}
+}
+
+static void run_f32(uint32_t flags, float *out, uint32_t n_src, uint32_t n_samples,
+		uint32_t offset)
+{
+	struct mix_ops ops;
+	const void *src[MAX_SOURCES];
+	uint32_t i;
+
+	spa_zero(ops);
+	ops.fmt = SPA_AUDIO_FORMAT_F32;
+	ops.n_channels = N_CHANNELS;
+	ops.cpu_flags = flags;
+	spa_assert_se(mix_ops_init(&ops) == 0);
+
+	memset(out, 0xaa, F32_SIZE * sizeof(float));
+	for (i = 0; i < n_src; i++)
+		src[i] = &f32_in[i][offset];
+	mix_ops_process(&ops, &out[offset], src, n_src, n_samples);
+
+	mix_ops_free(&ops);
+}
+
+/* the SIMD versions add the sources in the same order as the C version,
+ * the results must be the same, also in the tails */
+static void test_f32(uint32_t flags, uint32_t n_src, uint32_t n_samples,
+		uint32_t offset)
+{
+	uint32_t i, n;
+
+	for (i = 0; i < n_src; i++)
+		for (n = 0; n < n_samples * N_CHANNELS; n++)
+			f32_in[i][offset + n] = (float)(random_unit() * 2.0 - 1.0);
+
+	run_f32(0, f32_ref, n_src, n_samples, offset);
+	run_f32(flags, f32_out, n_src, n_samples, offset);
+
+	if (memcmp(f32_out, f32_ref, sizeof(f32_out)) != 0) {
+		fprintf(stderr, "f32 %08x sources:%u samples:%u offset:%u differ\n",
+				flags, n_src, n_samples, offset);
+		spa_assert_not_reached();
+	}
+}
+
+static void test_mix_f32(void)
+{
+	static const uint32_t f32_flags[] = {
+		SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3,
+		SPA_CPU_FLAG_SSE,
+		SPA_CPU_FLAG_NEON,
+	};
+	static const uint32_t offsets[] = { 0, 1 };
+	size_t i, j, k, l;
+
+	for (i = 0; i < SPA_N_ELEMENTS(f32_flags); i++) {
+		if ((cpu_flags & f32_flags[i]) != f32_flags[i])
+			continue;
+
+		for (j = 0; j < SPA_N_ELEMENTS(source_counts); j++)
+			for (k = 0; k < SPA_N_ELEMENTS(sample_sizes); k++)
+				for (l = 0; l < SPA_N_ELEMENTS(offsets); l++)
+					test_f32(f32_flags[i], source_counts[j],
+							sample_sizes[k], offsets[l]);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	cpu_flags = get_cpu_flags();
+	printf("got get CPU flags %d\n", cpu_flags);
+
+	test_mix_process();
+	test_mix_gain();
+	test_mix_f32();
+
+	return 0;
+}
@@ -692,6 +692,7 @@ static const struct a2dp_codec aptx_ll_msbc = {
 	.codec_id = A2DP_CODEC_VENDOR,
 	.name = "aptx_ll_msbc",
 	.description = "aptX-LL mSBC",
+	.decode_latency_msec = 20,
 	.fill_caps = codec_fill_caps,
 	.select_config = codec_select_config_ll,
 	.enum_config = msbc_enum_config,
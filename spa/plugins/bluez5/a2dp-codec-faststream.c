@@ -581,6 +581,7 @@ static const struct a2dp_codec duplex_codec = {
 	.codec_id = A2DP_CODEC_VENDOR,
 	.name = "faststream_sbc",
 	.description = "FastStream duplex SBC",
+	.decode_latency_msec = 20,
 	.fill_caps = codec_fill_caps,
 	.select_config = codec_select_config,
 	.enum_config = duplex_enum_config,
@@ -82,6 +82,8 @@ struct a2dp_codec {
 	const struct spa_dict *info;
 
 	const size_t send_buf_size;
+	const uint32_t decode_latency_msec;	/**< Minimum jitter buffer latency when decoding,
+						  *  0 for the default */
 
 	const struct a2dp_codec *duplex_codec;	/**< Codec for non-standard A2DP duplex channel */
 
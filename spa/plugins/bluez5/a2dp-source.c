@@ -55,6 +55,7 @@
 #include "defs.h"
 #include "rtp.h"
 #include "a2dp-codecs.h"
+#include "decode-buffer.h"
 
 static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.source.a2dp");
 #undef SPA_LOG_TOPIC_DEFAULT
@@ -65,11 +66,13 @@ static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.source.a2dp
 struct props {
 	uint32_t min_latency;
 	uint32_t max_latency;
+	uint32_t decode_latency_msec;
 	char clock_name[64];
 };
 
 #define FILL_FRAMES 2
 #define MAX_BUFFERS 32
+#define MAX_DECODED_PACKET 16384
 
 struct buffer {
 	uint32_t id;
@@ -87,6 +90,7 @@ struct port {
 	uint64_t info_all;
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
+	struct spa_io_rate_match *rate_match;
 	struct spa_latency_info latency;
 #define IDX_EnumFormat	0
 #define IDX_Meta	1
@@ -103,8 +107,7 @@ struct port {
 	struct spa_list free;
 	struct spa_list ready;
 
-	struct buffer *current_buffer;
-	uint32_t ready_offset;
+	struct spa_bt_decode_buffer buffer;
 };
 
 struct impl {
@@ -169,6 +172,7 @@ static void reset_props(struct props *props)
 {
 	props->min_latency = default_min_latency;
 	props->max_latency = default_max_latency;
+	props->decode_latency_msec = 0;
 	strncpy(props->clock_name, DEFAULT_CLOCK_NAME, sizeof(props->clock_name));
 }
 
@@ -215,21 +219,31 @@ static int impl_node_enum_params(void *object, int seq,
 				SPA_PROP_INFO_type, SPA_POD_CHOICE_RANGE_Int(p->max_latency, 1, INT32_MAX));
 			break;
 		default:
-			enum_codec = true;
-			index_offset = 2;
+			param = spa_bt_decode_buffer_enum_propinfo(&this->port.buffer,
+					p->decode_latency_msec, result.index - 2, &b);
+			if (param == NULL) {
+				enum_codec = true;
+				index_offset = 2 + DECODE_BUFFER_N_PROPINFO;
+			}
 		}
 		break;
 	}
 	case SPA_PARAM_Props:
 	{
 		struct props *p = &this->props;
+		struct spa_pod_frame f;
 
 		switch (result.index) {
 		case 0:
-			param = spa_pod_builder_add_object(&b,
-				SPA_TYPE_OBJECT_Props, id,
+			spa_pod_builder_push_object(&b, &f,
+				SPA_TYPE_OBJECT_Props, id);
+			spa_pod_builder_add(&b,
 				SPA_PROP_minLatency, SPA_POD_Int(p->min_latency),
-				SPA_PROP_maxLatency, SPA_POD_Int(p->max_latency));
+				SPA_PROP_maxLatency, SPA_POD_Int(p->max_latency),
+				0);
+			spa_bt_decode_buffer_add_prop_params(&this->port.buffer,
+					p->decode_latency_msec, &b);
+			param = spa_pod_builder_pop(&b, &f);
 			break;
 		default:
 			enum_codec = true;
@@ -313,9 +327,29 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 
 static void emit_node_info(struct impl *this, bool full);
 
+static uint32_t get_decode_latency(struct impl *this)
+{
+	if (this->props.decode_latency_msec > 0)
+		return this->props.decode_latency_msec;
+	return this->codec->decode_latency_msec;
+}
+
+static int do_update_decode_latency(struct spa_loop *loop,
+			bool async,
+			uint32_t seq,
+			const void *data,
+			size_t size,
+			void *user_data)
+{
+	struct impl *this = user_data;
+	spa_bt_decode_buffer_set_target_latency(&this->port.buffer, get_decode_latency(this));
+	return 0;
+}
+
 static int apply_props(struct impl *this, const struct spa_pod *param)
 {
 	struct props new_props = this->props;
+	struct spa_pod *params = NULL;
 	int changed = 0;
 
 	if (param == NULL) {
@@ -324,7 +358,9 @@ static int apply_props(struct impl *this, const struct spa_pod *param)
 		spa_pod_parse_object(param,
 				SPA_TYPE_OBJECT_Props, NULL,
 				SPA_PROP_minLatency, SPA_POD_OPT_Int(&new_props.min_latency),
-				SPA_PROP_maxLatency, SPA_POD_OPT_Int(&new_props.max_latency));
+				SPA_PROP_maxLatency, SPA_POD_OPT_Int(&new_props.max_latency),
+				SPA_PROP_params, SPA_POD_OPT_Pod(&params));
+		spa_bt_decode_buffer_parse_prop_params(params, &new_props.decode_latency_msec);
 	}
 
 	changed = (memcmp(&new_props, &this->props, sizeof(struct props)) != 0);
@@ -344,6 +380,8 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	{
 		int res, codec_res = 0;
 		res = apply_props(this, param);
+		if (res > 0 && this->transport_acquired)
+			spa_loop_invoke(this->data_loop, do_update_decode_latency, 0, NULL, 0, true, this);
 		if (this->codec_props && this->codec->set_props) {
 			codec_res = this->codec->set_props(this->codec_props, param);
 			if (codec_res > 0)
@@ -369,7 +407,6 @@ static void reset_buffers(struct port *port)
 
 	spa_list_init(&port->free);
 	spa_list_init(&port->ready);
-	port->current_buffer = NULL;
 
 	for (i = 0; i < port->n_buffers; i++) {
 		struct buffer *b = &port->buffers[i];
@@ -446,31 +483,183 @@ static int32_t decode_data(struct impl *this, uint8_t *src, uint32_t src_size,
 	return dst_size - avail;
 }
 
-static void skip_ready_buffers(struct impl *this)
+static void skip_ready_buffer(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct buffer *b;
+
+	/* Move the oldest buffer from ready to free */
+	if (spa_list_is_empty(&port->ready))
+		return;
+
+	b = spa_list_first(&port->ready, struct buffer, link);
+	spa_list_remove(&b->link);
+	spa_list_append(&port->free, &b->link);
+	spa_assert(!b->outstanding);
+	this->skip_count += b->buf->datas[0].chunk->size / port->frame_size;
+}
+
+static struct buffer *dequeue_buffer(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct buffer *buffer;
+
+	if (spa_list_is_empty(&port->free))
+		return NULL;
+
+	if (this->skip_count > 0) {
+		spa_log_info(this->log, "%p: xrun, skipped %"PRIu64" usec",
+		             this, (uint64_t)(this->skip_count * SPA_USEC_PER_SEC / port->current_format.info.raw.rate));
+		this->skip_count = 0;
+	}
+
+	buffer = spa_list_first(&port->free, struct buffer, link);
+	spa_list_remove(&buffer->link);
+	spa_log_trace(this->log, "dequeue %d", buffer->id);
+
+	return buffer;
+}
+
+static void queue_buffer(struct impl *this, struct buffer *buffer, uint32_t samples, uint64_t pts)
+{
+	struct port *port = &this->port;
+	struct spa_data *datas = buffer->buf->datas;
+
+	datas[0].chunk->offset = 0;
+	datas[0].chunk->size = samples * port->frame_size;
+	datas[0].chunk->stride = port->frame_size;
+
+	if (buffer->h) {
+		buffer->h->seq = this->sample_count;
+		buffer->h->pts = pts;
+		buffer->h->dts_offset = 0;
+	}
+	this->sample_count += samples;
+
+	spa_log_trace(this->log, "queue %d", buffer->id);
+	spa_list_append(&port->ready, &buffer->link);
+}
+
+static uint32_t get_samples(struct impl *this)
+{
+	struct port *port = &this->port;
+
+	if (port->rate_match && port->rate_match->size > 0)
+		return port->rate_match->size;
+	if (this->position && this->position->clock.rate.denom > 0)
+		return (uint64_t)this->position->clock.duration *
+			port->current_format.info.raw.rate / this->position->clock.rate.denom;
+	return this->props.min_latency;
+}
+
+/* When following, take the samples for this cycle from the decode buffer
+ * and let the resampler follow the remote clock. */
+static void process_buffering(struct impl *this)
 {
 	struct port *port = &this->port;
+	struct buffer *buffer;
+	struct spa_data *datas;
+	uint32_t samples;
+	uint64_t pts;
+
+	if (SPA_UNLIKELY(port->buffer.buffer_decoded == NULL))
+		return;
+
+	samples = get_samples(this);
+
+	spa_bt_decode_buffer_process(&port->buffer, samples);
+
+	if (port->rate_match) {
+		port->rate_match->rate = 1.0 / port->buffer.corr;
+		SPA_FLAG_SET(port->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+	}
+
+	if ((buffer = dequeue_buffer(this)) == NULL) {
+		spa_log_trace(this->log, "%p: no free buffers", this);
+		return;
+	}
+	datas = buffer->buf->datas;
+
+	samples = SPA_MIN(samples, datas[0].maxsize / port->frame_size);
+	pts = spa_bt_decode_buffer_get_pts(&port->buffer);
+	spa_bt_decode_buffer_fill(&port->buffer, datas[0].data, samples);
+
+	queue_buffer(this, buffer, samples, pts);
+}
+
+/* When driving, the graph runs at the rate of the remote clock and
+ * consumes everything that arrived. */
+static void process_driver(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct spa_io_buffers *io = port->io;
+	struct buffer *buffer;
+	struct spa_data *datas;
+	uint32_t avail, samples, min_data;
+	uint64_t pts;
+	void *data;
+
+	if (port->rate_match)
+		SPA_FLAG_CLEAR(port->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+
+	data = spa_bt_decode_buffer_get_read(&port->buffer, &avail);
 
-	/* Move all buffers from ready to free */
-	while (!spa_list_is_empty(&port->ready)) {
+	min_data = SPA_MIN(this->props.min_latency * port->frame_size,
+			port->buffers[0].buf->datas[0].maxsize / 2);
+	if (avail < min_data)
+		return;
+
+	/* xrun, the graph is behind. Drop the oldest buffer, the rest
+	 * of the data stays in the decode buffer */
+	if (spa_list_is_empty(&port->free))
+		skip_ready_buffer(this);
+
+	if ((buffer = dequeue_buffer(this)) == NULL)
+		return;
+	datas = buffer->buf->datas;
+
+	samples = SPA_MIN(avail, datas[0].maxsize) / port->frame_size;
+	pts = spa_bt_decode_buffer_get_pts(&port->buffer);
+	memcpy(datas[0].data, data, samples * port->frame_size);
+	spa_bt_decode_buffer_read(&port->buffer, samples * port->frame_size);
+
+	queue_buffer(this, buffer, samples, pts);
+
+	if (this->clock) {
+		this->clock->nsec = SPA_TIMESPEC_TO_NSEC(&this->now);
+		this->clock->duration = samples * this->clock->rate.denom / port->current_format.info.raw.rate;
+		this->clock->position = this->sample_count * this->clock->rate.denom / port->current_format.info.raw.rate;
+		this->clock->delay = 0;
+		this->clock->rate_diff = 1.0f;
+		this->clock->next_nsec = this->clock->nsec + (uint64_t)samples * SPA_NSEC_PER_SEC / port->current_format.info.raw.rate;
+	}
+
+	/* process the buffer if IO does not have any */
+	if (io != NULL && io->status != SPA_STATUS_HAVE_DATA) {
 		struct buffer *b;
+
+		if (io->buffer_id < port->n_buffers)
+			recycle_buffer(this, port, io->buffer_id);
+
 		b = spa_list_first(&port->ready, struct buffer, link);
 		spa_list_remove(&b->link);
-		spa_list_append(&port->free, &b->link);
-		spa_assert(!b->outstanding);
-		this->skip_count += b->buf->datas[0].chunk->size / port->frame_size;
+		b->outstanding = true;
+
+		io->buffer_id = b->id;
+		io->status = SPA_STATUS_HAVE_DATA;
 	}
+
+	/* notify ready */
+	spa_node_call_ready(&this->callbacks, SPA_STATUS_HAVE_DATA);
 }
 
 static void a2dp_on_ready_read(struct spa_source *source)
 {
 	struct impl *this = source->data;
 	struct port *port = &this->port;
-	struct spa_io_buffers *io = port->io;
-	int32_t size_read, decoded, avail;
-	struct spa_data *datas;
-	struct buffer *buffer;
-	uint32_t min_data;
-	uint8_t read_decoded[4096];
+	int32_t size_read, decoded;
+	uint32_t avail;
+	void *buf;
 
 	/* make sure the source is an input */
 	if ((source->rmask & SPA_IO_IN) == 0) {
@@ -503,9 +692,9 @@ static void a2dp_on_ready_read(struct spa_source *source)
 		this->codec_props_changed = false;
 	}
 
-	/* decode */
-	decoded = decode_data(this, this->buffer_read, size_read,
-			read_decoded, sizeof (read_decoded));
+	/* decode straight into the decode buffer */
+	buf = spa_bt_decode_buffer_get_write(&port->buffer, &avail);
+	decoded = decode_data(this, this->buffer_read, size_read, buf, avail);
 	if (decoded < 0) {
 		spa_log_error(this->log, "failed to decode data: %d", decoded);
 		goto stop;
@@ -519,95 +708,14 @@ static void a2dp_on_ready_read(struct spa_source *source)
 	if (!this->started)
 		return;
 
-	/* get buffer */
-	if (!port->current_buffer) {
-		if (spa_list_is_empty(&port->free)) {
-			/* xrun, skip ahead */
-			skip_ready_buffers(this);
-			this->skip_count += decoded / port->frame_size;
-			this->sample_count += decoded / port->frame_size;
-			return;
-		}
-		if (this->skip_count > 0) {
-			spa_log_info(this->log, "%p: xrun, skipped %"PRIu64" usec",
-			             this, (uint64_t)(this->skip_count * SPA_USEC_PER_SEC / port->current_format.info.raw.rate));
-			this->skip_count = 0;
-		}
-
-		buffer = spa_list_first(&port->free, struct buffer, link);
-		spa_list_remove(&buffer->link);
-
-		port->current_buffer = buffer;
-		port->ready_offset = 0;
-		spa_log_trace(this->log, "dequeue %d", buffer->id);
-
-		if (buffer->h) {
-			buffer->h->seq = this->sample_count;
-			buffer->h->pts = SPA_TIMESPEC_TO_NSEC(&this->now);
-			buffer->h->dts_offset = 0;
-		}
-	} else {
-		buffer = port->current_buffer;
-	}
-	datas = buffer->buf->datas;
-
-	/* copy data into buffer */
-	avail = SPA_MIN(decoded, (int32_t)(datas[0].maxsize - port->ready_offset));
-	if (avail < decoded)
-		spa_log_warn(this->log, "buffer too small (%d > %d)", decoded, avail);
-	memcpy ((uint8_t *)datas[0].data + port->ready_offset, read_decoded, avail);
-	port->ready_offset += avail;
-	this->sample_count += decoded / port->frame_size;
-
-	/* send buffer if full */
-	min_data = SPA_MIN(this->props.min_latency * port->frame_size, datas[0].maxsize / 2);
-	if (port->ready_offset >= min_data) {
-		uint64_t sample_count;
-
-		datas[0].chunk->offset = 0;
-		datas[0].chunk->size = port->ready_offset;
-		datas[0].chunk->stride = port->frame_size;
-
-		sample_count = datas[0].chunk->size / port->frame_size;
-
-		spa_log_trace(this->log, "queue %d", buffer->id);
-		spa_list_append(&port->ready, &buffer->link);
-		port->current_buffer = NULL;
-
-		if (!this->following && this->clock) {
-			this->clock->nsec = SPA_TIMESPEC_TO_NSEC(&this->now);
-			this->clock->duration = sample_count * this->clock->rate.denom / port->current_format.info.raw.rate;
-			this->clock->position = this->sample_count * this->clock->rate.denom / port->current_format.info.raw.rate;
-			this->clock->delay = 0;
-			this->clock->rate_diff = 1.0f;
-			this->clock->next_nsec = this->clock->nsec + (uint64_t)sample_count * SPA_NSEC_PER_SEC / port->current_format.info.raw.rate;
-		}
-	}
-
-	/* done if there are no buffers ready */
-	if (spa_list_is_empty(&port->ready))
-		return;
+	spa_bt_decode_buffer_write_packet(&port->buffer, decoded,
+			SPA_TIMESPEC_TO_NSEC(&this->now));
 
+	/* when following, the data is consumed in process */
 	if (this->following)
 		return;
 
-	/* process the buffer if IO does not have any */
-	if (io != NULL && io->status != SPA_STATUS_HAVE_DATA) {
-		struct buffer *b;
-
-		if (io->buffer_id < port->n_buffers)
-			recycle_buffer(this, port, io->buffer_id);
-
-		b = spa_list_first(&port->ready, struct buffer, link);
-		spa_list_remove(&b->link);
-		b->outstanding = true;
-
-		io->buffer_id = b->id;
-		io->status = SPA_STATUS_HAVE_DATA;
-	}
-
-	/* notify ready */
-	spa_node_call_ready(&this->callbacks, SPA_STATUS_HAVE_DATA);
+	process_driver(this);
 	return;
 
 stop:
@@ -665,6 +773,12 @@ static int transport_start(struct impl *this)
 
         spa_log_info(this->log, "%p: using A2DP codec %s", this, this->codec->description);
 
+	if ((res = spa_bt_decode_buffer_init(&port->buffer, this->log,
+			port->frame_size, port->current_format.info.raw.rate,
+			MAX_DECODED_PACKET)) < 0)
+		return res;
+	spa_bt_decode_buffer_set_target_latency(&port->buffer, get_decode_latency(this));
+
 	val = fcntl(this->transport->fd, F_GETFL);
 	if (fcntl(this->transport->fd, F_SETFL, val | O_NONBLOCK) < 0)
 		spa_log_warn(this->log, "%p: fcntl %u %m", this, val | O_NONBLOCK);
@@ -781,6 +895,8 @@ static int transport_stop(struct impl *this)
 		this->codec->deinit(this->codec_data);
 	this->codec_data = NULL;
 
+	spa_bt_decode_buffer_clear(&this->port.buffer);
+
 	return res;
 }
 
@@ -1019,6 +1135,12 @@ impl_node_port_enum_params(void *object, int seq,
 				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
 				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
 			break;
+		case 1:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_RateMatch),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_rate_match)));
+			break;
 		default:
 			return 0;
 		}
@@ -1057,7 +1179,6 @@ static int clear_buffers(struct impl *this, struct port *port)
 		spa_list_init(&port->ready);
 		port->n_buffers = 0;
 	}
-	port->current_buffer = NULL;
 	return 0;
 }
 
@@ -1215,6 +1336,9 @@ impl_node_port_set_io(void *object,
 	case SPA_IO_Buffers:
 		port->io = data;
 		break;
+	case SPA_IO_RateMatch:
+		port->rate_match = data;
+		break;
 	default:
 		return -ENOENT;
 	}
@@ -1267,6 +1391,10 @@ static int impl_node_process(void *object)
 		io->buffer_id = SPA_ID_INVALID;
 	}
 
+	/* Produce the samples for this cycle */
+	if (this->following)
+		process_buffering(this);
+
 	/* Return if there are no buffers ready to be processed */
 	if (spa_list_is_empty(&port->ready))
 		return SPA_STATUS_OK;
@@ -1456,6 +1584,8 @@ impl_init(const struct spa_handle_factory *factory,
 			this->is_input = spa_streq(str, "input");
 		if ((str = spa_dict_lookup(info, "api.bluez5.a2dp-duplex")) != NULL)
 			this->is_duplex = spa_atob(str);
+		if ((str = spa_dict_lookup(info, DECODE_BUFFER_KEY_TARGET)) != NULL)
+			this->props.decode_latency_msec = SPA_CLAMP(atoi(str), 0, DECODE_BUFFER_MAX_MSEC);
 	}
 
 	if (this->transport == NULL) {
@@ -0,0 +1,465 @@
+/* Spa Bluez5 decode buffer
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Jitter buffer between the decoder and the output port of the bluetooth
+ * sources.
+ *
+ * Decoded packets are appended together with their arrival time. The
+ * arrival times are used to estimate the jitter of the link, which raises
+ * the target fill level above the configured minimum when the link is bad.
+ *
+ * When following another driver, the graph takes a fixed amount of samples
+ * every cycle. The fill level is then kept around the target with a DLL,
+ * the resulting rate correction is given to the resampler of the adapter
+ * with the rate_match io. On underrun, silence is produced until the buffer
+ * is filled up to the target again. On overrun, only the excess above the
+ * target is dropped.
+ */
+
+#ifndef SPA_BLUEZ5_DECODE_BUFFER_H
+#define SPA_BLUEZ5_DECODE_BUFFER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/dll.h>
+#include <spa/utils/string.h>
+#include <spa/support/log.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
+#include <spa/param/props.h>
+
+#define DECODE_BUFFER_DEFAULT_MSEC	40
+#define DECODE_BUFFER_MAX_MSEC		500
+#define DECODE_BUFFER_SIZE_MSEC		(2 * DECODE_BUFFER_MAX_MSEC + 200)
+#define DECODE_BUFFER_AVG_SEC		1.0
+#define DECODE_BUFFER_JITTER_DECAY_SEC	10.0
+#define DECODE_BUFFER_MAX_RATE_DIFF	0.005
+
+#define DECODE_BUFFER_KEY_TARGET	"bluez5.decode-buffer.target-msec"
+#define DECODE_BUFFER_KEY_LEVEL		"bluez5.decode-buffer.level-msec"
+#define DECODE_BUFFER_KEY_JITTER	"bluez5.decode-buffer.jitter-usec"
+#define DECODE_BUFFER_KEY_RATE_DIFF	"bluez5.decode-buffer.rate-diff"
+#define DECODE_BUFFER_KEY_UNDERRUNS	"bluez5.decode-buffer.underruns"
+#define DECODE_BUFFER_KEY_OVERRUNS	"bluez5.decode-buffer.overruns"
+#define DECODE_BUFFER_N_PROPINFO	6
+
+struct spa_bt_decode_buffer
+{
+	struct spa_log *log;
+
+	uint32_t frame_size;
+	uint32_t rate;
+
+	uint8_t *buffer_decoded;
+	uint32_t buffer_size;
+	uint32_t buffer_reserve;
+	uint32_t write_index;
+	uint32_t read_index;
+
+	uint64_t write_nsec;		/**< arrival time of the last packet */
+	uint32_t packet_samples;	/**< samples in the last packet */
+	double jitter;			/**< peak arrival jitter in nsec */
+
+	uint32_t target_msec;		/**< configured minimum target */
+	uint32_t target;		/**< target level in samples */
+
+	uint32_t quantum;
+	double level;			/**< averaged level after the read of a cycle */
+	struct spa_dll dll;
+	double corr;
+
+	uint32_t underruns;
+	uint32_t overruns;
+
+	unsigned int buffering:1;
+};
+
+static inline void spa_bt_decode_buffer_recalc_target(struct spa_bt_decode_buffer *this)
+{
+	uint32_t target, jitter;
+
+	jitter = (uint32_t)(this->jitter * this->rate / SPA_NSEC_PER_SEC);
+
+	target = this->target_msec * this->rate / 1000;
+	target = SPA_MAX(target, jitter + this->packet_samples);
+	target = SPA_MIN(target, DECODE_BUFFER_MAX_MSEC * this->rate / 1000);
+
+	if (target != this->target)
+		spa_log_debug(this->log, "%p: target %u -> %u (jitter %u packet %u)",
+				this, this->target, target, jitter, this->packet_samples);
+	this->target = target;
+}
+
+/** Allocate a buffer for \a rate samples per second of \a frame_size bytes.
+ * \a reserve is the minimum amount of bytes that spa_bt_decode_buffer_get_write()
+ * makes available, it should be large enough to hold a decoded packet. */
+static inline int spa_bt_decode_buffer_init(struct spa_bt_decode_buffer *this, struct spa_log *log,
+		uint32_t frame_size, uint32_t rate, uint32_t reserve)
+{
+	spa_zero(*this);
+
+	if (frame_size == 0 || rate == 0)
+		return -EINVAL;
+
+	this->log = log;
+	this->frame_size = frame_size;
+	this->rate = rate;
+	this->buffer_reserve = (reserve + frame_size - 1) / frame_size * frame_size;
+	this->buffer_size = (uint32_t)((uint64_t)DECODE_BUFFER_SIZE_MSEC * rate / 1000) * frame_size
+		+ this->buffer_reserve;
+	this->buffer_decoded = malloc(this->buffer_size);
+	if (this->buffer_decoded == NULL)
+		return -errno;
+
+	this->target_msec = DECODE_BUFFER_DEFAULT_MSEC;
+	this->corr = 1.0;
+	this->buffering = true;
+	spa_dll_init(&this->dll);
+	spa_bt_decode_buffer_recalc_target(this);
+
+	return 0;
+}
+
+static inline void spa_bt_decode_buffer_clear(struct spa_bt_decode_buffer *this)
+{
+	free(this->buffer_decoded);
+	spa_zero(*this);
+}
+
+/** Set the minimum target latency, 0 selects the default */
+static inline void spa_bt_decode_buffer_set_target_latency(struct spa_bt_decode_buffer *this,
+		uint32_t msec)
+{
+	if (msec == 0)
+		msec = DECODE_BUFFER_DEFAULT_MSEC;
+	this->target_msec = SPA_MIN(msec, (uint32_t)DECODE_BUFFER_MAX_MSEC);
+	if (this->rate > 0)
+		spa_bt_decode_buffer_recalc_target(this);
+}
+
+static inline void spa_bt_decode_buffer_compact(struct spa_bt_decode_buffer *this)
+{
+	if (this->read_index == 0)
+		return;
+
+	memmove(this->buffer_decoded, this->buffer_decoded + this->read_index,
+			this->write_index - this->read_index);
+	this->write_index -= this->read_index;
+	this->read_index = 0;
+}
+
+static inline void *spa_bt_decode_buffer_get_read(struct spa_bt_decode_buffer *this, uint32_t *avail)
+{
+	spa_assert(this->write_index >= this->read_index);
+	*avail = this->write_index - this->read_index;
+	return SPA_PTROFF(this->buffer_decoded, this->read_index, void);
+}
+
+static inline void spa_bt_decode_buffer_read(struct spa_bt_decode_buffer *this, uint32_t size)
+{
+	spa_assert(size % this->frame_size == 0);
+	this->read_index += SPA_MIN(size, this->write_index - this->read_index);
+}
+
+/** Get space to decode into, at least the reserved size is available. */
+static inline void *spa_bt_decode_buffer_get_write(struct spa_bt_decode_buffer *this, uint32_t *avail)
+{
+	if (this->buffer_size - this->write_index < this->buffer_reserve)
+		spa_bt_decode_buffer_compact(this);
+
+	if (this->buffer_size - this->write_index < this->buffer_reserve) {
+		/* nobody is reading, drop the oldest data */
+		uint32_t drop = this->buffer_reserve - (this->buffer_size - this->write_index);
+
+		spa_log_debug(this->log, "%p: overrun, dropping %u samples",
+				this, drop / this->frame_size);
+		this->overruns++;
+		spa_bt_decode_buffer_read(this, drop);
+		spa_bt_decode_buffer_compact(this);
+	}
+	*avail = this->buffer_size - this->write_index;
+	return SPA_PTROFF(this->buffer_decoded, this->write_index, void);
+}
+
+/** Commit \a size bytes decoded from a packet that arrived at \a nsec */
+static inline void spa_bt_decode_buffer_write_packet(struct spa_bt_decode_buffer *this,
+		uint32_t size, uint64_t nsec)
+{
+	spa_assert(size % this->frame_size == 0);
+	spa_assert(size <= this->buffer_size - this->write_index);
+
+	this->write_index += size;
+
+	if (this->write_nsec != 0 && nsec > this->write_nsec &&
+	    nsec - this->write_nsec < DECODE_BUFFER_MAX_MSEC * SPA_NSEC_PER_MSEC) {
+		/* interarrival jitter as in RFC 3550, the difference between
+		 * the arrival time and the duration of the previous packet.
+		 * Keep the peak value and let it decay slowly. Longer gaps
+		 * are a lost link, not jitter. */
+		uint64_t elapsed = nsec - this->write_nsec;
+		int64_t d = (int64_t)elapsed -
+			(int64_t)((uint64_t)this->packet_samples * SPA_NSEC_PER_SEC / this->rate);
+		double decay = SPA_MIN(elapsed / (DECODE_BUFFER_JITTER_DECAY_SEC * SPA_NSEC_PER_SEC), 1.0);
+
+		this->jitter = SPA_MAX((double)SPA_ABS(d), this->jitter * (1.0 - decay));
+	}
+	this->write_nsec = nsec;
+	this->packet_samples = size / this->frame_size;
+
+	spa_bt_decode_buffer_recalc_target(this);
+}
+
+/** The arrival time of the first sample that will be read */
+static inline uint64_t spa_bt_decode_buffer_get_pts(struct spa_bt_decode_buffer *this)
+{
+	uint64_t queued = (this->write_index - this->read_index) / this->frame_size;
+	uint64_t delay = queued * SPA_NSEC_PER_SEC / this->rate;
+
+	return this->write_nsec > delay ? this->write_nsec - delay : 0;
+}
+
+/** Update the rate correction before reading \a samples in a cycle. The
+ * new correction is in this->corr. */
+static inline void spa_bt_decode_buffer_process(struct spa_bt_decode_buffer *this, uint32_t samples)
+{
+	uint32_t avail, max_level;
+	double err, max_err, w;
+
+	spa_bt_decode_buffer_get_read(this, &avail);
+	avail /= this->frame_size;
+
+	if (SPA_UNLIKELY(this->buffering)) {
+		this->corr = 1.0;
+		if (avail < this->target + samples)
+			return;
+
+		spa_log_debug(this->log, "%p: buffering done, level %u target %u",
+				this, avail, this->target);
+		this->buffering = false;
+		this->level = avail - samples;
+		spa_dll_init(&this->dll);
+	}
+
+	if (SPA_UNLIKELY(this->dll.bw == 0.0 || this->quantum != samples)) {
+		spa_dll_set_bw(&this->dll, SPA_DLL_BW_MIN, samples, this->rate);
+		this->quantum = samples;
+	}
+
+	/* packets arrive in bursts, track the average of what is left after
+	 * this cycle, that is what covers the late packets */
+	w = SPA_MIN((double)samples / (this->rate * DECODE_BUFFER_AVG_SEC), 1.0);
+	this->level += w * ((double)avail - samples - this->level);
+
+	max_err = SPA_MAX(256.0, samples / 2.0);
+	err = SPA_CLAMP(this->target - this->level, -max_err, max_err);
+	this->corr = spa_dll_update(&this->dll, err);
+	this->corr = SPA_CLAMP(this->corr, 1.0 - DECODE_BUFFER_MAX_RATE_DIFF,
+			1.0 + DECODE_BUFFER_MAX_RATE_DIFF);
+
+	max_level = 2 * (this->target + samples);
+
+	if (avail < samples) {
+		spa_log_debug(this->log, "%p: underrun, level %u < %u", this, avail, samples);
+		this->underruns++;
+		this->buffering = true;
+		this->corr = 1.0;
+	} else if (avail > max_level) {
+		uint32_t drop = avail - this->target - samples;
+
+		spa_log_debug(this->log, "%p: overrun, level %u > %u, dropping %u samples",
+				this, avail, max_level, drop);
+		this->overruns++;
+		spa_bt_decode_buffer_read(this, drop * this->frame_size);
+		this->level = this->target;
+	}
+}
+
+/** Read \a samples into \a dst, the missing samples are filled with silence.
+ * Returns the number of samples read from the buffer. */
+static inline uint32_t spa_bt_decode_buffer_fill(struct spa_bt_decode_buffer *this,
+		void *dst, uint32_t samples)
+{
+	uint32_t avail, size = samples * this->frame_size;
+	void *src = NULL;
+
+	if (this->buffering)
+		avail = 0;
+	else
+		src = spa_bt_decode_buffer_get_read(this, &avail);
+
+	avail = SPA_MIN(avail, size);
+	if (avail > 0) {
+		memcpy(dst, src, avail);
+		spa_bt_decode_buffer_read(this, avail);
+	}
+	if (avail < size)
+		memset(SPA_PTROFF(dst, avail, void), 0, size - avail);
+
+	return avail / this->frame_size;
+}
+
+static inline struct spa_pod *spa_bt_decode_buffer_enum_propinfo(struct spa_bt_decode_buffer *this,
+		uint32_t target_msec, uint32_t idx, struct spa_pod_builder *b)
+{
+	struct spa_pod *param;
+
+	switch (idx) {
+	case 0:
+		param = spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_PropInfo, SPA_PARAM_PropInfo,
+			SPA_PROP_INFO_name, SPA_POD_String(DECODE_BUFFER_KEY_TARGET),
+			SPA_PROP_INFO_description, SPA_POD_String("Minimum jitter buffer latency (ms), 0 for codec default"),
+			SPA_PROP_INFO_type, SPA_POD_CHOICE_RANGE_Int(target_msec, 0, DECODE_BUFFER_MAX_MSEC),
+			SPA_PROP_INFO_params, SPA_POD_Bool(true));
+		break;
+	case 1:
+		param = spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_PropInfo, SPA_PARAM_PropInfo,
+			SPA_PROP_INFO_name, SPA_POD_String(DECODE_BUFFER_KEY_LEVEL),
+			SPA_PROP_INFO_description, SPA_POD_String("Average jitter buffer level (ms)"),
+			SPA_PROP_INFO_type, SPA_POD_Float(0.0f),
+			SPA_PROP_INFO_params, SPA_POD_Bool(true));
+		break;
+	case 2:
+		param = spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_PropInfo, SPA_PARAM_PropInfo,
+			SPA_PROP_INFO_name, SPA_POD_String(DECODE_BUFFER_KEY_JITTER),
+			SPA_PROP_INFO_description, SPA_POD_String("Peak packet arrival jitter (us)"),
+			SPA_PROP_INFO_type, SPA_POD_Int(0),
+			SPA_PROP_INFO_params, SPA_POD_Bool(true));
+		break;
+	case 3:
+		param = spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_PropInfo, SPA_PARAM_PropInfo,
+			SPA_PROP_INFO_name, SPA_POD_String(DECODE_BUFFER_KEY_RATE_DIFF),
+			SPA_PROP_INFO_description, SPA_POD_String("Rate correction of the remote clock"),
+			SPA_PROP_INFO_type, SPA_POD_Float(1.0f),
+			SPA_PROP_INFO_params, SPA_POD_Bool(true));
+		break;
+	case 4:
+		param = spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_PropInfo, SPA_PARAM_PropInfo,
+			SPA_PROP_INFO_name, SPA_POD_String(DECODE_BUFFER_KEY_UNDERRUNS),
+			SPA_PROP_INFO_description, SPA_POD_String("Jitter buffer underruns"),
+			SPA_PROP_INFO_type, SPA_POD_Int(0),
+			SPA_PROP_INFO_params, SPA_POD_Bool(true));
+		break;
+	case 5:
+		param = spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_PropInfo, SPA_PARAM_PropInfo,
+			SPA_PROP_INFO_name, SPA_POD_String(DECODE_BUFFER_KEY_OVERRUNS),
+			SPA_PROP_INFO_description, SPA_POD_String("Jitter buffer overruns"),
+			SPA_PROP_INFO_type, SPA_POD_Int(0),
+			SPA_PROP_INFO_params, SPA_POD_Bool(true));
+		break;
+	default:
+		return NULL;
+	}
+	return param;
+}
+
+/** Add the target latency and the statistics to a Props object */
+static inline void spa_bt_decode_buffer_add_prop_params(struct spa_bt_decode_buffer *this,
+		uint32_t target_msec, struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[1];
+	float level = 0.0f, rate_diff = 1.0f;
+	int32_t jitter = 0, underruns = 0, overruns = 0;
+
+	if (this->rate > 0) {
+		level = (float)(this->level * 1000.0 / this->rate);
+		rate_diff = (float)this->corr;
+		jitter = (int32_t)(this->jitter / SPA_NSEC_PER_USEC);
+		underruns = this->underruns;
+		overruns = this->overruns;
+	}
+
+	spa_pod_builder_prop(b, SPA_PROP_params, 0);
+	spa_pod_builder_push_struct(b, &f[0]);
+
+	spa_pod_builder_string(b, DECODE_BUFFER_KEY_TARGET);
+	spa_pod_builder_int(b, target_msec);
+
+	spa_pod_builder_string(b, DECODE_BUFFER_KEY_LEVEL);
+	spa_pod_builder_float(b, level);
+
+	spa_pod_builder_string(b, DECODE_BUFFER_KEY_JITTER);
+	spa_pod_builder_int(b, jitter);
+
+	spa_pod_builder_string(b, DECODE_BUFFER_KEY_RATE_DIFF);
+	spa_pod_builder_float(b, rate_diff);
+
+	spa_pod_builder_string(b, DECODE_BUFFER_KEY_UNDERRUNS);
+	spa_pod_builder_int(b, underruns);
+
+	spa_pod_builder_string(b, DECODE_BUFFER_KEY_OVERRUNS);
+	spa_pod_builder_int(b, overruns);
+
+	spa_pod_builder_pop(b, &f[0]);
+}
+
+/** Parse the target latency from the params of a Props object, the
+ * statistics are read-only and ignored. */
+static inline int spa_bt_decode_buffer_parse_prop_params(struct spa_pod *params, uint32_t *target_msec)
+{
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	int changed = 0;
+
+	if (params == NULL)
+		return 0;
+
+	spa_pod_parser_pod(&prs, params);
+	if (spa_pod_parser_push_struct(&prs, &f) < 0)
+		return 0;
+
+	while (true) {
+		const char *name;
+		struct spa_pod *pod;
+		int32_t value;
+
+		if (spa_pod_parser_get_string(&prs, &name) < 0)
+			break;
+		if (spa_pod_parser_get_pod(&prs, &pod) < 0)
+			break;
+
+		if (!spa_streq(name, DECODE_BUFFER_KEY_TARGET))
+			continue;
+		if (spa_pod_get_int(pod, &value) < 0 || value < 0)
+			continue;
+
+		value = SPA_MIN(value, DECODE_BUFFER_MAX_MSEC);
+		if ((uint32_t)value != *target_msec) {
+			*target_msec = value;
+			changed++;
+		}
+	}
+	return changed;
+}
+
+#endif
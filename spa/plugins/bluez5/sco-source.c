@@ -53,6 +53,7 @@
 #include <sbc/sbc.h>
 
 #include "defs.h"
+#include "decode-buffer.h"
 
 static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.source.sco");
 #undef SPA_LOG_TOPIC_DEFAULT
@@ -63,10 +64,12 @@ static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.source.sco"
 struct props {
 	uint32_t min_latency;
 	uint32_t max_latency;
+	uint32_t decode_latency_msec;
 	char clock_name[64];
 };
 
 #define MAX_BUFFERS 32
+#define MAX_DECODED_PACKET 4096
 
 struct buffer {
 	uint32_t id;
@@ -101,8 +104,7 @@ struct port {
 	struct spa_list free;
 	struct spa_list ready;
 
-	struct buffer *current_buffer;
-	uint32_t ready_offset;
+	struct spa_bt_decode_buffer buffer;
 };
 
 struct impl {
@@ -146,6 +148,7 @@ struct impl {
 	uint8_t msbc_buffer_pos;
 
 	struct timespec now;
+	uint64_t sample_count;
 };
 
 #define CHECK_PORT(this,d,p)	((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
@@ -157,6 +160,7 @@ static void reset_props(struct props *props)
 {
 	props->min_latency = default_min_latency;
 	props->max_latency = default_max_latency;
+	props->decode_latency_msec = 0;
 	strncpy(props->clock_name, DEFAULT_CLOCK_NAME, sizeof(props->clock_name));
 }
 
@@ -202,20 +206,29 @@ static int impl_node_enum_params(void *object, int seq,
 				SPA_PROP_INFO_type, SPA_POD_CHOICE_RANGE_Int(p->max_latency, 1, INT32_MAX));
 			break;
 		default:
-			return 0;
+			param = spa_bt_decode_buffer_enum_propinfo(&this->port.buffer,
+					p->decode_latency_msec, result.index - 2, &b);
+			if (param == NULL)
+				return 0;
 		}
 		break;
 	}
 	case SPA_PARAM_Props:
 	{
 		struct props *p = &this->props;
+		struct spa_pod_frame f;
 
 		switch (result.index) {
 		case 0:
-			param = spa_pod_builder_add_object(&b,
-				SPA_TYPE_OBJECT_Props, id,
+			spa_pod_builder_push_object(&b, &f,
+				SPA_TYPE_OBJECT_Props, id);
+			spa_pod_builder_add(&b,
 				SPA_PROP_minLatency, SPA_POD_Int(p->min_latency),
-				SPA_PROP_maxLatency, SPA_POD_Int(p->max_latency));
+				SPA_PROP_maxLatency, SPA_POD_Int(p->max_latency),
+				0);
+			spa_bt_decode_buffer_add_prop_params(&this->port.buffer,
+					p->decode_latency_msec, &b);
+			param = spa_pod_builder_pop(&b, &f);
 			break;
 		default:
 			return 0;
@@ -276,9 +289,22 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 
 static void emit_node_info(struct impl *this, bool full);
 
+static int do_update_decode_latency(struct spa_loop *loop,
+			bool async,
+			uint32_t seq,
+			const void *data,
+			size_t size,
+			void *user_data)
+{
+	struct impl *this = user_data;
+	spa_bt_decode_buffer_set_target_latency(&this->port.buffer, this->props.decode_latency_msec);
+	return 0;
+}
+
 static int apply_props(struct impl *this, const struct spa_pod *param)
 {
 	struct props new_props = this->props;
+	struct spa_pod *params = NULL;
 	int changed = 0;
 
 	if (param == NULL) {
@@ -287,7 +313,9 @@ static int apply_props(struct impl *this, const struct spa_pod *param)
 		spa_pod_parse_object(param,
 				SPA_TYPE_OBJECT_Props, NULL,
 				SPA_PROP_minLatency, SPA_POD_OPT_Int(&new_props.min_latency),
-				SPA_PROP_maxLatency, SPA_POD_OPT_Int(&new_props.max_latency));
+				SPA_PROP_maxLatency, SPA_POD_OPT_Int(&new_props.max_latency),
+				SPA_PROP_params, SPA_POD_OPT_Pod(&params));
+		spa_bt_decode_buffer_parse_prop_params(params, &new_props.decode_latency_msec);
 	}
 
 	changed = (memcmp(&new_props, &this->props, sizeof(struct props)) != 0);
@@ -306,6 +334,8 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	case SPA_PARAM_Props:
 	{
 		if (apply_props(this, param) > 0) {
+			if (this->started)
+				spa_loop_invoke(this->data_loop, do_update_decode_latency, 0, NULL, 0, true, this);
 			this->info.change_mask |= SPA_NODE_CHANGE_MASK_PARAMS;
 			this->params[IDX_Props].flags ^= SPA_PARAM_INFO_SERIAL;
 			emit_node_info(this, false);
@@ -326,8 +356,6 @@ static void reset_buffers(struct port *port)
 	spa_list_init(&port->free);
 	spa_list_init(&port->ready);
 
-	port->current_buffer = NULL;
-
 	for (i = 0; i < port->n_buffers; i++) {
 		struct buffer *b = &port->buffers[i];
 		spa_list_append(&port->free, &b->link);
@@ -422,11 +450,11 @@ static bool is_zero_packet(uint8_t *data, int size)
 	return true;
 }
 
-static void preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data, int size_read)
+static uint32_t preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data, int size_read,
+		uint8_t *dst, uint32_t dst_size)
 {
 	struct impl *this = userdata;
-	struct port *port = &this->port;
-	struct spa_data *datas = port->current_buffer->buf->datas;
+	uint32_t decoded = 0;
 
 	spa_log_trace(this->log, "handling mSBC data");
 
@@ -435,7 +463,7 @@ static void preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data,
 	   into the datastream.
 	   See https://gitlab.freedesktop.org/pipewire/pipewire/-/issues/549 */
 	if (is_zero_packet(read_data, size_read)) {
-		return;
+		return 0;
 	}
 
 	int i;
@@ -445,12 +473,12 @@ static void preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data,
 		/* Handle found mSBC packets.
 		 *
 		 * XXX: if there's no space for the decoded audio in
-		 * XXX: the current buffer, we'll drop data.
+		 * XXX: the decode buffer, we'll drop data.
 		 */
 		if (this->msbc_buffer_pos == MSBC_ENCODED_SIZE) {
 			spa_log_trace(this->log, "Received full mSBC packet, start processing it");
 
-			if (port->ready_offset + MSBC_DECODED_SIZE <= datas[0].maxsize) {
+			if (decoded + MSBC_DECODED_SIZE <= dst_size) {
 				int seq, processed;
 				size_t written;
 				spa_log_trace(this->log,
@@ -475,7 +503,7 @@ static void preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data,
 				/* decode frame */
 				processed = sbc_decode(
 					&this->msbc, this->msbc_buffer + 2, MSBC_ENCODED_SIZE - 3,
-					(uint8_t *)datas[0].data + port->ready_offset, MSBC_DECODED_SIZE,
+					dst + decoded, MSBC_DECODED_SIZE,
 					&written);
 
 				if (processed < 0) {
@@ -484,40 +512,171 @@ static void preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data,
 					continue;
 				}
 
-				port->ready_offset += written;
+				decoded += written;
 
 			} else {
 				spa_log_warn(this->log, "Output buffer full, dropping mSBC packet");
 			}
 		}
 	}
+	return decoded;
 }
 
-static int sco_source_cb(void *userdata, uint8_t *read_data, int size_read)
+static struct buffer *dequeue_buffer(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct buffer *buffer;
+
+	if (spa_list_is_empty(&port->free))
+		return NULL;
+
+	buffer = spa_list_first(&port->free, struct buffer, link);
+	spa_list_remove(&buffer->link);
+
+	return buffer;
+}
+
+static void queue_buffer(struct impl *this, struct buffer *buffer, uint32_t samples, uint64_t pts)
+{
+	struct port *port = &this->port;
+	struct spa_data *datas = buffer->buf->datas;
+
+	datas[0].chunk->offset = 0;
+	datas[0].chunk->size = samples * port->frame_size;
+	datas[0].chunk->stride = port->frame_size;
+
+	if (buffer->h) {
+		buffer->h->seq = this->sample_count;
+		buffer->h->pts = pts;
+		buffer->h->dts_offset = 0;
+	}
+	this->sample_count += samples;
+
+	spa_list_append(&port->ready, &buffer->link);
+}
+
+static uint32_t get_samples(struct impl *this)
+{
+	struct port *port = &this->port;
+
+	if (port->rate_match && port->rate_match->size > 0)
+		return port->rate_match->size;
+	if (this->position && this->position->clock.rate.denom > 0)
+		return (uint64_t)this->position->clock.duration *
+			port->current_format.info.raw.rate / this->position->clock.rate.denom;
+	return this->props.min_latency;
+}
+
+/* When following, take the samples for this cycle from the decode buffer
+ * and let the resampler follow the remote clock. */
+static void process_buffering(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct buffer *buffer;
+	struct spa_data *datas;
+	uint32_t samples;
+	uint64_t pts;
+
+	if (SPA_UNLIKELY(port->buffer.buffer_decoded == NULL))
+		return;
+
+	samples = get_samples(this);
+
+	spa_bt_decode_buffer_process(&port->buffer, samples);
+
+	if (port->rate_match) {
+		port->rate_match->rate = 1.0 / port->buffer.corr;
+		SPA_FLAG_SET(port->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+	}
+
+	if ((buffer = dequeue_buffer(this)) == NULL) {
+		spa_log_trace(this->log, "%p: no free buffers", this);
+		return;
+	}
+	datas = buffer->buf->datas;
+
+	samples = SPA_MIN(samples, datas[0].maxsize / port->frame_size);
+	pts = spa_bt_decode_buffer_get_pts(&port->buffer);
+	spa_bt_decode_buffer_fill(&port->buffer, datas[0].data, samples);
+
+	queue_buffer(this, buffer, samples, pts);
+}
+
+/* When driving, the graph runs at the rate of the remote clock and
+ * consumes everything that arrived. */
+static void process_driver(struct impl *this)
 {
-	struct impl *this = userdata;
 	struct port *port = &this->port;
 	struct spa_io_buffers *io = port->io;
+	struct buffer *buffer;
 	struct spa_data *datas;
-	uint32_t min_data;
+	uint32_t avail, samples, min_data;
+	uint64_t pts;
+	void *data;
+
+	if (port->rate_match)
+		SPA_FLAG_CLEAR(port->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+
+	data = spa_bt_decode_buffer_get_read(&port->buffer, &avail);
+
+	min_data = SPA_MIN(this->props.min_latency * port->frame_size,
+			port->buffers[0].buf->datas[0].maxsize / 2);
+	if (avail < min_data)
+		return;
+
+	if ((buffer = dequeue_buffer(this)) == NULL) {
+		spa_log_warn(this->log, "buffer not available");
+		return;
+	}
+	datas = buffer->buf->datas;
+
+	samples = SPA_MIN(avail, datas[0].maxsize) / port->frame_size;
+	pts = spa_bt_decode_buffer_get_pts(&port->buffer);
+	memcpy(datas[0].data, data, samples * port->frame_size);
+	spa_bt_decode_buffer_read(&port->buffer, samples * port->frame_size);
+
+	queue_buffer(this, buffer, samples, pts);
+
+	if (this->clock) {
+		this->clock->nsec = SPA_TIMESPEC_TO_NSEC(&this->now);
+		this->clock->duration = samples * this->clock->rate.denom / port->current_format.info.raw.rate;
+		this->clock->position += this->clock->duration;
+		this->clock->delay = 0;
+		this->clock->rate_diff = 1.0f;
+		this->clock->next_nsec = this->clock->nsec;
+	}
+
+	/* process the buffer if IO does not have any */
+	if (io->status != SPA_STATUS_HAVE_DATA) {
+		struct buffer *b;
+
+		if (io->buffer_id < port->n_buffers)
+			recycle_buffer(this, port, io->buffer_id);
+
+		b = spa_list_first(&port->ready, struct buffer, link);
+		spa_list_remove(&b->link);
+		b->outstanding = true;
+
+		io->buffer_id = b->id;
+		io->status = SPA_STATUS_HAVE_DATA;
+	}
+
+	/* notify ready */
+	spa_node_call_ready(&this->callbacks, SPA_STATUS_HAVE_DATA);
+}
+
+static int sco_source_cb(void *userdata, uint8_t *read_data, int size_read)
+{
+	struct impl *this = userdata;
+	struct port *port = &this->port;
+	uint32_t decoded, avail;
+	uint8_t *dst;
 
 	if (this->transport == NULL) {
 		spa_log_debug(this->log, "no transport, stop reading");
 		goto stop;
 	}
 
-	/* get buffer */
-	if (!port->current_buffer) {
-		if (spa_list_is_empty(&port->free)) {
-			spa_log_warn(this->log, "buffer not available");
-			return 0;
-		}
-		port->current_buffer = spa_list_first(&port->free, struct buffer, link);
-		spa_list_remove(&port->current_buffer->link);
-		port->ready_offset = 0;
-	}
-	datas = port->current_buffer->buf->datas;
-
 	/* update the current pts */
 	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &this->now);
 
@@ -527,11 +686,13 @@ static int sco_source_cb(void *userdata, uint8_t *read_data, int size_read)
 	hexdump_to_log(this, read_data, size_read);
 #endif
 
+	dst = spa_bt_decode_buffer_get_write(&port->buffer, &avail);
+
 	if (this->transport->codec == HFP_AUDIO_CODEC_MSBC) {
-		preprocess_and_decode_msbc_data(userdata, read_data, size_read);
+		decoded = preprocess_and_decode_msbc_data(userdata, read_data, size_read,
+				dst, avail);
 
 	} else {
-		uint8_t *packet;
 		if (size_read != 48 && is_zero_packet(read_data, size_read)) {
 			/* Adapter is returning non-standard CVSD stream. For example
 			 * Intel 8087:0029 at Firmware revision 0.0 build 191 week 21 2021
@@ -539,58 +700,21 @@ static int sco_source_cb(void *userdata, uint8_t *read_data, int size_read)
 			 */
 			return 0;
 		}
-		packet = (uint8_t *)datas[0].data + port->ready_offset;
-		spa_memmove(packet, read_data, size_read);
-		port->ready_offset += size_read;
-	}
-
-	/* send buffer if full */
-	min_data = SPA_MIN(this->props.min_latency * port->frame_size, datas[0].maxsize / 2);
-	if (port->ready_offset >= min_data) {
-		uint64_t sample_count;
-
-		datas[0].chunk->offset = 0;
-		datas[0].chunk->size = port->ready_offset;
-		datas[0].chunk->stride = port->frame_size;
-
-		sample_count = datas[0].chunk->size / port->frame_size;
-		spa_list_append(&port->ready, &port->current_buffer->link);
-		port->current_buffer = NULL;
-
-		if (!this->following && this->clock) {
-			this->clock->nsec = SPA_TIMESPEC_TO_NSEC(&this->now);
-			this->clock->duration = sample_count * this->clock->rate.denom / port->current_format.info.raw.rate;
-			this->clock->position += this->clock->duration;
-			this->clock->delay = 0;
-			this->clock->rate_diff = 1.0f;
-			this->clock->next_nsec = this->clock->nsec;
-		}
+		decoded = SPA_MIN((uint32_t)size_read, avail);
+		decoded -= decoded % port->frame_size;
+		spa_memmove(dst, read_data, decoded);
 	}
-
-	/* done if there are no buffers ready */
-	if (spa_list_is_empty(&port->ready))
+	if (decoded == 0)
 		return 0;
 
+	spa_bt_decode_buffer_write_packet(&port->buffer, decoded,
+			SPA_TIMESPEC_TO_NSEC(&this->now));
+
+	/* when following, the data is consumed in process */
 	if (this->following)
 		return 0;
 
-	/* process the buffer if IO does not have any */
-	if (io->status != SPA_STATUS_HAVE_DATA) {
-		struct buffer *b;
-
-		if (io->buffer_id < port->n_buffers)
-			recycle_buffer(this, port, io->buffer_id);
-
-		b = spa_list_first(&port->ready, struct buffer, link);
-		spa_list_remove(&b->link);
-		b->outstanding = true;
-
-		io->buffer_id = b->id;
-		io->status = SPA_STATUS_HAVE_DATA;
-	}
-
-	/* notify ready */
-	spa_node_call_ready(&this->callbacks, SPA_STATUS_HAVE_DATA);
+	process_driver(this);
 	return 0;
 
 stop:
@@ -637,6 +761,13 @@ static int do_start(struct impl *this)
 
 	/* Reset the buffers and sample count */
 	reset_buffers(&this->port);
+	this->sample_count = 0;
+
+	if ((res = spa_bt_decode_buffer_init(&this->port.buffer, this->log,
+			this->port.frame_size, this->port.current_format.info.raw.rate,
+			MAX_DECODED_PACKET)) < 0)
+		goto fail;
+	spa_bt_decode_buffer_set_target_latency(&this->port.buffer, this->props.decode_latency_msec);
 
 	/* Init mSBC if needed */
 	if (this->transport->codec == HFP_AUDIO_CODEC_MSBC) {
@@ -659,6 +790,7 @@ static int do_start(struct impl *this)
 	return 0;
 
 fail:
+	spa_bt_decode_buffer_clear(&this->port.buffer);
 	spa_bt_transport_release(this->transport);
 	return res;
 }
@@ -691,6 +823,8 @@ static int do_stop(struct impl *this)
 
 	this->started = false;
 
+	spa_bt_decode_buffer_clear(&this->port.buffer);
+
 	if (this->transport) {
 		/* Release the transport; it is responsible for closing the fd */
 		res = spa_bt_transport_release(this->transport);
@@ -976,7 +1110,6 @@ static int clear_buffers(struct impl *this, struct port *port)
 		spa_list_init(&port->ready);
 		port->n_buffers = 0;
 	}
-	port->current_buffer = NULL;
 	return 0;
 }
 
@@ -1170,6 +1303,10 @@ static int impl_node_process(void *object)
 		io->buffer_id = SPA_ID_INVALID;
 	}
 
+	/* Produce the samples for this cycle */
+	if (this->following)
+		process_buffering(this);
+
 	/* Return if there are no buffers ready to be processed */
 	if (spa_list_is_empty(&port->ready))
 		return SPA_STATUS_OK;
@@ -1343,6 +1480,8 @@ impl_init(const struct spa_handle_factory *factory,
 
 	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_BLUEZ5_TRANSPORT)))
 		sscanf(str, "pointer:%p", &this->transport);
+	if (info && (str = spa_dict_lookup(info, DECODE_BUFFER_KEY_TARGET)))
+		this->props.decode_latency_msec = SPA_CLAMP(atoi(str), 0, DECODE_BUFFER_MAX_MSEC);
 
 	if (this->transport == NULL) {
 		spa_log_error(this->log, "a transport is needed");
@@ -0,0 +1,259 @@
+/* Spa Bluez5 decode buffer test
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "decode-buffer.h"
+
+#define MAX_QUANTUM	2048
+
+/* A source that follows another driver. The remote side sends packets with
+ * its own clock, the graph takes a quantum every cycle. Like the resampler
+ * of the adapter, the number of samples taken is scaled with the rate
+ * correction of the previous cycle. */
+struct test {
+	struct spa_bt_decode_buffer buffer;
+	uint32_t rate;
+	uint32_t packet_samples;
+	uint32_t quantum;
+	double drift;			/**< remote clock is this much faster */
+	uint32_t jitter_nsec;		/**< maximum packet arrival delay */
+
+	double now;
+	double next_packet;		/**< when the remote sends the next packet */
+	double next_arrival;		/**< when it is received */
+	double next_cycle;
+	double frac;
+
+	uint16_t write_seq;
+	uint16_t read_seq;
+	uint32_t discont;
+	uint32_t silence;
+	double corr_sum;
+	uint32_t n_cycles;
+};
+
+static uint32_t seed = 1;
+
+static uint32_t random_nsec(uint32_t max)
+{
+	seed = seed * 1103515245u + 12345u;
+	return max ? (seed >> 8) % max : 0;
+}
+
+static void test_init(struct test *t, uint32_t rate, uint32_t packet_samples,
+		uint32_t quantum, uint32_t target_msec)
+{
+	spa_zero(*t);
+	t->rate = rate;
+	t->packet_samples = packet_samples;
+	t->quantum = quantum;
+	spa_assert_se(spa_bt_decode_buffer_init(&t->buffer, NULL, sizeof(uint16_t), rate,
+				packet_samples * sizeof(uint16_t)) == 0);
+	spa_bt_decode_buffer_set_target_latency(&t->buffer, target_msec);
+}
+
+static void write_packet(struct test *t)
+{
+	uint16_t *dst;
+	uint32_t i, avail;
+
+	dst = spa_bt_decode_buffer_get_write(&t->buffer, &avail);
+	spa_assert_se(avail >= t->packet_samples * sizeof(uint16_t));
+	for (i = 0; i < t->packet_samples; i++)
+		dst[i] = t->write_seq++;
+
+	spa_bt_decode_buffer_write_packet(&t->buffer,
+			t->packet_samples * sizeof(uint16_t), (uint64_t)t->now);
+}
+
+static void read_cycle(struct test *t)
+{
+	uint16_t dst[MAX_QUANTUM];
+	uint32_t i, samples, n_read;
+
+	t->frac += t->quantum * t->buffer.corr;
+	samples = (uint32_t)t->frac;
+	t->frac -= samples;
+	spa_assert_se(samples <= MAX_QUANTUM);
+
+	spa_bt_decode_buffer_process(&t->buffer, samples);
+	t->corr_sum += t->buffer.corr;
+	t->n_cycles++;
+	n_read = spa_bt_decode_buffer_fill(&t->buffer, dst, samples);
+
+	for (i = 0; i < n_read; i++) {
+		if (dst[i] != t->read_seq)
+			t->discont++;
+		t->read_seq = dst[i] + 1;
+	}
+	for (; i < samples; i++) {
+		spa_assert_se(dst[i] == 0);
+		t->silence++;
+	}
+}
+
+/* run for the given time, without packets when stalled */
+static void run_seconds(struct test *t, double seconds, bool stalled)
+{
+	double end = t->now + seconds * SPA_NSEC_PER_SEC;
+	double packet_nsec = (double)t->packet_samples * SPA_NSEC_PER_SEC /
+		(t->rate * (1.0 + t->drift));
+	double cycle_nsec = (double)t->quantum * SPA_NSEC_PER_SEC / t->rate;
+
+	while (true) {
+		if (t->next_arrival <= t->next_cycle) {
+			if ((t->now = t->next_arrival) >= end)
+				break;
+			if (!stalled)
+				write_packet(t);
+			/* packets are delayed by the link but stay in order */
+			t->next_packet += packet_nsec;
+			t->next_arrival = SPA_MAX(t->next_arrival,
+					t->next_packet + random_nsec(t->jitter_nsec));
+		} else {
+			if ((t->now = t->next_cycle) >= end)
+				break;
+			read_cycle(t);
+			t->next_cycle += cycle_nsec;
+		}
+	}
+}
+
+static void check_locked(struct test *t, const char *name)
+{
+	struct spa_bt_decode_buffer *b = &t->buffer;
+	uint32_t underruns = b->underruns, overruns = b->overruns;
+	uint32_t discont = t->discont, silence = t->silence;
+	double corr;
+
+	/* once locked, the level stays at the target, no samples are
+	 * dropped or added and the average correction is the drift. The
+	 * packets and the cycles make a pattern that shifts slowly with the
+	 * drift, average over a few periods of that. */
+	t->corr_sum = 0.0;
+	t->n_cycles = 0;
+	run_seconds(t, 90.0, false);
+	corr = t->corr_sum / t->n_cycles;
+
+	fprintf(stderr, "%s: target %u level %.1f corr %.6f (drift %.6f) underruns %u overruns %u\n",
+			name, b->target, b->level, corr, 1.0 + t->drift,
+			b->underruns, b->overruns);
+
+	spa_assert_se(b->underruns == underruns);
+	spa_assert_se(b->overruns == overruns);
+	spa_assert_se(t->discont == discont);
+	spa_assert_se(t->silence == silence);
+	spa_assert_se(!b->buffering);
+	spa_assert_se(fabs(b->level - b->target) < t->packet_samples + t->quantum / 4);
+	spa_assert_se(fabs(corr - (1.0 + t->drift)) < 20e-6);
+}
+
+/* mSBC over SCO: 16 kHz, a packet every 7.5 ms and the default target */
+static void test_sco(double drift)
+{
+	struct test t;
+	char name[64];
+
+	test_init(&t, 16000, 120, 320, 0);
+	spa_assert_se(t.buffer.target_msec == DECODE_BUFFER_DEFAULT_MSEC);
+	spa_assert_se(DECODE_BUFFER_DEFAULT_MSEC == 40);
+	spa_assert_se(t.buffer.target == 640);
+	t.drift = drift;
+
+	/* buffering, then the rate correction locks to the remote clock */
+	run_seconds(&t, 60.0, false);
+	spa_assert_se(t.buffer.target == 640);
+	spa_assert_se(t.buffer.underruns == 0);
+
+	snprintf(name, sizeof(name), "sco drift %+.0f ppm", drift * 1e6);
+	check_locked(&t, name);
+
+	spa_bt_decode_buffer_clear(&t.buffer);
+}
+
+/* A2DP with a lot of arrival jitter, the target goes above the minimum */
+static void test_a2dp_jitter(void)
+{
+	struct test t;
+
+	test_init(&t, 48000, 512, 1024, 20);
+	spa_assert_se(t.buffer.target == 960);
+	t.drift = -300e-6;
+	t.jitter_nsec = 30 * SPA_NSEC_PER_MSEC;
+
+	run_seconds(&t, 60.0, false);
+	spa_assert_se(t.buffer.target > 960);
+	spa_assert_se(t.buffer.target <= 512 + 30 * 48);
+
+	check_locked(&t, "a2dp jitter");
+
+	spa_bt_decode_buffer_clear(&t.buffer);
+}
+
+/* When the packets stop, silence is produced until the buffer is filled
+ * up to the target again, after that the output continues without gaps */
+static void test_underrun(void)
+{
+	struct test t;
+	uint32_t silence;
+
+	test_init(&t, 16000, 120, 320, 0);
+	t.drift = 100e-6;
+
+	run_seconds(&t, 60.0, false);
+	spa_assert_se(t.buffer.underruns == 0);
+	silence = t.silence;
+
+	run_seconds(&t, 1.0, true);
+	spa_assert_se(t.buffer.underruns == 1);
+	spa_assert_se(t.buffer.buffering);
+	spa_assert_se(t.silence > silence);
+
+	/* the samples that were left are played after the buffering, the
+	 * output has a gap but no samples are lost */
+	run_seconds(&t, 60.0, false);
+	spa_assert_se(t.buffer.target == 640);
+	spa_assert_se(t.buffer.underruns == 1);
+	spa_assert_se(t.buffer.overruns == 0);
+	spa_assert_se(t.discont == 0);
+
+	check_locked(&t, "sco after underrun");
+
+	spa_bt_decode_buffer_clear(&t.buffer);
+}
+
+int main(int argc, char *argv[])
+{
+	test_sco(0.0);
+	test_sco(200e-6);
+	test_sco(-200e-6);
+	test_a2dp_jitter();
+	test_underrun();
+	return 0;
+}
@@ -147,6 +147,8 @@ static int impl_pollfd_add(void *object, int pfd, int fd, uint32_t events, void
 
 	if (impl->n_entries == MAX_POLL)
 		return -ENOSPC;
+	if (events & SPA_IO_ET)
+		return -ENOTSUP;
 
 	e = &impl->entries[impl->n_entries++];
 	e->pfd = pfd;
@@ -164,6 +166,8 @@ static int impl_pollfd_mod(void *object, int pfd, int fd, uint32_t events, void
 	e = find_entry(impl, pfd, fd);
 	if (e == NULL)
 		return -ENOENT;
+	if (events & SPA_IO_ET)
+		return -ENOTSUP;
 
 	e->events = events;
 	e->data = data;
@@ -0,0 +1,521 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/string.h>
+
+#include "log-trace.h"
+
+#define MAX_STRING	256
+
+enum arg_type {
+	ARG_NONE,
+	ARG_INT,
+	ARG_UINT,
+	ARG_CHAR,
+	ARG_DOUBLE,
+	ARG_POINTER,
+	ARG_STRING,
+	ARG_ERRNO,
+};
+
+enum arg_length {
+	LEN_NONE,
+	LEN_HH,
+	LEN_H,
+	LEN_L,
+	LEN_LL,
+	LEN_Z,
+	LEN_J,
+	LEN_T,
+	LEN_LD,
+};
+
+struct spec {
+	const char *start;
+	const char *length_start;
+	const char *end;
+	unsigned int width_star:1;
+	unsigned int prec_star:1;
+	int precision;
+	enum arg_length length;
+	enum arg_type type;
+	char conv;
+};
+
+struct builder {
+	uint8_t *data;
+	size_t size;
+	size_t pos;
+};
+
+struct parser {
+	const uint8_t *data;
+	size_t size;
+	size_t pos;
+};
+
+static int parse_spec(const char *p, struct spec *s)
+{
+	s->start = p++;
+	s->width_star = s->prec_star = false;
+	s->precision = -1;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		s->width_star = true;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			s->prec_star = true;
+			p++;
+		} else {
+			s->precision = 0;
+			while (*p >= '0' && *p <= '9')
+				s->precision = s->precision * 10 + (*p++ - '0');
+		}
+	}
+
+	s->length_start = p;
+	switch (*p) {
+	case 'h':
+		s->length = *++p == 'h' ? (p++, LEN_HH) : LEN_H;
+		break;
+	case 'l':
+		s->length = *++p == 'l' ? (p++, LEN_LL) : LEN_L;
+		break;
+	case 'q':
+		s->length = LEN_LL;
+		p++;
+		break;
+	case 'L':
+		s->length = LEN_LD;
+		p++;
+		break;
+	case 'z':
+	case 'Z':
+		s->length = LEN_Z;
+		p++;
+		break;
+	case 'j':
+		s->length = LEN_J;
+		p++;
+		break;
+	case 't':
+		s->length = LEN_T;
+		p++;
+		break;
+	default:
+		s->length = LEN_NONE;
+		break;
+	}
+
+	switch ((s->conv = *p)) {
+	case 'd': case 'i':
+		s->type = ARG_INT;
+		break;
+	case 'u': case 'o': case 'x': case 'X':
+		s->type = ARG_UINT;
+		break;
+	case 'c':
+		s->type = ARG_CHAR;
+		break;
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		s->type = ARG_DOUBLE;
+		break;
+	case 's':
+		if (s->length != LEN_NONE)
+			return -ENOTSUP;
+		s->type = ARG_STRING;
+		break;
+	case 'p':
+		s->type = ARG_POINTER;
+		break;
+	case 'm':
+		s->type = ARG_ERRNO;
+		break;
+	case '%':
+		s->type = ARG_NONE;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	s->end = p + 1;
+	return 0;
+}
+
+static void *builder_add(struct builder *b, size_t size)
+{
+	void *p;
+	size = SPA_ROUND_UP_N(size, sizeof(uint64_t));
+	if (b->pos + size > b->size)
+		return NULL;
+	p = SPA_PTROFF(b->data, b->pos, void);
+	b->pos += size;
+	return p;
+}
+
+static int builder_add_value(struct builder *b, const void *val, size_t size)
+{
+	void *p;
+	if ((p = builder_add(b, size)) == NULL)
+		return -ENOSPC;
+	memcpy(p, val, size);
+	return 0;
+}
+
+static int builder_add_int(struct builder *b, int64_t val)
+{
+	return builder_add_value(b, &val, sizeof(val));
+}
+
+static int builder_add_string(struct builder *b, const char *str, int precision)
+{
+	uint32_t len;
+	uint8_t *p;
+
+	if (str == NULL)
+		str = "(null)";
+	len = strnlen(str, precision >= 0 ? SPA_MIN(precision, MAX_STRING) : MAX_STRING);
+	if ((p = builder_add(b, sizeof(len) + len)) == NULL)
+		return -ENOSPC;
+	memcpy(p, &len, sizeof(len));
+	memcpy(p + sizeof(len), str, len);
+	return 0;
+}
+
+static int64_t get_int(const struct spec *s, va_list *ap)
+{
+	switch (s->length) {
+	case LEN_HH:
+		return (signed char)va_arg(*ap, int);
+	case LEN_H:
+		return (short)va_arg(*ap, int);
+	case LEN_L:
+		return va_arg(*ap, long);
+	case LEN_LL:
+	case LEN_LD:
+		return va_arg(*ap, long long);
+	case LEN_Z:
+		return va_arg(*ap, ssize_t);
+	case LEN_J:
+		return va_arg(*ap, intmax_t);
+	case LEN_T:
+		return va_arg(*ap, ptrdiff_t);
+	default:
+		return va_arg(*ap, int);
+	}
+}
+
+static uint64_t get_uint(const struct spec *s, va_list *ap)
+{
+	switch (s->length) {
+	case LEN_HH:
+		return (unsigned char)va_arg(*ap, unsigned int);
+	case LEN_H:
+		return (unsigned short)va_arg(*ap, unsigned int);
+	case LEN_L:
+		return va_arg(*ap, unsigned long);
+	case LEN_LL:
+	case LEN_LD:
+		return va_arg(*ap, unsigned long long);
+	case LEN_Z:
+		return va_arg(*ap, size_t);
+	case LEN_J:
+		return va_arg(*ap, uintmax_t);
+	case LEN_T:
+		return (uint64_t)va_arg(*ap, ptrdiff_t);
+	default:
+		return va_arg(*ap, unsigned int);
+	}
+}
+
+static int encode(struct builder *b, const char *fmt, va_list *ap, int err)
+{
+	const char *p = fmt;
+	struct spec s;
+	int res = 0, precision;
+	uint64_t uval;
+	double dval;
+	void *pval;
+
+	while ((p = strchr(p, '%')) != NULL) {
+		if ((res = parse_spec(p, &s)) < 0)
+			return res;
+
+		precision = s.precision;
+		if (s.width_star &&
+		    (res = builder_add_int(b, va_arg(*ap, int))) < 0)
+			return res;
+		if (s.prec_star) {
+			precision = va_arg(*ap, int);
+			if ((res = builder_add_int(b, precision)) < 0)
+				return res;
+		}
+
+		switch (s.type) {
+		case ARG_INT:
+			res = builder_add_int(b, get_int(&s, ap));
+			break;
+		case ARG_UINT:
+			uval = get_uint(&s, ap);
+			res = builder_add_value(b, &uval, sizeof(uval));
+			break;
+		case ARG_CHAR:
+			res = builder_add_int(b, va_arg(*ap, int));
+			break;
+		case ARG_DOUBLE:
+			if (s.length == LEN_LD)
+				dval = (double)va_arg(*ap, long double);
+			else
+				dval = va_arg(*ap, double);
+			res = builder_add_value(b, &dval, sizeof(dval));
+			break;
+		case ARG_POINTER:
+			pval = va_arg(*ap, void *);
+			res = builder_add_value(b, &pval, sizeof(pval));
+			break;
+		case ARG_STRING:
+			res = builder_add_string(b, va_arg(*ap, const char *), precision);
+			break;
+		case ARG_ERRNO:
+			res = builder_add_int(b, err);
+			break;
+		case ARG_NONE:
+			break;
+		}
+		if (res < 0)
+			return res;
+		p = s.end;
+	}
+	return b->pos;
+}
+
+int support_log_trace_encode(void *buf, size_t size, const char *fmt, va_list args)
+{
+	struct builder b = { buf, size, 0 };
+	int res, err = errno;
+	va_list ap;
+
+	va_copy(ap, args);
+	res = encode(&b, fmt, &ap, err);
+	va_end(ap);
+
+	errno = err;
+	return res;
+}
+
+int support_log_trace_encode_string(void *buf, size_t size, const char *str)
+{
+	struct builder b = { buf, size, 0 };
+	int res;
+
+	if ((res = builder_add_string(&b, str, -1)) < 0)
+		return res;
+	return b.pos;
+}
+
+static const void *parser_get(struct parser *p, size_t size)
+{
+	const void *d;
+	size = SPA_ROUND_UP_N(size, sizeof(uint64_t));
+	if (p->pos + size > p->size)
+		return NULL;
+	d = SPA_PTROFF(p->data, p->pos, void);
+	p->pos += size;
+	return d;
+}
+
+static int parser_get_value(struct parser *p, void *val, size_t size)
+{
+	const void *d;
+	if ((d = parser_get(p, size)) == NULL)
+		return -EINVAL;
+	memcpy(val, d, size);
+	return 0;
+}
+
+static int parser_get_string(struct parser *p, const char **str, uint32_t *len)
+{
+	const uint8_t *d;
+
+	if (p->pos + sizeof(*len) > p->size)
+		return -EINVAL;
+	memcpy(len, p->data + p->pos, sizeof(*len));
+	if (*len > MAX_STRING ||
+	    (d = parser_get(p, sizeof(*len) + *len)) == NULL)
+		return -EINVAL;
+	*str = (const char *)d + sizeof(*len);
+	return 0;
+}
+
+struct out {
+	char *str;
+	size_t size;
+	size_t pos;
+};
+
+static SPA_PRINTF_FUNC(2,3) void out_printf(struct out *o, const char *fmt, ...)
+{
+	va_list args;
+
+	if (o->pos + 1 >= o->size)
+		return;
+	va_start(args, fmt);
+	o->pos += spa_vscnprintf(o->str + o->pos, o->size - o->pos, fmt, args);
+	va_end(args);
+}
+
+static void out_write(struct out *o, const char *str, size_t len)
+{
+	if (o->pos + 1 >= o->size)
+		return;
+	len = SPA_MIN(len, o->size - o->pos - 1);
+	memcpy(o->str + o->pos, str, len);
+	o->pos += len;
+	o->str[o->pos] = '\0';
+}
+
+#define out_printf_star(o,n_star,star,fmt,...)						\
+({											\
+	switch (n_star) {								\
+	case 0: out_printf(o, fmt, __VA_ARGS__); break;					\
+	case 1: out_printf(o, fmt, star[0], __VA_ARGS__); break;			\
+	default: out_printf(o, fmt, star[0], star[1], __VA_ARGS__); break;		\
+	}										\
+})
+
+int support_log_trace_format(char *str, size_t size, const char *fmt,
+		const void *buf, size_t len)
+{
+	struct parser p = { buf, len, 0 };
+	struct out o = { str, size, 0 };
+	const char *f = fmt, *n;
+	char sub[64];
+	int star[2], n_star, sub_len;
+	struct spec s;
+	int64_t ival;
+	uint64_t uval;
+	double dval;
+	void *pval;
+	const char *sval;
+	char sbuf[MAX_STRING + 1];
+	uint32_t slen;
+
+	spa_return_val_if_fail(size > 0, -EINVAL);
+	str[0] = '\0';
+
+	while ((n = strchr(f, '%')) != NULL) {
+		out_write(&o, f, n - f);
+
+		if (parse_spec(n, &s) < 0)
+			return -EINVAL;
+		f = s.end;
+
+		if (s.type == ARG_NONE) {
+			out_write(&o, "%", 1);
+			continue;
+		}
+
+		n_star = 0;
+		if (s.width_star && parser_get_value(&p, &ival, sizeof(ival)) == 0)
+			star[n_star++] = ival;
+		if (s.prec_star && parser_get_value(&p, &ival, sizeof(ival)) == 0)
+			star[n_star++] = ival;
+		if (n_star != s.width_star + s.prec_star)
+			return -EINVAL;
+
+		/* rebuild the conversion with a length modifier that matches
+		 * how the argument was stored */
+		sub_len = s.length_start - s.start;
+		if (sub_len + 4 > (int)sizeof(sub))
+			return -EINVAL;
+		memcpy(sub, s.start, sub_len);
+
+		switch (s.type) {
+		case ARG_INT:
+			if (parser_get_value(&p, &ival, sizeof(ival)) < 0)
+				return -EINVAL;
+			snprintf(sub + sub_len, sizeof(sub) - sub_len, "ll%c", s.conv);
+			out_printf_star(&o, n_star, star, sub, (long long)ival);
+			break;
+		case ARG_UINT:
+			if (parser_get_value(&p, &uval, sizeof(uval)) < 0)
+				return -EINVAL;
+			snprintf(sub + sub_len, sizeof(sub) - sub_len, "ll%c", s.conv);
+			out_printf_star(&o, n_star, star, sub, (unsigned long long)uval);
+			break;
+		case ARG_CHAR:
+			if (parser_get_value(&p, &ival, sizeof(ival)) < 0)
+				return -EINVAL;
+			snprintf(sub + sub_len, sizeof(sub) - sub_len, "c");
+			out_printf_star(&o, n_star, star, sub, (int)ival);
+			break;
+		case ARG_DOUBLE:
+			if (parser_get_value(&p, &dval, sizeof(dval)) < 0)
+				return -EINVAL;
+			snprintf(sub + sub_len, sizeof(sub) - sub_len, "%c", s.conv);
+			out_printf_star(&o, n_star, star, sub, dval);
+			break;
+		case ARG_POINTER:
+			if (parser_get_value(&p, &pval, sizeof(pval)) < 0)
+				return -EINVAL;
+			snprintf(sub + sub_len, sizeof(sub) - sub_len, "p");
+			out_printf_star(&o, n_star, star, sub, pval);
+			break;
+		case ARG_STRING:
+			if (parser_get_string(&p, &sval, &slen) < 0)
+				return -EINVAL;
+			memcpy(sbuf, sval, slen);
+			sbuf[slen] = '\0';
+			snprintf(sub + sub_len, sizeof(sub) - sub_len, "s");
+			out_printf_star(&o, n_star, star, sub, sbuf);
+			break;
+		case ARG_ERRNO:
+			if (parser_get_value(&p, &ival, sizeof(ival)) < 0)
+				return -EINVAL;
+			snprintf(sub + sub_len, sizeof(sub) - sub_len, "s");
+			out_printf_star(&o, n_star, star, sub, strerror(ival));
+			break;
+		case ARG_NONE:
+			break;
+		}
+	}
+	out_write(&o, f, strlen(f));
+	return o.pos;
+}
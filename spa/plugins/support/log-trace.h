@@ -0,0 +1,45 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef LOG_TRACE_H
+#define LOG_TRACE_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/* Encode the arguments of a printf style format string into buf so that the
+ * message can be formatted later with support_log_trace_format(). Strings
+ * are copied, everything else is stored by value. Returns the number of bytes
+ * used in buf or a negative error when the format can't be encoded. */
+int support_log_trace_encode(void *buf, size_t size, const char *fmt, va_list args);
+
+/* Encode str as the argument of a "%s" format. */
+int support_log_trace_encode_string(void *buf, size_t size, const char *str);
+
+/* Format a message from fmt and the arguments encoded in buf into str. */
+int support_log_trace_format(char *str, size_t size, const char *fmt,
+		const void *buf, size_t len);
+
+#endif /* LOG_TRACE_H */
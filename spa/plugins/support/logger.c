@@ -29,11 +29,13 @@
 #include <stdio.h>
 #include <time.h>
 #include <fnmatch.h>
+#include <pthread.h>
 
 #include <spa/support/log.h>
 #include <spa/support/loop.h>
 #include <spa/support/system.h>
 #include <spa/support/plugin.h>
+#include <spa/utils/result.h>
 #include <spa/utils/ringbuffer.h>
 #include <spa/utils/type.h>
 #include <spa/utils/names.h>
@@ -41,6 +43,7 @@
 #include <spa/utils/ansi.h>
 
 #include "log-patterns.h"
+#include "log-trace.h"
 
 #ifdef __FreeBSD__
 #define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
@@ -52,6 +55,34 @@
 
 #define TRACE_BUFFER (16*1024)
 
+#define BINARY_TRACE_BUFFER	(1024*1024)
+#define BINARY_TRACE_MAX	4096
+#define BINARY_TRACE_STRING	256
+#define BINARY_TRACE_TIMEOUT	50
+#define BINARY_TRACE_MAX_RINGS	64
+#define BINARY_TRACE_FREE_RINGS	4
+
+/* In binary trace mode, trace messages are not formatted in the thread that
+ * logs them. Each thread gets its own ringbuffer where the format string,
+ * location and encoded arguments are stored. A separate thread merges the
+ * ringbuffers in timestamp order and formats the messages.
+ *
+ * The record is followed by the topic, file, function and format strings
+ * and the encoded arguments at offset args. */
+struct trace_record {
+	uint32_t size;
+	uint32_t args;
+	uint64_t time;
+	int line;
+};
+
+struct trace_ring {
+	struct spa_ringbuffer rb;
+	uint32_t dropped;
+	bool in_use;
+	uint8_t data[BINARY_TRACE_BUFFER];
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_log log;
@@ -67,23 +98,34 @@ struct impl {
 	unsigned int colors:1;
 	unsigned int timestamp:1;
 	unsigned int line:1;
+	unsigned int binary_trace:1;
 
 	struct spa_list patterns;
+
+	pthread_key_t trace_key;
+	pthread_mutex_t trace_lock;
+	pthread_cond_t trace_cond;
+	pthread_t trace_thread;
+	bool trace_running;
+	struct trace_ring *trace_rings[BINARY_TRACE_MAX_RINGS];
+	uint32_t n_trace_rings;
+	uint32_t trace_threads;
+	uint32_t trace_dropped;
 };
 
-static SPA_PRINTF_FUNC(7,0) void
-impl_log_logtv(void *object,
+static SPA_PRINTF_FUNC(8,0) void
+log_line(struct impl *impl,
 	      enum spa_log_level level,
 	      const struct spa_log_topic *topic,
 	      const char *file,
 	      int line,
 	      const char *func,
+	      const struct timespec *time,
 	      const char *fmt,
 	      va_list args)
 {
 #define RESERVED_LENGTH 24
 
-	struct impl *impl = object;
 	char timestamp[15] = {0};
 	char topicstr[32] = {0};
 	char filename[64] = {0};
@@ -112,9 +154,12 @@ impl_log_logtv(void *object,
 
 	if (impl->timestamp) {
 		struct timespec now;
-		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		if (time == NULL) {
+			clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+			time = &now;
+		}
 		spa_scnprintf(timestamp, sizeof(timestamp), "[%05lu.%06lu]",
-			(now.tv_sec & 0x1FFFFFFF) % 100000, now.tv_nsec / 1000);
+			(time->tv_sec & 0x1FFFFFFF) % 100000, time->tv_nsec / 1000);
 	}
 
 	if (topic && topic->topic)
@@ -171,6 +216,342 @@ impl_log_logtv(void *object,
 #undef RESERVED_LENGTH
 }
 
+static SPA_PRINTF_FUNC(8,9) void
+log_line_fmt(struct impl *impl,
+	      enum spa_log_level level,
+	      const struct spa_log_topic *topic,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const struct timespec *time,
+	      const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	log_line(impl, level, topic, file, line, func, time, fmt, args);
+	va_end(args);
+}
+
+static void free_trace_rings(struct impl *impl)
+{
+	uint32_t i;
+	for (i = 0; i < impl->n_trace_rings; i++)
+		free(impl->trace_rings[i]);
+	impl->n_trace_rings = 0;
+}
+
+static void trace_ring_release(void *data)
+{
+	struct trace_ring *ring = data;
+	__atomic_store_n(&ring->in_use, false, __ATOMIC_RELEASE);
+}
+
+/* Called from the thread that logs, this can be a realtime thread. The
+ * rings are made in advance by the trace thread and are taken without a
+ * lock or allocation. */
+static struct trace_ring *trace_ring_get(struct impl *impl)
+{
+	struct trace_ring *ring;
+	uint32_t i, n_rings, index;
+	bool in_use;
+
+	if (SPA_LIKELY((ring = pthread_getspecific(impl->trace_key)) != NULL))
+		return ring;
+
+	/* first trace message from this thread, take a free ring. The ring
+	 * of a thread that exited is free when it is drained */
+	n_rings = __atomic_load_n(&impl->n_trace_rings, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n_rings; i++) {
+		ring = impl->trace_rings[i];
+		in_use = false;
+		if (spa_ringbuffer_get_read_index(&ring->rb, &index) == 0 &&
+		    __atomic_compare_exchange_n(&ring->in_use, &in_use, true, false,
+				    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			pthread_setspecific(impl->trace_key, ring);
+			return ring;
+		}
+	}
+	/* the trace thread makes more rings */
+	if (__atomic_fetch_add(&impl->trace_dropped, 1, __ATOMIC_RELAXED) == 0)
+		pthread_cond_signal(&impl->trace_cond);
+	return NULL;
+}
+
+/* make a ring for each of the expected threads and keep some free rings
+ * for new threads after that. Rings of threads that exited are reused. */
+static void trace_rings_refill(struct impl *impl)
+{
+	struct trace_ring *ring;
+	uint32_t i, n_free = 0;
+
+	for (i = 0; i < impl->n_trace_rings; i++)
+		if (!__atomic_load_n(&impl->trace_rings[i]->in_use, __ATOMIC_ACQUIRE))
+			n_free++;
+
+	for (i = impl->n_trace_rings; i < BINARY_TRACE_MAX_RINGS &&
+			(n_free < BINARY_TRACE_FREE_RINGS || i < impl->trace_threads);
+			i++, n_free++) {
+		if ((ring = calloc(1, sizeof(*ring))) == NULL)
+			break;
+		spa_ringbuffer_init(&ring->rb);
+		impl->trace_rings[i] = ring;
+		__atomic_store_n(&impl->n_trace_rings, i + 1, __ATOMIC_RELEASE);
+	}
+}
+
+static uint32_t trace_copy_string(uint8_t *dst, size_t size, const char *str)
+{
+	size_t len = strnlen(str ? str : "", size - 1);
+	memcpy(dst, str ? str : "", len);
+	dst[len] = '\0';
+	return len + 1;
+}
+
+static SPA_PRINTF_FUNC(6,0) void
+log_binary_trace(struct impl *impl,
+	      const struct spa_log_topic *topic,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const char *fmt,
+	      va_list args)
+{
+	uint8_t buffer[BINARY_TRACE_MAX] SPA_ALIGNED(8);
+	struct trace_record *rec = (struct trace_record *)buffer;
+	struct trace_ring *ring;
+	struct timespec now;
+	uint32_t pos, fmt_pos, index;
+	int32_t filled;
+	int res;
+
+	if ((ring = trace_ring_get(impl)) == NULL)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+	rec->time = SPA_TIMESPEC_TO_NSEC(&now);
+	rec->line = line;
+
+	/* the strings are copied, the code they are in can be unloaded
+	 * before the message is formatted */
+	pos = sizeof(*rec);
+	pos += trace_copy_string(buffer + pos, BINARY_TRACE_STRING,
+			topic ? topic->topic : NULL);
+	pos += trace_copy_string(buffer + pos, BINARY_TRACE_STRING, file);
+	pos += trace_copy_string(buffer + pos, BINARY_TRACE_STRING, func);
+	fmt_pos = pos;
+	pos += trace_copy_string(buffer + pos, BINARY_TRACE_MAX / 2, fmt);
+	pos = rec->args = SPA_ROUND_UP_N(pos, 8);
+
+	res = support_log_trace_encode(buffer + pos, sizeof(buffer) - pos, fmt, args);
+	if (SPA_UNLIKELY(res < 0)) {
+		/* can't encode the arguments, store the formatted message */
+		char msg[512];
+
+		spa_vscnprintf(msg, sizeof(msg), fmt, args);
+		pos = fmt_pos + trace_copy_string(buffer + fmt_pos, 3, "%s");
+		pos = rec->args = SPA_ROUND_UP_N(pos, 8);
+		res = support_log_trace_encode_string(buffer + pos,
+				sizeof(buffer) - pos, msg);
+	}
+	rec->size = SPA_ROUND_UP_N(pos + SPA_MAX(res, 0), 8);
+
+	filled = spa_ringbuffer_get_write_index(&ring->rb, &index);
+	if (filled < 0 || filled + rec->size > BINARY_TRACE_BUFFER) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	spa_ringbuffer_write_data(&ring->rb, ring->data, BINARY_TRACE_BUFFER,
+			index & (BINARY_TRACE_BUFFER - 1), rec, rec->size);
+	spa_ringbuffer_write_update(&ring->rb, index + rec->size);
+
+	/* only wake up the trace thread when the ringbuffer gets full, it
+	 * polls the ringbuffers otherwise */
+	if (filled < BINARY_TRACE_BUFFER / 2 &&
+	    filled + rec->size >= BINARY_TRACE_BUFFER / 2)
+		pthread_cond_signal(&impl->trace_cond);
+}
+
+static bool trace_ring_peek(struct trace_ring *ring, struct trace_record *rec)
+{
+	uint32_t index;
+
+	if (spa_ringbuffer_get_read_index(&ring->rb, &index) < (int32_t)sizeof(*rec))
+		return false;
+	spa_ringbuffer_read_data(&ring->rb, ring->data, BINARY_TRACE_BUFFER,
+			index & (BINARY_TRACE_BUFFER - 1), rec, sizeof(*rec));
+	return true;
+}
+
+static const char *trace_next_string(const uint8_t *buffer, uint32_t *pos, uint32_t end)
+{
+	const char *str = (const char *)buffer + *pos;
+	*pos += strnlen(str, end - *pos) + 1;
+	return str;
+}
+
+/* Only called from the trace thread, or after it stopped */
+static void flush_binary_trace(struct impl *impl)
+{
+	uint8_t buffer[BINARY_TRACE_MAX] SPA_ALIGNED(8);
+	struct trace_record *rec = (struct trace_record *)buffer, head;
+	struct trace_ring *ring, *next;
+	struct spa_log_topic topic = SPA_LOG_TOPIC(0, NULL);
+	const char *file, *func, *fmt;
+	char msg[1000];
+	uint32_t i, n_rings, index, dropped, pos;
+	struct timespec time;
+
+	n_rings = __atomic_load_n(&impl->n_trace_rings, __ATOMIC_ACQUIRE);
+
+	while (true) {
+		uint64_t min_time = UINT64_MAX;
+
+		/* find the oldest message of all threads */
+		next = NULL;
+		for (i = 0; i < n_rings; i++) {
+			ring = impl->trace_rings[i];
+			if (trace_ring_peek(ring, &head) && head.time < min_time) {
+				min_time = head.time;
+				next = ring;
+			}
+		}
+		if (next == NULL)
+			break;
+
+		spa_ringbuffer_get_read_index(&next->rb, &index);
+		trace_ring_peek(next, rec);
+		spa_ringbuffer_read_data(&next->rb, next->data, BINARY_TRACE_BUFFER,
+				index & (BINARY_TRACE_BUFFER - 1), buffer,
+				SPA_MIN(rec->size, sizeof(buffer)));
+		spa_ringbuffer_read_update(&next->rb, index + rec->size);
+
+		if (rec->size > sizeof(buffer) || rec->args > rec->size)
+			continue;
+
+		pos = sizeof(*rec);
+		topic.topic = trace_next_string(buffer, &pos, rec->args);
+		file = trace_next_string(buffer, &pos, rec->args);
+		func = trace_next_string(buffer, &pos, rec->args);
+		fmt = trace_next_string(buffer, &pos, rec->args);
+		if (pos > rec->args)
+			continue;
+
+		if (support_log_trace_format(msg, sizeof(msg), fmt,
+				buffer + rec->args, rec->size - rec->args) < 0)
+			continue;
+
+		time.tv_sec = rec->time / SPA_NSEC_PER_SEC;
+		time.tv_nsec = rec->time % SPA_NSEC_PER_SEC;
+		/* TRACE + 1 is printed as a delayed trace message */
+		log_line_fmt(impl, SPA_LOG_LEVEL_TRACE + 1,
+				topic.topic[0] ? &topic : NULL, file,
+				rec->line, func, &time, "%s", msg);
+	}
+
+	for (i = 0; i < n_rings; i++) {
+		ring = impl->trace_rings[i];
+		if ((dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) > 0)
+			log_line_fmt(impl, SPA_LOG_LEVEL_WARN, NULL, __FILE__, __LINE__,
+					__func__, NULL, "%p: %u trace messages dropped",
+					ring, dropped);
+	}
+	if ((dropped = __atomic_exchange_n(&impl->trace_dropped, 0, __ATOMIC_RELAXED)) > 0)
+		log_line_fmt(impl, SPA_LOG_LEVEL_WARN, NULL, __FILE__, __LINE__,
+				__func__, NULL, "%p: %u trace messages dropped, no free ring",
+				impl, dropped);
+}
+
+static void *trace_thread(void *data)
+{
+	struct impl *impl = data;
+	struct timespec timeout;
+
+	pthread_mutex_lock(&impl->trace_lock);
+	while (impl->trace_running) {
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_nsec += BINARY_TRACE_TIMEOUT * SPA_NSEC_PER_MSEC;
+		if (timeout.tv_nsec >= (long)SPA_NSEC_PER_SEC) {
+			timeout.tv_sec++;
+			timeout.tv_nsec -= SPA_NSEC_PER_SEC;
+		}
+		pthread_cond_timedwait(&impl->trace_cond, &impl->trace_lock, &timeout);
+
+		pthread_mutex_unlock(&impl->trace_lock);
+		flush_binary_trace(impl);
+		trace_rings_refill(impl);
+		pthread_mutex_lock(&impl->trace_lock);
+	}
+	pthread_mutex_unlock(&impl->trace_lock);
+	return NULL;
+}
+
+static int start_binary_trace(struct impl *impl)
+{
+	int res;
+
+	if ((res = pthread_key_create(&impl->trace_key, trace_ring_release)) != 0)
+		return -res;
+
+	pthread_mutex_init(&impl->trace_lock, NULL);
+	pthread_cond_init(&impl->trace_cond, NULL);
+	impl->trace_running = true;
+	impl->n_trace_rings = 0;
+	impl->trace_dropped = 0;
+
+	/* make the rings now, the first threads that log are usually the
+	 * main and data loop threads */
+	trace_rings_refill(impl);
+
+	if ((res = pthread_create(&impl->trace_thread, NULL, trace_thread, impl)) != 0) {
+		pthread_cond_destroy(&impl->trace_cond);
+		pthread_mutex_destroy(&impl->trace_lock);
+		pthread_key_delete(impl->trace_key);
+		free_trace_rings(impl);
+		return -res;
+	}
+	impl->binary_trace = true;
+	return 0;
+}
+
+static void stop_binary_trace(struct impl *impl)
+{
+	if (!impl->binary_trace)
+		return;
+
+	pthread_mutex_lock(&impl->trace_lock);
+	impl->trace_running = false;
+	pthread_cond_signal(&impl->trace_cond);
+	pthread_mutex_unlock(&impl->trace_lock);
+	pthread_join(impl->trace_thread, NULL);
+
+	impl->binary_trace = false;
+	flush_binary_trace(impl);
+
+	pthread_key_delete(impl->trace_key);
+	free_trace_rings(impl);
+	pthread_cond_destroy(&impl->trace_cond);
+	pthread_mutex_destroy(&impl->trace_lock);
+}
+
+static SPA_PRINTF_FUNC(7,0) void
+impl_log_logtv(void *object,
+	      enum spa_log_level level,
+	      const struct spa_log_topic *topic,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const char *fmt,
+	      va_list args)
+{
+	struct impl *impl = object;
+
+	if (SPA_UNLIKELY(level == SPA_LOG_LEVEL_TRACE && impl->binary_trace))
+		log_binary_trace(impl, topic, file, line, func, fmt, args);
+	else
+		log_line(impl, level, topic, file, line, func, NULL, fmt, args);
+}
+
 static SPA_PRINTF_FUNC(6,0) void
 impl_log_logv(void *object,
 	      enum spa_log_level level,
@@ -283,6 +664,8 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	stop_binary_trace(this);
+
 	support_log_free_patterns(&this->patterns);
 
 	if (this->have_source) {
@@ -310,6 +693,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct impl *this;
 	struct spa_loop *loop = NULL;
 	const char *str;
+	int res;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -359,6 +743,12 @@ impl_init(const struct spa_handle_factory *factory,
 		}
 		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_PATTERNS)) != NULL)
 			support_log_parse_patterns(&this->patterns, str);
+		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_BINARY_TRACE_THREADS)) != NULL)
+			this->trace_threads = atoi(str);
+		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_BINARY_TRACE)) != NULL &&
+		    spa_atob(str) && (res = start_binary_trace(this)) < 0)
+			fprintf(stderr, "Warning: failed to start binary trace: %s\n",
+					spa_strerror(res));
 	}
 	if (this->file == NULL)
 		this->file = stderr;
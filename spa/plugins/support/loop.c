@@ -38,7 +38,6 @@
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
 #include <spa/utils/type.h>
-#include <spa/utils/ringbuffer.h>
 #include <spa/utils/string.h>
 
 static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.loop");
@@ -51,15 +50,20 @@ static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.loop");
 
 /** \cond */
 
+/* The invoke queue is a ringbuffer with many producers and one consumer.
+ * Producers reserve space by advancing write_index with a CAS, fill in the
+ * item and then set the committed flag. The consumer handles committed items
+ * in order, clears the memory they used and advances read_index. Unused
+ * memory is always zero so that a stale committed flag can't be seen. */
 struct invoke_item {
 	size_t item_size;
 	spa_invoke_func_t func;
 	uint32_t seq;
 	void *data;
 	size_t size;
-	bool block;
+	int *res;
 	void *user_data;
-	int res;
+	uint32_t committed;
 };
 
 static int loop_signal_event(void *object, struct spa_source *source);
@@ -82,8 +86,12 @@ struct impl {
 
 	struct spa_source *wakeup;
 	int ack_fd;
+	int space_fd;
+	pthread_mutex_t block_lock;
 
-	struct spa_ringbuffer buffer;
+	uint32_t read_index;
+	uint32_t write_index;
+	uint32_t n_space_waiters;
 	uint8_t *buffer_data;
 	uint8_t buffer_mem[DATAS_SIZE + MAX_ALIGN];
 
@@ -129,33 +137,57 @@ static int loop_remove_source(void *object, struct spa_source *source)
 	return spa_system_pollfd_del(impl->system, impl->poll_fd, source->fd);
 }
 
+static void clear_item(struct impl *impl, uint32_t index, uint32_t size)
+{
+	uint32_t offset = index & (DATAS_SIZE - 1);
+	uint32_t l0 = SPA_MIN(size, DATAS_SIZE - offset);
+
+	memset(SPA_PTROFF(impl->buffer_data, offset, void), 0, l0);
+	if (size > l0)
+		memset(impl->buffer_data, 0, size - l0);
+}
+
 static void flush_items(struct impl *impl)
 {
-	uint32_t index;
-	int res;
+	uint32_t index, item_size;
+	int res, *item_res;
 
 	impl->flushing = true;
-	while (spa_ringbuffer_get_read_index(&impl->buffer, &index) > 0) {
+	index = impl->read_index;
+	while (true) {
 		struct invoke_item *item;
-		bool block;
 
 		item = SPA_PTROFF(impl->buffer_data, index & (DATAS_SIZE - 1), struct invoke_item);
-		block = item->block;
+		if (!__atomic_load_n(&item->committed, __ATOMIC_ACQUIRE))
+			break;
 
 		spa_log_trace(impl->log, "%p: flush item %p", impl, item);
-		item->res = item->func ? item->func(&impl->loop,
+		res = item->func ? item->func(&impl->loop,
 				true, item->seq, item->data, item->size,
 			   item->user_data) : 0;
 
-		spa_ringbuffer_read_update(&impl->buffer, index + item->item_size);
+		item_res = item->res;
+		item_size = item->item_size;
+		clear_item(impl, index, item_size);
+		index += item_size;
+		__atomic_store_n(&impl->read_index, index, __ATOMIC_SEQ_CST);
 
-		if (block) {
+		if (item_res) {
+			*item_res = res;
 			if ((res = spa_system_eventfd_write(impl->system, impl->ack_fd, 1)) < 0)
 				spa_log_warn(impl->log, "%p: failed to write event fd: %s",
 						impl, spa_strerror(res));
 		}
 	}
 	impl->flushing = false;
+
+	if (__atomic_load_n(&impl->n_space_waiters, __ATOMIC_SEQ_CST) > 0) {
+		uint32_t n_waiters = __atomic_exchange_n(&impl->n_space_waiters, 0, __ATOMIC_SEQ_CST);
+		if (n_waiters > 0 &&
+		    (res = spa_system_eventfd_write(impl->system, impl->space_fd, n_waiters)) < 0)
+			spa_log_warn(impl->log, "%p: failed to write event fd: %s",
+					impl, spa_strerror(res));
+	}
 }
 
 static int
@@ -172,6 +204,63 @@ loop_invoke_inthread(struct impl *impl,
 	return func ? func(&impl->loop, true, seq, data, size, user_data) : 0;
 }
 
+/* Work out where an item of size bytes goes when it is placed at index. Returns
+ * the total number of bytes the item uses in the ringbuffer. */
+static uint32_t layout_item(struct impl *impl, uint32_t index, size_t size, void **data)
+{
+	uint32_t offset, l0, item_size;
+
+	offset = index & (DATAS_SIZE - 1);
+
+	/* l0 is remaining size in ringbuffer, this should always be larger than
+	 * invoke_item, see below */
+	l0 = DATAS_SIZE - offset;
+
+	item_size = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, ITEM_ALIGN);
+
+	if (l0 >= item_size) {
+		/* item + size fit in current ringbuffer idx */
+		*data = SPA_PTROFF(impl->buffer_data, offset + sizeof(struct invoke_item), void);
+		if (l0 < sizeof(struct invoke_item) + item_size) {
+			/* not enough space for next invoke_item, fill up till the end
+			 * so that the next item will be at the start */
+			item_size = l0;
+		}
+	} else {
+		/* item does not fit, place the invoke_item at idx and start the
+		 * data at the start of the ringbuffer */
+		*data = impl->buffer_data;
+		item_size = SPA_ROUND_UP_N(l0 + size, ITEM_ALIGN);
+	}
+	return item_size;
+}
+
+/* only called for blocking invokes, the caller waits for the loop anyway and
+ * the hooks are called like when waiting for the ack_fd */
+static void wait_space(struct impl *impl, uint32_t index, uint32_t item_size)
+{
+	uint64_t count = 1;
+	uint32_t read_index;
+	int res;
+
+	/* register as waiter before checking again, the consumer writes to the
+	 * space_fd for all waiters after it advanced the read_index */
+	__atomic_add_fetch(&impl->n_space_waiters, 1, __ATOMIC_SEQ_CST);
+	read_index = __atomic_load_n(&impl->read_index, __ATOMIC_SEQ_CST);
+	if ((int32_t)(index + item_size - read_index) <= DATAS_SIZE)
+		return;
+
+	spa_log_debug(impl->log, "%p: queue full, waiting for space", impl);
+
+	loop_signal_event(impl, impl->wakeup);
+
+	spa_loop_control_hook_before(&impl->hooks_list);
+	if ((res = spa_system_eventfd_read(impl->system, impl->space_fd, &count)) < 0)
+		spa_log_warn(impl->log, "%p: failed to read event fd: %s",
+				impl, spa_strerror(res));
+	spa_loop_control_hook_after(&impl->hooks_list);
+}
+
 static int
 loop_invoke(void *object,
 	    spa_invoke_func_t func,
@@ -183,77 +272,78 @@ loop_invoke(void *object,
 {
 	struct impl *impl = object;
 	struct invoke_item *item;
-	int res;
-	int32_t filled;
-	uint32_t avail, idx, offset, l0;
+	int res = 0;
+	uint32_t idx, read_index, item_size;
+	void *item_data;
 
 	if (impl->thread == 0 || pthread_equal(impl->thread, pthread_self()))
 		return loop_invoke_inthread(impl, func, seq, data, size, block, user_data);
 
-	filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-	if (filled < 0 || filled > DATAS_SIZE) {
-		spa_log_warn(impl->log, "%p: queue xrun %d", impl, filled);
-		return -EPIPE;
-	}
-	avail = DATAS_SIZE - filled;
-	if (avail < sizeof(struct invoke_item)) {
-		spa_log_warn(impl->log, "%p: queue full %d", impl, avail);
+	if (size > DATAS_SIZE / 4) {
+		spa_log_warn(impl->log, "%p: invoke data too large %zd", impl, size);
 		return -EPIPE;
 	}
-	offset = idx & (DATAS_SIZE - 1);
 
-	/* l0 is remaining size in ringbuffer, this should always be larger than
-	 * invoke_item, see below */
-	l0 = DATAS_SIZE - offset;
+	/* blocking invokes are serialized so that there is only one thread
+	 * waiting for the ack_fd */
+	if (block)
+		pthread_mutex_lock(&impl->block_lock);
+
+	idx = __atomic_load_n(&impl->write_index, __ATOMIC_RELAXED);
+	while (true) {
+		item_size = layout_item(impl, idx, size, &item_data);
+
+		read_index = __atomic_load_n(&impl->read_index, __ATOMIC_ACQUIRE);
+		if ((int32_t)(idx + item_size - read_index) > DATAS_SIZE) {
+			/* a non-blocking invoke can come from a realtime thread
+			 * or from a loop that the target loop is waiting for,
+			 * never wait for space then */
+			if (!block) {
+				spa_log_warn(impl->log, "%p: queue full, need %u", impl,
+						item_size);
+				return -EPIPE;
+			}
+			/* apply back-pressure, wait for the loop to consume
+			 * items and try again */
+			wait_space(impl, idx, item_size);
+			idx = __atomic_load_n(&impl->write_index, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&impl->write_index, &idx, idx + item_size,
+					true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
 
-	item = SPA_PTROFF(impl->buffer_data, offset, struct invoke_item);
+	item = SPA_PTROFF(impl->buffer_data, idx & (DATAS_SIZE - 1), struct invoke_item);
+	item->item_size = item_size;
 	item->func = func;
 	item->seq = seq;
+	item->data = item_data;
 	item->size = size;
-	item->block = block;
+	item->res = block ? &res : NULL;
 	item->user_data = user_data;
-	item->item_size = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, ITEM_ALIGN);
-
-	spa_log_trace(impl->log, "%p: add item %p filled:%d", impl, item, filled);
-
-	if (l0 >= item->item_size) {
-		/* item + size fit in current ringbuffer idx */
-		item->data = SPA_PTROFF(item, sizeof(struct invoke_item), void);
-		if (l0 < sizeof(struct invoke_item) + item->item_size) {
-			/* not enough space for next invoke_item, fill up till the end
-			 * so that the next item will be at the start */
-			item->item_size = l0;
-		}
-	} else {
-		/* item does not fit, place the invoke_item at idx and start the
-		 * data at the start of the ringbuffer */
-		item->data = impl->buffer_data;
-		item->item_size = SPA_ROUND_UP_N(l0 + size, ITEM_ALIGN);
-	}
-	if (avail < item->item_size) {
-		spa_log_warn(impl->log, "%p: queue full %d, need %zd", impl, avail,
-				item->item_size);
-		return -EPIPE;
-	}
 	if (data && size > 0)
-		memcpy(item->data, data, size);
+		memcpy(item_data, data, size);
 
-	spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
+	spa_log_trace(impl->log, "%p: add item %p size:%u", impl, item, item_size);
+
+	__atomic_store_n(&item->committed, 1, __ATOMIC_RELEASE);
 
 	loop_signal_event(impl, impl->wakeup);
 
 	if (block) {
 		uint64_t count = 1;
+		int r;
 
 		spa_loop_control_hook_before(&impl->hooks_list);
 
-		if ((res = spa_system_eventfd_read(impl->system, impl->ack_fd, &count)) < 0)
+		if ((r = spa_system_eventfd_read(impl->system, impl->ack_fd, &count)) < 0)
 			spa_log_warn(impl->log, "%p: failed to read event fd: %s",
-					impl, spa_strerror(res));
+					impl, spa_strerror(r));
 
 		spa_loop_control_hook_after(&impl->hooks_list);
 
-		res = item->res;
+		pthread_mutex_unlock(&impl->block_lock);
 	}
 	else {
 		if (seq != SPA_ID_INVALID)
@@ -761,8 +851,10 @@ static int impl_clear(struct spa_handle *handle)
 
 	process_destroy(impl);
 
+	spa_system_close(impl->system, impl->space_fd);
 	spa_system_close(impl->system, impl->ack_fd);
 	spa_system_close(impl->system, impl->poll_fd);
+	pthread_mutex_destroy(&impl->block_lock);
 
 	return 0;
 }
@@ -826,7 +918,9 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_hook_list_init(&impl->hooks_list);
 
 	impl->buffer_data = SPA_PTR_ALIGN(impl->buffer_mem, MAX_ALIGN, uint8_t);
-	spa_ringbuffer_init(&impl->buffer);
+	memset(impl->buffer_data, 0, DATAS_SIZE);
+	impl->read_index = impl->write_index = 0;
+	impl->n_space_waiters = 0;
 
 	impl->wakeup = loop_add_event(impl, wakeup_func, impl);
 	if (impl->wakeup == NULL) {
@@ -842,10 +936,21 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 	impl->ack_fd = res;
 
+	if ((res = spa_system_eventfd_create(impl->system,
+			SPA_FD_EVENT_SEMAPHORE | SPA_FD_CLOEXEC)) < 0) {
+		spa_log_error(impl->log, "%p: can't create space event: %s",
+				impl, spa_strerror(res));
+		goto error_exit_free_ack;
+	}
+	impl->space_fd = res;
+	pthread_mutex_init(&impl->block_lock, NULL);
+
 	spa_log_debug(impl->log, "%p: initialized", impl);
 
 	return 0;
 
+error_exit_free_ack:
+	spa_system_close(impl->system, impl->ack_fd);
 error_exit_free_wakeup:
 	loop_destroy_source(impl, impl->wakeup);
 error_exit_free_poll:
@@ -0,0 +1,1229 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <endian.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include <linux/io_uring.h>
+
+#include <spa/support/log.h>
+#include <spa/support/system.h>
+#include <spa/support/plugin.h>
+#include <spa/utils/type.h>
+#include <spa/utils/list.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+
+static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.uring-system");
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#  define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
+/* A spa_system where the pollfd is an io_uring instance. Sources are
+ * watched with POLL_ADD requests, multishot for edge triggered sources.
+ *
+ * For nonblocking eventfds made with this system, the poll is linked to a
+ * read of the counter. The value arrives in the completion queue and
+ * eventfd_read() takes it from there without a syscall. All requests that
+ * need to be rearmed after a wakeup are submitted in the same io_uring_enter
+ * that waits for the next events.
+ *
+ * Each pollfd has its own ring and state, protected by a lock of the ring.
+ * The lock is only held for short times, requests are canceled without
+ * waiting for them. */
+
+#define RING_ENTRIES		256
+
+#define FD_CHUNK_SIZE		1024
+#define FD_MAX_CHUNKS		1024
+
+#define OP_POLL			0
+#define OP_READ			1
+#define OP_CANCEL		2
+
+#define UDATA(slot,gen,op)	(((uint64_t)(slot) << 32) | (((gen) & 0xffffffu) << 8) | (op))
+#define UDATA_SLOT(u)		((uint32_t)((u) >> 32))
+#define UDATA_GEN(u)		(((uint32_t)(u) >> 8) & 0xffffffu)
+#define UDATA_OP(u)		((uint32_t)(u) & 0xffu)
+
+struct ring;
+
+struct entry {
+	struct ring *ring;
+	uint32_t slot;
+	uint32_t gen;
+
+	int fd;
+	uint32_t events;
+	void *data;
+
+	uint32_t inflight;		/* requests without a final completion */
+	uint32_t revents;		/* events to report */
+	unsigned int active:1;		/* added to the pollfd */
+	unsigned int prefetch:1;	/* eventfd, the counter is read with the poll */
+	unsigned int armed:1;		/* requests in flight that will report */
+	unsigned int pending:1;		/* in the ready list */
+	unsigned int rearm:1;		/* in the rearm list */
+	unsigned int dup:1;		/* fd is a dup, the entry was removed */
+
+	uint64_t buf;			/* read buffer for the prefetch */
+	uint64_t value;			/* prefetched counter */
+	int error;			/* prefetch read error */
+
+	struct spa_list ready_link;
+	struct spa_list rearm_link;
+};
+
+struct ring {
+	struct spa_list link;
+	int fd;
+
+	pthread_mutex_t lock;
+
+	void *ring_ptr;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_flags;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	uint32_t *sq_array;
+
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+
+	uint32_t to_submit;
+	pthread_t thread;		/* the thread that waits on the ring */
+	unsigned int waiting:1;
+
+	struct entry **slots;
+	uint32_t n_slots;
+	struct entry **by_fd;
+	uint32_t n_by_fd;
+
+	struct spa_list ready;
+	struct spa_list rearm;
+};
+
+struct fd_info {
+	unsigned int eventfd:1;		/* nonblocking eventfd made by us */
+	unsigned int semaphore:1;
+	struct ring *ring;		/* the ring when this is a pollfd */
+	struct ring *owner;		/* the ring that prefetches the counter */
+	struct entry *entry;		/* the prefetching entry, owner->lock */
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_system system;
+        struct spa_log *log;
+
+	pthread_mutex_t lock;		/* the list of rings and fd chunks */
+	struct spa_list rings;
+
+	/* lookups are lock free, chunks are only freed with the handle */
+	struct fd_info *fd_chunks[FD_MAX_CHUNKS];
+};
+
+static inline int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned int to_submit,
+		unsigned int min_complete, unsigned int flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int grow_array(void **array, uint32_t *n_items, size_t item_size, uint32_t index)
+{
+	uint32_t n = SPA_ROUND_UP_N(index + 1, 64);
+	void *a;
+
+	if (index < *n_items)
+		return 0;
+	if ((a = realloc(*array, n * item_size)) == NULL)
+		return -errno;
+	memset(SPA_PTROFF(a, *n_items * item_size, void), 0, (n - *n_items) * item_size);
+	*array = a;
+	*n_items = n;
+	return 0;
+}
+
+static struct fd_info *get_fd_info(struct impl *impl, int fd, bool create)
+{
+	struct fd_info *chunk;
+	uint32_t c;
+
+	if (fd < 0 || (c = fd / FD_CHUNK_SIZE) >= FD_MAX_CHUNKS)
+		return NULL;
+
+	chunk = __atomic_load_n(&impl->fd_chunks[c], __ATOMIC_ACQUIRE);
+	if (chunk == NULL && create) {
+		pthread_mutex_lock(&impl->lock);
+		if ((chunk = impl->fd_chunks[c]) == NULL &&
+		    (chunk = calloc(FD_CHUNK_SIZE, sizeof(struct fd_info))) != NULL)
+			__atomic_store_n(&impl->fd_chunks[c], chunk, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&impl->lock);
+	}
+	return chunk ? &chunk[fd % FD_CHUNK_SIZE] : NULL;
+}
+
+static struct ring *get_ring(struct impl *impl, int fd)
+{
+	struct fd_info *fi = get_fd_info(impl, fd, false);
+	return fi ? __atomic_load_n(&fi->ring, __ATOMIC_ACQUIRE) : NULL;
+}
+
+static struct io_uring_sqe *ring_get_sqe(struct ring *r)
+{
+	uint32_t tail = *r->sq_tail, head;
+	struct io_uring_sqe *sqe;
+
+	head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= r->sq_entries) {
+		/* full, submit what we have */
+		int res = sys_io_uring_enter(r->fd, r->to_submit, 0, 0, NULL, 0);
+		if (res > 0)
+			r->to_submit -= SPA_MIN((uint32_t)res, r->to_submit);
+		head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+		if (tail - head >= r->sq_entries)
+			return NULL;
+	}
+	sqe = &r->sqes[tail & r->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+static void ring_commit_sqe(struct ring *r)
+{
+	uint32_t tail = *r->sq_tail;
+	r->sq_array[tail & r->sq_mask] = tail & r->sq_mask;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->to_submit++;
+}
+
+static int ring_submit(struct ring *r)
+{
+	int res;
+
+	if (r->to_submit == 0)
+		return 0;
+	res = sys_io_uring_enter(r->fd, r->to_submit, 0, 0, NULL, 0);
+	if (res < 0)
+		return -errno;
+	r->to_submit -= SPA_MIN((uint32_t)res, r->to_submit);
+	return 0;
+}
+
+static inline uint32_t io_to_poll(uint32_t events)
+{
+	uint32_t e = events & (SPA_IO_IN | SPA_IO_OUT | SPA_IO_ERR | SPA_IO_HUP);
+#if __BYTE_ORDER == __BIG_ENDIAN
+	e = (e << 16) | (e >> 16);
+#endif
+	return e;
+}
+
+static void entry_add_ready(struct entry *e, uint32_t revents)
+{
+	e->revents |= revents;
+	if (!e->pending) {
+		spa_list_append(&e->ring->ready, &e->ready_link);
+		e->pending = true;
+	}
+}
+
+static void entry_remove_ready(struct entry *e)
+{
+	if (e->pending) {
+		spa_list_remove(&e->ready_link);
+		e->pending = false;
+	}
+	e->revents = 0;
+}
+
+static void entry_queue_rearm(struct entry *e)
+{
+	if (!e->rearm) {
+		spa_list_append(&e->ring->rearm, &e->rearm_link);
+		e->rearm = true;
+	}
+}
+
+static int entry_arm(struct entry *e)
+{
+	struct ring *r = e->ring;
+	struct io_uring_sqe *sqe;
+
+	if (e->armed || !e->active) {
+		if (e->rearm) {
+			spa_list_remove(&e->rearm_link);
+			e->rearm = false;
+		}
+		return 0;
+	}
+	/* canceled requests still use the read buffer, arm when they
+	 * are done */
+	if (e->inflight > 0) {
+		entry_queue_rearm(e);
+		return 0;
+	}
+	if (e->rearm) {
+		spa_list_remove(&e->rearm_link);
+		e->rearm = false;
+	}
+
+	if ((sqe = ring_get_sqe(r)) == NULL)
+		return -EBUSY;
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = e->fd;
+	sqe->poll32_events = io_to_poll(e->prefetch ? SPA_IO_IN : e->events);
+	sqe->user_data = UDATA(e->slot, e->gen, OP_POLL);
+	if (e->prefetch)
+		sqe->flags = IOSQE_IO_LINK;
+	else if (e->events & SPA_IO_ET)
+		sqe->len = IORING_POLL_ADD_MULTI;
+	ring_commit_sqe(r);
+	e->inflight++;
+
+	if (e->prefetch) {
+		if ((sqe = ring_get_sqe(r)) == NULL) {
+			/* the poll will complete without a read and
+			 * we try again after that */
+			e->armed = true;
+			return -EBUSY;
+		}
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = e->fd;
+		sqe->addr = (uintptr_t)&e->buf;
+		sqe->len = sizeof(e->buf);
+		sqe->off = -1;
+		sqe->user_data = UDATA(e->slot, e->gen, OP_READ);
+		ring_commit_sqe(r);
+		e->inflight++;
+	}
+	e->armed = true;
+	return 0;
+}
+
+/* a count that was read but not consumed goes back to the eventfd */
+static void entry_give_back(struct impl *impl, struct entry *e)
+{
+	if (e->value > 0 && e->fd >= 0 &&
+	    write(e->fd, &e->value, sizeof(e->value)) < 0)
+		spa_log_warn(impl->log, "%p: write fd:%d failed: %m", impl, e->fd);
+	e->value = 0;
+}
+
+static void entry_free(struct entry *e)
+{
+	struct ring *r = e->ring;
+	r->slots[e->slot] = NULL;
+	if (e->dup && e->fd >= 0)
+		close(e->fd);
+	free(e);
+}
+
+static void handle_cqe(struct impl *impl, struct ring *r, struct io_uring_cqe *cqe)
+{
+	uint64_t u = cqe->user_data;
+	uint32_t slot = UDATA_SLOT(u);
+	struct entry *e;
+	bool more = cqe->flags & IORING_CQE_F_MORE;
+	bool current;
+
+	if (UDATA_OP(u) == OP_CANCEL)
+		return;
+	if (slot >= r->n_slots || (e = r->slots[slot]) == NULL)
+		return;
+
+	if (!more)
+		e->inflight--;
+
+	/* results of canceled requests are not reported */
+	current = e->active && UDATA_GEN(u) == e->gen;
+
+	switch (UDATA_OP(u)) {
+	case OP_POLL:
+		if (!current)
+			break;
+		if (e->prefetch) {
+			/* the linked read completes next, unless the poll
+			 * failed and the read was canceled. */
+			if (cqe->res < 0 && cqe->res != -ECANCELED)
+				spa_log_warn(impl->log, "%p: poll fd:%d failed: %s",
+						impl, e->fd, spa_strerror(cqe->res));
+			break;
+		}
+		if (cqe->res < 0) {
+			if (cqe->res != -ECANCELED)
+				entry_add_ready(e, SPA_IO_ERR);
+		} else {
+			entry_add_ready(e, cqe->res);
+		}
+		break;
+	case OP_READ:
+		/* a count that was read is never lost, even when the read
+		 * was canceled. It is reported or given back. */
+		if (cqe->res == sizeof(uint64_t)) {
+			e->value += e->buf;
+			if (e->active && e->prefetch)
+				entry_add_ready(e, SPA_IO_IN);
+		} else if (current && cqe->res < 0 && cqe->res != -EAGAIN &&
+		    cqe->res != -ECANCELED) {
+			e->error = cqe->res;
+			entry_add_ready(e, SPA_IO_IN | SPA_IO_ERR);
+		}
+		break;
+	}
+
+	if (e->inflight > 0)
+		return;
+
+	e->armed = false;
+	if (!e->active) {
+		entry_give_back(impl, e);
+		entry_free(e);
+	} else {
+		if (!e->prefetch)
+			entry_give_back(impl, e);
+		/* level triggered polls are reported before they are
+		 * rearmed in the next wait */
+		entry_queue_rearm(e);
+	}
+}
+
+static void ring_reap(struct impl *impl, struct ring *r)
+{
+	uint32_t head, tail;
+
+	/* with cooperative task running, completions are only posted
+	 * when we enter the kernel */
+	if (__atomic_load_n(r->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_TASKRUN)
+		sys_io_uring_enter(r->fd, 0, 0, IORING_ENTER_GETEVENTS, NULL, 0);
+
+	head = *r->cq_head;
+
+	tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		handle_cqe(impl, r, &r->cqes[head & r->cq_mask]);
+		head++;
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* cancel the requests of the entry without waiting for them. Their
+ * completions are not reported anymore and a count that they read
+ * is kept or given back. */
+static void entry_cancel(struct impl *impl, struct entry *e)
+{
+	struct ring *r = e->ring;
+	struct io_uring_sqe *sqe;
+	uint32_t op;
+
+	for (op = OP_POLL; e->inflight > 0 &&
+			op <= (e->prefetch ? OP_READ : OP_POLL); op++) {
+		if ((sqe = ring_get_sqe(r)) == NULL) {
+			spa_log_warn(impl->log, "%p: can't cancel fd:%d, ring is full",
+					impl, e->fd);
+			break;
+		}
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = UDATA(e->slot, e->gen, op);
+		sqe->user_data = UDATA(e->slot, e->gen, OP_CANCEL);
+		ring_commit_sqe(r);
+	}
+	e->armed = false;
+	e->gen++;
+}
+
+/* stop prefetching, eventfd_read() reads from the fd again */
+static void entry_release_fd(struct impl *impl, struct entry *e)
+{
+	struct fd_info *fi;
+
+	if ((fi = get_fd_info(impl, e->fd, false)) != NULL && fi->entry == e) {
+		fi->entry = NULL;
+		__atomic_store_n(&fi->owner, NULL, __ATOMIC_RELEASE);
+	}
+	e->prefetch = false;
+}
+
+static void ring_destroy(struct impl *impl, struct ring *r)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&impl->lock);
+	spa_list_remove(&r->link);
+	pthread_mutex_unlock(&impl->lock);
+
+	for (i = 0; i < r->n_slots; i++) {
+		struct entry *e = r->slots[i];
+		if (e == NULL)
+			continue;
+		if (e->prefetch)
+			entry_release_fd(impl, e);
+		entry_free(e);
+	}
+	free(r->slots);
+	free(r->by_fd);
+	if (r->sqes != NULL && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqes_size);
+	if (r->ring_ptr != NULL && r->ring_ptr != MAP_FAILED)
+		munmap(r->ring_ptr, r->ring_size);
+	pthread_mutex_destroy(&r->lock);
+	free(r);
+}
+
+static ssize_t impl_read(void *object, int fd, void *buf, size_t count)
+{
+	ssize_t res = read(fd, buf, count);
+	return res < 0 ? -errno : res;
+}
+
+static ssize_t impl_write(void *object, int fd, const void *buf, size_t count)
+{
+	ssize_t res = write(fd, buf, count);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_ioctl(void *object, int fd, unsigned long request, ...)
+{
+	int res;
+	va_list ap;
+	long arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, long);
+	res = ioctl(fd, request, arg);
+	va_end(ap);
+
+	return res < 0 ? -errno : res;
+}
+
+static int impl_close(void *object, int fd)
+{
+	struct impl *impl = object;
+	struct fd_info *fi;
+	struct ring *r;
+	int res;
+
+	if ((fi = get_fd_info(impl, fd, false)) != NULL) {
+		if ((r = fi->ring) != NULL) {
+			__atomic_store_n(&fi->ring, NULL, __ATOMIC_RELEASE);
+			ring_destroy(impl, r);
+		}
+		spa_zero(*fi);
+	}
+	res = close(fd);
+
+	spa_log_debug(impl->log, "%p: close fd:%d", impl, fd);
+	return res < 0 ? -errno : res;
+}
+
+/* clock */
+static int impl_clock_gettime(void *object,
+			int clockid, struct timespec *value)
+{
+	int res = clock_gettime(clockid, value);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_clock_getres(void *object,
+			int clockid, struct timespec *res)
+{
+	int r = clock_getres(clockid, res);
+	return r < 0 ? -errno : r;
+}
+
+/* poll */
+static int impl_pollfd_create(void *object, int flags)
+{
+	struct impl *impl = object;
+	struct io_uring_params p;
+	struct fd_info *fi;
+	struct ring *r;
+	uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+		IORING_FEAT_EXT_ARG | IORING_FEAT_RW_CUR_POS;
+	size_t sq_size, cq_size;
+	int res;
+
+	if ((r = calloc(1, sizeof(struct ring))) == NULL)
+		return -errno;
+
+	pthread_mutex_init(&r->lock, NULL);
+	spa_list_init(&r->link);
+	spa_list_init(&r->ready);
+	spa_list_init(&r->rearm);
+
+	/* io_uring fds are always close-on-exec. We only run completions
+	 * when we wait so there is no need to interrupt the thread. */
+	spa_zero(p);
+	p.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+	if ((r->fd = sys_io_uring_setup(RING_ENTRIES, &p)) < 0 && errno == EINVAL) {
+		spa_zero(p);
+		r->fd = sys_io_uring_setup(RING_ENTRIES, &p);
+	}
+	if (r->fd < 0) {
+		res = -errno;
+		spa_log_error(impl->log, "%p: io_uring_setup failed: %m", impl);
+		pthread_mutex_destroy(&r->lock);
+		free(r);
+		return res;
+	}
+	if ((p.features & required) != required) {
+		spa_log_error(impl->log, "%p: io_uring features %08x, need %08x",
+				impl, p.features, required);
+		res = -ENOTSUP;
+		goto error;
+	}
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->ring_size = SPA_MAX(sq_size, cq_size);
+	r->ring_ptr = mmap(NULL, r->ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->ring_ptr == MAP_FAILED) {
+		res = -errno;
+		goto error;
+	}
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		res = -errno;
+		goto error;
+	}
+
+	r->sq_head = SPA_PTROFF(r->ring_ptr, p.sq_off.head, uint32_t);
+	r->sq_tail = SPA_PTROFF(r->ring_ptr, p.sq_off.tail, uint32_t);
+	r->sq_flags = SPA_PTROFF(r->ring_ptr, p.sq_off.flags, uint32_t);
+	r->sq_mask = *SPA_PTROFF(r->ring_ptr, p.sq_off.ring_mask, uint32_t);
+	r->sq_entries = *SPA_PTROFF(r->ring_ptr, p.sq_off.ring_entries, uint32_t);
+	r->sq_array = SPA_PTROFF(r->ring_ptr, p.sq_off.array, uint32_t);
+	r->cq_head = SPA_PTROFF(r->ring_ptr, p.cq_off.head, uint32_t);
+	r->cq_tail = SPA_PTROFF(r->ring_ptr, p.cq_off.tail, uint32_t);
+	r->cq_mask = *SPA_PTROFF(r->ring_ptr, p.cq_off.ring_mask, uint32_t);
+	r->cqes = SPA_PTROFF(r->ring_ptr, p.cq_off.cqes, struct io_uring_cqe);
+
+	if ((fi = get_fd_info(impl, r->fd, true)) == NULL) {
+		res = -ENOMEM;
+		goto error;
+	}
+	pthread_mutex_lock(&impl->lock);
+	spa_list_append(&impl->rings, &r->link);
+	pthread_mutex_unlock(&impl->lock);
+
+	spa_zero(*fi);
+	__atomic_store_n(&fi->ring, r, __ATOMIC_RELEASE);
+
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, r->fd);
+	return r->fd;
+
+error:
+	close(r->fd);
+	r->fd = -1;
+	ring_destroy(impl, r);
+	return res;
+}
+
+static int impl_pollfd_add(void *object, int pfd, int fd, uint32_t events, void *data)
+{
+	struct impl *impl = object;
+	struct ring *r;
+	struct entry *e;
+	struct fd_info *fi;
+	uint32_t slot;
+	int res;
+
+	if ((r = get_ring(impl, pfd)) == NULL)
+		return -EBADF;
+	if (fd < 0)
+		return -EBADF;
+
+	pthread_mutex_lock(&r->lock);
+	if ((uint32_t)fd < r->n_by_fd && r->by_fd[fd] != NULL) {
+		res = -EEXIST;
+		goto done;
+	}
+	if ((res = grow_array((void**)&r->by_fd, &r->n_by_fd,
+					sizeof(struct entry*), fd)) < 0)
+		goto done;
+
+	for (slot = 0; slot < r->n_slots; slot++)
+		if (r->slots[slot] == NULL)
+			break;
+	if ((res = grow_array((void**)&r->slots, &r->n_slots,
+					sizeof(struct entry*), slot)) < 0)
+		goto done;
+
+	if ((e = calloc(1, sizeof(struct entry))) == NULL) {
+		res = -errno;
+		goto done;
+	}
+	e->ring = r;
+	e->slot = slot;
+	e->fd = fd;
+	e->events = events;
+	e->data = data;
+	e->active = true;
+
+	/* only one ring can prefetch the counter of an eventfd */
+	fi = get_fd_info(impl, fd, false);
+	if (fi != NULL && fi->eventfd &&
+	    (events & (SPA_IO_IN | SPA_IO_OUT)) == SPA_IO_IN) {
+		struct ring *owner = NULL;
+		if (__atomic_compare_exchange_n(&fi->owner, &owner, r, false,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			e->prefetch = true;
+			fi->entry = e;
+		}
+	}
+	r->slots[slot] = e;
+	r->by_fd[fd] = e;
+
+	entry_arm(e);
+
+	/* when called from the thread that waits on the ring, the
+	 * requests are submitted with the next wait */
+	if (r->waiting || !pthread_equal(r->thread, pthread_self()))
+		ring_submit(r);
+	res = 0;
+done:
+	pthread_mutex_unlock(&r->lock);
+	return res;
+}
+
+static int impl_pollfd_mod(void *object, int pfd, int fd, uint32_t events, void *data)
+{
+	struct impl *impl = object;
+	struct ring *r;
+	struct entry *e;
+	int res = 0;
+
+	if ((r = get_ring(impl, pfd)) == NULL)
+		return -EBADF;
+
+	pthread_mutex_lock(&r->lock);
+	if (fd < 0 || (uint32_t)fd >= r->n_by_fd || (e = r->by_fd[fd]) == NULL) {
+		res = -ENOENT;
+		goto done;
+	}
+	e->data = data;
+	if (e->events == events)
+		goto done;
+
+	entry_cancel(impl, e);
+	entry_remove_ready(e);
+	e->events = events;
+	if (e->prefetch && (events & (SPA_IO_IN | SPA_IO_OUT)) != SPA_IO_IN) {
+		entry_release_fd(impl, e);
+		/* a count that is still being read is given back when
+		 * the read completes */
+		if (e->inflight == 0)
+			entry_give_back(impl, e);
+	} else if (e->prefetch && e->value > 0) {
+		/* like epoll, report what is readable after a mod */
+		entry_add_ready(e, SPA_IO_IN);
+	}
+	/* the new requests are made when the canceled ones completed */
+	entry_arm(e);
+	if (r->waiting || !pthread_equal(r->thread, pthread_self()))
+		ring_submit(r);
+done:
+	pthread_mutex_unlock(&r->lock);
+	return res;
+}
+
+static int impl_pollfd_del(void *object, int pfd, int fd)
+{
+	struct impl *impl = object;
+	struct ring *r;
+	struct entry *e;
+	int res = 0;
+
+	if ((r = get_ring(impl, pfd)) == NULL)
+		return -EBADF;
+
+	pthread_mutex_lock(&r->lock);
+	if (fd < 0 || (uint32_t)fd >= r->n_by_fd || (e = r->by_fd[fd]) == NULL) {
+		res = -ENOENT;
+		goto done;
+	}
+	entry_cancel(impl, e);
+	entry_remove_ready(e);
+	if (e->rearm) {
+		spa_list_remove(&e->rearm_link);
+		e->rearm = false;
+	}
+	r->by_fd[fd] = NULL;
+	e->active = false;
+
+	if (e->prefetch) {
+		entry_release_fd(impl, e);
+		if (e->inflight > 0) {
+			/* the fd can be closed before the canceled read
+			 * completes, keep the eventfd to give back what it
+			 * reads. The fd might be added to another loop. */
+			if ((e->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0)
+				spa_log_warn(impl->log, "%p: dup fd:%d failed: %m",
+						impl, fd);
+			e->dup = true;
+		}
+	}
+	if (e->inflight == 0) {
+		entry_give_back(impl, e);
+		entry_free(e);
+	} else if (r->waiting || !pthread_equal(r->thread, pthread_self())) {
+		ring_submit(r);
+	}
+done:
+	pthread_mutex_unlock(&r->lock);
+	return res;
+}
+
+static int fill_events(struct ring *r, struct spa_poll_event *ev, int n_ev)
+{
+	struct entry *e, *t;
+	int n = 0;
+
+	spa_list_for_each_safe(e, t, &r->ready, ready_link) {
+		uint32_t revents = e->revents;
+
+		if (n == n_ev)
+			break;
+
+		if (e->prefetch && !(e->events & SPA_IO_ET)) {
+			/* level triggered, report until it is consumed */
+			if (e->value == 0 && e->error == 0) {
+				entry_remove_ready(e);
+				continue;
+			}
+			revents = SPA_IO_IN | (e->error ? SPA_IO_ERR : 0);
+			/* move to the end for fairness */
+			spa_list_remove(&e->ready_link);
+			spa_list_append(&r->ready, &e->ready_link);
+		} else {
+			entry_remove_ready(e);
+		}
+		revents &= e->events | SPA_IO_ERR | SPA_IO_HUP;
+		if (revents == 0)
+			continue;
+
+		ev[n].events = revents;
+		ev[n].data = e->data;
+		n++;
+	}
+	return n;
+}
+
+static int impl_pollfd_wait(void *object, int pfd,
+		struct spa_poll_event *ev, int n_ev, int timeout)
+{
+	struct impl *impl = object;
+	struct ring *r;
+	struct entry *e, *t;
+	struct timespec now;
+	uint64_t deadline = 0;
+	uint32_t to_submit;
+	int res, n;
+
+	if ((r = get_ring(impl, pfd)) == NULL)
+		return -EBADF;
+
+	if (timeout > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		deadline = SPA_TIMESPEC_TO_NSEC(&now) + timeout * SPA_NSEC_PER_MSEC;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	r->thread = pthread_self();
+again:
+	ring_reap(impl, r);
+	spa_list_for_each_safe(e, t, &r->rearm, rearm_link)
+		entry_arm(e);
+	spa_list_for_each_safe(e, t, &r->ready, ready_link) {
+		/* level triggered eventfds that were consumed */
+		if (e->prefetch && !(e->events & SPA_IO_ET) &&
+		    e->value == 0 && e->error == 0)
+			entry_remove_ready(e);
+	}
+
+	to_submit = r->to_submit;
+	r->to_submit = 0;
+
+	if (spa_list_is_empty(&r->ready) && timeout != 0) {
+		struct __kernel_timespec ts;
+		struct io_uring_getevents_arg arg;
+
+		spa_zero(arg);
+		if (timeout > 0) {
+			uint64_t left, nsec;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			nsec = SPA_TIMESPEC_TO_NSEC(&now);
+			left = deadline - SPA_MIN(deadline, nsec);
+			ts.tv_sec = left / SPA_NSEC_PER_SEC;
+			ts.tv_nsec = left % SPA_NSEC_PER_SEC;
+			arg.ts = (uintptr_t)&ts;
+		}
+		r->waiting = true;
+		pthread_mutex_unlock(&r->lock);
+
+		res = sys_io_uring_enter(r->fd, to_submit, 1,
+				IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+				&arg, sizeof(arg));
+		if (res < 0)
+			res = -errno;
+
+		pthread_mutex_lock(&r->lock);
+		r->waiting = false;
+	} else {
+		res = to_submit ? sys_io_uring_enter(r->fd, to_submit, 0, 0, NULL, 0) : 0;
+		if (res < 0)
+			res = -errno;
+	}
+	/* a failed or interrupted submit leaves the requests in the queue */
+	if (res < 0 || (uint32_t)res < to_submit)
+		r->to_submit += to_submit - SPA_MAX(res, 0);
+
+	ring_reap(impl, r);
+	n = fill_events(r, ev, n_ev);
+
+	/* woken up by completions that report nothing, like those of
+	 * canceled requests. Make the new requests and wait for the time
+	 * that is left. */
+	if (n == 0 && res >= 0 && timeout != 0)
+		goto again;
+	pthread_mutex_unlock(&r->lock);
+
+	if (n == 0 && res < 0 && res != -ETIME)
+		return res;
+	return n;
+}
+
+/* timers */
+static int impl_timerfd_create(void *object, int clockid, int flags)
+{
+	struct impl *impl = object;
+	int fl = 0, res;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= TFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= TFD_NONBLOCK;
+	res = timerfd_create(clockid, fl);
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_timerfd_settime(void *object,
+			int fd, int flags,
+			const struct itimerspec *new_value,
+			struct itimerspec *old_value)
+{
+	int fl = 0, res;
+	if (flags & SPA_FD_TIMER_ABSTIME)
+		fl |= TFD_TIMER_ABSTIME;
+	if (flags & SPA_FD_TIMER_CANCEL_ON_SET)
+		fl |= TFD_TIMER_CANCEL_ON_SET;
+	res = timerfd_settime(fd, fl, new_value, old_value);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_timerfd_gettime(void *object,
+			int fd, struct itimerspec *curr_value)
+{
+	int res = timerfd_gettime(fd, curr_value);
+	return res < 0 ? -errno : res;
+
+}
+static int impl_timerfd_read(void *object, int fd, uint64_t *expirations)
+{
+	if (read(fd, expirations, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+/* events */
+static int impl_eventfd_create(void *object, int flags)
+{
+	struct impl *impl = object;
+	struct fd_info *fi;
+	int fl = 0, res;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= EFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= EFD_NONBLOCK;
+	if (flags & SPA_FD_EVENT_SEMAPHORE)
+		fl |= EFD_SEMAPHORE;
+	res = eventfd(0, fl);
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+	if (res < 0)
+		return -errno;
+
+	/* a blocking read could race with our read of the counter so
+	 * we only read nonblocking eventfds */
+	if (flags & SPA_FD_NONBLOCK &&
+	    (fi = get_fd_info(impl, res, true)) != NULL) {
+		spa_zero(*fi);
+		fi->eventfd = true;
+		fi->semaphore = SPA_FLAG_IS_SET(flags, SPA_FD_EVENT_SEMAPHORE);
+	}
+	return res;
+}
+
+static int impl_eventfd_write(void *object, int fd, uint64_t count)
+{
+	if (write(fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+static int impl_eventfd_read(void *object, int fd, uint64_t *count)
+{
+	struct impl *impl = object;
+	struct fd_info *fi;
+	struct ring *r;
+	struct entry *e;
+	int res = 1;
+
+	/* only the lock of the ring that prefetches the counter is taken,
+	 * this is usually the ring of the calling thread */
+	if ((fi = get_fd_info(impl, fd, false)) != NULL &&
+	    (r = __atomic_load_n(&fi->owner, __ATOMIC_ACQUIRE)) != NULL) {
+		pthread_mutex_lock(&r->lock);
+		if ((e = fi->entry) != NULL && e->ring == r) {
+			if (e->value == 0 && e->error == 0)
+				ring_reap(impl, r);
+			if (e->error < 0) {
+				res = e->error;
+				e->error = 0;
+			} else if (e->value > 0) {
+				*count = fi->semaphore ? 1 : e->value;
+				e->value -= *count;
+				res = 0;
+			}
+		}
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	if (res <= 0)
+		return res;
+
+	/* not prefetched, or nothing was read yet */
+	if (read(fd, count, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+/* signals */
+static int impl_signalfd_create(void *object, int signal, int flags)
+{
+	struct impl *impl = object;
+	sigset_t mask;
+	int res, fl = 0;
+
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= SFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= SFD_NONBLOCK;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, signal);
+	res = signalfd(-1, &mask, fl);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+
+	return res < 0 ? -errno : res;
+}
+
+static int impl_signalfd_read(void *object, int fd, int *signal)
+{
+	struct signalfd_siginfo signal_info;
+	int len;
+
+	len = read(fd, &signal_info, sizeof signal_info);
+	if (!(len == -1 && errno == EAGAIN) && len != sizeof signal_info)
+		return -errno;
+
+	*signal = signal_info.ssi_signo;
+
+	return 0;
+}
+
+static const struct spa_system_methods impl_system = {
+	SPA_VERSION_SYSTEM_METHODS,
+	.read = impl_read,
+	.write = impl_write,
+	.ioctl = impl_ioctl,
+	.close = impl_close,
+	.clock_gettime = impl_clock_gettime,
+	.clock_getres = impl_clock_getres,
+	.pollfd_create = impl_pollfd_create,
+	.pollfd_add = impl_pollfd_add,
+	.pollfd_mod = impl_pollfd_mod,
+	.pollfd_del = impl_pollfd_del,
+	.pollfd_wait = impl_pollfd_wait,
+	.timerfd_create = impl_timerfd_create,
+	.timerfd_settime = impl_timerfd_settime,
+	.timerfd_gettime = impl_timerfd_gettime,
+	.timerfd_read = impl_timerfd_read,
+	.eventfd_create = impl_eventfd_create,
+	.eventfd_write = impl_eventfd_write,
+	.eventfd_read = impl_eventfd_read,
+	.signalfd_create = impl_signalfd_create,
+	.signalfd_read = impl_signalfd_read,
+};
+
+static int impl_get_interface(struct spa_handle *handle, const char *type, void **interface)
+{
+	struct impl *impl;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+
+	if (spa_streq(type, SPA_TYPE_INTERFACE_System))
+		*interface = &impl->system;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *impl;
+	struct ring *r;
+	uint32_t i;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+
+	spa_list_consume(r, &impl->rings, link) {
+		close(r->fd);
+		ring_destroy(impl, r);
+	}
+	for (i = 0; i < FD_MAX_CHUNKS; i++)
+		free(impl->fd_chunks[i]);
+	pthread_mutex_destroy(&impl->lock);
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *impl;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	impl = (struct impl *) handle;
+	impl->system.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_System,
+			SPA_VERSION_SYSTEM,
+			&impl_system, impl);
+
+	impl->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	spa_log_topic_init(impl->log, &log_topic);
+
+	pthread_mutex_init(&impl->lock, NULL);
+	spa_list_init(&impl->rings);
+
+	spa_log_debug(impl->log, "%p: initialized", impl);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_System,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	if (*index >= SPA_N_ELEMENTS(impl_interfaces))
+		return 0;
+
+	*info = &impl_interfaces[(*index)++];
+	return 1;
+}
+
+const struct spa_handle_factory spa_support_uring_system_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_SUPPORT_SYSTEM,
+	NULL,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info
+};
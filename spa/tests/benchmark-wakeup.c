@@ -0,0 +1,148 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <spa/utils/defs.h>
+
+#define MAX_COUNT 100000
+
+/* Measures the cost of waking up a peer node through an eventfd, the way
+ * nodes in the graph signal each other. In level triggered mode the woken
+ * up side needs to read the eventfd, in edge triggered mode it does not. */
+
+struct peer {
+	int epfd;
+	int fd;
+	struct peer *other;
+	bool edge;
+};
+
+static void peer_init(struct peer *p, bool edge)
+{
+	struct epoll_event ev;
+
+	p->edge = edge;
+	p->epfd = epoll_create1(EPOLL_CLOEXEC);
+	p->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	spa_assert_se(p->epfd >= 0 && p->fd >= 0);
+
+	spa_zero(ev);
+	ev.events = EPOLLIN | (edge ? EPOLLET : 0);
+	ev.data.ptr = p;
+	spa_assert_se(epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->fd, &ev) == 0);
+}
+
+static void peer_clear(struct peer *p)
+{
+	close(p->fd);
+	close(p->epfd);
+}
+
+static void peer_wait(struct peer *p)
+{
+	struct epoll_event ev;
+	uint64_t count;
+	int res;
+
+	do {
+		res = epoll_wait(p->epfd, &ev, 1, -1);
+	} while (res < 0 && errno == EINTR);
+	spa_assert_se(res == 1);
+
+	if (!p->edge)
+		spa_assert_se(read(p->fd, &count, sizeof(count)) == sizeof(count));
+}
+
+static void peer_signal(struct peer *p)
+{
+	uint64_t count = 1;
+	spa_assert_se(write(p->other->fd, &count, sizeof(count)) == sizeof(count));
+}
+
+static void *peer_thread(void *arg)
+{
+	struct peer *p = arg;
+	int i;
+
+	for (i = 0; i < MAX_COUNT; i++) {
+		peer_wait(p);
+		peer_signal(p);
+	}
+	return NULL;
+}
+
+static void test_wakeup(bool edge)
+{
+	struct peer a, b;
+	pthread_t thread;
+	struct timespec ts;
+	uint64_t t1, t2;
+	int i;
+
+	peer_init(&a, edge);
+	peer_init(&b, edge);
+	a.other = &b;
+	b.other = &a;
+
+	pthread_create(&thread, NULL, peer_thread, &b);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	for (i = 0; i < MAX_COUNT; i++) {
+		peer_signal(&a);
+		peer_wait(&a);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	pthread_join(thread, NULL);
+
+	fprintf(stderr, "%s: elapsed %"PRIu64" count %u = %"PRIu64" nsec/wakeup, %d syscalls/wakeup\n",
+			edge ? "edge triggered " : "level triggered",
+			t2 - t1, MAX_COUNT, (t2 - t1) / (2 * MAX_COUNT), edge ? 2 : 3);
+
+	peer_clear(&a);
+	peer_clear(&b);
+}
+
+int main(int argc, char *argv[])
+{
+	/* warmup */
+	test_wakeup(false);
+
+	test_wakeup(false);
+	test_wakeup(true);
+
+	return 0;
+}
@@ -0,0 +1,264 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/loop.h>
+#include <spa/support/system.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/type.h>
+
+#define MAX_THREADS	8
+#define MAX_INVOKES	200000
+#define BLOCK_EVERY	1000
+
+/* Many threads invoke on one loop at the same time. Each invoke carries the
+ * thread id, a sequence number and some padding so that items of different
+ * sizes wrap around the queue. The loop checks that the invokes of each
+ * thread arrive exactly once and in order. */
+
+struct data {
+	struct spa_support support[2];
+	uint32_t n_support;
+
+	struct spa_system *system;
+	struct spa_loop *loop;
+	struct spa_loop_control *control;
+
+	pthread_t loop_thread;
+	sem_t started;
+	bool running;
+
+	uint32_t n_threads;
+	uint32_t next_seq[MAX_THREADS];
+	uint32_t n_blocking;
+	uint32_t n_full;
+	uint32_t errors;
+};
+
+struct invoke_msg {
+	uint32_t thread;
+	uint32_t seq;
+	uint8_t pad[120];
+};
+
+struct producer {
+	struct data *data;
+	uint32_t id;
+	pthread_t thread;
+};
+
+static int load_handle(struct data *data, struct spa_handle **handle, const char *lib, const char *name)
+{
+	const char *dir;
+	char path[PATH_MAX];
+	void *hnd;
+	spa_handle_factory_enum_func_t enum_func;
+	uint32_t i;
+	int res;
+
+	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL) {
+		printf("SPA_PLUGIN_DIR is not set\n");
+		return -ENOENT;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", dir, lib);
+	if ((hnd = dlopen(path, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", path, dlerror());
+		return -ENOENT;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return -ENOENT;
+	}
+
+	for (i = 0;;) {
+		const struct spa_handle_factory *factory;
+
+		if ((res = enum_func(&factory, &i)) <= 0) {
+			if (res != 0)
+				printf("can't enumerate factories: %s\n", spa_strerror(res));
+			break;
+		}
+		if (!spa_streq(factory->name, name))
+			continue;
+
+		*handle = calloc(1, spa_handle_factory_get_size(factory, NULL));
+		if ((res = spa_handle_factory_init(factory, *handle,
+						NULL, data->support, data->n_support)) < 0) {
+			printf("can't make factory instance: %d\n", res);
+			return res;
+		}
+		return 0;
+	}
+	return -EBADF;
+}
+
+static int do_check(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	const struct invoke_msg *msg = data;
+
+	if (size != sizeof(*msg) - (msg->seq % sizeof(msg->pad)) ||
+	    msg->thread >= d->n_threads ||
+	    msg->seq != d->next_seq[msg->thread]) {
+		__atomic_add_fetch(&d->errors, 1, __ATOMIC_SEQ_CST);
+		return -EINVAL;
+	}
+	d->next_seq[msg->thread]++;
+	return (int)msg->seq;
+}
+
+static void *producer_start(void *arg)
+{
+	struct producer *p = arg;
+	struct data *d = p->data;
+	struct invoke_msg msg;
+	uint32_t i;
+	int res;
+
+	spa_zero(msg);
+	msg.thread = p->id;
+
+	for (i = 0; i < MAX_INVOKES; i++) {
+		bool block = (i % BLOCK_EVERY) == BLOCK_EVERY - 1;
+
+		msg.seq = i;
+		/* a non-blocking invoke fails when the queue is full, try
+		 * again after the loop had a chance to flush */
+		while ((res = spa_loop_invoke(d->loop, do_check, 0, &msg,
+				sizeof(msg) - (i % sizeof(msg.pad)), block, d)) == -EPIPE &&
+		    !block) {
+			__atomic_add_fetch(&d->n_full, 1, __ATOMIC_SEQ_CST);
+			sched_yield();
+		}
+		if (block) {
+			if (res != (int)i)
+				__atomic_add_fetch(&d->errors, 1, __ATOMIC_SEQ_CST);
+			__atomic_add_fetch(&d->n_blocking, 1, __ATOMIC_SEQ_CST);
+		} else if (res < 0) {
+			printf("invoke failed: %s\n", spa_strerror(res));
+			__atomic_add_fetch(&d->errors, 1, __ATOMIC_SEQ_CST);
+		}
+	}
+	return NULL;
+}
+
+static void *loop_start(void *arg)
+{
+	struct data *d = arg;
+
+	spa_loop_control_enter(d->control);
+	sem_post(&d->started);
+	while (d->running)
+		spa_loop_control_iterate(d->control, -1);
+	spa_loop_control_leave(d->control);
+	return NULL;
+}
+
+static int do_stop(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	d->running = false;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data;
+	struct spa_handle *handle;
+	struct producer producers[MAX_THREADS];
+	struct timespec start, stop;
+	uint32_t i, total = 0;
+	void *iface;
+	int res;
+
+	spa_zero(data);
+	data.n_threads = MAX_THREADS;
+	if (argc > 1)
+		data.n_threads = SPA_CLAMP(atoi(argv[1]), 1, MAX_THREADS);
+
+	if ((res = load_handle(&data, &handle, "support/libspa-support.so",
+					SPA_NAME_SUPPORT_SYSTEM)) < 0)
+		return -res;
+	spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_System, &iface);
+	data.system = iface;
+	data.support[data.n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_System, data.system);
+
+	if ((res = load_handle(&data, &handle, "support/libspa-support.so",
+					SPA_NAME_SUPPORT_LOOP)) < 0)
+		return -res;
+	spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_Loop, &iface);
+	data.loop = iface;
+	spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_LoopControl, &iface);
+	data.control = iface;
+
+	printf("starting loop invoke stress test with %u threads\n", data.n_threads);
+
+	/* make sure the loop thread is running before starting the producers
+	 * or the invokes would be done from the producer threads */
+	sem_init(&data.started, 0, 0);
+	data.running = true;
+	pthread_create(&data.loop_thread, NULL, loop_start, &data);
+	sem_wait(&data.started);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < data.n_threads; i++) {
+		producers[i].data = &data;
+		producers[i].id = i;
+		pthread_create(&producers[i].thread, NULL, producer_start, &producers[i]);
+	}
+	for (i = 0; i < data.n_threads; i++)
+		pthread_join(producers[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	spa_loop_invoke(data.loop, do_stop, 0, NULL, 0, true, &data);
+	pthread_join(data.loop_thread, NULL);
+
+	for (i = 0; i < data.n_threads; i++) {
+		if (data.next_seq[i] != MAX_INVOKES)
+			data.errors++;
+		total += data.next_seq[i];
+	}
+
+	printf("invokes %u (blocking %u, queue full %u) errors %u in %f secs\n", total,
+			data.n_blocking, data.n_full, data.errors,
+			(stop.tv_sec - start.tv_sec) +
+			(stop.tv_nsec - start.tv_nsec) / 1e9);
+
+	return data.errors == 0 ? 0 : 1;
+}
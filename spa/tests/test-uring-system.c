@@ -0,0 +1,350 @@
+/* Spa
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/system.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/type.h>
+
+/* Drives the io_uring system through the spa_system interface: sources
+ * are added, modified and removed while counts are in flight and no count
+ * of an eventfd may be lost or reported twice. */
+
+#define SKIP	77
+
+static struct spa_system *load_system(struct spa_handle **handle)
+{
+	const char *dir;
+	char path[PATH_MAX];
+	void *hnd, *iface;
+	spa_handle_factory_enum_func_t enum_func;
+	const struct spa_handle_factory *factory;
+	uint32_t i;
+
+	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL) {
+		printf("SPA_PLUGIN_DIR is not set\n");
+		return NULL;
+	}
+	snprintf(path, sizeof(path), "%s/support/libspa-uring.so", dir);
+	if ((hnd = dlopen(path, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", path, dlerror());
+		return NULL;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return NULL;
+	}
+	for (i = 0; enum_func(&factory, &i) > 0;) {
+		if (!spa_streq(factory->name, SPA_NAME_SUPPORT_SYSTEM))
+			continue;
+		*handle = calloc(1, spa_handle_factory_get_size(factory, NULL));
+		spa_assert_se(*handle != NULL);
+		spa_assert_se(spa_handle_factory_init(factory, *handle, NULL, NULL, 0) == 0);
+		spa_assert_se(spa_handle_get_interface(*handle,
+					SPA_TYPE_INTERFACE_System, &iface) == 0);
+		return iface;
+	}
+	return NULL;
+}
+
+static int wait_events(struct spa_system *s, int pfd, struct spa_poll_event *ev,
+		int n_ev, int timeout)
+{
+	int res;
+	do {
+		res = spa_system_pollfd_wait(s, pfd, ev, n_ev, timeout);
+	} while (res == -EINTR);
+	spa_assert_se(res >= 0);
+	return res;
+}
+
+static void test_level(struct spa_system *s, int pfd)
+{
+	struct spa_poll_event ev[4];
+	uint64_t count;
+	int fd, marker;
+
+	fd = spa_system_eventfd_create(s, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	spa_assert_se(fd >= 0);
+	spa_assert_se(spa_system_pollfd_add(s, pfd, fd, SPA_IO_IN, &marker) == 0);
+	spa_assert_se(spa_system_pollfd_add(s, pfd, fd, SPA_IO_IN, &marker) == -EEXIST);
+
+	spa_assert_se(wait_events(s, pfd, ev, 4, 0) == 0);
+
+	spa_assert_se(spa_system_eventfd_write(s, fd, 3) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(ev[0].data == &marker);
+	spa_assert_se(ev[0].events == SPA_IO_IN);
+
+	/* not consumed, reported again */
+	spa_assert_se(wait_events(s, pfd, ev, 4, 0) == 1);
+	spa_assert_se(spa_system_eventfd_write(s, fd, 2) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+
+	/* wait until both counts are read, they are added up */
+	spa_assert_se(spa_system_eventfd_read(s, fd, &count) == 0);
+	if (count == 3) {
+		spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+		spa_assert_se(spa_system_eventfd_read(s, fd, &count) == 0);
+		spa_assert_se(count == 2);
+	} else {
+		spa_assert_se(count == 5);
+	}
+	spa_assert_se(wait_events(s, pfd, ev, 4, 0) == 0);
+	spa_assert_se(spa_system_eventfd_read(s, fd, &count) == -EAGAIN);
+
+	spa_assert_se(spa_system_pollfd_del(s, pfd, fd) == 0);
+	spa_assert_se(spa_system_pollfd_del(s, pfd, fd) == -ENOENT);
+	spa_system_close(s, fd);
+}
+
+static void test_edge(struct spa_system *s, int pfd)
+{
+	struct spa_poll_event ev[4];
+	uint64_t count;
+	int fd, marker;
+
+	fd = spa_system_eventfd_create(s, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	spa_assert_se(fd >= 0);
+	spa_assert_se(spa_system_pollfd_add(s, pfd, fd, SPA_IO_IN | SPA_IO_ET, &marker) == 0);
+
+	spa_assert_se(spa_system_eventfd_write(s, fd, 1) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(ev[0].data == &marker);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 0) == 0);
+
+	spa_assert_se(spa_system_eventfd_write(s, fd, 1) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(spa_system_eventfd_read(s, fd, &count) == 0);
+	if (count == 1) {
+		spa_assert_se(spa_system_eventfd_read(s, fd, &count) == 0);
+		spa_assert_se(count == 1);
+	} else {
+		spa_assert_se(count == 2);
+	}
+
+	spa_assert_se(spa_system_pollfd_del(s, pfd, fd) == 0);
+	spa_system_close(s, fd);
+}
+
+static void test_mod(struct spa_system *s, int pfd)
+{
+	struct spa_poll_event ev[4];
+	uint64_t count;
+	int fd, marker1, marker2;
+
+	fd = spa_system_eventfd_create(s, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	spa_assert_se(fd >= 0);
+	spa_assert_se(spa_system_pollfd_mod(s, pfd, fd, SPA_IO_IN, &marker1) == -ENOENT);
+	spa_assert_se(spa_system_pollfd_add(s, pfd, fd, SPA_IO_IN, &marker1) == 0);
+
+	spa_assert_se(spa_system_eventfd_write(s, fd, 5) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(ev[0].data == &marker1);
+
+	/* only the data changes */
+	spa_assert_se(spa_system_pollfd_mod(s, pfd, fd, SPA_IO_IN, &marker2) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(ev[0].data == &marker2);
+
+	/* the count stays when switching to edge triggered */
+	spa_assert_se(spa_system_pollfd_mod(s, pfd, fd, SPA_IO_IN | SPA_IO_ET, &marker1) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(ev[0].data == &marker1);
+
+	/* the count is given back to the eventfd when it is no longer
+	 * prefetched */
+	spa_assert_se(spa_system_pollfd_mod(s, pfd, fd, SPA_IO_IN | SPA_IO_OUT, &marker2) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(ev[0].data == &marker2);
+	spa_assert_se(ev[0].events == (SPA_IO_IN | SPA_IO_OUT));
+
+	spa_assert_se(spa_system_eventfd_read(s, fd, &count) == 0);
+	spa_assert_se(count == 5);
+
+	spa_assert_se(spa_system_pollfd_del(s, pfd, fd) == 0);
+	spa_system_close(s, fd);
+}
+
+/* remove an eventfd while its read is in flight and add it to another
+ * ring, the count must arrive there */
+static void test_del(struct spa_system *s, int pfd1, int pfd2)
+{
+	struct spa_poll_event ev[4];
+	uint64_t count, total;
+	int fd, i, marker;
+
+	fd = spa_system_eventfd_create(s, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	spa_assert_se(fd >= 0);
+
+	for (i = 0; i < 100; i++) {
+		spa_assert_se(spa_system_pollfd_add(s, pfd1, fd, SPA_IO_IN, &marker) == 0);
+		spa_assert_se(wait_events(s, pfd1, ev, 4, 0) == 0);
+		if (i & 1)
+			spa_assert_se(spa_system_eventfd_write(s, fd, 7) == 0);
+		spa_assert_se(spa_system_pollfd_del(s, pfd1, fd) == 0);
+		if (!(i & 1))
+			spa_assert_se(spa_system_eventfd_write(s, fd, 7) == 0);
+		/* reap the canceled requests */
+		wait_events(s, pfd1, ev, 4, 0);
+
+		spa_assert_se(spa_system_pollfd_add(s, pfd2, fd, SPA_IO_IN, &marker) == 0);
+		for (total = 0; total < 7;) {
+			spa_assert_se(wait_events(s, pfd2, ev, 4, 1000) == 1);
+			spa_assert_se(spa_system_eventfd_read(s, fd, &count) == 0);
+			total += count;
+		}
+		spa_assert_se(total == 7);
+		spa_assert_se(wait_events(s, pfd2, ev, 4, 0) == 0);
+		spa_assert_se(spa_system_pollfd_del(s, pfd2, fd) == 0);
+	}
+
+	/* remove and close while the read is in flight */
+	spa_assert_se(spa_system_pollfd_add(s, pfd1, fd, SPA_IO_IN, &marker) == 0);
+	spa_assert_se(wait_events(s, pfd1, ev, 4, 0) == 0);
+	spa_assert_se(spa_system_pollfd_del(s, pfd1, fd) == 0);
+	spa_system_close(s, fd);
+	wait_events(s, pfd1, ev, 4, 10);
+}
+
+static void test_timer(struct spa_system *s, int pfd)
+{
+	struct spa_poll_event ev[4];
+	struct itimerspec its;
+	uint64_t expirations;
+	int fd, marker;
+
+	fd = spa_system_timerfd_create(s, CLOCK_MONOTONIC, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	spa_assert_se(fd >= 0);
+	spa_assert_se(spa_system_pollfd_add(s, pfd, fd, SPA_IO_IN, &marker) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 0) == 0);
+
+	spa_zero(its);
+	its.it_value.tv_nsec = 1000000;
+	spa_assert_se(spa_system_timerfd_settime(s, fd, 0, &its, NULL) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(ev[0].data == &marker);
+	spa_assert_se(ev[0].events == SPA_IO_IN);
+
+	/* level triggered, reported until read */
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(spa_system_timerfd_read(s, fd, &expirations) == 0);
+	spa_assert_se(expirations == 1);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 0) == 0);
+
+	/* a periodic timer on an edge triggered source */
+	spa_assert_se(spa_system_pollfd_mod(s, pfd, fd, SPA_IO_IN | SPA_IO_ET, &marker) == 0);
+	its.it_interval.tv_nsec = 1000000;
+	spa_assert_se(spa_system_timerfd_settime(s, fd, 0, &its, NULL) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(spa_system_timerfd_read(s, fd, &expirations) == 0);
+	spa_assert_se(wait_events(s, pfd, ev, 4, 1000) == 1);
+	spa_assert_se(spa_system_timerfd_read(s, fd, &expirations) == 0);
+	spa_assert_se(expirations >= 1);
+
+	spa_assert_se(spa_system_pollfd_del(s, pfd, fd) == 0);
+	spa_system_close(s, fd);
+}
+
+struct waiter {
+	struct spa_system *system;
+	int pfd;
+	struct spa_poll_event ev;
+	int res;
+};
+
+static void *waiter_start(void *arg)
+{
+	struct waiter *w = arg;
+	w->res = wait_events(w->system, w->pfd, &w->ev, 1, 5000);
+	return NULL;
+}
+
+/* add a source from another thread while the ring is waited on */
+static void test_thread(struct spa_system *s, int pfd)
+{
+	struct waiter w = { .system = s, .pfd = pfd };
+	pthread_t thread;
+	uint64_t count;
+	int fd, marker;
+
+	fd = spa_system_eventfd_create(s, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	spa_assert_se(fd >= 0);
+
+	spa_assert_se(pthread_create(&thread, NULL, waiter_start, &w) == 0);
+	usleep(10000);
+	spa_assert_se(spa_system_pollfd_add(s, pfd, fd, SPA_IO_IN, &marker) == 0);
+	spa_assert_se(spa_system_eventfd_write(s, fd, 1) == 0);
+	pthread_join(thread, NULL);
+
+	spa_assert_se(w.res == 1);
+	spa_assert_se(w.ev.data == &marker);
+	spa_assert_se(spa_system_eventfd_read(s, fd, &count) == 0);
+	spa_assert_se(count == 1);
+
+	spa_assert_se(spa_system_pollfd_del(s, pfd, fd) == 0);
+	spa_system_close(s, fd);
+}
+
+int main(int argc, char *argv[])
+{
+	struct spa_handle *handle = NULL;
+	struct spa_system *s;
+	int pfd1, pfd2;
+
+	if ((s = load_system(&handle)) == NULL)
+		return SKIP;
+
+	if ((pfd1 = spa_system_pollfd_create(s, SPA_FD_CLOEXEC)) < 0) {
+		printf("can't create io_uring: %s\n", spa_strerror(pfd1));
+		return SKIP;
+	}
+	pfd2 = spa_system_pollfd_create(s, SPA_FD_CLOEXEC);
+	spa_assert_se(pfd2 >= 0);
+
+	test_level(s, pfd1);
+	test_edge(s, pfd1);
+	test_mod(s, pfd1);
+	test_del(s, pfd1, pfd2);
+	test_timer(s, pfd1);
+	test_thread(s, pfd2);
+
+	spa_system_close(s, pfd1);
+	spa_system_close(s, pfd2);
+	spa_handle_clear(handle);
+	free(handle);
+
+	return 0;
+}
@@ -34,6 +34,7 @@
 #include <spa/utils/result.h>
 
 #include <pipewire/impl.h>
+#include <pipewire/private.h>
 
 #include "modules/spa/spa-node.h"
 #include "module-adapter/adapter.h"
@@ -188,6 +189,9 @@ static void *create_object(void *_data,
 				pw_impl_client_get_info(client)->id);
 	}
 
+	/* the follower and the adapter need to run on the same data loop */
+	pw_context_assign_data_loop(d->context, properties);
+
 	follower = NULL;
 	str = pw_properties_get(properties, "adapt.follower.node");
 	if (str != NULL) {
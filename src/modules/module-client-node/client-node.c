@@ -127,6 +127,7 @@ struct node {
 	struct pw_impl_client *client;
 
 	struct spa_source data_source;
+	uint32_t wakeups;
 	int writefd;
 
 	uint32_t n_inputs;
@@ -1139,15 +1140,15 @@ static void node_on_data_fd_events(struct spa_source *source)
 	}
 
 	if (source->rmask & SPA_IO_IN) {
-		uint64_t cmd;
+		uint64_t missed;
 		struct pw_impl_node *node = this->impl->this.node;
 
-		if (SPA_UNLIKELY(spa_system_eventfd_read(this->data_system,
-					this->data_source.fd, &cmd) < 0))
+		if (SPA_UNLIKELY(pw_impl_node_read_wakeups(this->data_system, source,
+					&this->wakeups, &missed) < 0))
 			pw_log_warn("%p: read failed %m", this);
-		else if (SPA_UNLIKELY(cmd > 1))
+		else if (SPA_UNLIKELY(missed > 0))
 			pw_log_info("(%s-%u) client missed %"PRIu64" wakeups",
-				node->name, node->info.id, cmd - 1);
+				node->name, node->info.id, missed);
 
 		spa_log_trace_fp(this->log, "%p: got ready", this);
 		spa_node_call_ready(&this->callbacks, SPA_STATUS_HAVE_DATA);
@@ -1201,7 +1202,7 @@ node_init(struct node *this,
 	this->data_source.func = node_on_data_fd_events;
 	this->data_source.data = this;
 	this->data_source.fd = -1;
-	this->data_source.mask = SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP;
+	this->data_source.mask = SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP | SPA_IO_ET;
 	this->data_source.rmask = 0;
 
 	return 0;
@@ -1325,7 +1326,7 @@ static void node_initialized(void *data)
 	node->data_source.fd = impl->fds[0];
 	node->writefd = impl->fds[1];
 
-	spa_loop_add_source(node->data_loop, &node->data_source);
+	pw_impl_node_add_wakeup_source(data_system, node->data_loop, &node->data_source);
 	pw_log_debug("%p: transport read-fd:%d write-fd:%d", node, impl->fds[0], impl->fds[1]);
 
 	size = sizeof(struct spa_io_buffers) * MAX_AREAS;
@@ -1657,6 +1658,30 @@ static void node_peer_removed(void *data, struct pw_impl_node *peer)
 	pw_memblock_unref(m);
 }
 
+/* the client wakes us up on the data loop of the node, follow the node when it
+ * was moved to the data loop of its driver */
+static void move_data_source(struct impl *impl)
+{
+	struct node *this = &impl->node;
+	struct pw_loop *data_loop = impl->this.node->data_loop;
+
+	if (this->data_loop == data_loop->loop)
+		return;
+
+	pw_log_debug("%p: move data source to %p", this, data_loop);
+
+	if (this->data_source.fd != -1)
+		spa_loop_invoke(this->data_loop, do_remove_source, SPA_ID_INVALID,
+				NULL, 0, true, &this->data_source);
+
+	this->data_loop = data_loop->loop;
+	this->data_system = data_loop->system;
+
+	if (this->data_source.fd != -1)
+		pw_impl_node_add_wakeup_source(this->data_system, this->data_loop,
+				&this->data_source);
+}
+
 static void node_driver_changed(void *data, struct pw_impl_node *old, struct pw_impl_node *driver)
 {
 	struct impl *impl = data;
@@ -1664,6 +1689,8 @@ static void node_driver_changed(void *data, struct pw_impl_node *old, struct pw_
 
 	pw_log_debug("%p: driver changed %p -> %p", this, old, driver);
 
+	move_data_source(impl);
+
 	node_peer_removed(data, old);
 	node_peer_added(data, driver);
 }
@@ -1707,7 +1734,9 @@ struct pw_impl_client_node *pw_impl_client_node_new(struct pw_resource *resource
 	struct pw_impl_client *client = pw_resource_get_client(resource);
 	struct pw_context *context = pw_impl_client_get_context(client);
 	const struct spa_support *support;
+	struct pw_loop *data_loop;
 	uint32_t n_support;
+	bool follow_driver_loop;
 	int res;
 
 	impl = calloc(1, sizeof(struct impl));
@@ -1731,8 +1760,17 @@ struct pw_impl_client_node *pw_impl_client_node_new(struct pw_resource *resource
 	impl->fds[0] = impl->fds[1] = -1;
 	pw_log_debug("%p: new", &impl->node);
 
+	/* without a configured data loop, the node starts on the default data
+	 * loop and moves to the data loop of its driver */
+	follow_driver_loop = pw_properties_get(properties, PW_KEY_NODE_DATA_LOOP) == NULL;
+	data_loop = pw_data_loop_get_loop(
+			pw_context_find_data_loop(context, &properties->dict));
+
 	support = pw_context_get_support(impl->context, &n_support);
 	node_init(&impl->node, NULL, support, n_support);
+	/* the client wakes us up on the data loop of the node */
+	impl->node.data_loop = data_loop->loop;
+	impl->node.data_system = data_loop->system;
 	impl->node.impl = impl;
 	impl->node.resource = resource;
 	impl->node.client = client;
@@ -1752,6 +1790,7 @@ struct pw_impl_client_node *pw_impl_client_node_new(struct pw_resource *resource
 		goto error_no_node;
 
 	this->node->remote = true;
+	this->node->follow_driver_loop = follow_driver_loop;
 	this->flags = 0;
 
 	pw_resource_add_listener(this->resource,
@@ -156,6 +156,7 @@ static void clean_transport(struct node_data *data)
 
 	pw_memmap_free(data->activation);
 	data->node->rt.activation = data->node->activation->map->ptr;
+	data->node->rt.activation_stats = true;
 
 	spa_system_close(data->context->data_system, data->rtwritefd);
 	data->have_transport = false;
@@ -273,6 +274,8 @@ static int client_node_transport(void *object,
 	}
 
 	data->node->rt.activation = data->activation->ptr;
+	/* an older server has a smaller activation */
+	data->node->rt.activation_stats = pw_node_activation_has_stats(size);
 
 	pw_log_debug("remote-node %p: fds:%d %d node:%u activation:%p",
 		proxy, readfd, writefd, data->remote_id, data->activation->ptr);
@@ -902,6 +905,7 @@ client_node_set_activation(void *object,
 		link->node_id = node_id;
 		link->map = mm;
 		link->target.activation = ptr;
+		link->target.has_stats = pw_node_activation_has_stats(size);
 		link->signalfd = signalfd;
 		link->target.signal = link_signal_func;
 		link->target.data = link;
@@ -1246,6 +1250,9 @@ static struct pw_proxy *node_export(struct pw_core *core, void *object, bool do_
 						  data->context->settings.mem_warn_mlock);
 
 	node->exported = true;
+	/* exported nodes are scheduled by the remote end and are woken up
+	 * on the default data loop */
+	node->data_loop = data->context->data_loop;
 
 	spa_list_init(&data->free_mix);
 	spa_list_init(&data->mix[0]);
@@ -43,6 +43,7 @@
 #include <spa/param/audio/raw.h>
 #include <spa/param/profiler.h>
 #include <spa/pod/builder.h>
+#include <spa/support/cpu.h>
 #include <spa/utils/json.h>
 #include <spa/utils/result.h>
 #include <spa/utils/ringbuffer.h>
@@ -54,7 +55,9 @@
 
 #include <pipewire/extensions/profiler.h>
 
+#include "module-echo-cancel/delay-estimator.h"
 #include "module-echo-cancel/echo-cancel.h"
+#include "module-filter-chain/pffft.h"
 
 /** \page page_module_echo_cancel PipeWire Module: Echo Cancel
  *
@@ -69,8 +72,24 @@
  * - `source.props = {}`: properties to be passed to the source stream
  * - `sink.props = {}`: properties to be passed to the sink stream
  * - `aec.method = <str>`: the echo cancellation method. Currently supported:
- * `webrtc`. Leave unset to use the default method (`webrtc`).
+ * `webrtc`, `mdf` and `null`. Leave unset to use the default method (`webrtc`
+ * or `mdf` when webrtc is not available).
  * - `aec.args = <str>`: arguments to pass to the echo cancellation method
+ * - `buffer.play_delay = <int>`: the initial delay of the played samples in
+ *   milliseconds, default 0.
+ * - `aec.delay_estimation = <bool>`: measure the delay of the echo in the
+ *   captured samples and align the played samples with it, default false. The
+ *   measured delay is set as the `aec.delay_usec` property on the nodes.
+ * - `aec.max_delay = <int>`: the largest delay to measure in milliseconds,
+ *   default 300.
+ *
+ * The `mdf` method is a multidelay block frequency domain adaptive filter
+ * that runs on any quantum. It accepts the following `aec.args`:
+ *
+ * - `mdf.block-size = <int>`: the block size in samples, default 256. Use
+ *   the graph quantum or a divisor of it, other sizes add one block of latency.
+ * - `mdf.filter-msec = <int>`: the length of the echo tail, default 100 ms.
+ * - `mdf.step = <float>`: the adaptation step between 0.0 and 1.0, default 0.5.
  *
  * ## General options
  *
@@ -127,6 +146,10 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
  * input requirement for rate matching */
 #define MAX_BUFSIZE_MS 100
 #define DELAY_MS 0
+#define MAX_DELAY_MS 300
+/* align a little before the measured delay so that the start of the echo
+ * path stays inside the filter of the canceller */
+#define DELAY_MARGIN_MS 5
 
 static const struct spa_dict_item module_props[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
@@ -138,6 +161,8 @@ static const struct spa_dict_item module_props[] = {
 				"[ audio.position=<channel map> ] "
 				"[ buffer.max_size=<max buffer size in ms> ] "
 				"[ buffer.play_delay=<play delay in ms> ] "
+				"[ aec.delay_estimation=<estimate the play delay> ] "
+				"[ aec.max_delay=<max play delay in ms> ] "
 				"[ aec.method=<aec method> ] "
 				"[ aec.args=<aec arguments> ] "
 				"[ source.props=<properties> ] "
@@ -197,6 +222,11 @@ struct impl {
 
 	uint32_t max_buffer_size;
 	uint32_t buffer_delay;
+	uint32_t max_delay;
+	uint32_t play_delay;
+
+	struct delay_estimator *estimator;
+	struct spa_source *delay_event;
 };
 
 static void do_unload_module(void *obj, void *data, int res, uint32_t id)
@@ -212,6 +242,31 @@ static void unload_module(struct impl *impl)
 	}
 }
 
+static void update_play_delay(struct impl *impl)
+{
+	int32_t delay;
+	uint32_t margin, target, pindex;
+
+	if ((delay = delay_estimator_get_delay(impl->estimator)) < 0)
+		return;
+
+	margin = DELAY_MARGIN_MS * impl->info.rate / 1000;
+	target = delay > (int32_t)margin ? delay - margin : 0;
+	target = sizeof(float) * SPA_MIN(target, impl->max_delay * impl->info.rate / 1000);
+	if (target == impl->play_delay)
+		return;
+
+	pw_log_debug("play delay %u -> %u", impl->play_delay, target);
+
+	/* the delayed samples are still in the ringbuffer, move the read
+	 * pointer of the delayed ring relative to the played samples */
+	spa_ringbuffer_get_read_index(&impl->play_ring, &pindex);
+	spa_ringbuffer_read_update(&impl->play_delayed_ring, pindex - target);
+	impl->play_delay = target;
+
+	pw_loop_signal_event(pw_context_get_main_loop(impl->context), impl->delay_event);
+}
+
 static void process(struct impl *impl)
 {
 	struct pw_buffer *cout;
@@ -236,6 +291,9 @@ static void process(struct impl *impl)
 
 	size = impl->aec_blocksize;
 
+	if (impl->estimator)
+		update_play_delay(impl);
+
 	/* First read a block from the playback and capture ring buffers */
 
 	spa_ringbuffer_get_read_index(&impl->rec_ring, &rindex);
@@ -282,6 +340,10 @@ static void process(struct impl *impl)
 
 	pw_stream_queue_buffer(impl->playback, pout);
 
+	if (impl->estimator)
+		delay_estimator_push(impl->estimator, rec, play,
+				impl->info.channels, size / sizeof(float));
+
 	/* Now run the canceller */
 	echo_cancel_run(impl->aec_info, impl->aec, rec,	play_delayed, out, size / sizeof(float));
 
@@ -560,11 +622,12 @@ static void sink_process(void *data)
 
 	avail = spa_ringbuffer_get_write_index(&impl->play_ring, &index);
 	size = buf->buffer->datas[0].chunk->size;
-	if (avail + size > impl->play_ringsize) {
+	/* the delayed samples before the read pointer are kept as well */
+	if (avail + size > impl->play_ringsize - impl->play_delay) {
 		uint32_t rindex, drop;
 
 		/* Drop enough so we have size bytes left */
-		drop = avail + size - impl->play_ringsize;
+		drop = avail + size - (impl->play_ringsize - impl->play_delay);
 		pw_log_debug("sink ringbuffer xrun %d + %u > %u, dropping %u",
 				avail, size, impl->play_ringsize, drop);
 
@@ -742,11 +805,11 @@ static int setup_streams(struct impl *impl)
 		return res;
 
 	impl->rec_ringsize = sizeof(float) * impl->max_buffer_size * impl->info.rate / 1000;
-	impl->play_ringsize = sizeof(float) * (impl->max_buffer_size + impl->buffer_delay) * impl->info.rate / 1000;
+	impl->play_ringsize = sizeof(float) * (impl->max_buffer_size + impl->max_delay) * impl->info.rate / 1000;
 	impl->out_ringsize = sizeof(float) * impl->max_buffer_size * impl->info.rate / 1000;
 	for (i = 0; i < impl->info.channels; i++) {
 		impl->rec_buffer[i] = malloc(impl->rec_ringsize);
-		impl->play_buffer[i] = malloc(impl->play_ringsize);
+		impl->play_buffer[i] = calloc(1, impl->play_ringsize);
 		impl->out_buffer[i] = malloc(impl->out_ringsize);
 	}
 	spa_ringbuffer_init(&impl->rec_ring);
@@ -754,10 +817,11 @@ static int setup_streams(struct impl *impl)
 	spa_ringbuffer_init(&impl->play_delayed_ring);
 	spa_ringbuffer_init(&impl->out_ring);
 
+	impl->play_delay = sizeof(float) * impl->buffer_delay * impl->info.rate / 1000;
 	spa_ringbuffer_get_write_index(&impl->play_ring, &index);
-	spa_ringbuffer_write_update(&impl->play_ring, index + (sizeof(float) * (impl->buffer_delay) * impl->info.rate / 1000));
+	spa_ringbuffer_write_update(&impl->play_ring, index + impl->play_delay);
 	spa_ringbuffer_get_read_index(&impl->play_ring, &index);
-	spa_ringbuffer_read_update(&impl->play_ring, index + (sizeof(float) * (impl->buffer_delay) * impl->info.rate / 1000));
+	spa_ringbuffer_read_update(&impl->play_ring, index + impl->play_delay);
 
 	return 0;
 }
@@ -805,6 +869,10 @@ static void impl_destroy(struct impl *impl)
 		pw_core_disconnect(impl->core);
 	if (impl->aec)
 		echo_cancel_destroy(impl->aec_info, impl->aec);
+	if (impl->estimator)
+		delay_estimator_free(impl->estimator);
+	if (impl->delay_event)
+		pw_loop_destroy_source(pw_context_get_main_loop(impl->context), impl->delay_event);
 	pw_properties_free(impl->source_props);
 	pw_properties_free(impl->sink_props);
 
@@ -823,6 +891,29 @@ static void impl_destroy(struct impl *impl)
 	free(impl);
 }
 
+static void delay_changed(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	struct spa_dict_item items[1];
+	char val[64];
+	int32_t delay;
+	uint64_t usec;
+
+	if ((delay = delay_estimator_get_delay(impl->estimator)) < 0)
+		return;
+
+	usec = delay * SPA_USEC_PER_SEC / impl->info.rate;
+	snprintf(val, sizeof(val), "%"PRIu64, usec);
+	items[0] = SPA_DICT_ITEM_INIT("aec.delay_usec", val);
+
+	pw_log_info("measured play delay %s usec", val);
+
+	if (impl->source)
+		pw_stream_update_properties(impl->source, &SPA_DICT_INIT(items, 1));
+	if (impl->sink)
+		pw_stream_update_properties(impl->sink, &SPA_DICT_INIT(items, 1));
+}
+
 static void module_destroy(void *data)
 {
 	struct impl *impl = data;
@@ -892,6 +983,9 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	struct pw_properties *props, *aec_props;
 	struct impl *impl;
 	uint32_t id = pw_global_get_id(pw_impl_module_get_global(module));
+	const struct spa_support *support;
+	struct spa_cpu *cpu_iface;
+	uint32_t n_support;
 	const char *str;
 	int res;
 
@@ -967,14 +1061,26 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	if (pw_properties_get(impl->sink_props, PW_KEY_MEDIA_CLASS) == NULL)
 		pw_properties_set(impl->sink_props, PW_KEY_MEDIA_CLASS, "Audio/Sink");
 
-	if ((str = pw_properties_get(props, "aec.method")) == NULL)
+	support = pw_context_get_support(context, &n_support);
+	cpu_iface = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
+	pffft_select_cpu(cpu_iface ? spa_cpu_get_flags(cpu_iface) : 0);
+
+	if ((str = pw_properties_get(props, "aec.method")) == NULL) {
+#ifdef HAVE_WEBRTC
 		str = "webrtc";
+#else
+		str = "mdf";
+#endif
+	}
 
 #ifdef HAVE_WEBRTC
 	if (spa_streq(str, "webrtc"))
 		impl->aec_info = echo_cancel_webrtc;
 	else
 #endif
+	if (spa_streq(str, "mdf"))
+		impl->aec_info = echo_cancel_mdf;
+	else
 		impl->aec_info = echo_cancel_null;
 
 	if ((str = pw_properties_get(props, "aec.args")) != NULL)
@@ -986,6 +1092,12 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	pw_properties_free(aec_props);
 
+	if (impl->aec == NULL) {
+		res = -EINVAL;
+		pw_log_error("can't create %s echo canceller", impl->aec_info->name);
+		goto error;
+	}
+
 	if (impl->aec_info->latency) {
 		unsigned int num, denom, req_num, req_denom;
 		unsigned int factor = 0;
@@ -1036,6 +1148,19 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	impl->max_buffer_size = pw_properties_get_uint32(props,"buffer.max_size", MAX_BUFSIZE_MS);
 	impl->buffer_delay = pw_properties_get_uint32(props,"buffer.play_delay", DELAY_MS);
+	impl->max_delay = impl->buffer_delay;
+
+	if (pw_properties_get_bool(props, "aec.delay_estimation", false)) {
+		impl->max_delay = SPA_MAX(impl->max_delay,
+				pw_properties_get_uint32(props, "aec.max_delay", MAX_DELAY_MS));
+		impl->delay_event = pw_loop_add_event(pw_context_get_main_loop(context),
+				delay_changed, impl);
+		if (impl->delay_event != NULL)
+			impl->estimator = delay_estimator_new(impl->info.rate,
+					impl->max_delay * impl->info.rate / 1000);
+		if (impl->estimator == NULL)
+			pw_log_warn("can't create delay estimator: %m");
+	}
 
 	pw_properties_free(props);
 
@@ -0,0 +1,366 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include <pipewire/log.h>
+
+#include "echo-cancel.h"
+#include "../module-filter-chain/pffft.h"
+
+/* Multidelay block frequency domain adaptive filter.
+ *
+ * The echo path of each channel is modeled with an FIR filter that is split
+ * in partitions of block_size taps. Every block of block_size samples, the
+ * far end (play) signal is transformed with a 2 * block_size FFT and the echo
+ * estimate is made with an overlap-save convolution of the last partitions
+ * of the far end spectrum with the filter partitions. The filter is adapted
+ * with a normalized step per frequency bin. The gradient constraint is
+ * applied to one partition per block, in turn.
+ *
+ * The spectra are kept in the pffft internal layout so that the
+ * multiply-accumulate of the convolution and the adaptation is done with the
+ * SIMD zconvolve functions. */
+
+#define DEFAULT_BLOCK_SIZE	256
+#define MIN_BLOCK_SIZE		16
+#define MAX_BLOCK_SIZE		8192
+#define DEFAULT_FILTER_MSEC	100
+#define MAX_FILTER_MSEC		1000
+#define DEFAULT_STEP		0.5f
+
+#define MIN_RATE		0.05f
+#define DOUBLE_TALK_RATIO	4.0f
+#define SILENCE_POWER		1e-10f
+
+struct channel {
+	float *far;		/* previous block of far end samples */
+	float *X;		/* n_parts far end spectra, newest at pos */
+	float *Xc;		/* conjugates of X */
+	float *W;		/* n_parts filter partitions */
+	float *P;		/* smoothed far end power per bin */
+	uint32_t pos;
+	uint32_t constrain;
+	bool adapted;
+
+	float *rec;		/* block buffers when the quantum is not */
+	float *play;		/* a multiple of the block size */
+	float *out;
+};
+
+struct impl {
+	uint32_t channels;
+	uint32_t block_size;
+	uint32_t fft_size;
+	uint32_t n_parts;
+	float step;
+
+	PFFFT_Setup *fft;
+	float *mask;		/* 1.0 at the real parts, 0.0 at the imaginary parts */
+	float *time;
+	float *Y;
+	float *E;
+	float *G;
+	float *work;
+
+	bool buffered;
+	uint32_t fill;
+
+	struct channel ch[SPA_AUDIO_MAX_CHANNELS];
+};
+
+static float *alloc_floats(uint32_t n)
+{
+	float *d = pffft_aligned_malloc(n * sizeof(float));
+	if (d != NULL)
+		memset(d, 0, n * sizeof(float));
+	return d;
+}
+
+static void mdf_destroy(void *ec)
+{
+	struct impl *impl = ec;
+	uint32_t i;
+
+	for (i = 0; i < impl->channels; i++) {
+		struct channel *c = &impl->ch[i];
+		pffft_aligned_free(c->far);
+		pffft_aligned_free(c->X);
+		pffft_aligned_free(c->Xc);
+		pffft_aligned_free(c->W);
+		pffft_aligned_free(c->P);
+		pffft_aligned_free(c->rec);
+		pffft_aligned_free(c->play);
+		pffft_aligned_free(c->out);
+	}
+	pffft_aligned_free(impl->mask);
+	pffft_aligned_free(impl->time);
+	pffft_aligned_free(impl->Y);
+	pffft_aligned_free(impl->E);
+	pffft_aligned_free(impl->G);
+	pffft_aligned_free(impl->work);
+	if (impl->fft)
+		pffft_destroy_setup(impl->fft);
+	free(impl);
+}
+
+static void *mdf_create(const struct pw_properties *args, const struct spa_audio_info_raw *info)
+{
+	struct impl *impl;
+	uint32_t i, N, B, filter_len;
+	const char *str;
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		return NULL;
+
+	impl->channels = SPA_MIN(info->channels, SPA_AUDIO_MAX_CHANNELS);
+
+	B = DEFAULT_BLOCK_SIZE;
+	if ((str = pw_properties_get(args, "mdf.block-size")) != NULL)
+		B = SPA_CLAMP(atoi(str), MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+	filter_len = info->rate * DEFAULT_FILTER_MSEC / 1000;
+	if ((str = pw_properties_get(args, "mdf.filter-msec")) != NULL)
+		filter_len = info->rate * SPA_CLAMP(atoi(str), 1, MAX_FILTER_MSEC) / 1000;
+	impl->step = DEFAULT_STEP;
+	if ((str = pw_properties_get(args, "mdf.step")) != NULL)
+		impl->step = SPA_CLAMP(strtof(str, NULL), 0.0f, 1.0f);
+
+	/* the real SIMD transforms need a multiple of 32 */
+	B = (B + 15) & ~15u;
+	N = 2 * B;
+	impl->block_size = B;
+	impl->fft_size = N;
+	impl->n_parts = SPA_MAX((filter_len + B - 1) / B, 1u);
+
+	impl->fft = pffft_new_setup(N, PFFFT_REAL);
+	if (impl->fft == NULL) {
+		pw_log_error("mdf: unsupported block size %u", B);
+		goto error;
+	}
+
+	impl->mask = alloc_floats(N);
+	impl->time = alloc_floats(N);
+	impl->Y = alloc_floats(N);
+	impl->E = alloc_floats(N);
+	impl->G = alloc_floats(N);
+	impl->work = alloc_floats(N);
+	if (impl->mask == NULL || impl->time == NULL || impl->Y == NULL ||
+	    impl->E == NULL || impl->G == NULL || impl->work == NULL)
+		goto error;
+
+	/* The DC and nyquist bins are both real and packed in the first
+	 * complex value. Make the mask in the ordered layout and let pffft
+	 * move it to its internal layout. */
+	impl->time[0] = impl->time[1] = 1.0f;
+	for (i = 2; i < N; i += 2)
+		impl->time[i] = 1.0f;
+	pffft_zreorder(impl->fft, impl->time, impl->mask, PFFFT_BACKWARD);
+	memset(impl->time, 0, N * sizeof(float));
+
+	for (i = 0; i < impl->channels; i++) {
+		struct channel *c = &impl->ch[i];
+		c->far = alloc_floats(B);
+		c->X = alloc_floats(N * impl->n_parts);
+		c->Xc = alloc_floats(N * impl->n_parts);
+		c->W = alloc_floats(N * impl->n_parts);
+		c->P = alloc_floats(N);
+		c->rec = alloc_floats(B);
+		c->play = alloc_floats(B);
+		c->out = alloc_floats(B);
+		if (c->far == NULL || c->X == NULL || c->Xc == NULL ||
+		    c->W == NULL || c->P == NULL || c->rec == NULL ||
+		    c->play == NULL || c->out == NULL)
+			goto error;
+	}
+
+	pw_log_info("mdf: %u channels, block size %u, %u partitions, step %f",
+			impl->channels, B, impl->n_parts, impl->step);
+
+	return impl;
+
+error:
+	mdf_destroy(impl);
+	return NULL;
+}
+
+static inline float block_power(const float *d, uint32_t n)
+{
+	float sum = 0.0f;
+	uint32_t i;
+	for (i = 0; i < n; i++)
+		sum += d[i] * d[i];
+	return sum;
+}
+
+static void process_block(struct impl *impl, struct channel *c,
+		const float *rec, const float *play, float *out)
+{
+	const uint32_t B = impl->block_size, N = impl->fft_size, K = impl->n_parts;
+	const float *mask = impl->mask;
+	float *time = impl->time, *Y = impl->Y, *E = impl->E, *G = impl->G;
+	float *X, *Xc, far_power, echo_power, err_power, rate, reg, smooth;
+	uint32_t i, k, p;
+
+	/* transform the last two blocks of the far end */
+	memcpy(time, c->far, B * sizeof(float));
+	memcpy(time + B, play, B * sizeof(float));
+	memcpy(c->far, play, B * sizeof(float));
+
+	c->pos = c->pos == 0 ? K - 1 : c->pos - 1;
+	X = &c->X[c->pos * N];
+	Xc = &c->Xc[c->pos * N];
+	pffft_transform(impl->fft, time, X, impl->work, PFFFT_FORWARD);
+	for (i = 0; i < N; i++)
+		Xc[i] = mask[i] != 0.0f ? X[i] : -X[i];
+
+	/* echo estimate, the last half of the circular convolution */
+	for (k = 0, p = c->pos; k < K; k++) {
+		if (k == 0)
+			pffft_zconvolve(impl->fft, &c->X[p * N], &c->W[k * N], Y, 1.0f / N);
+		else
+			pffft_zconvolve_accumulate(impl->fft, &c->X[p * N], &c->W[k * N], Y, Y, 1.0f / N);
+		if (++p == K)
+			p = 0;
+	}
+	pffft_transform(impl->fft, Y, time, impl->work, PFFFT_BACKWARD);
+
+	for (i = 0; i < B; i++)
+		out[i] = rec[i] - time[B + i];
+
+	far_power = block_power(play, B);
+	if (far_power < SILENCE_POWER * B)
+		return;
+
+	/* Slow down the adaptation when the error is not well below the
+	 * estimated echo, this happens with double talk. */
+	echo_power = block_power(time + B, B);
+	err_power = block_power(out, B);
+	if (!c->adapted) {
+		rate = impl->step;
+		c->adapted = echo_power > err_power;
+	} else {
+		rate = impl->step * SPA_CLAMP(echo_power /
+				(DOUBLE_TALK_RATIO * err_power + 1e-10f), MIN_RATE, 1.0f);
+	}
+	rate /= K;
+
+	memset(time, 0, B * sizeof(float));
+	memcpy(time + B, out, B * sizeof(float));
+	pffft_transform(impl->fft, time, E, impl->work, PFFFT_FORWARD);
+
+	/* Normalized step per bin. The power is averaged over the length of
+	 * the filter so that the step stays small when the far end drops. */
+	pffft_zconvolve(impl->fft, X, Xc, G, 1.0f);
+	smooth = 1.0f - 1.0f / K;
+	reg = 0.0f;
+	for (i = 0; i < N; i++) {
+		c->P[i] = smooth * c->P[i] + (1.0f - smooth) * G[i] * mask[i];
+		reg += c->P[i];
+	}
+	reg = reg / N * 0.01f + SILENCE_POWER * N;
+	for (i = 0; i < N; i++)
+		G[i] = mask[i] * rate / (c->P[i] + reg);
+	pffft_zconvolve(impl->fft, E, G, E, 1.0f);
+
+	for (k = 0, p = c->pos; k < K; k++) {
+		float *W = &c->W[k * N];
+
+		pffft_zconvolve_accumulate(impl->fft, &c->Xc[p * N], E, W, W, 1.0f);
+
+		if (k == c->constrain) {
+			/* keep only the first half of the impulse response */
+			pffft_transform(impl->fft, W, time, impl->work, PFFFT_BACKWARD);
+			for (i = 0; i < B; i++)
+				time[i] *= 1.0f / N;
+			memset(time + B, 0, B * sizeof(float));
+			pffft_transform(impl->fft, time, W, impl->work, PFFFT_FORWARD);
+		}
+		if (++p == K)
+			p = 0;
+	}
+	if (++c->constrain == K)
+		c->constrain = 0;
+}
+
+static int mdf_run(void *ec, const float *rec[], const float *play[], float *out[], uint32_t n_samples)
+{
+	struct impl *impl = ec;
+	const uint32_t B = impl->block_size;
+	uint32_t i, offs, chunk;
+
+	/* Process the blocks in place when the quantum is a multiple of the
+	 * block size, else delay the output with one block. */
+	if (!impl->buffered && n_samples % B != 0) {
+		pw_log_info("mdf: %u samples is not a multiple of block size %u, adding %u samples latency",
+				n_samples, B, B);
+		impl->buffered = true;
+		impl->fill = 0;
+	}
+
+	if (!impl->buffered) {
+		for (offs = 0; offs < n_samples; offs += B) {
+			for (i = 0; i < impl->channels; i++)
+				process_block(impl, &impl->ch[i],
+						rec[i] + offs, play[i] + offs, out[i] + offs);
+		}
+		return 0;
+	}
+
+	for (offs = 0; offs < n_samples; offs += chunk) {
+		chunk = SPA_MIN(n_samples - offs, B - impl->fill);
+
+		for (i = 0; i < impl->channels; i++) {
+			struct channel *c = &impl->ch[i];
+			memcpy(c->rec + impl->fill, rec[i] + offs, chunk * sizeof(float));
+			memcpy(c->play + impl->fill, play[i] + offs, chunk * sizeof(float));
+			memcpy(out[i] + offs, c->out + impl->fill, chunk * sizeof(float));
+		}
+		impl->fill += chunk;
+		if (impl->fill == B) {
+			for (i = 0; i < impl->channels; i++) {
+				struct channel *c = &impl->ch[i];
+				process_block(impl, c, c->rec, c->play, c->out);
+			}
+			impl->fill = 0;
+		}
+	}
+	return 0;
+}
+
+static const struct echo_cancel_info echo_cancel_mdf_impl = {
+	.name = "mdf",
+	.info = SPA_DICT_INIT(NULL, 0),
+	.latency = NULL,
+
+	.create = mdf_create,
+	.destroy = mdf_destroy,
+
+	.run = mdf_run,
+};
+
+const struct echo_cancel_info *echo_cancel_mdf = &echo_cancel_mdf_impl;
@@ -0,0 +1,320 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+
+#include <pipewire/log.h>
+#include <pipewire/thread.h>
+
+#include "delay-estimator.h"
+#include "../module-filter-chain/pffft.h"
+
+/* Estimates the delay of the echo in the captured signal with a generalized
+ * cross correlation with phase transform (GCC-PHAT).
+ *
+ * The process thread pushes a mono downmix of the captured and played
+ * samples in a ringbuffer. A worker thread takes frames of frame_size
+ * samples, with half a frame of overlap, and averages the cross spectrum of
+ * the frames. The inverse transform of the whitened cross spectrum has a peak
+ * at the delay. A new delay is only published when the peak is clear and
+ * the same delay is found in two consecutive frames. */
+
+#define MIN_FRAME_SIZE		1024
+#define SPECTRUM_SMOOTH		0.5f
+#define MIN_CONFIDENCE		10.0f
+#define MIN_POWER		1e-8f
+#define TOLERANCE_MSEC		2
+
+struct delay_estimator {
+	uint32_t frame_size;
+	uint32_t max_delay;
+	uint32_t tolerance;
+
+	float *rec;		/* ringbuffer with the mono samples */
+	float *play;
+	uint32_t ring_size;
+	struct spa_ringbuffer ring;
+
+	PFFFT_Setup *fft;
+	float *window;
+	float *frame;
+	float *R;
+	float *P;
+	float *G;		/* averaged cross spectrum */
+	float *C;		/* whitened cross spectrum */
+	float *work;
+
+	int32_t candidate;
+	int32_t delay;
+
+	struct spa_thread *thread;
+	sem_t wakeup;
+	int quit;
+	unsigned int started:1;
+};
+
+static inline float *alloc_floats(uint32_t n)
+{
+	float *d = pffft_aligned_malloc(n * sizeof(float));
+	if (d != NULL)
+		memset(d, 0, n * sizeof(float));
+	return d;
+}
+
+static inline float frame_power(const float *d, uint32_t n)
+{
+	float sum = 0.0f;
+	uint32_t i;
+	for (i = 0; i < n; i++)
+		sum += d[i] * d[i];
+	return sum;
+}
+
+static void take_frame(struct delay_estimator *de, const float *ring, uint32_t index, float *spectrum)
+{
+	uint32_t i, N = de->frame_size, mask = de->ring_size - 1;
+
+	for (i = 0; i < N; i++)
+		de->frame[i] = ring[(index + i) & mask] * de->window[i];
+	pffft_transform_ordered(de->fft, de->frame, spectrum, de->work, PFFFT_FORWARD);
+}
+
+static void estimate_frame(struct delay_estimator *de, uint32_t index)
+{
+	const uint32_t N = de->frame_size;
+	const float a = SPECTRUM_SMOOTH, b = 1.0f - SPECTRUM_SMOOTH;
+	float *R = de->R, *P = de->P, *G = de->G, *C = de->C;
+	float peak, power, mag, confidence;
+	uint32_t i, peak_pos;
+	int32_t delay;
+
+	take_frame(de, de->play, index, P);
+	if (frame_power(P, N) < MIN_POWER * N * N)
+		return;
+	take_frame(de, de->rec, index, R);
+	if (frame_power(R, N) < MIN_POWER * N * N)
+		return;
+
+	/* average R * conj(P). The DC and nyquist bins are real and
+	 * stored in the first two values. */
+	G[0] = a * G[0] + b * R[0] * P[0];
+	G[1] = a * G[1] + b * R[1] * P[1];
+	for (i = 2; i < N; i += 2) {
+		G[i + 0] = a * G[i + 0] + b * (R[i] * P[i] + R[i + 1] * P[i + 1]);
+		G[i + 1] = a * G[i + 1] + b * (R[i + 1] * P[i] - R[i] * P[i + 1]);
+	}
+
+	/* phase transform, keep only the phase of the cross spectrum */
+	C[0] = G[0] / (fabsf(G[0]) + 1e-20f);
+	C[1] = G[1] / (fabsf(G[1]) + 1e-20f);
+	for (i = 2; i < N; i += 2) {
+		mag = sqrtf(G[i] * G[i] + G[i + 1] * G[i + 1]) + 1e-20f;
+		C[i + 0] = G[i + 0] / mag;
+		C[i + 1] = G[i + 1] / mag;
+	}
+	pffft_transform_ordered(de->fft, C, de->frame, de->work, PFFFT_BACKWARD);
+
+	peak = 0.0f;
+	peak_pos = 0;
+	for (i = 0; i <= de->max_delay; i++) {
+		if (de->frame[i] > peak) {
+			peak = de->frame[i];
+			peak_pos = i;
+		}
+	}
+	power = frame_power(de->frame, N) / N;
+	confidence = power > 0.0f ? peak / sqrtf(power) : 0.0f;
+
+	pw_log_trace("delay %u confidence %f", peak_pos, confidence);
+
+	if (confidence < MIN_CONFIDENCE) {
+		de->candidate = -1;
+		return;
+	}
+	delay = peak_pos;
+	if (de->candidate >= 0 &&
+	    (uint32_t)abs(delay - de->candidate) <= de->tolerance) {
+		int32_t current = __atomic_load_n(&de->delay, __ATOMIC_SEQ_CST);
+		if (current < 0 || (uint32_t)abs(delay - current) > de->tolerance) {
+			pw_log_info("echo delay %d samples, confidence %f", delay, confidence);
+			__atomic_store_n(&de->delay, delay, __ATOMIC_SEQ_CST);
+		}
+	}
+	de->candidate = delay;
+}
+
+static void *estimator_thread(void *data)
+{
+	struct delay_estimator *de = data;
+	uint32_t index;
+	int32_t avail;
+
+	while (true) {
+		while (sem_wait(&de->wakeup) < 0 && errno == EINTR);
+		if (__atomic_load_n(&de->quit, __ATOMIC_SEQ_CST))
+			break;
+
+		avail = spa_ringbuffer_get_read_index(&de->ring, &index);
+		if (avail < (int32_t)de->frame_size)
+			continue;
+
+		/* skip to the last frame when we are behind */
+		index += avail - de->frame_size;
+		estimate_frame(de, index);
+		spa_ringbuffer_read_update(&de->ring, index + de->frame_size / 2);
+	}
+	return NULL;
+}
+
+void delay_estimator_push(struct delay_estimator *de, const float *rec[], const float *play[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	uint32_t i, j, index, mask = de->ring_size - 1;
+	float scale = 1.0f / n_channels;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_write_index(&de->ring, &index);
+	if (avail + n_samples > de->ring_size) {
+		/* the worker is behind, drop the samples. They are dropped for
+		 * both signals so the alignment is not affected. */
+		sem_post(&de->wakeup);
+		return;
+	}
+	for (i = 0; i < n_samples; i++) {
+		float r = 0.0f, p = 0.0f;
+		for (j = 0; j < n_channels; j++) {
+			r += rec[j][i];
+			p += play[j][i];
+		}
+		de->rec[(index + i) & mask] = r * scale;
+		de->play[(index + i) & mask] = p * scale;
+	}
+	spa_ringbuffer_write_update(&de->ring, index + n_samples);
+
+	if (avail + n_samples >= de->frame_size)
+		sem_post(&de->wakeup);
+}
+
+int32_t delay_estimator_get_delay(struct delay_estimator *de)
+{
+	return __atomic_load_n(&de->delay, __ATOMIC_SEQ_CST);
+}
+
+void delay_estimator_free(struct delay_estimator *de)
+{
+	if (de->started) {
+		__atomic_store_n(&de->quit, 1, __ATOMIC_SEQ_CST);
+		sem_post(&de->wakeup);
+		pw_thread_utils_join(de->thread, NULL);
+		sem_destroy(&de->wakeup);
+	}
+	free(de->rec);
+	free(de->play);
+	pffft_aligned_free(de->window);
+	pffft_aligned_free(de->frame);
+	pffft_aligned_free(de->R);
+	pffft_aligned_free(de->P);
+	pffft_aligned_free(de->G);
+	pffft_aligned_free(de->C);
+	pffft_aligned_free(de->work);
+	if (de->fft)
+		pffft_destroy_setup(de->fft);
+	free(de);
+}
+
+struct delay_estimator *delay_estimator_new(uint32_t rate, uint32_t max_delay)
+{
+	struct delay_estimator *de;
+	uint32_t i, N;
+	int res;
+
+	de = calloc(1, sizeof(*de));
+	if (de == NULL)
+		return NULL;
+
+	/* the frames overlap at least half at the largest delay */
+	N = MIN_FRAME_SIZE;
+	while (N < 2 * max_delay)
+		N *= 2;
+
+	de->frame_size = N;
+	de->max_delay = max_delay;
+	de->tolerance = rate * TOLERANCE_MSEC / 1000;
+	de->ring_size = 2 * N;
+	de->candidate = -1;
+	de->delay = -1;
+
+	de->rec = calloc(de->ring_size, sizeof(float));
+	de->play = calloc(de->ring_size, sizeof(float));
+	de->fft = pffft_new_setup(N, PFFFT_REAL);
+	de->window = alloc_floats(N);
+	de->frame = alloc_floats(N);
+	de->R = alloc_floats(N);
+	de->P = alloc_floats(N);
+	de->G = alloc_floats(N);
+	de->C = alloc_floats(N);
+	de->work = alloc_floats(N);
+	if (de->rec == NULL || de->play == NULL || de->fft == NULL ||
+	    de->window == NULL || de->frame == NULL || de->R == NULL ||
+	    de->P == NULL || de->G == NULL || de->C == NULL || de->work == NULL) {
+		res = -ENOMEM;
+		goto error;
+	}
+	for (i = 0; i < N; i++)
+		de->window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / N);
+
+	spa_ringbuffer_init(&de->ring);
+
+	if (sem_init(&de->wakeup, 0, 0) < 0) {
+		res = -errno;
+		goto error;
+	}
+
+	/* the estimate is not urgent, the thread is not made realtime so
+	 * that it doesn't compete with the realtime threads */
+	de->thread = pw_thread_utils_create(NULL, estimator_thread, de);
+	if (de->thread == NULL) {
+		res = -errno;
+		sem_destroy(&de->wakeup);
+		goto error;
+	}
+	de->started = 1;
+
+	pw_log_info("delay estimator: frame size %u, max delay %u", N, max_delay);
+
+	return de;
+
+error:
+	delay_estimator_free(de);
+	errno = -res;
+	return NULL;
+}
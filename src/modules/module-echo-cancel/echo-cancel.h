@@ -48,3 +48,4 @@ struct echo_cancel_info {
 extern const struct echo_cancel_info *echo_cancel_webrtc;
 #endif
 extern const struct echo_cancel_info *echo_cancel_null;
+extern const struct echo_cancel_info *echo_cancel_mdf;
@@ -0,0 +1,196 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <spa/support/cpu.h>
+#include <spa/utils/defs.h>
+
+#include <pipewire/pipewire.h>
+
+#include "aec-mdf.c"
+
+#define RATE		48000
+#define ECHO_LEN	2400
+#define ECHO_DELAY	480
+#define MAX_QUANTUM	1024
+
+/* the ERLE after 4 seconds of far end only */
+#define MIN_ERLE	30.0
+/* the ERLE of the echo in the near end signal during double talk */
+#define MIN_ERLE_DOUBLE_TALK	10.0
+
+static uint32_t seed;
+
+static float random_sample(void)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (float)(seed >> 8) / (1u << 24) - 0.5f;
+}
+
+struct test {
+	void *ec;
+	uint32_t quantum;
+	float echo[ECHO_LEN];
+	float history[ECHO_LEN];
+	uint32_t pos;
+
+	uint32_t latency;
+	float echo_delay[MAX_QUANTUM + DEFAULT_BLOCK_SIZE];
+	float near_delay[MAX_QUANTUM + DEFAULT_BLOCK_SIZE];
+};
+
+/* an echo path with some delay and a decaying random response */
+static void make_echo_path(struct test *t)
+{
+	uint32_t i;
+
+	memset(t->echo, 0, sizeof(t->echo));
+	for (i = ECHO_DELAY; i < ECHO_LEN; i++)
+		t->echo[i] = random_sample() * expf(-6.0f * (i - ECHO_DELAY) / ECHO_LEN) * 0.5f;
+	memset(t->history, 0, sizeof(t->history));
+	t->pos = 0;
+}
+
+static float apply_echo_path(struct test *t, float sample)
+{
+	uint32_t i, p;
+	float sum = 0.0f;
+
+	t->history[t->pos] = sample;
+	for (i = 0, p = t->pos; i < ECHO_LEN; i++) {
+		sum += t->echo[i] * t->history[p];
+		p = p == 0 ? ECHO_LEN - 1 : p - 1;
+	}
+	if (++t->pos == ECHO_LEN)
+		t->pos = 0;
+	return sum;
+}
+
+/* Run the canceller for the given number of seconds. With near_gain, a near
+ * end talker is added to the echo. Returns the ERLE in dB over the last
+ * second, of the echo and the part of the output that is not the near end. */
+static double run_seconds(struct test *t, uint32_t seconds, float near_gain)
+{
+	float rec[MAX_QUANTUM], play[MAX_QUANTUM], out[MAX_QUANTUM];
+	const float *rec_p[1] = { rec }, *play_p[1] = { play };
+	float *out_p[1] = { out };
+	uint32_t i, n, n_samples = seconds * RATE;
+	double echo_power = 0.0, residual_power = 0.0;
+
+	spa_assert_se(t->quantum <= MAX_QUANTUM);
+
+	for (n = 0; n < n_samples; n += t->quantum) {
+		float *echo = t->echo_delay + t->latency;
+		float *near = t->near_delay + t->latency;
+
+		for (i = 0; i < t->quantum; i++) {
+			play[i] = random_sample();
+			near[i] = random_sample() * near_gain;
+			echo[i] = apply_echo_path(t, play[i]);
+			rec[i] = echo[i] + near[i];
+		}
+		spa_assert_se(mdf_run(t->ec, rec_p, play_p, out_p, t->quantum) == 0);
+
+		/* the output is delayed with one block when the quantum is not
+		 * a multiple of the block size, compare with the delayed echo */
+		if (n + t->quantum > n_samples - RATE) {
+			for (i = 0; i < t->quantum; i++) {
+				float residual = out[i] - t->near_delay[i];
+				echo_power += t->echo_delay[i] * t->echo_delay[i];
+				residual_power += residual * residual;
+			}
+		}
+		memmove(t->echo_delay, t->echo_delay + t->quantum, t->latency * sizeof(float));
+		memmove(t->near_delay, t->near_delay + t->quantum, t->latency * sizeof(float));
+	}
+	return 10.0 * log10(echo_power / (residual_power + 1e-20));
+}
+
+static void test_quantum(uint32_t quantum)
+{
+	struct spa_audio_info_raw info;
+	struct pw_properties *args;
+	struct test t;
+	double erle;
+
+	spa_zero(info);
+	info.rate = RATE;
+	info.channels = 1;
+
+	args = pw_properties_new(NULL, NULL);
+	spa_assert_se(args != NULL);
+
+	spa_zero(t);
+	t.quantum = quantum;
+	t.latency = quantum % DEFAULT_BLOCK_SIZE == 0 ? 0 : DEFAULT_BLOCK_SIZE;
+	t.ec = mdf_create(args, &info);
+	spa_assert_se(t.ec != NULL);
+	make_echo_path(&t);
+
+	/* far end only, the filter converges */
+	erle = run_seconds(&t, 4, 0.0f);
+	fprintf(stderr, "quantum %u: ERLE %.1f dB\n", quantum, erle);
+	spa_assert_se(erle > MIN_ERLE);
+
+	/* double talk with a near end talker as loud as the echo, the
+	 * filter must not diverge */
+	erle = run_seconds(&t, 2, 2.0f);
+	fprintf(stderr, "quantum %u: ERLE %.1f dB in double talk\n", quantum, erle);
+	spa_assert_se(erle > MIN_ERLE_DOUBLE_TALK);
+
+	/* far end only again, the filter recovers */
+	erle = run_seconds(&t, 2, 0.0f);
+	fprintf(stderr, "quantum %u: ERLE %.1f dB after double talk\n", quantum, erle);
+	spa_assert_se(erle > MIN_ERLE);
+
+	mdf_destroy(t.ec);
+	pw_properties_free(args);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t cpu_flags = 0;
+
+#if defined(HAVE_SSE)
+	cpu_flags |= SPA_CPU_FLAG_SSE;
+#endif
+#if defined(HAVE_NEON)
+	cpu_flags |= SPA_CPU_FLAG_NEON;
+#endif
+	pffft_select_cpu(cpu_flags);
+
+	pw_init(&argc, &argv);
+
+	test_quantum(256);
+	test_quantum(480);
+
+	pw_deinit();
+
+	return 0;
+}
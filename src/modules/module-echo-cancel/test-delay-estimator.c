@@ -0,0 +1,137 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <spa/support/cpu.h>
+#include <spa/utils/defs.h>
+
+#include <pipewire/pipewire.h>
+
+#include "delay-estimator.c"
+
+#define RATE		48000
+#define MAX_DELAY	(RATE * 300 / 1000)
+#define QUANTUM		480
+#define HISTORY		16384
+
+struct test {
+	struct delay_estimator *de;
+	float history[HISTORY];
+	uint32_t pos;
+};
+
+static uint32_t seed;
+
+static float random_sample(void)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (float)(seed >> 8) / (1u << 24) - 0.5f;
+}
+
+/* wait until the worker took the frames that are ready, so that no samples
+ * are dropped and the test doesn't depend on the timing of the worker */
+static void wait_worker(struct delay_estimator *de)
+{
+	uint32_t index;
+
+	while (spa_ringbuffer_get_read_index(&de->ring, &index) >= (int32_t)de->frame_size)
+		sched_yield();
+}
+
+/* push the given number of seconds of noise with an echo at delay samples
+ * and return after how many samples the estimate is the delay, or -1 */
+static int32_t run_seconds(struct test *t, uint32_t seconds, uint32_t delay)
+{
+	float rec[QUANTUM], play[QUANTUM];
+	const float *rec_p[1] = { rec }, *play_p[1] = { play };
+	uint32_t i, n, n_samples = seconds * RATE;
+	int32_t found = -1;
+
+	spa_assert_se(delay < HISTORY);
+
+	for (n = 0; n < n_samples; n += QUANTUM) {
+		for (i = 0; i < QUANTUM; i++) {
+			play[i] = random_sample();
+			t->history[t->pos] = play[i];
+			rec[i] = 0.5f * t->history[(t->pos + HISTORY - delay) % HISTORY] +
+				0.01f * random_sample();
+			t->pos = (t->pos + 1) % HISTORY;
+		}
+		delay_estimator_push(t->de, rec_p, play_p, 1, QUANTUM);
+		wait_worker(t->de);
+
+		if (abs(delay_estimator_get_delay(t->de) - (int32_t)delay) <= (int32_t)t->de->tolerance) {
+			if (found < 0)
+				found = n + QUANTUM;
+		} else {
+			found = -1;
+		}
+	}
+	return found;
+}
+
+int main(int argc, char *argv[])
+{
+	struct test t;
+	uint32_t cpu_flags = 0;
+	int32_t found;
+
+#if defined(HAVE_SSE)
+	cpu_flags |= SPA_CPU_FLAG_SSE;
+#endif
+#if defined(HAVE_NEON)
+	cpu_flags |= SPA_CPU_FLAG_NEON;
+#endif
+	pffft_select_cpu(cpu_flags);
+
+	pw_init(&argc, &argv);
+
+	spa_zero(t);
+	t.de = delay_estimator_new(RATE, MAX_DELAY);
+	spa_assert_se(t.de != NULL);
+	spa_assert_se(delay_estimator_get_delay(t.de) < 0);
+
+	/* the delay is found and stays found */
+	found = run_seconds(&t, 5, 4800);
+	fprintf(stderr, "delay 4800 found after %d samples\n", found);
+	spa_assert_se(found >= 0);
+	spa_assert_se(found < 2 * RATE);
+
+	/* the echo path changes, the estimate follows */
+	found = run_seconds(&t, 5, 9600);
+	fprintf(stderr, "delay 9600 found after %d samples\n", found);
+	spa_assert_se(found >= 0);
+	spa_assert_se(found < 2 * RATE);
+
+	delay_estimator_free(t.de);
+
+	pw_deinit();
+
+	return 0;
+}
@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <dlfcn.h>
 #include <unistd.h>
+#include <semaphore.h>
 
 #include "config.h"
 
@@ -43,6 +44,7 @@
 
 #include <pipewire/utils.h>
 #include <pipewire/private.h>
+#include <pipewire/thread.h>
 #include <pipewire/impl.h>
 #include <pipewire/extensions/profiler.h>
 
@@ -86,6 +88,7 @@ static const struct spa_dict_item module_props[] = {
 				"    inputs = [ <portname> ... ] "
 				"    outputs = [ <portname> ... ] "
 				"] "
+				"[ filter.graph.threads=<number of threads> ] "
 				"[ capture.props=<properties> ] "
 				"[ playback.props=<properties> ] " },
 	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
@@ -110,9 +113,9 @@ static const struct spa_dict_item module_props[] = {
 #define MAX_PORTS 64
 #define MAX_CONTROLS 256
 #define MAX_SAMPLES 8192
+#define MAX_THREADS 16
 
 static float silence_data[MAX_SAMPLES];
-static float discard_data[MAX_SAMPLES];
 
 struct plugin {
 	struct spa_list link;
@@ -154,7 +157,7 @@ struct port {
 	uint32_t n_links;
 	uint32_t external;
 
-	float control_data;
+	float control_data[MAX_HNDL];
 	float *audio_data[MAX_HNDL];
 };
 
@@ -198,6 +201,18 @@ struct graph_port {
 struct graph_hndl {
 	const struct fc_descriptor *desc;
 	void *hndl;
+	uint32_t instance;
+};
+
+/* Each instance of the graph only links to itself, so the instances
+ * can be processed in parallel. A worker processes the instances from
+ * first up to last and is woken up for every cycle. */
+struct graph_worker {
+	struct graph *graph;
+	struct spa_thread *thread;
+	sem_t start;
+	uint32_t first;
+	uint32_t last;
 };
 
 struct graph {
@@ -217,6 +232,17 @@ struct graph {
 
 	uint32_t n_control;
 	struct port *control_port[MAX_CONTROLS];
+
+	uint32_t n_instance;
+	/* unconnected outputs of each instance, the instances can run
+	 * in different threads */
+	float *discard_data[MAX_HNDL];
+
+	uint32_t n_workers;
+	struct graph_worker workers[MAX_THREADS];
+	sem_t done;
+	uint32_t n_samples;
+	unsigned int quit:1;
 };
 
 struct impl {
@@ -271,12 +297,130 @@ static void capture_destroy(void *d)
 	impl->capture = NULL;
 }
 
+static void graph_run(struct graph *graph, uint32_t first, uint32_t last, uint32_t n_samples)
+{
+	uint32_t i;
+
+	for (i = 0; i < graph->n_hndl; i++) {
+		struct graph_hndl *hndl = &graph->hndl[i];
+		if (hndl->instance >= first && hndl->instance < last)
+			hndl->desc->run(hndl->hndl, n_samples);
+	}
+}
+
+static void *graph_worker_thread(void *data)
+{
+	struct graph_worker *w = data;
+	struct graph *graph = w->graph;
+
+	while (true) {
+		while (sem_wait(&w->start) < 0 && errno == EINTR);
+		if (graph->quit)
+			break;
+		graph_run(graph, w->first, w->last, graph->n_samples);
+		sem_post(&graph->done);
+	}
+	return NULL;
+}
+
+static void graph_process(struct graph *graph, uint32_t n_samples)
+{
+	uint32_t i, n_workers = graph->n_workers;
+
+	if (n_workers == 0) {
+		graph_run(graph, 0, graph->n_instance, n_samples);
+		return;
+	}
+
+	/* the first instances are done in this thread, the workers do the
+	 * others. We need to wait for all of them before the output can
+	 * be queued. */
+	graph->n_samples = n_samples;
+	for (i = 0; i < n_workers; i++)
+		sem_post(&graph->workers[i].start);
+
+	graph_run(graph, 0, graph->workers[0].first, n_samples);
+
+	for (i = 0; i < n_workers; i++)
+		while (sem_wait(&graph->done) < 0 && errno == EINTR);
+}
+
+static void graph_stop_workers(struct graph *graph)
+{
+	uint32_t i;
+
+	graph->quit = true;
+	for (i = 0; i < graph->n_workers; i++)
+		sem_post(&graph->workers[i].start);
+	for (i = 0; i < graph->n_workers; i++) {
+		struct graph_worker *w = &graph->workers[i];
+		pw_thread_utils_join(w->thread, NULL);
+		sem_destroy(&w->start);
+	}
+	if (graph->n_workers > 0)
+		sem_destroy(&graph->done);
+	graph->n_workers = 0;
+}
+
+static int graph_start_workers(struct graph *graph, uint32_t n_threads)
+{
+	uint32_t i, first, per_thread, extra;
+	int res;
+
+	n_threads = SPA_CLAMP(n_threads, 1u, SPA_MIN(graph->n_instance, (uint32_t)MAX_THREADS));
+	if (n_threads <= 1)
+		return 0;
+
+	if (sem_init(&graph->done, 0, 0) < 0)
+		return -errno;
+
+	/* spread the instances over the threads, the calling thread
+	 * gets the first share */
+	per_thread = graph->n_instance / n_threads;
+	extra = graph->n_instance % n_threads;
+	first = per_thread + (extra > 0 ? 1 : 0);
+
+	graph->quit = false;
+	for (i = 1; i < n_threads; i++) {
+		struct graph_worker *w = &graph->workers[i - 1];
+
+		w->graph = graph;
+		w->first = first;
+		w->last = first + per_thread + (i < extra ? 1 : 0);
+		first = w->last;
+
+		if (sem_init(&w->start, 0, 0) < 0) {
+			res = -errno;
+			goto error;
+		}
+		w->thread = pw_thread_utils_create(NULL, graph_worker_thread, w);
+		if (w->thread == NULL) {
+			res = -errno;
+			sem_destroy(&w->start);
+			goto error;
+		}
+		graph->n_workers++;
+		pw_thread_utils_acquire_rt(w->thread, -1);
+
+		pw_log_info("worker %d: instances %d-%d", i, w->first, w->last - 1);
+	}
+	return 0;
+
+error:
+	pw_log_error("can't create worker thread: %s", spa_strerror(res));
+	if (graph->n_workers == 0)
+		sem_destroy(&graph->done);
+	else
+		graph_stop_workers(graph);
+	return res;
+}
+
 static void capture_process(void *d)
 {
 	struct impl *impl = d;
 	struct pw_buffer *in, *out;
 	struct graph *graph = &impl->graph;
-	uint32_t i, size = 0, n_hndl = graph->n_hndl;
+	uint32_t i, size = 0;
 	int32_t stride = 0;
 
 	if ((in = pw_stream_dequeue_buffer(impl->capture)) == NULL)
@@ -308,10 +452,7 @@ static void capture_process(void *d)
 		dd->chunk->size = size;
 		dd->chunk->stride = stride;
 	}
-	for (i = 0; i < n_hndl; i++) {
-		struct graph_hndl *hndl = &graph->hndl[i];
-		hndl->desc->run(hndl->hndl, size / sizeof(float));
-	}
+	graph_process(graph, size / sizeof(float));
 
 done:
 	if (in != NULL)
@@ -462,7 +603,7 @@ static struct spa_pod *get_props_param(struct graph *graph, struct spa_pod_build
 			snprintf(name, sizeof(name), "%s", p->name);
 
 		spa_pod_builder_string(b, name);
-		spa_pod_builder_float(b, port->control_data);
+		spa_pod_builder_float(b, port->control_data[0]);
 	}
 	spa_pod_builder_pop(b, &f[1]);
 	return spa_pod_builder_pop(b, &f[0]);
@@ -473,6 +614,7 @@ static int set_control_value(struct node *node, const char *name, float *value)
 	struct descriptor *desc;
 	struct port *port;
 	float old;
+	uint32_t i;
 
 	port = find_port(node, name, FC_PORT_INPUT | FC_PORT_CONTROL);
 	if (port == NULL)
@@ -481,10 +623,11 @@ static int set_control_value(struct node *node, const char *name, float *value)
 	node = port->node;
 	desc = node->desc;
 
-	old = port->control_data;
-	port->control_data = value ? *value : desc->default_control[port->idx];
-	pw_log_info("control %d ('%s') from %f to %f", port->idx, name, old, port->control_data);
-	return old == port->control_data ? 0 : 1;
+	old = port->control_data[0];
+	for (i = 0; i < MAX_HNDL; i++)
+		port->control_data[i] = value ? *value : desc->default_control[port->idx];
+	pw_log_info("control %d ('%s') from %f to %f", port->idx, name, old, port->control_data[0]);
+	return old == port->control_data[0] ? 0 : 1;
 }
 
 static int parse_params(struct graph *graph, const struct spa_pod *pod)
@@ -1041,7 +1184,7 @@ static int load_node(struct graph *graph, struct spa_json *json)
 	char label[256] = "";
 	bool have_control = false;
 	bool have_config = false;
-	uint32_t i;
+	uint32_t i, j;
 
 	while (spa_json_get_string(json, key, sizeof(key)) > 0) {
 		if (spa_streq("type", key)) {
@@ -1118,7 +1261,8 @@ static int load_node(struct graph *graph, struct spa_json *json)
 		port->external = SPA_ID_INVALID;
 		port->p = desc->control[i];
 		spa_list_init(&port->link_list);
-		port->control_data = desc->default_control[i];
+		for (j = 0; j < MAX_HNDL; j++)
+			port->control_data[j] = desc->default_control[i];
 	}
 	for (i = 0; i < desc->n_notify; i++) {
 		struct port *port = &node->notify_port[i];
@@ -1273,19 +1417,30 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 		goto error;
 	}
 	pw_log_info("using %d instances %d %d", n_hndl, n_input, n_output);
+	graph->n_instance = n_hndl;
+
+	for (i = 0; i < n_hndl; i++) {
+		graph->discard_data[i] = calloc(1, MAX_SAMPLES * sizeof(float));
+		if (graph->discard_data[i] == NULL) {
+			res = -errno;
+			goto error;
+		}
+	}
 
 	/* now go over all nodes and create instances. We can also link
 	 * the control and notify ports already */
 	graph->n_control = 0;
 	spa_list_for_each(node, &graph->node_list, link) {
-		float *sd = silence_data, *dd = discard_data;
+		bool null_data;
 
 		desc = node->desc;
 		d = desc->desc;
-		if (d->flags & FC_DESCRIPTOR_SUPPORTS_NULL_DATA)
-			sd = dd = NULL;
+		null_data = SPA_FLAG_IS_SET(d->flags, FC_DESCRIPTOR_SUPPORTS_NULL_DATA);
 
 		for (i = 0; i < n_hndl; i++) {
+			float *sd = null_data ? NULL : silence_data;
+			float *dd = null_data ? NULL : graph->discard_data[i];
+
 			pw_log_info("instantiate %s %d", d->name, i);
 			if ((node->hndl[i] = d->instantiate(d, &impl->rate, i, node->config)) == NULL) {
 				pw_log_error("cannot create plugin instance");
@@ -1304,11 +1459,11 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 			}
 			for (j = 0; j < desc->n_control; j++) {
 				port = &node->control_port[j];
-				d->connect_port(node->hndl[i], port->p, &port->control_data);
+				d->connect_port(node->hndl[i], port->p, &port->control_data[i]);
 			}
 			for (j = 0; j < desc->n_notify; j++) {
 				port = &node->notify_port[j];
-				d->connect_port(node->hndl[i], port->p, &port->control_data);
+				d->connect_port(node->hndl[i], port->p, &port->control_data[i]);
 			}
 			if (d->activate)
 				d->activate(node->hndl[i]);
@@ -1443,6 +1598,7 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 			gh = &graph->hndl[graph->n_hndl++];
 			gh->hndl = node->hndl[i];
 			gh->desc = d;
+			gh->instance = i;
 		}
 
 		for (i = 0; i < desc->n_output; i++)
@@ -1535,10 +1691,16 @@ static void graph_free(struct graph *graph)
 {
 	struct link *link;
 	struct node *node;
+	uint32_t i;
+
 	spa_list_consume(link, &graph->link_list, link)
 		link_free(link);
 	spa_list_consume(node, &graph->node_list, link)
 		node_free(node);
+	for (i = 0; i < MAX_HNDL; i++) {
+		free(graph->discard_data[i]);
+		graph->discard_data[i] = NULL;
+	}
 }
 
 static void core_error(void *data, uint32_t id, int seq, int res, const char *message)
@@ -1577,6 +1739,7 @@ static void impl_destroy(struct impl *impl)
 		pw_stream_destroy(impl->playback);
 	if (impl->core && impl->do_disconnect)
 		pw_core_disconnect(impl->core);
+	graph_stop_workers(&impl->graph);
 	pw_properties_free(impl->capture_props);
 	pw_properties_free(impl->playback_props);
 	if (impl->work)
@@ -1744,6 +1907,9 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 		pw_log_error("can't load graph: %s", spa_strerror(res));
 		goto error;
 	}
+	if ((str = pw_properties_get(props, "filter.graph.threads")) != NULL &&
+	    (res = graph_start_workers(&impl->graph, SPA_MAX(atoi(str), 1))) < 0)
+		goto error;
 
 	impl->core = pw_context_get_object(impl->context, PW_TYPE_INTERFACE_Core);
 	if (impl->core == NULL) {
@@ -0,0 +1,122 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <spa/support/cpu.h>
+#include <spa/utils/defs.h>
+
+#include "convolver.h"
+#include "pffft.h"
+
+#define RATE		48000
+#define QUANTUM		64
+#define N_QUANTA	(RATE * 4 / QUANTUM)
+
+static const int ir_seconds[] = { 1, 4, 8 };
+
+static float samp_in[QUANTUM];
+static float samp_out[QUANTUM];
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void run_test1(const float *ir, int n_ir, int background)
+{
+	struct convolver *conv;
+	uint64_t t1, t2, total = 0, max = 0;
+	uint64_t period = (uint64_t)QUANTUM * SPA_NSEC_PER_SEC / RATE;
+	struct timespec next;
+	int i;
+
+	conv = convolver_new(QUANTUM, 4096, ir, n_ir, background);
+	if (conv == NULL) {
+		fprintf(stderr, "can't create convolver\n");
+		exit(1);
+	}
+
+	/* wake up once per quantum like a driver would, the background
+	 * stages can only keep up when they get the real time to run */
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < N_QUANTA; i++) {
+		t1 = SPA_TIMESPEC_TO_NSEC(&next) + period;
+		next.tv_sec = t1 / SPA_NSEC_PER_SEC;
+		next.tv_nsec = t1 % SPA_NSEC_PER_SEC;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		t1 = get_time_ns();
+		convolver_run(conv, samp_in, samp_out, QUANTUM);
+		t2 = get_time_ns();
+
+		total += t2 - t1;
+		max = SPA_MAX(max, t2 - t1);
+	}
+	convolver_free(conv);
+
+	fprintf(stderr, "ir:%-8d %-10s avg:%8"PRIu64"ns max:%10"PRIu64"ns quantum:%"PRIu64"ns\n",
+			n_ir, background ? "background" : "inline",
+			total / N_QUANTA, max, period);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t i;
+	int j;
+	uint32_t cpu_flags = 0;
+
+#if defined(HAVE_SSE)
+	cpu_flags |= SPA_CPU_FLAG_SSE;
+#endif
+#if defined(HAVE_NEON)
+	cpu_flags |= SPA_CPU_FLAG_NEON;
+#endif
+	pffft_select_cpu(cpu_flags);
+
+	srand(0);
+	for (j = 0; j < QUANTUM; j++)
+		samp_in[j] = (float)rand() / RAND_MAX - 0.5f;
+
+	for (i = 0; i < SPA_N_ELEMENTS(ir_seconds); i++) {
+		int n_ir = ir_seconds[i] * RATE;
+		float *ir = malloc(n_ir * sizeof(float));
+
+		for (j = 0; j < n_ir; j++)
+			ir[j] = ((float)rand() / RAND_MAX - 0.5f) * expf(-4.0f * j / n_ir);
+
+		run_test1(ir, n_ir, 0);
+		run_test1(ir, n_ir, 1);
+		free(ir);
+	}
+	return 0;
+}
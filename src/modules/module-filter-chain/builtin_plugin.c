@@ -31,6 +31,7 @@
 
 #include <spa/utils/json.h>
 #include <spa/support/cpu.h>
+#include <spa/param/audio/format.h>
 
 #include <pipewire/log.h>
 
@@ -40,6 +41,10 @@
 #include "pffft.h"
 #include "convolver.h"
 
+#include "../../../spa/plugins/audiomixer/mix-ops.h"
+
+static struct mix_ops mix_ops;
+
 struct builtin {
 	unsigned long rate;
 	float *port[64];
@@ -111,10 +116,10 @@ static const struct fc_descriptor copy_desc = {
 static void mixer_run(void * Instance, unsigned long SampleCount)
 {
 	struct builtin *impl = Instance;
-	int i;
-	unsigned long j;
+	int i, n_src = 0;
 	float *out = impl->port[0];
-	bool first = true;
+	const void *src[8];
+	float gains[8];
 
 	if (out == NULL)
 		return;
@@ -126,24 +131,12 @@ static void mixer_run(void * Instance, unsigned long SampleCount)
 		if (in == NULL || gain == 0.0f)
 			continue;
 
-		if (first) {
-			if (gain == 1.0f)
-				memcpy(out, in, SampleCount * sizeof(float));
-			else
-				for (j = 0; j < SampleCount; j++)
-					out[j] = in[j] * gain;
-			first = false;
-		} else {
-			if (gain == 1.0f)
-				for (j = 0; j < SampleCount; j++)
-					out[j] += in[j];
-			else
-				for (j = 0; j < SampleCount; j++)
-					out[j] += in[j] * gain;
-		}
+		src[n_src] = in;
+		gains[n_src++] = gain;
 	}
-	if (first)
-		memset(out, 0, SampleCount * sizeof(float));
+	/* scale and mix the inputs in one pass, this also clears the output
+	 * when there are no inputs */
+	mix_ops_process_gain(&mix_ops, out, src, gains, n_src, SampleCount);
 }
 
 static struct fc_port mixer_ports[] = {
@@ -468,6 +461,8 @@ struct convolver_impl {
 	float *port[64];
 
 	struct convolver *conv;
+	int late;
+	uint32_t overruns;
 };
 
 static float *read_samples(const char *filename, float gain, int delay, int offset,
@@ -585,6 +580,7 @@ static void * convolver_instantiate(const struct fc_descriptor * Descriptor,
 	int blocksize = 0, tailsize = 0;
 	int delay = 0;
 	float gain = 1.0f;
+	bool background = true;
 
 	if (config == NULL)
 		return NULL;
@@ -626,6 +622,10 @@ static void * convolver_instantiate(const struct fc_descriptor * Descriptor,
 			if (spa_json_get_int(&it[1], &channel) <= 0)
 				return NULL;
 		}
+		else if (spa_streq(key, "background")) {
+			if (spa_json_get_bool(&it[1], &background) <= 0)
+				return NULL;
+		}
 		else if (spa_json_next(&it[1], &val) < 0)
 			break;
 	}
@@ -663,7 +663,7 @@ static void * convolver_instantiate(const struct fc_descriptor * Descriptor,
 
 	impl->rate = *SampleRate;
 
-	impl->conv = convolver_new(blocksize, tailsize, samples, n_samples);
+	impl->conv = convolver_new(blocksize, tailsize, samples, n_samples, background);
 	if (impl->conv == NULL)
 		goto error;
 
@@ -711,7 +711,17 @@ static void convolver_deactivate(void * Instance)
 static void convolve_run(void * Instance, unsigned long SampleCount)
 {
 	struct convolver_impl *impl = Instance;
-	convolver_run(impl->conv, impl->port[1], impl->port[0], SampleCount);
+	int late;
+
+	late = convolver_run(impl->conv, impl->port[1], impl->port[0], SampleCount);
+	if (late > 0) {
+		impl->overruns += late;
+		/* only log when the stages start to be late */
+		if (!impl->late)
+			pw_log_warn("convolver %p: background stages are late, overruns:%u",
+					impl, impl->overruns);
+	}
+	impl->late = late > 0;
 }
 
 static const struct fc_descriptor convolve_desc = {
@@ -777,7 +787,19 @@ struct fc_plugin *load_builtin_plugin(const struct spa_support *support, uint32_
 		const char *plugin, const char *config)
 {
 	struct spa_cpu *cpu_iface;
+	uint32_t cpu_flags;
+
 	cpu_iface = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
-	pffft_select_cpu(cpu_iface ? spa_cpu_get_flags(cpu_iface) : 0);
+	cpu_flags = cpu_iface ? spa_cpu_get_flags(cpu_iface) : 0;
+	pffft_select_cpu(cpu_flags);
+
+	if (mix_ops.process_gain == NULL) {
+		mix_ops.fmt = SPA_AUDIO_FORMAT_F32;
+		mix_ops.n_channels = 1;
+		mix_ops.cpu_flags = cpu_flags;
+		if (mix_ops_init(&mix_ops) < 0)
+			return NULL;
+	}
+
 	return &builtin_plugin;
 }
@@ -28,7 +28,12 @@
 
 #include <spa/utils/defs.h>
 
+#include <errno.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdbool.h>
 
 #include "pffft.h"
 
@@ -315,6 +320,32 @@ static int convolver1_run(struct convolver1 *conv, const float *input, float *ou
 	return len;
 }
 
+/* The tail of the IR is split in stages with growing block sizes. The
+ * output of a stage for a block of input is only needed one block later
+ * so it can be computed in the background while the next block is
+ * collected. */
+#define MAX_STAGES	4
+#define STAGE_GROWTH	8
+
+struct stage {
+	int blockSize;
+	struct convolver1 *conv;
+	float *input;
+	float *jobInput;
+	float *lateInput;
+	float *output;
+	float *precalculated;
+	int inputFill;
+	int pending;
+	int queued;
+	int discard;
+	int reset;
+	int jobReset;
+	int late;
+	int jobLate;
+	sem_t done;
+};
+
 struct convolver
 {
 	int headBlockSize;
@@ -323,16 +354,114 @@ struct convolver
 	struct convolver1 *tailConvolver0;
 	float *tailOutput0;
 	float *tailPrecalculated0;
-	struct convolver1 *tailConvolver;
-	float *tailOutput;
-	float *tailPrecalculated;
 	float *tailInput;
 	int tailInputFill;
 	int precalculatedPos;
+
+	int n_stages;
+	struct stage stages[MAX_STAGES];
+
+	int background;
+	pthread_t thread;
+	sem_t wakeup;
+	int quit;
 };
 
+static void *stage_thread(void *data)
+{
+	struct convolver *conv = data;
+	int i;
+
+	while (true) {
+		while (sem_wait(&conv->wakeup) < 0 && errno == EINTR);
+		if (__atomic_load_n(&conv->quit, __ATOMIC_SEQ_CST))
+			break;
+
+		/* smallest blocks have the nearest deadline, do them first */
+		for (i = 0; i < conv->n_stages; i++) {
+			struct stage *s = &conv->stages[i];
+			if (!__atomic_load_n(&s->queued, __ATOMIC_SEQ_CST))
+				continue;
+			if (s->jobReset)
+				convolver1_reset(s->conv);
+			/* feed the input of the missed block first so that the
+			 * history of the stage is complete, its output is not used */
+			if (s->jobLate)
+				convolver1_run(s->conv, s->lateInput, s->output, s->blockSize);
+			convolver1_run(s->conv, s->jobInput, s->output, s->blockSize);
+			__atomic_store_n(&s->queued, 0, __ATOMIC_SEQ_CST);
+			sem_post(&s->done);
+		}
+	}
+	return NULL;
+}
+
+static void stage_wait(struct stage *s)
+{
+	if (s->pending) {
+		while (sem_wait(&s->done) < 0 && errno == EINTR);
+		s->pending = 0;
+	}
+}
+
+/* returns 1 when the stage missed its deadline */
+static int stage_dispatch(struct convolver *conv, struct stage *s)
+{
+	if (!conv->background) {
+		SPA_SWAP(s->precalculated, s->output);
+		convolver1_run(s->conv, s->input, s->output, s->blockSize);
+		return 0;
+	}
+	/* the previous block had a complete block period to finish. When the
+	 * worker missed its deadline, don't wait for it in the realtime thread,
+	 * the stage is silent for this block. Keep the input so that the worker
+	 * can add it to the history of the stage with the next block. When the
+	 * worker is still late after that, the input is lost. */
+	if (s->pending) {
+		if (sem_trywait(&s->done) < 0) {
+			fft_clear(s->precalculated, s->blockSize);
+			s->discard = 1;
+			if (!s->late && !s->jobLate) {
+				fft_copy(s->lateInput, s->input, s->blockSize);
+				s->late = 1;
+			}
+			return 1;
+		}
+		s->pending = 0;
+	}
+	/* the output of a late or reset block is not used */
+	if (s->discard) {
+		fft_clear(s->output, s->blockSize);
+		s->discard = 0;
+	}
+	SPA_SWAP(s->precalculated, s->output);
+	SPA_SWAP(s->input, s->jobInput);
+	s->jobReset = s->reset;
+	s->reset = 0;
+	s->jobLate = s->late;
+	s->late = 0;
+	s->pending = 1;
+	__atomic_store_n(&s->queued, 1, __ATOMIC_SEQ_CST);
+	sem_post(&conv->wakeup);
+	return 0;
+}
+
+static void stage_free(struct stage *s)
+{
+	if (s->conv)
+		convolver1_free(s->conv);
+	fft_free(s->input);
+	fft_free(s->jobInput);
+	fft_free(s->lateInput);
+	fft_free(s->output);
+	fft_free(s->precalculated);
+	sem_destroy(&s->done);
+}
+
 void convolver_reset(struct convolver *conv)
 {
+	int i;
+
 	if (conv->headConvolver)
 		convolver1_reset(conv->headConvolver);
 	if (conv->tailConvolver0) {
@@ -340,19 +469,74 @@ void convolver_reset(struct convolver *conv)
 		fft_clear(conv->tailOutput0, conv->tailBlockSize);
 		fft_clear(conv->tailPrecalculated0, conv->tailBlockSize);
 	}
-	if (conv->tailConvolver) {
-		convolver1_reset(conv->tailConvolver);
-		fft_clear(conv->tailOutput, conv->tailBlockSize);
-		fft_clear(conv->tailPrecalculated, conv->tailBlockSize);
+	for (i = 0; i < conv->n_stages; i++) {
+		struct stage *s = &conv->stages[i];
+		if (!conv->background) {
+			convolver1_reset(s->conv);
+			fft_clear(s->output, s->blockSize);
+		} else {
+			/* the worker might still be busy with the stage, don't
+			 * wait for it, it resets the stage with the next block */
+			s->reset = 1;
+			s->discard = 1;
+			s->late = 0;
+		}
+		fft_clear(s->precalculated, s->blockSize);
+		s->inputFill = 0;
 	}
 	conv->tailInputFill = 0;
 	conv->precalculatedPos = 0;
 }
 
-struct convolver *convolver_new(int head_block, int tail_block, const float *ir, int irlen)
+static int stage_init(struct stage *s, int block, const float *ir, int irlen)
+{
+	s->blockSize = block;
+	if (sem_init(&s->done, 0, 0) < 0)
+		return -errno;
+	s->conv = convolver1_new(block, ir, irlen);
+	s->input = fft_alloc(block);
+	s->jobInput = fft_alloc(block);
+	s->lateInput = fft_alloc(block);
+	s->output = fft_alloc(block);
+	s->precalculated = fft_alloc(block);
+	if (s->conv == NULL || s->input == NULL || s->jobInput == NULL ||
+	    s->lateInput == NULL || s->output == NULL || s->precalculated == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+static int start_thread(struct convolver *conv)
+{
+	pthread_attr_t attr;
+	struct sched_param sp;
+	int res;
+
+	if (sem_init(&conv->wakeup, 0, 0) < 0)
+		return -errno;
+
+	/* the stages have a full block to finish, run them with normal
+	 * priority so that they don't compete with the realtime threads */
+	spa_zero(sp);
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	pthread_attr_setschedparam(&attr, &sp);
+	res = pthread_create(&conv->thread, &attr, stage_thread, conv);
+	pthread_attr_destroy(&attr);
+
+	if (res != 0) {
+		sem_destroy(&conv->wakeup);
+		return -res;
+	}
+	conv->background = 1;
+	return 0;
+}
+
+struct convolver *convolver_new(int head_block, int tail_block, const float *ir, int irlen,
+		int background)
 {
 	struct convolver *conv;
-	int head_ir_len;
+	int head_ir_len, offset, block;
 
 	if (head_block == 0 || tail_block == 0)
 		return NULL;
@@ -382,42 +566,63 @@ struct convolver *convolver_new(int head_block, int tail_block, const float *ir,
 		conv->tailConvolver0 = convolver1_new(conv->headBlockSize, ir + conv->tailBlockSize, conv1IrLen);
 		conv->tailOutput0 = fft_alloc(conv->tailBlockSize);
 		conv->tailPrecalculated0 = fft_alloc(conv->tailBlockSize);
+		conv->tailInput = fft_alloc(conv->tailBlockSize);
 	}
 
-	if (irlen > 2 * conv->tailBlockSize) {
-		int tailIrLen = irlen - (2 * conv->tailBlockSize);
-		conv->tailConvolver = convolver1_new(conv->tailBlockSize, ir + (2 * conv->tailBlockSize), tailIrLen);
-		conv->tailOutput = fft_alloc(conv->tailBlockSize);
-		conv->tailPrecalculated = fft_alloc(conv->tailBlockSize);
-	}
+	/* a stage with block size N handles the IR from 2 * N, up to where
+	 * the next stage with block size N * STAGE_GROWTH takes over. */
+	block = conv->tailBlockSize;
+	offset = 2 * block;
+	while (offset < irlen && conv->n_stages < MAX_STAGES) {
+		int end = conv->n_stages == MAX_STAGES - 1 ?
+			irlen : SPA_MIN(irlen, 2 * block * STAGE_GROWTH);
 
-	if (conv->tailConvolver0 || conv->tailConvolver)
-		conv->tailInput = fft_alloc(conv->tailBlockSize);
+		if (stage_init(&conv->stages[conv->n_stages++], block,
+					ir + offset, end - offset) < 0)
+			goto error;
+
+		offset = end;
+		block *= STAGE_GROWTH;
+	}
 
 	convolver_reset(conv);
 
+	if (background && conv->n_stages > 0 && start_thread(conv) < 0)
+		goto error;
+
 	return conv;
+error:
+	convolver_free(conv);
+	return NULL;
 }
 
 void convolver_free(struct convolver *conv)
 {
+	int i;
+
+	if (conv->background) {
+		for (i = 0; i < conv->n_stages; i++)
+			stage_wait(&conv->stages[i]);
+		__atomic_store_n(&conv->quit, 1, __ATOMIC_SEQ_CST);
+		sem_post(&conv->wakeup);
+		pthread_join(conv->thread, NULL);
+		sem_destroy(&conv->wakeup);
+	}
 	if (conv->headConvolver)
 		convolver1_free(conv->headConvolver);
 	if (conv->tailConvolver0)
 		convolver1_free(conv->tailConvolver0);
-	if (conv->tailConvolver)
-		convolver1_free(conv->tailConvolver);
+	for (i = 0; i < conv->n_stages; i++)
+		stage_free(&conv->stages[i]);
 	fft_free(conv->tailOutput0);
 	fft_free(conv->tailPrecalculated0);
-	fft_free(conv->tailOutput);
-	fft_free(conv->tailPrecalculated);
 	fft_free(conv->tailInput);
 	free(conv);
 }
 
 int convolver_run(struct convolver *conv, const float *input, float *output, int length)
 {
-	int i;
+	int i, j, late = 0;
 
 	convolver1_run(conv->headConvolver, input, output, length);
 
@@ -438,15 +643,23 @@ int convolver_run(struct convolver *conv, const float *input, float *output, int
 					precalculatedPos++;
 				}
 			}
+			conv->precalculatedPos += processing;
 
-			if (conv->tailPrecalculated) {
-				int precalculatedPos = conv->precalculatedPos;
-				for (i = sumBegin; i < sumEnd; i++) {
-					output[i] += conv->tailPrecalculated[precalculatedPos];
-					precalculatedPos++;
+			/* all stage blocks are multiples of the head block so
+			 * they never end in the middle of this chunk */
+			for (j = 0; j < conv->n_stages; j++) {
+				struct stage *s = &conv->stages[j];
+
+				fft_sum(output + sumBegin, output + sumBegin,
+						s->precalculated + s->inputFill, processing);
+				fft_copy(s->input + s->inputFill, input + processed, processing);
+				s->inputFill += processing;
+
+				if (s->inputFill == s->blockSize) {
+					late += stage_dispatch(conv, s);
+					s->inputFill = 0;
 				}
 			}
-			conv->precalculatedPos += processing;
 
 			fft_copy(conv->tailInput + conv->tailInputFill, input + processed, processing);
 			conv->tailInputFill += processing;
@@ -461,11 +674,6 @@ int convolver_run(struct convolver *conv, const float *input, float *output, int
 					SPA_SWAP(conv->tailPrecalculated0, conv->tailOutput0);
 			}
 
-			if (conv->tailPrecalculated &&
-			    conv->tailInputFill == conv->tailBlockSize) {
-				SPA_SWAP(conv->tailPrecalculated, conv->tailOutput);
-				convolver1_run(conv->tailConvolver, conv->tailInput, conv->tailOutput, conv->tailBlockSize);
-			}
 			if (conv->tailInputFill == conv->tailBlockSize) {
 				conv->tailInputFill = 0;
 				conv->precalculatedPos = 0;
@@ -473,5 +681,5 @@ int convolver_run(struct convolver *conv, const float *input, float *output, int
 			processed += processing;
 		}
 	}
-	return 0;
+	return late;
 }
@@ -25,8 +25,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
-struct convolver *convolver_new(int block, int tail, const float *ir, int irlen);
+struct convolver *convolver_new(int block, int tail, const float *ir, int irlen,
+		int background);
 void convolver_free(struct convolver *conv);
 
 void convolver_reset(struct convolver *conv);
+/* returns the number of background stage blocks that missed their deadline */
 int convolver_run(struct convolver *conv, const float *input, float *output, int length);
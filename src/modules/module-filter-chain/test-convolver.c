@@ -0,0 +1,230 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <spa/support/cpu.h>
+#include <spa/utils/defs.h>
+
+#include "convolver.c"
+
+#define HEAD_BLOCK	64
+#define TAIL_BLOCK	256
+#define EXTRA		4096
+#define TOLERANCE	1e-4f
+
+/* IR lengths for the head only, the first tail block and 1, 2 and 3
+ * background stages */
+static const int ir_lengths[] = { 50, 400, 600, 5000, 40000 };
+
+static const int quantum_sizes[] = { 64, 200, 256 };
+
+static uint32_t seed;
+
+static float random_sample(void)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (float)(seed >> 8) / (1u << 24) - 0.5f;
+}
+
+/* wait until the worker is done with the queued stages so that no stage
+ * misses its deadline and the output is exact */
+static void wait_stages(struct convolver *conv)
+{
+	int i;
+
+	for (i = 0; i < conv->n_stages; i++)
+		stage_wait(&conv->stages[i]);
+}
+
+static void run_convolver(struct convolver *conv, const float *in, float *out,
+		int n_samples, int quantum)
+{
+	int i, n;
+
+	for (i = 0; i < n_samples; i += n) {
+		n = SPA_MIN(quantum, n_samples - i);
+		if (conv->background)
+			wait_stages(conv);
+		spa_assert_se(convolver_run(conv, &in[i], &out[i], n) == 0);
+	}
+}
+
+/* check all samples of short IRs and spread the checks over the output
+ * of long ones */
+static int check_step(int n_ir)
+{
+	return n_ir > 8192 ? 13 : 1;
+}
+
+static void direct_convolution(const float *ir, int n_ir, const float *in,
+		float *out, int n_samples)
+{
+	int i, j, step = check_step(n_ir);
+
+	for (i = 0; i < n_samples; i += step) {
+		double sum = 0.0;
+		for (j = 0; j < n_ir && j <= i; j++)
+			sum += (double)ir[j] * in[i - j];
+		out[i] = (float)sum;
+	}
+}
+
+static void compare_range(int n_ir, const float *out, const float *ref,
+		int begin, int end)
+{
+	int i, step = check_step(n_ir);
+
+	for (i = (begin + step - 1) / step * step; i < end; i += step) {
+		if (fabsf(out[i] - ref[i]) > TOLERANCE) {
+			fprintf(stderr, "ir:%d sample %d: %f != %f\n", n_ir, i, out[i], ref[i]);
+			spa_assert_not_reached();
+		}
+	}
+}
+
+static void compare(int n_ir, const float *out, const float *ref, int n_samples)
+{
+	compare_range(n_ir, out, ref, 0, n_samples);
+}
+
+static void test_convolver(const float *ir, int n_ir, const float *in, const float *ref,
+		float *out, int n_samples, int quantum, int background)
+{
+	struct convolver *conv;
+
+	conv = convolver_new(HEAD_BLOCK, TAIL_BLOCK, ir, n_ir, background);
+	spa_assert_se(conv != NULL);
+	spa_assert_se(!background || conv->n_stages == 0 || conv->background);
+
+	run_convolver(conv, in, out, n_samples, quantum);
+	compare(n_ir, out, ref, n_samples);
+
+	/* after a reset the convolver starts from silence again */
+	convolver_reset(conv);
+	run_convolver(conv, in, out, n_samples, quantum);
+	compare(n_ir, out, ref, n_samples);
+
+	convolver_free(conv);
+}
+
+/* make the first background stage miss its deadline once. The stage is
+ * silent for two blocks but it has the complete input history after it
+ * caught up, so the output is exact again after that. */
+static void test_late_stage(const float *ir, int n_ir, const float *in, const float *ref,
+		float *out, int n_samples)
+{
+	struct convolver *conv;
+	struct stage *s;
+	int i, block, start, late = 0;
+
+	conv = convolver_new(HEAD_BLOCK, TAIL_BLOCK, ir, n_ir, 1);
+	spa_assert_se(conv != NULL);
+	if (conv->n_stages == 0) {
+		convolver_free(conv);
+		return;
+	}
+	spa_assert_se(conv->background);
+
+	s = &conv->stages[0];
+	block = s->blockSize;
+	start = 4 * block;
+
+	run_convolver(conv, in, out, start, HEAD_BLOCK);
+
+	/* the worker is done with the last block but the realtime thread
+	 * doesn't see it in time */
+	while (sem_wait(&s->done) < 0 && errno == EINTR);
+	for (i = 1; i < conv->n_stages; i++)
+		stage_wait(&conv->stages[i]);
+	for (i = start; i < start + block; i += HEAD_BLOCK)
+		late += convolver_run(conv, &in[i], &out[i], HEAD_BLOCK);
+	spa_assert_se(late == 1);
+
+	/* and catches up */
+	sem_post(&s->done);
+	run_convolver(conv, &in[start + block], &out[start + block],
+			n_samples - start - block, HEAD_BLOCK);
+
+	compare_range(n_ir, out, ref, 0, start + block);
+	compare_range(n_ir, out, ref, start + 3 * block, n_samples);
+
+	convolver_free(conv);
+}
+
+static void test_ir_length(int n_ir)
+{
+	int i, n_samples = n_ir + EXTRA;
+	float *ir, *in, *out, *ref;
+	size_t j;
+
+	ir = malloc(n_ir * sizeof(float));
+	in = malloc(n_samples * sizeof(float));
+	out = malloc(n_samples * sizeof(float));
+	ref = calloc(n_samples, sizeof(float));
+	spa_assert_se(ir != NULL && in != NULL && out != NULL && ref != NULL);
+
+	/* a decaying IR with the last sample non-zero so that it is not
+	 * trimmed */
+	for (i = 0; i < n_ir; i++)
+		ir[i] = random_sample() * expf(-4.0f * i / n_ir) * 0.1f;
+	ir[n_ir - 1] = 0.001f;
+	for (i = 0; i < n_samples; i++)
+		in[i] = random_sample();
+
+	direct_convolution(ir, n_ir, in, ref, n_samples);
+
+	for (j = 0; j < SPA_N_ELEMENTS(quantum_sizes); j++) {
+		test_convolver(ir, n_ir, in, ref, out, n_samples, quantum_sizes[j], 0);
+		test_convolver(ir, n_ir, in, ref, out, n_samples, quantum_sizes[j], 1);
+	}
+	test_late_stage(ir, n_ir, in, ref, out, n_samples);
+
+	free(ir);
+	free(in);
+	free(out);
+	free(ref);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t i;
+	uint32_t cpu_flags = 0;
+
+#if defined(HAVE_SSE)
+	cpu_flags |= SPA_CPU_FLAG_SSE;
+#endif
+#if defined(HAVE_NEON)
+	cpu_flags |= SPA_CPU_FLAG_NEON;
+#endif
+	pffft_select_cpu(cpu_flags);
+
+	for (i = 0; i < SPA_N_ELEMENTS(ir_lengths); i++)
+		test_ir_length(ir_lengths[i]);
+	return 0;
+}
@@ -49,11 +49,12 @@
 PW_LOG_TOPIC(mod_topic, "mod." NAME);
 #define PW_LOG_TOPIC_DEFAULT mod_topic
 
-#define TMP_BUFFER		(16 * 1024)
+#define TMP_BUFFER		(64 * 1024)
 #define MAX_BUFFER		(8 * 1024 * 1024)
 #define MIN_FLUSH		(16 * 1024)
 #define DEFAULT_IDLE		5
 #define DEFAULT_INTERVAL	1
+#define HISTOGRAM_INTERVAL	32
 
 int pw_protocol_native_ext_profiler_init(struct pw_context *context);
 
@@ -73,13 +74,13 @@ struct impl {
 	struct pw_context *context;
 	struct pw_properties *properties;
 
-	struct spa_hook context_listener;
 	struct spa_hook module_listener;
 
 	struct pw_global *global;
 	struct spa_hook global_listener;
 
 	int64_t count;
+	int writing;
 	uint32_t busy;
 	uint32_t empty;
 	struct spa_source *flush_timeout;
@@ -91,6 +92,10 @@ struct impl {
 	uint8_t data[MAX_BUFFER];
 
 	uint8_t flush[MAX_BUFFER + sizeof(struct spa_pod_struct)];
+
+	/* one listener for each data loop, added and removed on that loop */
+	uint32_t n_listeners;
+	struct spa_hook context_listener[];
 };
 
 struct resource_data {
@@ -170,10 +175,21 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 	struct pw_node_target *t;
 	int32_t filled;
 	uint32_t idx, avail;
+	bool histograms;
 
 	if (SPA_FLAG_IS_SET(pos->clock.flags, SPA_IO_CLOCK_FLAG_FREEWHEEL))
 		return;
 
+	/* drivers on other data loops can complete at the same time, skip
+	 * this cycle when the buffer is in use */
+	if (ATOMIC_XCHG(impl->writing, 1) != 0)
+		return;
+
+	/* the histograms are cumulative, only send them now and then. Count
+	 * the cycles of each driver, with one counter for all drivers the
+	 * way they interleave decides which one gets to send them */
+	histograms = node->rt.histogram_countdown == 0;
+
 	spa_pod_builder_init(&b, impl->tmp, sizeof(impl->tmp));
 	spa_pod_builder_push_object(&b, &f[0],
 			SPA_TYPE_OBJECT_Profiler, 0);
@@ -211,6 +227,24 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 			SPA_POD_Int(a->status),
 			SPA_POD_Fraction(&node->latency));
 
+	if (a->incomplete_count > 0) {
+		const char *name = NULL;
+
+		spa_list_for_each(t, &node->rt.target_list, link) {
+			if (t->node != NULL && t->node->info.id == a->pending_id) {
+				name = t->node->name;
+				break;
+			}
+		}
+		spa_pod_builder_prop(&b, SPA_PROFILER_driverXrun, 0);
+		spa_pod_builder_add_struct(&b,
+				SPA_POD_Int(a->incomplete_count),
+				SPA_POD_Long(a->pending_time),
+				SPA_POD_Int(a->pending_id),
+				SPA_POD_String(name),
+				SPA_POD_Int(a->pending_status));
+	}
+
 	spa_list_for_each(t, &node->rt.target_list, link) {
 		struct pw_impl_node *n = t->node;
 		struct pw_node_activation *na;
@@ -230,6 +264,28 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 			SPA_POD_Int(na->status),
 			SPA_POD_Fraction(&n->latency));
 	}
+
+	if (histograms) {
+		spa_list_for_each(t, &node->rt.target_list, link) {
+			struct pw_impl_node *n = t->node;
+			struct pw_node_activation *na;
+
+			if (n == NULL)
+				continue;
+
+			na = n->rt.activation;
+			spa_pod_builder_prop(&b, SPA_PROFILER_followerHistogram, 0);
+			spa_pod_builder_add_struct(&b,
+				SPA_POD_Int(n->info.id),
+				SPA_POD_Int(na->pending_count),
+				SPA_POD_Long(na->wait_max),
+				SPA_POD_Long(na->busy_max),
+				SPA_POD_Array(sizeof(uint32_t), SPA_TYPE_Int,
+					SPA_PROFILER_HISTOGRAM_BUCKETS, na->wait_histogram),
+				SPA_POD_Array(sizeof(uint32_t), SPA_TYPE_Int,
+					SPA_PROFILER_HISTOGRAM_BUCKETS, na->busy_histogram));
+		}
+	}
 	spa_pod_builder_pop(&b, &f[0]);
 
 	if (b.state.offset > sizeof(impl->tmp))
@@ -251,10 +307,16 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 			b.data, b.state.offset);
 	spa_ringbuffer_write_update(&impl->buffer, idx + b.state.offset);
 
+	/* only count the written records, a dropped record with the
+	 * histograms is sent again in the next cycle */
+	node->rt.histogram_countdown = histograms ?
+		HISTOGRAM_INTERVAL - 1 : node->rt.histogram_countdown - 1;
+
 	if (!impl->flushing || filled + b.state.offset > MIN_FLUSH)
 		start_flush(impl);
 done:
 	impl->count++;
+	ATOMIC_STORE(impl->writing, 0);
 }
 
 static const struct pw_context_driver_events context_events = {
@@ -267,15 +329,20 @@ static int do_stop(struct spa_loop *loop,
 		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct impl *impl = user_data;
-	spa_hook_remove(&impl->context_listener);
+	uint32_t index = *(uint32_t*)data;
+	spa_hook_remove(&impl->context_listener[index]);
 	return 0;
 }
 
 static void stop_listener(struct impl *impl)
 {
+	struct pw_context *context = impl->context;
+	uint32_t i;
+
 	if (impl->listening) {
-		pw_loop_invoke(impl->context->data_loop,
-                       do_stop, SPA_ID_INVALID, NULL, 0, true, impl);
+		for (i = 0; i < SPA_MIN(impl->n_listeners, context->n_data_loops); i++)
+			pw_loop_invoke(pw_data_loop_get_loop(context->data_loops[i]),
+					do_stop, SPA_ID_INVALID, &i, sizeof(i), true, impl);
 		impl->listening = false;
 	}
 }
@@ -299,8 +366,9 @@ do_start(struct spa_loop *loop,
 		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct impl *impl = user_data;
-	spa_hook_list_append(&impl->context->driver_listener_list,
-			&impl->context_listener,
+	uint32_t index = *(uint32_t*)data;
+	spa_hook_list_append(&impl->context->driver_listener_lists[index],
+			&impl->context_listener[index],
 			&context_events, impl);
 	return 0;
 }
@@ -327,9 +395,15 @@ global_bind(void *_data, struct pw_impl_client *client, uint32_t permissions,
 			&resource_events, impl);
 
 	if (++impl->busy == 1) {
+		struct pw_context *context = impl->context;
+		uint32_t i;
+
 		pw_log_info("%p: starting profiler", impl);
-		pw_loop_invoke(impl->context->data_loop,
-                       do_start, SPA_ID_INVALID, NULL, 0, false, impl);
+		/* the driver listeners of a data loop are only used from that
+		 * loop, add our listener on each of them */
+		for (i = 0; i < impl->n_listeners; i++)
+			pw_loop_invoke(pw_data_loop_get_loop(context->data_loops[i]),
+					do_start, SPA_ID_INVALID, &i, sizeof(i), false, impl);
 		impl->listening = true;
 	}
 	return 0;
@@ -386,10 +460,13 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	PW_LOG_TOPIC_INIT(mod_topic);
 
-	impl = calloc(1, sizeof(struct impl));
+	impl = calloc(1, sizeof(struct impl) +
+			context->n_data_loops * sizeof(struct spa_hook));
 	if (impl == NULL)
 		return -errno;
 
+	impl->n_listeners = context->n_data_loops;
+
 	pw_protocol_native_ext_profiler_init(context);
 
 	pw_log_debug("module %p: new %s", impl, args);
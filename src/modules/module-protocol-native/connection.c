@@ -84,6 +84,9 @@ struct impl {
 
 	uint32_t version;
 	size_t hdr_size;
+
+	/* offset in the out buffer of the message that uses each out fd */
+	uint32_t out_fds_pos[MAX_FDS];
 };
 
 /** \endcond */
@@ -150,7 +153,10 @@ static void *connection_ensure_size(struct pw_protocol_native_connection *conn,
 	int res;
 
 	if (buf->buffer_size + size > buf->buffer_maxsize) {
-		buf->buffer_maxsize = SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE);
+		/* grow exponentially so that a burst of messages does not
+		 * realloc the buffer for each MAX_BUFFER_SIZE */
+		buf->buffer_maxsize = SPA_MAX(buf->buffer_maxsize * 2,
+				SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE));
 		buf->buffer_data = realloc(buf->buffer_data, buf->buffer_maxsize);
 		if (buf->buffer_data == NULL) {
 			res = -errno;
@@ -270,11 +276,27 @@ too_many_fds:
 	return -EPROTO;
 }
 
+/* move the unconsumed data and fds of the in buffer to the start so that
+ * the buffer does not grow when messages are split over reads */
+static void shift_buffer(struct buffer *buf)
+{
+	if (buf->offset > 0) {
+		buf->buffer_size -= buf->offset;
+		memmove(buf->buffer_data, buf->buffer_data + buf->offset, buf->buffer_size);
+		buf->offset = 0;
+	}
+	if (buf->fds_offset > 0) {
+		buf->n_fds -= buf->fds_offset;
+		memmove(buf->fds, &buf->fds[buf->fds_offset], buf->n_fds * sizeof(int));
+		buf->fds_offset = 0;
+	}
+}
+
 static void clear_buffer(struct buffer *buf, bool fds)
 {
 	uint32_t i;
 	if (fds) {
-		for (i = 0; i < buf->n_fds; i++)
+		for (i = buf->fds_offset; i < buf->n_fds; i++)
 			close(buf->fds[i]);
 	}
 	buf->n_fds = 0;
@@ -537,8 +559,10 @@ static int prepare_packet(struct pw_protocol_native_connection *conn, struct buf
 	buf->offset += impl->hdr_size + len;
 	buf->fds_offset += buf->msg.n_fds;
 
+	/* keep the fds, they can arrive before the data of the
+	 * messages that use them */
 	if (buf->offset >= buf->buffer_size)
-		clear_buffer(buf, false);
+		buf->buffer_size = buf->offset = 0;
 
 	return 0;
 }
@@ -579,6 +603,7 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 		if (len == 0)
 			break;
 
+		shift_buffer(buf);
 		if (connection_ensure_size(conn, buf, len) == NULL)
 			return -errno;
 		if ((res = refill_buffer(conn, buf)) < 0)
@@ -657,7 +682,7 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 				  struct spa_pod_builder *builder)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	uint32_t *p, size = builder->state.offset;
+	uint32_t *p, size = builder->state.offset, i;
 	struct buffer *buf = &impl->out;
 	int res;
 
@@ -671,11 +696,13 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 		p[3] = buf->msg.n_fds;
 	}
 
-	buf->buffer_size += impl->hdr_size + size;
-	if (impl->version >= 3)
+	if (impl->version >= 3) {
+		for (i = 0; i < buf->msg.n_fds; i++)
+			impl->out_fds_pos[buf->n_fds + i] = buf->buffer_size;
 		buf->n_fds += buf->msg.n_fds;
-	else
+	} else
 		buf->n_fds = buf->msg.n_fds;
+	buf->buffer_size += impl->hdr_size + size;
 
 	if (mod_topic_connection->level >= SPA_LOG_LEVEL_DEBUG) {
 		pw_log_debug(">>>>>>>>> out: id:%d op:%d size:%d seq:%d",
@@ -704,20 +731,20 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	ssize_t sent, outsize;
+	ssize_t sent, outsize, avail;
 	struct msghdr msg = { 0 };
 	struct iovec iov[1];
 	struct cmsghdr *cmsg;
 	char cmsgbuf[CMSG_SPACE(MAX_FDS_MSG * sizeof(int))];
 	int res = 0, *fds;
-	uint32_t fds_len, to_close, n_fds, outfds, i;
+	uint32_t fds_len, to_close, n_fds, outfds, pos, i;
 	struct buffer *buf;
 	void *data;
-	size_t size;
+	size_t size, offset;
 
 	buf = &impl->out;
-	data = buf->buffer_data;
-	size = buf->buffer_size;
+	data = buf->buffer_data + buf->offset;
+	size = buf->buffer_size - buf->offset;
 	fds = buf->fds;
 	n_fds = buf->n_fds;
 	to_close = 0;
@@ -726,6 +753,22 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 		if (n_fds > MAX_FDS_MSG) {
 			outfds = MAX_FDS_MSG;
 			outsize = SPA_MIN(sizeof(uint32_t), size);
+			if (impl->version >= 3) {
+				/* send all messages before the one that uses the
+				 * first fd that does not fit in this batch. The fds
+				 * of that message all go in the next batch. */
+				pos = impl->out_fds_pos[to_close + outfds];
+				while (outfds > 0 &&
+				    impl->out_fds_pos[to_close + outfds - 1] == pos)
+					outfds--;
+				avail = pos - SPA_PTRDIFF(data, buf->buffer_data);
+				if (outfds > 0 && avail > 0)
+					outsize = avail;
+				else
+					/* a message with more than MAX_FDS_MSG fds,
+					 * its fds are sent before its data */
+					outfds = MAX_FDS_MSG;
+			}
 		} else {
 			outfds = n_fds;
 			outsize = size;
@@ -777,13 +820,28 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 	res = 0;
 
 exit:
-	if (size > 0)
+	/* only move the unsent data to the start of the buffer when that is
+	 * cheaper than what was sent, a partial write of a large buffer then
+	 * does not memmove the remainder each time */
+	offset = SPA_PTRDIFF(data, buf->buffer_data);
+	if (size == 0) {
+		buf->buffer_size = 0;
+		offset = 0;
+	} else if (offset >= size) {
 		memmove(buf->buffer_data, data, size);
-	buf->buffer_size = size;
+		buf->buffer_size = size;
+		for (i = 0; i < n_fds; i++)
+			impl->out_fds_pos[to_close + i] -= offset;
+		offset = 0;
+	}
+	buf->offset = offset;
 	for (i = 0; i < to_close; i++)
 		close(buf->fds[i]);
-	if (n_fds > 0)
+	if (n_fds > 0) {
 		memmove(buf->fds, fds, n_fds * sizeof(int));
+		memmove(impl->out_fds_pos, &impl->out_fds_pos[to_close],
+				n_fds * sizeof(uint32_t));
+	}
 	buf->n_fds = n_fds;
 	return res;
 }
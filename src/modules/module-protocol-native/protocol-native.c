@@ -105,31 +105,6 @@ static int core_method_marshal_error(void *object, uint32_t id, int seq, int res
 	return pw_protocol_native_end_proxy(proxy, b);
 }
 
-static struct pw_registry * core_method_marshal_get_registry(void *object,
-		uint32_t version, size_t user_data_size)
-{
-	struct pw_proxy *proxy = object;
-	struct spa_pod_builder *b;
-	struct pw_proxy *res;
-	uint32_t new_id;
-
-	res = pw_proxy_new(object, PW_TYPE_INTERFACE_Registry, version, user_data_size);
-	if (res == NULL)
-		return NULL;
-
-	new_id = pw_proxy_get_id(res);
-
-	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_METHOD_GET_REGISTRY, NULL);
-
-	spa_pod_builder_add_struct(b,
-		       SPA_POD_Int(version),
-		       SPA_POD_Int(new_id));
-
-	pw_protocol_native_end_proxy(proxy, b);
-
-	return (struct pw_registry *) res;
-}
-
 static inline void push_item(struct spa_pod_builder *b, const struct spa_dict_item *item)
 {
 	const char *str;
@@ -154,6 +129,45 @@ static void push_dict(struct spa_pod_builder *b, const struct spa_dict *dict)
 	spa_pod_builder_pop(b, &f);
 }
 
+static struct pw_registry * core_method_marshal_get_registry_filter(void *object,
+		uint32_t version, const struct spa_dict *filter, size_t user_data_size)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+	struct spa_pod_frame f;
+	struct pw_proxy *res;
+	uint32_t new_id;
+
+	res = pw_proxy_new(object, PW_TYPE_INTERFACE_Registry, version, user_data_size);
+	if (res == NULL)
+		return NULL;
+
+	new_id = pw_proxy_get_id(res);
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_METHOD_GET_REGISTRY, NULL);
+
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_builder_add(b,
+		       SPA_POD_Int(version),
+		       SPA_POD_Int(new_id),
+		       NULL);
+	/* the filter is appended, older servers don't parse it and emit
+	 * all globals */
+	if (filter != NULL && filter->n_items > 0)
+		push_dict(b, filter);
+	spa_pod_builder_pop(b, &f);
+
+	pw_protocol_native_end_proxy(proxy, b);
+
+	return (struct pw_registry *) res;
+}
+
+static struct pw_registry * core_method_marshal_get_registry(void *object,
+		uint32_t version, size_t user_data_size)
+{
+	return core_method_marshal_get_registry_filter(object, version, NULL, user_data_size);
+}
+
 static inline int parse_item(struct spa_pod_parser *prs, struct spa_dict_item *item)
 {
 	int res;
@@ -582,15 +596,32 @@ static int core_method_demarshal_get_registry(void *object, const struct pw_prot
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_parser prs;
+	struct spa_pod_frame f[2];
+	struct spa_dict filter = SPA_DICT_INIT(NULL, 0);
 	int32_t version, new_id;
 
 	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
+	if (spa_pod_parser_push_struct(&prs, &f[0]) < 0 ||
+	    spa_pod_parser_get(&prs,
 				SPA_POD_Int(&version),
-				SPA_POD_Int(&new_id)) < 0)
+				SPA_POD_Int(&new_id), NULL) < 0)
+		return -EINVAL;
+
+	/* the filter is optional */
+	if (spa_pod_parser_push_struct(&prs, &f[1]) < 0)
+		return pw_resource_notify(resource, struct pw_core_methods, get_registry, 0,
+				version, new_id);
+
+	if (spa_pod_parser_get(&prs,
+			SPA_POD_Int(&filter.n_items), NULL) < 0)
+		return -EINVAL;
+
+	filter.items = alloca(filter.n_items * sizeof(struct spa_dict_item));
+	if (parse_dict(&prs, &filter) < 0)
 		return -EINVAL;
 
-	return pw_resource_notify(resource, struct pw_core_methods, get_registry, 0, version, new_id);
+	return pw_resource_notify(resource, struct pw_core_methods, get_registry_filter, 1,
+			version, &filter, new_id);
 }
 
 static int core_method_demarshal_create_object(void *object, const struct pw_protocol_native_message *msg)
@@ -1940,6 +1971,7 @@ static const struct pw_core_methods pw_protocol_native_core_method_marshal = {
 	.get_registry = &core_method_marshal_get_registry,
 	.create_object = &core_method_marshal_create_object,
 	.destroy = &core_method_marshal_destroy,
+	.get_registry_filter = &core_method_marshal_get_registry_filter,
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_demarshal[PW_CORE_METHOD_NUM] = {
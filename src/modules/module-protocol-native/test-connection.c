@@ -23,6 +23,9 @@
  */
 
 #include <sys/socket.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <spa/pod/builder.h>
 #include <spa/pod/parser.h>
@@ -185,6 +188,169 @@ static void test_reentering(struct pw_protocol_native_connection *in,
 	}
 }
 
+#define STORM_MESSAGES	100000
+#define STORM_BATCH	2000
+#define STORM_FD_EVERY	16
+
+static void write_storm_message(struct pw_protocol_native_connection *conn,
+		uint32_t seq, int fd)
+{
+	struct spa_pod_builder *b;
+	uint8_t payload[1024];
+	uint32_t size = 64 + (seq * 37) % (sizeof(payload) - 64);
+
+	memset(payload, seq & 0xff, size);
+
+	b = pw_protocol_native_connection_begin(conn, 2, 4, NULL);
+	spa_assert_se(b != NULL);
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(seq),
+			SPA_POD_Int(fd >= 0 ? (int)pw_protocol_native_connection_add_fd(conn, fd) : -1),
+			SPA_POD_Bytes(payload, size));
+	spa_assert_se(pw_protocol_native_connection_end(conn, b) >= 0);
+}
+
+static uint32_t read_storm_messages(struct pw_protocol_native_connection *conn,
+		uint32_t seq)
+{
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_parser prs;
+	const uint8_t *payload;
+	uint32_t v_seq, size, i;
+	int fdidx, fd;
+
+	while (pw_protocol_native_connection_get_next(conn, &msg) == 1) {
+		spa_assert_se(msg->id == 2);
+		spa_assert_se(msg->opcode == 4);
+
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		if (spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&v_seq),
+				SPA_POD_Int(&fdidx),
+				SPA_POD_Bytes(&payload, &size)) < 0)
+			spa_assert_not_reached();
+
+		spa_assert_se(v_seq == seq);
+		spa_assert_se(size == 64 + (seq * 37) % (1024 - 64));
+		for (i = 0; i < size; i++)
+			spa_assert_se(payload[i] == (seq & 0xff));
+
+		if (seq % STORM_FD_EVERY == 0) {
+			spa_assert_se(msg->n_fds == 1);
+			fd = pw_protocol_native_connection_get_fd(conn, fdidx);
+			spa_assert_se(fd >= 0);
+			spa_assert_se(fcntl(fd, F_GETFD) >= 0);
+			close(fd);
+		} else {
+			spa_assert_se(fdidx == -1);
+		}
+		seq++;
+	}
+	return seq;
+}
+
+/* A storm of messages like the param enumeration when a session manager
+ * starts. The messages are queued in batches and the socket is too small
+ * for a batch so that the writes are partial. Some of the messages carry
+ * an fd so that more than MAX_FDS_MSG fds are queued. */
+static void test_storm(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	struct timespec start, stop;
+	uint32_t n_written = 0, n_read = 0, i;
+	double secs;
+	int res;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (n_read < STORM_MESSAGES) {
+		if (n_written == n_read) {
+			for (i = 0; i < STORM_BATCH; i++, n_written++)
+				write_storm_message(out, n_written,
+						n_written % STORM_FD_EVERY == 0 ? out->fd : -1);
+		}
+		res = pw_protocol_native_connection_flush(out);
+		spa_assert_se(res == 0 || res == -EAGAIN);
+		n_read = read_storm_messages(in, n_read);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	secs = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "storm: %u messages in %f secs, %f messages/s\n",
+			n_read, secs, n_read / secs);
+}
+
+#define BATCH_MESSAGES	10
+#define BATCH_FDS	6
+
+/* More than MAX_FDS_MSG fds are queued and the fds of a message must all
+ * arrive with the same write. The peer is a plain socket so that each
+ * write can be checked. */
+static void test_fd_batches(struct pw_context *context)
+{
+	struct pw_protocol_native_connection *out;
+	struct spa_pod_builder *b;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cmsgbuf[CMSG_SPACE(BATCH_MESSAGES * BATCH_FDS * sizeof(int))];
+	uint32_t data[4096], total_fds = 0, total_size = 0, msg_size = 0, i, j, n;
+	int fds[2], msg_fds[BATCH_FDS], *rfds;
+	ssize_t len;
+
+	spa_assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	out = pw_protocol_native_connection_new(context, fds[1]);
+	spa_assert_se(out != NULL);
+
+	for (i = 0; i < BATCH_FDS; i++)
+		spa_assert_se((msg_fds[i] = dup(fds[1])) >= 0);
+
+	for (i = 0; i < BATCH_MESSAGES; i++) {
+		b = pw_protocol_native_connection_begin(out, 3, 1, NULL);
+		spa_assert_se(b != NULL);
+		for (j = 0; j < BATCH_FDS; j++)
+			spa_pod_builder_int(b, pw_protocol_native_connection_add_fd(out, msg_fds[j]));
+		spa_assert_se(pw_protocol_native_connection_end(out, b) >= 0);
+	}
+	spa_assert_se(pw_protocol_native_connection_flush(out) == 0);
+
+	while (true) {
+		spa_zero(msg);
+		iov.iov_base = data;
+		iov.iov_len = sizeof(data);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cmsgbuf;
+		msg.msg_controllen = sizeof(cmsgbuf);
+
+		if ((len = recvmsg(fds[0], &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) <= 0)
+			break;
+		/* all messages have the same size, header + 6 Int pods */
+		if (msg_size == 0)
+			msg_size = 16 + (data[1] & 0xffffff);
+		total_size += len;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+				continue;
+			n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			rfds = (int *)CMSG_DATA(cmsg);
+			for (j = 0; j < n; j++)
+				close(rfds[j]);
+			total_fds += n;
+		}
+		/* each write ends with a complete message and carries the
+		 * fds of its messages, they are never split over writes */
+		spa_assert_se(total_size % msg_size == 0);
+		spa_assert_se(total_fds == total_size / msg_size * BATCH_FDS);
+	}
+	spa_assert_se(total_fds == BATCH_MESSAGES * BATCH_FDS);
+
+	for (i = 0; i < BATCH_FDS; i++)
+		close(msg_fds[i]);
+	pw_protocol_native_connection_destroy(out);
+	close(fds[0]);
+}
+
 int main(int argc, char *argv[])
 {
 	struct pw_main_loop *loop;
@@ -215,6 +381,8 @@ int main(int argc, char *argv[])
 	test_create(out);
 	test_read_write(in, out);
 	test_reentering(in, out);
+	test_storm(in, out);
+	test_fd_batches(context);
 
 	pw_protocol_native_connection_destroy(in);
 	pw_protocol_native_connection_destroy(out);
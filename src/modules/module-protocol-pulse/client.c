@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include <spa/utils/defs.h>
 #include <spa/utils/hook.h>
@@ -47,6 +48,7 @@
 #include "operation.h"
 #include "pending-sample.h"
 #include "server.h"
+#include "shm.h"
 #include "stream.h"
 
 #define client_emit_disconnect(c) spa_hook_list_call(&(c)->listener_list, struct client_events, disconnect, 0)
@@ -67,6 +69,7 @@ struct client *client_new(struct server *server)
 	spa_list_init(&client->operations);
 	spa_list_init(&client->pending_samples);
 	spa_list_init(&client->pending_streams);
+	spa_list_init(&client->shm_segments);
 	spa_hook_list_init(&client->listener_list);
 
 	spa_list_append(&server->clients, &client->link);
@@ -142,6 +145,7 @@ void client_free(struct client *client)
 	struct pending_sample *p;
 	struct message *msg;
 	struct operation *o;
+	struct shm_segment *seg;
 
 	pw_log_debug("client %p: free", client);
 
@@ -163,6 +167,11 @@ void client_free(struct client *client)
 	spa_list_consume(o, &client->operations, link)
 		operation_free(o);
 
+	spa_list_consume(seg, &client->shm_segments, link)
+		shm_segment_free(seg);
+
+	client_close_ancil_fds(client);
+
 	if (client->core) {
 		client->disconnecting = true;
 		pw_core_disconnect(client->core);
@@ -194,7 +203,7 @@ int client_queue_message(struct client *client, struct message *msg)
 		goto error;
 	}
 
-	if (msg->length == 0) {
+	if (msg->length == 0 && msg->flags == 0) {
 		res = 0;
 		goto error;
 	} else if (msg->length > msg->allocated) {
@@ -220,6 +229,31 @@ error:
 	return res;
 }
 
+int client_queue_shm_release(struct client *client, uint32_t block_id)
+{
+	struct message *msg;
+
+	/* an empty frame that tells the client it can reuse the block */
+	if ((msg = message_alloc(client->impl, -1, 0)) == NULL)
+		return -errno;
+
+	msg->flags = FLAG_SHMRELEASE;
+	msg->block_id = block_id;
+
+	return client_queue_message(client, msg);
+}
+
+void client_close_ancil_fds(struct client *client)
+{
+	uint32_t i;
+
+	for (i = 0; i < client->n_ancil_fds; i++) {
+		if (client->ancil_fds[i] >= 0)
+			close(client->ancil_fds[i]);
+	}
+	client->n_ancil_fds = 0;
+}
+
 static int client_try_flush_messages(struct client *client)
 {
 	struct impl *impl = client->impl;
@@ -237,9 +271,9 @@ static int client_try_flush_messages(struct client *client)
 		if (client->out_index < sizeof(desc)) {
 			desc.length = htonl(m->length);
 			desc.channel = htonl(m->channel);
-			desc.offset_hi = 0;
+			desc.offset_hi = htonl(m->block_id);
 			desc.offset_lo = 0;
-			desc.flags = 0;
+			desc.flags = htonl(m->flags);
 
 			data = SPA_PTROFF(&desc, client->out_index, void);
 			size = sizeof(desc) - client->out_index;
@@ -42,6 +42,8 @@ struct pw_manager;
 struct pw_manager_object;
 struct pw_properties;
 
+#define MAX_ANCIL_FDS	2
+
 struct descriptor {
 	uint32_t length;
 	uint32_t channel;
@@ -85,6 +87,10 @@ struct client {
 	struct descriptor desc;
 	struct message *message;
 
+	int ancil_fds[MAX_ANCIL_FDS];
+	uint32_t n_ancil_fds;
+	struct spa_list shm_segments;
+
 	struct pw_map streams;
 	struct spa_list out_messages;
 
@@ -98,6 +104,9 @@ struct client {
 	unsigned int disconnecting:1;
 	unsigned int new_msg_since_last_flush:1;
 	unsigned int authenticated:1;
+	unsigned int shm_allowed:1;
+	unsigned int shm:1;
+	unsigned int memfd:1;
 
 	struct pw_manager_object *prev_default_sink;
 	struct pw_manager_object *prev_default_source;
@@ -117,6 +126,8 @@ bool client_detach(struct client *client);
 void client_disconnect(struct client *client);
 void client_free(struct client *client);
 int client_queue_message(struct client *client, struct message *msg);
+int client_queue_shm_release(struct client *client, uint32_t block_id);
+void client_close_ancil_fds(struct client *client);
 int client_flush_messages(struct client *client);
 int client_queue_subscribe_event(struct client *client, uint32_t mask, uint32_t event, uint32_t id);
 
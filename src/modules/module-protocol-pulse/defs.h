@@ -43,6 +43,8 @@
 #define FRAME_SIZE_MAX_ALLOW (1024*1024*16)
 
 #define PROTOCOL_FLAG_MASK	0xffff0000u
+#define PROTOCOL_FLAG_SHM	0x80000000u
+#define PROTOCOL_FLAG_MEMFD	0x40000000u
 #define PROTOCOL_VERSION_MASK	0x0000ffffu
 #define PROTOCOL_VERSION	35
 
@@ -549,6 +549,23 @@ static const struct object_info *find_info(const char *type, uint32_t version)
 	return NULL;
 }
 
+/* let the server only send the globals of the types we bind, this skips the
+ * ports and factories, which are most of the globals */
+static struct pw_registry *get_registry(struct pw_core *core)
+{
+	char types[1024];
+	struct spa_dict_item items[1];
+	size_t i, len = 0;
+
+	for (i = 0; i < SPA_N_ELEMENTS(objects); i++)
+		len += spa_scnprintf(types + len, sizeof(types) - len, "%s%s",
+				i == 0 ? "" : "|", objects[i]->type);
+
+	items[0] = SPA_DICT_ITEM_INIT(PW_REGISTRY_FILTER_TYPE, types);
+	return pw_core_get_registry_filter(core, PW_VERSION_REGISTRY,
+			&SPA_DICT_INIT_ARRAY(items), 0);
+}
+
 static void
 destroy_removed(void *data)
 {
@@ -722,8 +739,7 @@ struct pw_manager *pw_manager_new(struct pw_core *core)
 		return NULL;
 
 	m->this.core = core;
-	m->this.registry = pw_core_get_registry(m->this.core,
-			PW_VERSION_REGISTRY, 0);
+	m->this.registry = get_registry(m->this.core);
 	if (m->this.registry == NULL) {
 		free(m);
 		return NULL;
@@ -854,6 +854,8 @@ struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size
 
 	spa_zero(msg->extra);
 	msg->channel = channel;
+	msg->flags = 0;
+	msg->block_id = 0;
 	msg->offset = 0;
 	msg->length = size;
 
@@ -75,6 +75,7 @@
 #include "sample.h"
 #include "sample-play.h"
 #include "server.h"
+#include "shm.h"
 #include "stream.h"
 #include "utils.h"
 #include "volume.h"
@@ -126,7 +127,7 @@ void broadcast_subscribe_event(struct impl *impl, uint32_t mask, uint32_t event,
 static int do_command_auth(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	struct message *reply;
-	uint32_t version;
+	uint32_t version, flags = 0, reply_flags = 0;
 	const void *cookie;
 	size_t len;
 
@@ -141,17 +142,31 @@ static int do_command_auth(struct client *client, uint32_t command, uint32_t tag
 	if (len != NATIVE_COOKIE_LENGTH)
 		return -EINVAL;
 
-	if ((version & PROTOCOL_VERSION_MASK) >= 13)
+	if ((version & PROTOCOL_VERSION_MASK) >= 13) {
+		flags = version & PROTOCOL_FLAG_MASK;
 		version &= PROTOCOL_VERSION_MASK;
+	}
 
 	client->version = version;
 	client->authenticated = true;
 
-	pw_log_info("client:%p AUTH tag:%u version:%d", client, tag, version);
+	/* memblocks can be passed in shared memory, only memfd is supported,
+	 * which is available since version 31 */
+	client->memfd = client->shm_allowed && version >= 31 &&
+		(flags & PROTOCOL_FLAG_SHM) && (flags & PROTOCOL_FLAG_MEMFD);
+	client->shm = client->memfd;
+
+	pw_log_info("client:%p AUTH tag:%u version:%d shm:%d memfd:%d", client, tag,
+			version, client->shm, client->memfd);
+
+	if (client->shm)
+		reply_flags |= PROTOCOL_FLAG_SHM;
+	if (client->memfd)
+		reply_flags |= PROTOCOL_FLAG_MEMFD;
 
 	reply = reply_new(client, tag);
 	message_put(reply,
-			TAG_U32, PROTOCOL_VERSION,
+			TAG_U32, PROTOCOL_VERSION | reply_flags,
 			TAG_INVALID);
 
 	return client_queue_message(client, reply);
@@ -4867,6 +4882,30 @@ static int do_send_object_message(struct client *client, uint32_t command, uint3
 	return client_queue_message(client, reply);
 }
 
+static int do_register_memfd_shmid(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	uint32_t shm_id;
+	int fd;
+
+	if (message_get(m,
+			TAG_U32, &shm_id,
+			TAG_INVALID) < 0)
+		return -EPROTO;
+
+	pw_log_info("[%s] %s tag:%u shm_id:%u", client->name,
+			commands[command].name, tag, shm_id);
+
+	if (!client->memfd)
+		return -EACCES;
+	if (client->n_ancil_fds != 1)
+		return -EPROTO;
+
+	fd = client->ancil_fds[0];
+	client->ancil_fds[0] = -1;
+
+	return shm_segment_add_memfd(client, shm_id, fd);
+}
+
 static int do_error_access(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	return -EACCES;
@@ -5035,7 +5074,7 @@ const struct command commands[COMMAND_MAX] =
 
 	/* Supported since protocol v31 (9.0)
 	 * BOTH DIRECTIONS */
-	COMMAND(REGISTER_MEMFD_SHMID, do_error_access),
+	COMMAND(REGISTER_MEMFD_SHMID, do_register_memfd_shmid, COMMAND_ACCESS_WITHOUT_MANAGER),
 
 	/* Supported since protocol v35 (15.0) */
 	COMMAND(SEND_OBJECT_MESSAGE, do_send_object_message),
@@ -58,6 +58,7 @@
 #include "message.h"
 #include "reply.h"
 #include "server.h"
+#include "shm.h"
 #include "stream.h"
 #include "utils.h"
 
@@ -111,6 +112,8 @@ static int handle_packet(struct client *client, struct message *msg)
 
 finish:
 	message_free(impl, msg, false, false);
+	/* close the fds that were not used by the command */
+	client_close_ancil_fds(client);
 	if (res < 0)
 		reply_error(client, command, tag, res);
 
@@ -121,7 +124,8 @@ static int handle_memblock(struct client *client, struct message *msg)
 {
 	struct impl * const impl = client->impl;
 	struct stream *stream;
-	uint32_t channel, flags, index;
+	uint32_t channel, flags, index, length, block_id = 0;
+	const void *data;
 	int64_t offset, diff;
 	int32_t filled;
 	int res = 0;
@@ -132,8 +136,37 @@ static int handle_memblock(struct client *client, struct message *msg)
 		(((uint64_t) ntohl(client->desc.offset_lo))));
 	flags = ntohl(client->desc.flags);
 
+	if (flags & FLAG_SHMDATA) {
+		uint32_t *info = (uint32_t *) msg->data;
+		uint32_t shm_id, shm_offset;
+
+		/* the data is in a shared memory segment of the client */
+		block_id = ntohl(info[0]);
+		shm_id = ntohl(info[1]);
+		shm_offset = ntohl(info[2]);
+		length = ntohl(info[3]);
+
+		/* only memfd segments are supported, POSIX shm segments can be
+		 * opened by name and truncated behind our back */
+		if (flags & FLAG_SHMDATA_MEMFD_BLOCK) {
+			data = shm_segment_get_data(client, shm_id, shm_offset, length);
+		} else {
+			errno = ENOTSUP;
+			data = NULL;
+		}
+		if (data == NULL) {
+			pw_log_warn("client %p [%s]: invalid shm block id:%u shm:%u offset:%u size:%u: %m",
+				    client, client->name, block_id, shm_id, shm_offset, length);
+			res = -EPROTO;
+			goto finish;
+		}
+	} else {
+		data = msg->data;
+		length = msg->length;
+	}
+
 	pw_log_debug("client %p: received memblock channel:%d offset:%" PRIi64 " flags:%08x size:%u",
-		     client, channel, offset, flags, msg->length);
+		     client, channel, offset, flags, length);
 
 	stream = pw_map_lookup(&client->streams, channel);
 	if (stream == NULL || stream->type == STREAM_TYPE_RECORD) {
@@ -144,7 +177,7 @@ static int handle_memblock(struct client *client, struct message *msg)
 
 	filled = spa_ringbuffer_get_write_index(&stream->ring, &index);
 	pw_log_debug("new block %p %p/%u filled:%d index:%d flags:%02x offset:%" PRIu64,
-		     msg, msg->data, msg->length, filled, index, flags, offset);
+		     msg, data, length, filled, index, flags, offset);
 
 	switch (flags & FLAG_SEEKMASK) {
 	case SEEK_RELATIVE:
@@ -170,7 +203,7 @@ static int handle_memblock(struct client *client, struct message *msg)
 
 	if (filled < 0) {
 		/* underrun, reported on reader side */
-	} else if (filled + msg->length > stream->attr.maxlength) {
+	} else if (filled + length > stream->attr.maxlength) {
 		/* overrun */
 		stream_send_overflow(stream);
 	}
@@ -180,20 +213,46 @@ static int handle_memblock(struct client *client, struct message *msg)
 	spa_ringbuffer_write_data(&stream->ring,
 			stream->buffer, stream->attr.maxlength,
 			index % stream->attr.maxlength,
-			msg->data,
-			SPA_MIN(msg->length, stream->attr.maxlength));
-	index += msg->length;
-	stream->write_index += msg->length;
+			data,
+			SPA_MIN(length, stream->attr.maxlength));
+	index += length;
+	stream->write_index += length;
 	spa_ringbuffer_write_update(&stream->ring, index);
-	stream->requested -= SPA_MIN(msg->length, stream->requested);
+	stream->requested -= SPA_MIN(length, stream->requested);
 
 	stream_send_request(stream);
 
 finish:
+	/* the data was copied, the client can reuse the block */
+	if (flags & FLAG_SHMDATA && res >= 0)
+		client_queue_shm_release(client, block_id);
 	message_free(impl, msg, false, false);
 	return res;
 }
 
+static void collect_ancil_fds(struct client *client, struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		int *fds;
+		uint32_t i, n_fds;
+
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		fds = (int *) CMSG_DATA(cmsg);
+		n_fds = (cmsg->cmsg_len - ((char *) fds - (char *) cmsg)) / sizeof(int);
+
+		for (i = 0; i < n_fds; i++) {
+			if (client->n_ancil_fds < MAX_ANCIL_FDS)
+				client->ancil_fds[client->n_ancil_fds++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+}
+
 static int do_read(struct client *client)
 {
 	struct impl * const impl = client->impl;
@@ -217,7 +276,15 @@ static int do_read(struct client *client)
 	}
 
 	while (true) {
-		ssize_t r = recv(client->source->fd, data, size, MSG_DONTWAIT);
+		char control[CMSG_SPACE(MAX_ANCIL_FDS * sizeof(int))];
+		struct iovec iov = { .iov_base = data, .iov_len = size };
+		struct msghdr m = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+		ssize_t r = recvmsg(client->source->fd, &m, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
 
 		if (r == 0 && size != 0) {
 			res = -EPIPE;
@@ -231,6 +298,10 @@ static int do_read(struct client *client)
 			goto exit;
 		}
 
+		/* fds are sent along with a packet, used by REGISTER_MEMFD_SHMID */
+		if (m.msg_controllen > 0)
+			collect_ancil_fds(client, &m);
+
 		client->in_index += r;
 		break;
 	}
@@ -239,12 +310,30 @@ static int do_read(struct client *client)
 		uint32_t flags, length, channel;
 
 		flags = ntohl(client->desc.flags);
-		if ((flags & FLAG_SHMMASK) != 0) {
+		length = ntohl(client->desc.length);
+		channel = ntohl(client->desc.channel);
+
+		switch (flags & FLAG_SHMMASK) {
+		case 0:
+			break;
+		case FLAG_SHMDATA:
+		case FLAG_SHMDATA | FLAG_SHMDATA_MEMFD_BLOCK:
+			if (!client->shm || channel == (uint32_t) -1 ||
+			    length != 4 * sizeof(uint32_t)) {
+				res = -EPROTO;
+				goto exit;
+			}
+			break;
+		case FLAG_SHMRELEASE:
+		case FLAG_SHMREVOKE:
+			/* we don't export memory to the client, nothing to release */
+			client->in_index = 0;
+			goto exit;
+		default:
 			res = -EPROTO;
 			goto exit;
 		}
 
-		length = ntohl(client->desc.length);
 		if (length > FRAME_SIZE_MAX_ALLOW || length <= 0) {
 			pw_log_warn("client %p: received invalid frame size: %u",
 				    client, length);
@@ -252,7 +341,6 @@ static int do_read(struct client *client)
 			goto exit;
 		}
 
-		channel = ntohl(client->desc.channel);
 		if (channel == (uint32_t) -1) {
 			if (flags != 0) {
 				pw_log_warn("client %p: received packet frame with invalid flags",
@@ -424,6 +512,8 @@ on_connect(void *data, int fd, uint32_t mask)
 		pid = get_client_pid(client, client_fd);
 		if (pid != 0 && check_flatpak(client, pid) == 1)
 			client_access = "flatpak";
+		/* only share memory with clients of the same user */
+		client->shm_allowed = get_client_uid(client, client_fd) == getuid();
 	}
 	else if (server->addr.ss_family == AF_INET || server->addr.ss_family == AF_INET6) {
 
@@ -0,0 +1,154 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <spa/utils/list.h>
+#include <pipewire/log.h>
+
+#include "client.h"
+#include "log.h"
+#include "shm.h"
+
+#ifndef F_LINUX_SPECIFIC_BASE
+#define F_LINUX_SPECIFIC_BASE 1024
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (F_LINUX_SPECIFIC_BASE + 9)
+#define F_GET_SEALS (F_LINUX_SPECIFIC_BASE + 10)
+
+#define F_SEAL_SHRINK   0x0002	/* prevent file from shrinking */
+#endif
+
+#define MAX_SHM_SIZE	(1024u*1024u*64u)
+
+static struct shm_segment *shm_segment_find(struct client *client, uint32_t id)
+{
+	struct shm_segment *seg;
+
+	spa_list_for_each(seg, &client->shm_segments, link) {
+		if (seg->id == id)
+			return seg;
+	}
+	return NULL;
+}
+
+static struct shm_segment *shm_segment_new(struct client *client, uint32_t id, int fd)
+{
+	struct shm_segment *seg;
+	struct stat st;
+	void *data;
+	int seals;
+
+	/* reading from the mapping would fault when the client truncates the
+	 * memfd, make sure it can't shrink. The memfd is created with sealing
+	 * allowed, add the seal when the client did not do that already. */
+	if ((seals = fcntl(fd, F_GET_SEALS)) < 0) {
+		pw_log_warn("client %p: can't get seals of memfd: %m", client);
+		return NULL;
+	}
+	if (!(seals & F_SEAL_SHRINK) &&
+	    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+		pw_log_warn("client %p: can't seal memfd: %m", client);
+		return NULL;
+	}
+
+	/* the size can only grow from now on */
+	if (fstat(fd, &st) < 0)
+		return NULL;
+
+	if (st.st_size <= 0 || (uint64_t)st.st_size > MAX_SHM_SIZE) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* we only read from the segment */
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	seg = calloc(1, sizeof(*seg));
+	if (seg == NULL) {
+		munmap(data, st.st_size);
+		return NULL;
+	}
+	seg->id = id;
+	seg->data = data;
+	seg->size = st.st_size;
+
+	spa_list_append(&client->shm_segments, &seg->link);
+
+	pw_log_debug("client %p: new memfd segment id:%u size:%zu", client,
+			id, seg->size);
+
+	return seg;
+}
+
+void shm_segment_free(struct shm_segment *seg)
+{
+	spa_list_remove(&seg->link);
+	munmap(seg->data, seg->size);
+	free(seg);
+}
+
+int shm_segment_add_memfd(struct client *client, uint32_t id, int fd)
+{
+	struct shm_segment *seg;
+	int res;
+
+	if ((seg = shm_segment_find(client, id)) != NULL)
+		shm_segment_free(seg);
+
+	/* the mapping keeps the memory alive */
+	seg = shm_segment_new(client, id, fd);
+	res = seg == NULL ? -errno : 0;
+	close(fd);
+
+	return res;
+}
+
+const void *shm_segment_get_data(struct client *client, uint32_t id,
+		uint32_t offset, uint32_t length)
+{
+	struct shm_segment *seg;
+
+	seg = shm_segment_find(client, id);
+	if (seg == NULL) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	if ((uint64_t)offset + length > seg->size) {
+		errno = ERANGE;
+		return NULL;
+	}
+	return SPA_PTROFF(seg->data, offset, const void);
+}
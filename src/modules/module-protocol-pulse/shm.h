@@ -0,0 +1,50 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PULSE_SERVER_SHM_H
+#define PULSE_SERVER_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <spa/utils/list.h>
+
+struct client;
+
+/* a shared memory segment of a client that memblocks can point to, a memfd
+ * registered with REGISTER_MEMFD_SHMID and sealed against shrinking */
+struct shm_segment {
+	struct spa_list link;
+	uint32_t id;
+	void *data;
+	size_t size;
+};
+
+int shm_segment_add_memfd(struct client *client, uint32_t id, int fd);
+const void *shm_segment_get_data(struct client *client, uint32_t id,
+		uint32_t offset, uint32_t length);
+void shm_segment_free(struct shm_segment *seg);
+
+#endif /* PULSE_SERVER_SHM_H */
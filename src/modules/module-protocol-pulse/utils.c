@@ -163,6 +163,27 @@ pid_t get_client_pid(struct client *client, int client_fd)
 	return 0;
 }
 
+uid_t get_client_uid(struct client *client, int client_fd)
+{
+	socklen_t len;
+#if defined(__linux__)
+	struct ucred ucred;
+	len = sizeof(ucred);
+	if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) < 0) {
+		pw_log_warn("client %p: no peercred: %m", client);
+	} else
+		return ucred.uid;
+#elif defined(__FreeBSD__)
+	struct xucred xucred;
+	len = sizeof(xucred);
+	if (getsockopt(client_fd, 0, LOCAL_PEERCRED, &xucred, &len) < 0) {
+		pw_log_warn("client %p: no peercred: %m", client);
+	} else
+		return xucred.cr_uid;
+#endif
+	return (uid_t) -1;
+}
+
 const char *get_server_name(struct pw_context *context)
 {
 	const char *name = NULL;
@@ -0,0 +1,1028 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+
+#include "config.h"
+
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/json.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/debug/types.h>
+#include <spa/pod/builder.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/audio/raw.h>
+#include <spa/node/io.h>
+
+#include <pipewire/impl.h>
+
+#include "module-rtp/rtp.h"
+#include "module-rtp/sap.h"
+
+/** \page page_module_rtp_sink PipeWire Module: RTP sink
+ *
+ * The `rtp-sink` module creates a PipeWire sink that sends audio
+ * RTP packets to a (multicast) network address. The session is announced
+ * with SAP/SDP so that receivers such as \ref page_module_rtp_source can
+ * find it.
+ *
+ * The RTP timestamps follow the position of the clock of the graph the
+ * sink is running in. When the graph is driven by a PTP synchronized
+ * device, use `sess.ts-refclk` to announce the reference clock.
+ *
+ * ## Module Options
+ *
+ * Options specific to the behavior of this module
+ *
+ * - `source.ip = <str>`: the source ip address, default 0.0.0.0
+ * - `destination.ip = <str>`: the destination ip address, default 224.0.0.56
+ * - `destination.port = <int>`: the destination port, default 46000
+ * - `net.mtu = <int>`: the maximum packet size, default 1280
+ * - `net.ttl = <int>`: the multicast ttl, default 1
+ * - `net.loop = <bool>`: loop back multicast packets, default false
+ * - `net.dscp = <int>`: the DSCP value of the packets, default 34 (AF41)
+ * - `sess.name = <str>`: the session name to announce
+ * - `sess.ptime = <int>`: the packet duration in milliseconds, default 1
+ * - `sess.ts-refclk = <str>`: the reference clock to announce, default local
+ * - `sap.ip = <str>`: the SAP address, default 224.0.0.56
+ * - `sap.port = <int>`: the SAP port, default 9875
+ * - `stream.props = {}`: properties to be passed to the stream
+ *
+ * ## General options
+ *
+ * Options with well-known behavior:
+ *
+ * - \ref PW_KEY_AUDIO_FORMAT: one of S16BE (L16), S24BE (L24) or F32BE
+ * - \ref PW_KEY_AUDIO_RATE
+ * - \ref PW_KEY_AUDIO_CHANNELS
+ * - \ref SPA_KEY_AUDIO_POSITION
+ * - \ref PW_KEY_NODE_NAME
+ * - \ref PW_KEY_NODE_DESCRIPTION
+ * - \ref PW_KEY_MEDIA_NAME
+ *
+ * ## Example configuration
+ *\code{.unparsed}
+ * context.modules = [
+ * {   name = libpipewire-module-rtp-sink
+ *     args = {
+ *         #source.ip = 0.0.0.0
+ *         #destination.ip = 224.0.0.56
+ *         #destination.port = 46000
+ *         #net.mtu = 1280
+ *         #net.ttl = 1
+ *         #net.loop = false
+ *         #sess.name = "PipeWire RTP stream"
+ *         #audio.format = "S16BE"
+ *         #audio.rate = 48000
+ *         #audio.channels = 2
+ *         #audio.position = [ FL FR ]
+ *         stream.props = {
+ *             node.name = "rtp-sink"
+ *         }
+ *     }
+ * }
+ * ]
+ *\endcode
+ *
+ * Set `net.loop = true` to receive the stream on the same machine.
+ *
+ * \since 0.3.44
+ */
+
+#define NAME "rtp-sink"
+
+PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
+#define PW_LOG_TOPIC_DEFAULT mod_topic
+
+#define SAP_INTERVAL_SEC	5
+#define SAP_DEFAULT_IP		"224.0.0.56"
+#define SAP_DEFAULT_PORT	9875
+
+#define BUFFER_FRAMES		(1u<<16)
+#define BUFFER_MASK		(BUFFER_FRAMES-1)
+
+#define DEFAULT_FORMAT		"S16BE"
+#define DEFAULT_RATE		48000
+#define DEFAULT_CHANNELS	2
+#define DEFAULT_POSITION	"[ FL FR ]"
+
+#define DEFAULT_SOURCE_IP	"0.0.0.0"
+#define DEFAULT_DESTINATION_IP	"224.0.0.56"
+#define DEFAULT_PORT		46000
+#define DEFAULT_MTU		1280
+#define DEFAULT_TTL		1
+#define DEFAULT_LOOP		false
+#define DEFAULT_DSCP		34
+#define DEFAULT_PTIME		1
+#define DEFAULT_TS_REFCLK	"local"
+#define DEFAULT_PAYLOAD		127
+
+#define MODULE_USAGE	"[ source.ip=<source IP address, default:"DEFAULT_SOURCE_IP"> ] "	\
+			"[ destination.ip=<destination IP address, default:"DEFAULT_DESTINATION_IP"> ] " \
+			"[ destination.port=<int, default:"SPA_STRINGIFY(DEFAULT_PORT)"> ] "	\
+			"[ net.mtu=<MTU to use, default:"SPA_STRINGIFY(DEFAULT_MTU)"> ] "	\
+			"[ net.ttl=<TTL to use, default:"SPA_STRINGIFY(DEFAULT_TTL)"> ] "	\
+			"[ net.loop=<enable multicast loopback, default:false> ] "		\
+			"[ net.dscp=<DSCP to use, default:"SPA_STRINGIFY(DEFAULT_DSCP)"> ] "	\
+			"[ sess.name=<a name for the session> ] "				\
+			"[ sess.ptime=<packet time in msec, default:"SPA_STRINGIFY(DEFAULT_PTIME)"> ] " \
+			"[ sess.ts-refclk=<reference clock, default:"DEFAULT_TS_REFCLK"> ] "	\
+			"[ sap.ip=<SAP IP address, default:"SAP_DEFAULT_IP"> ] "		\
+			"[ sap.port=<SAP port, default:"SPA_STRINGIFY(SAP_DEFAULT_PORT)"> ] "	\
+			"[ audio.format=<format, default:"DEFAULT_FORMAT"> ] "			\
+			"[ audio.rate=<sample rate, default:"SPA_STRINGIFY(DEFAULT_RATE)"> ] "	\
+			"[ audio.channels=<number of channels, default:"SPA_STRINGIFY(DEFAULT_CHANNELS)"> ] " \
+			"[ audio.position=<channel map, default:"DEFAULT_POSITION"> ] "		\
+			"[ stream.props=<properties> ] "
+
+static const struct spa_dict_item module_info[] = {
+	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
+	{ PW_KEY_MODULE_DESCRIPTION, "RTP Sink" },
+	{ PW_KEY_MODULE_USAGE, MODULE_USAGE },
+	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
+};
+
+struct format_info {
+	uint32_t format;
+	uint32_t size;
+	const char *mime;
+};
+
+static const struct format_info format_info[] = {
+	{ SPA_AUDIO_FORMAT_S16_BE, 2, "L16" },
+	{ SPA_AUDIO_FORMAT_S24_BE, 3, "L24" },
+	{ SPA_AUDIO_FORMAT_F32_BE, 4, "L32F" },
+};
+
+struct impl {
+	struct pw_context *context;
+
+	struct pw_impl_module *module;
+	struct spa_hook module_listener;
+	struct pw_properties *props;
+
+	struct pw_loop *loop;
+	struct pw_work_queue *work;
+
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	struct spa_hook core_proxy_listener;
+
+	struct spa_source *timer;
+
+	struct pw_properties *stream_props;
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+	struct spa_io_position *position;
+
+	unsigned int do_disconnect:1;
+	unsigned int unloading:1;
+	unsigned int sync:1;
+
+	struct spa_audio_info_raw info;
+	const struct format_info *format_info;
+	uint32_t stride;
+
+	char *session_name;
+	char *ts_refclk;
+	uint32_t mtu;
+	uint32_t ttl;
+	bool mcast_loop;
+	uint32_t dscp;
+	uint32_t ptime;
+	uint32_t psamples;
+
+	struct sockaddr_storage src_addr;
+	socklen_t src_len;
+	uint16_t dst_port;
+	struct sockaddr_storage dst_addr;
+	socklen_t dst_len;
+	struct sockaddr_storage sap_addr;
+	socklen_t sap_len;
+
+	uint16_t msg_id_hash;
+	uint32_t ntp;
+
+	uint8_t payload;
+	uint16_t seq;
+	uint32_t ssrc;
+	uint32_t ts_offset;
+
+	struct spa_ringbuffer ring;
+	uint8_t *buffer;
+
+	int rtp_fd;
+	int sap_fd;
+};
+
+static void do_unload_module(void *obj, void *data, int res, uint32_t id)
+{
+	struct impl *impl = data;
+	pw_impl_module_destroy(impl->module);
+}
+
+static void unload_module(struct impl *impl)
+{
+	if (!impl->unloading) {
+		impl->unloading = true;
+		pw_work_queue_add(impl->work, impl, 0, do_unload_module, impl);
+	}
+}
+
+static void stream_destroy(void *d)
+{
+	struct impl *impl = d;
+	spa_hook_remove(&impl->stream_listener);
+	impl->stream = NULL;
+}
+
+static inline void
+set_iovec(struct spa_ringbuffer *rbuf, void *buffer, uint32_t size,
+		uint32_t offset, struct iovec *iov, uint32_t len)
+{
+	iov[0].iov_len = SPA_MIN(len, size - offset);
+	iov[0].iov_base = SPA_PTROFF(buffer, offset, void);
+	iov[1].iov_len = len - iov[0].iov_len;
+	iov[1].iov_base = buffer;
+}
+
+static void flush_packets(struct impl *impl)
+{
+	int32_t avail;
+	uint32_t index, size = BUFFER_FRAMES * impl->stride;
+	struct iovec iov[3];
+	struct msghdr msg;
+	struct rtp_header header;
+
+	avail = spa_ringbuffer_get_read_index(&impl->ring, &index);
+
+	spa_zero(header);
+	header.v = 2;
+	header.pt = impl->payload;
+	header.ssrc = htonl(impl->ssrc);
+
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+
+	spa_zero(msg);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 3;
+
+	while (avail >= (int32_t)impl->psamples) {
+		header.sequence_number = htons(impl->seq);
+		header.timestamp = htonl(impl->ts_offset + index);
+
+		set_iovec(&impl->ring, impl->buffer, size,
+				(index & BUFFER_MASK) * impl->stride,
+				&iov[1], impl->psamples * impl->stride);
+
+		if (sendmsg(impl->rtp_fd, &msg, MSG_NOSIGNAL) < 0)
+			pw_log_trace("sendmsg failed: %m");
+
+		impl->seq++;
+		index += impl->psamples;
+		avail -= impl->psamples;
+	}
+	spa_ringbuffer_read_update(&impl->ring, index);
+}
+
+static inline uint32_t get_timestamp(struct impl *impl, uint32_t index)
+{
+	struct spa_io_position *pos = impl->position;
+
+	/* when the graph runs at our rate, the RTP time follows the clock
+	 * position, otherwise we can only count samples */
+	if (pos == NULL || pos->clock.rate.denom != impl->info.rate)
+		return index;
+	return (uint32_t)pos->clock.position;
+}
+
+static void stream_process(void *data)
+{
+	struct impl *impl = data;
+	struct pw_buffer *buf;
+	struct spa_data *d;
+	uint32_t offs, size, index, timestamp, wanted;
+	int32_t filled;
+
+	if ((buf = pw_stream_dequeue_buffer(impl->stream)) == NULL) {
+		pw_log_debug("Out of stream buffers: %m");
+		return;
+	}
+	d = buf->buffer->datas;
+
+	offs = SPA_MIN(d[0].chunk->offset, d[0].maxsize);
+	size = SPA_MIN(d[0].chunk->size, d[0].maxsize - offs);
+	wanted = size / impl->stride;
+
+	filled = spa_ringbuffer_get_write_index(&impl->ring, &index);
+	timestamp = get_timestamp(impl, index);
+
+	if (!impl->sync || timestamp != index) {
+		if (impl->sync)
+			pw_log_info("discontinuity %u != %u, resync", timestamp, index);
+		/* drop the incomplete packet and restart at the new time */
+		index = timestamp;
+		impl->ring.readindex = impl->ring.writeindex = index;
+		filled = 0;
+		impl->sync = true;
+	}
+	if (filled + wanted > BUFFER_FRAMES) {
+		pw_log_warn("overrun %u + %u > %u", filled, wanted, BUFFER_FRAMES);
+	} else {
+		spa_ringbuffer_write_data(&impl->ring,
+				impl->buffer, BUFFER_FRAMES * impl->stride,
+				(index & BUFFER_MASK) * impl->stride,
+				SPA_PTROFF(d[0].data, offs, void), wanted * impl->stride);
+		index += wanted;
+		spa_ringbuffer_write_update(&impl->ring, index);
+	}
+	pw_stream_queue_buffer(impl->stream, buf);
+
+	flush_packets(impl);
+}
+
+static void stream_io_changed(void *data, uint32_t id, void *area, uint32_t size)
+{
+	struct impl *impl = data;
+
+	switch (id) {
+	case SPA_IO_Position:
+		impl->position = area;
+		break;
+	}
+}
+
+static void on_stream_state_changed(void *d, enum pw_stream_state old,
+		enum pw_stream_state state, const char *error)
+{
+	struct impl *impl = d;
+
+	switch (state) {
+	case PW_STREAM_STATE_UNCONNECTED:
+		pw_log_info("stream disconnected, unloading");
+		unload_module(impl);
+		break;
+	case PW_STREAM_STATE_ERROR:
+		pw_log_error("stream error: %s", error);
+		break;
+	case PW_STREAM_STATE_PAUSED:
+		impl->sync = false;
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_stream_events in_stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.destroy = stream_destroy,
+	.state_changed = on_stream_state_changed,
+	.io_changed = stream_io_changed,
+	.process = stream_process
+};
+
+static bool is_multicast(struct sockaddr *sa, socklen_t salen)
+{
+	if (sa->sa_family == AF_INET) {
+		static const uint32_t ipv4_mcast_mask = 0xe0000000;
+		struct sockaddr_in *sa4 = (struct sockaddr_in*)sa;
+		return (ntohl(sa4->sin_addr.s_addr) & ipv4_mcast_mask) == ipv4_mcast_mask;
+	} else if (sa->sa_family == AF_INET6) {
+		struct sockaddr_in6 *sa6 = (struct sockaddr_in6*)sa;
+		return sa6->sin6_addr.s6_addr[0] == 0xff;
+	}
+	return false;
+}
+
+static int make_socket(struct sockaddr_storage *src, socklen_t src_len,
+		struct sockaddr_storage *dst, socklen_t dst_len,
+		bool loop, int ttl, int dscp)
+{
+	int af, fd, val, res;
+
+	af = src->ss_family;
+	if ((fd = socket(af, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0) {
+		pw_log_error("socket failed: %m");
+		return -errno;
+	}
+	if (bind(fd, (struct sockaddr*)src, src_len) < 0) {
+		res = -errno;
+		pw_log_error("bind() failed: %m");
+		goto error;
+	}
+	if (connect(fd, (struct sockaddr*)dst, dst_len) < 0) {
+		res = -errno;
+		pw_log_error("connect() failed: %m");
+		goto error;
+	}
+	if (is_multicast((struct sockaddr*)dst, dst_len)) {
+		val = loop;
+		if (setsockopt(fd, af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6,
+				af == AF_INET ? IP_MULTICAST_LOOP : IPV6_MULTICAST_LOOP,
+				&val, sizeof(val)) < 0)
+			pw_log_warn("setsockopt(MULTICAST_LOOP) failed: %m");
+
+		val = ttl;
+		if (setsockopt(fd, af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6,
+				af == AF_INET ? IP_MULTICAST_TTL : IPV6_MULTICAST_HOPS,
+				&val, sizeof(val)) < 0)
+			pw_log_warn("setsockopt(MULTICAST_TTL) failed: %m");
+	}
+	val = dscp << 2;
+	if (setsockopt(fd, af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6,
+			af == AF_INET ? IP_TOS : IPV6_TCLASS,
+			&val, sizeof(val)) < 0)
+		pw_log_warn("setsockopt(TOS) failed: %m");
+
+	return fd;
+error:
+	close(fd);
+	return res;
+}
+
+static int get_ip(const struct sockaddr_storage *sa, char *ip, size_t len)
+{
+	if (sa->ss_family == AF_INET) {
+		struct sockaddr_in *in = (struct sockaddr_in*)sa;
+		inet_ntop(sa->ss_family, &in->sin_addr, ip, len);
+	} else if (sa->ss_family == AF_INET6) {
+		struct sockaddr_in6 *in = (struct sockaddr_in6*)sa;
+		inet_ntop(sa->ss_family, &in->sin6_addr, ip, len);
+	} else
+		return -EINVAL;
+	return 0;
+}
+
+static void send_sap(struct impl *impl, bool bye)
+{
+	char buffer[2048], src_addr[64], dst_addr[64], dst_ttl[8];
+	const char *user_name, *af;
+	struct sockaddr *sa = (struct sockaddr*)&impl->src_addr;
+	struct sap_header header;
+	struct iovec iov[4];
+	struct msghdr msg;
+	uint32_t ptime;
+
+	spa_zero(header);
+	header.v = 1;
+	header.t = bye;
+	header.msg_id_hash = impl->msg_id_hash;
+
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+
+	if (sa->sa_family == AF_INET) {
+		iov[1].iov_base = &((struct sockaddr_in*) sa)->sin_addr;
+		iov[1].iov_len = 4U;
+		af = "IP4";
+	} else {
+		iov[1].iov_base = &((struct sockaddr_in6*) sa)->sin6_addr;
+		iov[1].iov_len = 16U;
+		header.a = 1;
+		af = "IP6";
+	}
+	iov[2].iov_base = SAP_MIME_TYPE;
+	iov[2].iov_len = sizeof(SAP_MIME_TYPE);
+
+	get_ip(&impl->src_addr, src_addr, sizeof(src_addr));
+	get_ip(&impl->dst_addr, dst_addr, sizeof(dst_addr));
+
+	if ((user_name = pw_get_user_name()) == NULL)
+		user_name = "-";
+
+	spa_zero(dst_ttl);
+	if (is_multicast((struct sockaddr*)&impl->dst_addr, impl->dst_len))
+		snprintf(dst_ttl, sizeof(dst_ttl), "/%d", impl->ttl);
+
+	ptime = impl->psamples * 1000000 / impl->info.rate;
+
+	snprintf(buffer, sizeof(buffer),
+			"v=0\n"
+			"o=%s %u 0 IN %s %s\n"
+			"s=%s\n"
+			"c=IN %s %s%s\n"
+			"t=%u 0\n"
+			"a=recvonly\n"
+			"a=tool:PipeWire %s\n"
+			"m=audio %u RTP/AVP %i\n"
+			"a=rtpmap:%i %s/%u/%u\n"
+			"a=ptime:%u.%03u\n"
+			"a=ts-refclk:%s\n"
+			"a=mediaclk:direct=%u\n",
+			user_name, impl->ntp, af, src_addr,
+			impl->session_name,
+			af, dst_addr, dst_ttl,
+			impl->ntp,
+			pw_get_library_version(),
+			impl->dst_port, impl->payload,
+			impl->payload, impl->format_info->mime,
+			impl->info.rate, impl->info.channels,
+			ptime / 1000, ptime % 1000,
+			impl->ts_refclk,
+			impl->ts_offset);
+
+	iov[3].iov_base = buffer;
+	iov[3].iov_len = strlen(buffer);
+
+	spa_zero(msg);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 4;
+
+	pw_log_debug("sending SAP for %u %s", impl->dst_port, buffer);
+
+	if (sendmsg(impl->sap_fd, &msg, MSG_NOSIGNAL) < 0)
+		pw_log_warn("sendmsg() failed: %m");
+}
+
+static void on_timer_event(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	send_sap(impl, false);
+}
+
+static int start_sap_announce(struct impl *impl)
+{
+	int fd, res;
+	struct timespec value, interval;
+	struct sockaddr_storage sa = impl->src_addr;
+
+	/* same interface as the RTP packets but with any port */
+	if (sa.ss_family == AF_INET)
+		((struct sockaddr_in*)&sa)->sin_port = 0;
+	else
+		((struct sockaddr_in6*)&sa)->sin6_port = 0;
+
+	if ((fd = make_socket(&sa, impl->src_len,
+					&impl->sap_addr, impl->sap_len,
+					impl->mcast_loop, impl->ttl, 0)) < 0)
+		return fd;
+
+	impl->sap_fd = fd;
+
+	pw_log_info("starting SAP timer");
+	impl->timer = pw_loop_add_timer(impl->loop, on_timer_event, impl);
+	if (impl->timer == NULL) {
+		res = -errno;
+		pw_log_error("can't create timer source: %m");
+		goto error;
+	}
+	value.tv_sec = 0;
+	value.tv_nsec = 1;
+	interval.tv_sec = SAP_INTERVAL_SEC;
+	interval.tv_nsec = 0;
+	pw_loop_update_timer(impl->loop, impl->timer, &value, &interval, false);
+
+	return 0;
+error:
+	close(fd);
+	impl->sap_fd = -1;
+	return res;
+}
+
+static int setup_stream(struct impl *impl)
+{
+	const struct spa_pod *params[1];
+	struct spa_pod_builder b;
+	uint32_t n_params;
+	uint8_t buffer[1024];
+	int res, fd;
+
+	if ((fd = make_socket(&impl->src_addr, impl->src_len,
+					&impl->dst_addr, impl->dst_len,
+					impl->mcast_loop, impl->ttl, impl->dscp)) < 0)
+		return fd;
+	impl->rtp_fd = fd;
+
+	/* announce the address the kernel picked for us */
+	impl->src_len = sizeof(impl->src_addr);
+	if (getsockname(fd, (struct sockaddr*)&impl->src_addr, &impl->src_len) < 0) {
+		pw_log_error("getsockname() failed: %m");
+		return -errno;
+	}
+
+	impl->stream = pw_stream_new(impl->core,
+			"rtp-sink capture", impl->stream_props);
+	impl->stream_props = NULL;
+
+	if (impl->stream == NULL)
+		return -errno;
+
+	pw_stream_add_listener(impl->stream,
+			&impl->stream_listener,
+			&in_stream_events, impl);
+
+	n_params = 0;
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	params[n_params++] = spa_format_audio_raw_build(&b,
+			SPA_PARAM_EnumFormat, &impl->info);
+
+	if ((res = pw_stream_connect(impl->stream,
+			PW_DIRECTION_INPUT,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, n_params)) < 0)
+		return res;
+
+	return 0;
+}
+
+static void core_error(void *data, uint32_t id, int seq, int res, const char *message)
+{
+	struct impl *impl = data;
+
+	pw_log_error("error id:%u seq:%d res:%d (%s): %s",
+			id, seq, res, spa_strerror(res), message);
+
+	if (id == PW_ID_CORE && res == -EPIPE)
+		unload_module(impl);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.error = core_error,
+};
+
+static void core_destroy(void *d)
+{
+	struct impl *impl = d;
+	spa_hook_remove(&impl->core_listener);
+	impl->core = NULL;
+	unload_module(impl);
+}
+
+static const struct pw_proxy_events core_proxy_events = {
+	.destroy = core_destroy,
+};
+
+static void impl_destroy(struct impl *impl)
+{
+	if (impl->sap_fd != -1) {
+		send_sap(impl, true);
+		close(impl->sap_fd);
+	}
+	if (impl->timer)
+		pw_loop_destroy_source(impl->loop, impl->timer);
+
+	if (impl->stream)
+		pw_stream_destroy(impl->stream);
+	if (impl->core && impl->do_disconnect)
+		pw_core_disconnect(impl->core);
+
+	if (impl->rtp_fd != -1)
+		close(impl->rtp_fd);
+
+	pw_properties_free(impl->stream_props);
+	pw_properties_free(impl->props);
+
+	if (impl->work)
+		pw_work_queue_cancel(impl->work, impl, SPA_ID_INVALID);
+
+	free(impl->buffer);
+	free(impl->ts_refclk);
+	free(impl->session_name);
+	free(impl);
+}
+
+static void module_destroy(void *data)
+{
+	struct impl *impl = data;
+	impl->unloading = true;
+	spa_hook_remove(&impl->module_listener);
+	impl_destroy(impl);
+}
+
+static const struct pw_impl_module_events module_events = {
+	PW_VERSION_IMPL_MODULE_EVENTS,
+	.destroy = module_destroy,
+};
+
+static inline uint32_t format_from_name(const char *name, size_t len)
+{
+	int i;
+	for (i = 0; spa_type_audio_format[i].name; i++) {
+		if (strncmp(name, spa_debug_type_short_name(spa_type_audio_format[i].name), len) == 0)
+			return spa_type_audio_format[i].type;
+	}
+	return SPA_AUDIO_FORMAT_UNKNOWN;
+}
+
+static uint32_t channel_from_name(const char *name)
+{
+	int i;
+	for (i = 0; spa_type_audio_channel[i].name; i++) {
+		if (spa_streq(name, spa_debug_type_short_name(spa_type_audio_channel[i].name)))
+			return spa_type_audio_channel[i].type;
+	}
+	return SPA_AUDIO_CHANNEL_UNKNOWN;
+}
+
+static void parse_position(struct spa_audio_info_raw *info, const char *val, size_t len)
+{
+	struct spa_json it[2];
+	char v[256];
+
+	spa_json_init(&it[0], val, len);
+	if (spa_json_enter_array(&it[0], &it[1]) <= 0)
+		spa_json_init(&it[1], val, len);
+
+	info->channels = 0;
+	while (spa_json_get_string(&it[1], v, sizeof(v)) > 0 &&
+	    info->channels < SPA_AUDIO_MAX_CHANNELS) {
+		info->position[info->channels++] = channel_from_name(v);
+	}
+}
+
+static int parse_audio_info(struct impl *impl)
+{
+	struct pw_properties *props = impl->stream_props;
+	struct spa_audio_info_raw *info = &impl->info;
+	const char *str;
+	uint32_t i;
+
+	spa_zero(*info);
+
+	if ((str = pw_properties_get(props, PW_KEY_AUDIO_FORMAT)) == NULL)
+		str = DEFAULT_FORMAT;
+	info->format = format_from_name(str, strlen(str));
+	for (i = 0; i < SPA_N_ELEMENTS(format_info); i++) {
+		if (format_info[i].format == info->format)
+			impl->format_info = &format_info[i];
+	}
+	if (impl->format_info == NULL) {
+		pw_log_error("unsupported format '%s'", str);
+		return -EINVAL;
+	}
+	info->rate = pw_properties_get_uint32(props, PW_KEY_AUDIO_RATE, DEFAULT_RATE);
+	if (info->rate == 0) {
+		pw_log_error("invalid rate '%s'", str);
+		return -EINVAL;
+	}
+	info->channels = pw_properties_get_uint32(props, PW_KEY_AUDIO_CHANNELS, DEFAULT_CHANNELS);
+	if ((str = pw_properties_get(props, SPA_KEY_AUDIO_POSITION)) != NULL)
+		parse_position(info, str, strlen(str));
+	else if (info->channels == DEFAULT_CHANNELS)
+		parse_position(info, DEFAULT_POSITION, strlen(DEFAULT_POSITION));
+	else
+		info->flags |= SPA_AUDIO_FLAG_UNPOSITIONED;
+
+	if (info->channels == 0 || info->channels > SPA_AUDIO_MAX_CHANNELS) {
+		pw_log_error("invalid channels %u", info->channels);
+		return -EINVAL;
+	}
+	impl->stride = impl->format_info->size * info->channels;
+
+	return 0;
+}
+
+static int parse_address(const char *address, uint16_t port,
+		struct sockaddr_storage *addr, socklen_t *len)
+{
+	struct sockaddr_in *sa4 = (struct sockaddr_in*)addr;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6*)addr;
+
+	if (inet_pton(AF_INET, address, &sa4->sin_addr) > 0) {
+		sa4->sin_family = AF_INET;
+		sa4->sin_port = htons(port);
+		*len = sizeof(*sa4);
+	} else if (inet_pton(AF_INET6, address, &sa6->sin6_addr) > 0) {
+		sa6->sin6_family = AF_INET6;
+		sa6->sin6_port = htons(port);
+		*len = sizeof(*sa6);
+	} else
+		return -EINVAL;
+
+	return 0;
+}
+
+static void copy_props(struct impl *impl, struct pw_properties *props, const char *key)
+{
+	const char *str;
+	if ((str = pw_properties_get(props, key)) != NULL) {
+		if (pw_properties_get(impl->stream_props, key) == NULL)
+			pw_properties_set(impl->stream_props, key, str);
+	}
+}
+
+SPA_EXPORT
+int pipewire__module_init(struct pw_impl_module *module, const char *args)
+{
+	struct pw_context *context = pw_impl_module_get_context(module);
+	struct pw_properties *props = NULL;
+	uint32_t id = pw_global_get_id(pw_impl_module_get_global(module));
+	struct impl *impl;
+	const char *str;
+	uint32_t port;
+	int res;
+
+	PW_LOG_TOPIC_INIT(mod_topic);
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		return -errno;
+
+	impl->rtp_fd = -1;
+	impl->sap_fd = -1;
+
+	if (args == NULL)
+		args = "";
+
+	props = pw_properties_new_string(args);
+	if (props == NULL) {
+		res = -errno;
+		pw_log_error( "can't create properties: %m");
+		goto out;
+	}
+	impl->props = props;
+
+	impl->stream_props = pw_properties_new(NULL, NULL);
+	if (impl->stream_props == NULL) {
+		res = -errno;
+		pw_log_error( "can't create properties: %m");
+		goto out;
+	}
+
+	impl->module = module;
+	impl->context = context;
+	impl->loop = pw_context_get_main_loop(context);
+	impl->work = pw_context_get_work_queue(context);
+	if (impl->work == NULL) {
+		res = -errno;
+		pw_log_error( "can't get work queue: %m");
+		goto out;
+	}
+
+	if (pw_properties_get(props, PW_KEY_NODE_GROUP) == NULL)
+		pw_properties_set(props, PW_KEY_NODE_GROUP, "pipewire.dummy");
+	if (pw_properties_get(props, PW_KEY_NODE_VIRTUAL) == NULL)
+		pw_properties_set(props, PW_KEY_NODE_VIRTUAL, "true");
+	if (pw_properties_get(props, PW_KEY_NODE_NETWORK) == NULL)
+		pw_properties_set(props, PW_KEY_NODE_NETWORK, "true");
+	if (pw_properties_get(props, PW_KEY_MEDIA_CLASS) == NULL)
+		pw_properties_set(props, PW_KEY_MEDIA_CLASS, "Audio/Sink");
+	if (pw_properties_get(props, PW_KEY_NODE_NAME) == NULL)
+		pw_properties_setf(props, PW_KEY_NODE_NAME, "rtp-sink-%u", id);
+	if (pw_properties_get(props, PW_KEY_NODE_DESCRIPTION) == NULL)
+		pw_properties_set(props, PW_KEY_NODE_DESCRIPTION, "RTP Sink");
+
+	if ((str = pw_properties_get(props, "stream.props")) != NULL)
+		pw_properties_update_string(impl->stream_props, str, strlen(str));
+
+	copy_props(impl, props, PW_KEY_AUDIO_FORMAT);
+	copy_props(impl, props, PW_KEY_AUDIO_RATE);
+	copy_props(impl, props, PW_KEY_AUDIO_CHANNELS);
+	copy_props(impl, props, SPA_KEY_AUDIO_POSITION);
+	copy_props(impl, props, PW_KEY_NODE_NAME);
+	copy_props(impl, props, PW_KEY_NODE_DESCRIPTION);
+	copy_props(impl, props, PW_KEY_NODE_GROUP);
+	copy_props(impl, props, PW_KEY_NODE_LATENCY);
+	copy_props(impl, props, PW_KEY_NODE_VIRTUAL);
+	copy_props(impl, props, PW_KEY_NODE_NETWORK);
+	copy_props(impl, props, PW_KEY_MEDIA_NAME);
+	copy_props(impl, props, PW_KEY_MEDIA_CLASS);
+
+	if ((res = parse_audio_info(impl)) < 0) {
+		pw_log_error( "can't parse audio format");
+		goto out;
+	}
+	/* try to run the graph at our rate so that the RTP time can
+	 * follow the graph clock */
+	if (pw_properties_get(impl->stream_props, PW_KEY_NODE_RATE) == NULL)
+		pw_properties_setf(impl->stream_props, PW_KEY_NODE_RATE, "1/%u", impl->info.rate);
+
+	impl->buffer = calloc(BUFFER_FRAMES, impl->stride);
+	if (impl->buffer == NULL) {
+		res = -errno;
+		goto out;
+	}
+
+	impl->mtu = pw_properties_get_uint32(props, "net.mtu", DEFAULT_MTU);
+	impl->ttl = pw_properties_get_uint32(props, "net.ttl", DEFAULT_TTL);
+	impl->mcast_loop = pw_properties_get_bool(props, "net.loop", DEFAULT_LOOP);
+	impl->dscp = pw_properties_get_uint32(props, "net.dscp", DEFAULT_DSCP);
+	impl->ptime = pw_properties_get_uint32(props, "sess.ptime", DEFAULT_PTIME);
+
+	if (impl->mtu <= sizeof(struct rtp_header) + impl->stride) {
+		pw_log_error("invalid MTU %u", impl->mtu);
+		res = -EINVAL;
+		goto out;
+	}
+	impl->psamples = SPA_MAX(1u, impl->ptime * impl->info.rate / 1000);
+	impl->psamples = SPA_MIN(impl->psamples,
+			(impl->mtu - (uint32_t)sizeof(struct rtp_header)) / impl->stride);
+
+	if ((str = pw_properties_get(props, "sess.name")) == NULL)
+		pw_properties_setf(props, "sess.name", "PipeWire RTP Stream on %s",
+				pw_get_host_name());
+	impl->session_name = strdup(pw_properties_get(props, "sess.name"));
+
+	if ((str = pw_properties_get(props, "sess.ts-refclk")) == NULL)
+		str = DEFAULT_TS_REFCLK;
+	impl->ts_refclk = strdup(str);
+
+	if ((str = pw_properties_get(props, "source.ip")) == NULL)
+		str = DEFAULT_SOURCE_IP;
+	if ((res = parse_address(str, 0, &impl->src_addr, &impl->src_len)) < 0) {
+		pw_log_error("invalid source.ip %s: %s", str, spa_strerror(res));
+		goto out;
+	}
+
+	port = pw_properties_get_uint32(props, "destination.port", DEFAULT_PORT);
+	impl->dst_port = port;
+	if ((str = pw_properties_get(props, "destination.ip")) == NULL)
+		str = DEFAULT_DESTINATION_IP;
+	if ((res = parse_address(str, port, &impl->dst_addr, &impl->dst_len)) < 0) {
+		pw_log_error("invalid destination.ip %s: %s", str, spa_strerror(res));
+		goto out;
+	}
+
+	port = pw_properties_get_uint32(props, "sap.port", SAP_DEFAULT_PORT);
+	if ((str = pw_properties_get(props, "sap.ip")) == NULL)
+		str = SAP_DEFAULT_IP;
+	if ((res = parse_address(str, port, &impl->sap_addr, &impl->sap_len)) < 0) {
+		pw_log_error("invalid sap.ip %s: %s", str, spa_strerror(res));
+		goto out;
+	}
+
+	impl->payload = DEFAULT_PAYLOAD;
+	pw_getrandom(&impl->msg_id_hash, sizeof(impl->msg_id_hash), 0);
+	pw_getrandom(&impl->ntp, sizeof(impl->ntp), 0);
+	pw_getrandom(&impl->seq, sizeof(impl->seq), 0);
+	pw_getrandom(&impl->ssrc, sizeof(impl->ssrc), 0);
+	pw_getrandom(&impl->ts_offset, sizeof(impl->ts_offset), 0);
+
+	impl->core = pw_context_get_object(impl->context, PW_TYPE_INTERFACE_Core);
+	if (impl->core == NULL) {
+		str = pw_properties_get(props, PW_KEY_REMOTE_NAME);
+		impl->core = pw_context_connect(impl->context,
+				pw_properties_new(
+					PW_KEY_REMOTE_NAME, str,
+					NULL),
+				0);
+		impl->do_disconnect = true;
+	}
+	if (impl->core == NULL) {
+		res = -errno;
+		pw_log_error("can't connect: %m");
+		goto out;
+	}
+
+	pw_proxy_add_listener((struct pw_proxy*)impl->core,
+			&impl->core_proxy_listener,
+			&core_proxy_events, impl);
+	pw_core_add_listener(impl->core,
+			&impl->core_listener,
+			&core_events, impl);
+
+	if ((res = setup_stream(impl)) < 0)
+		goto out;
+
+	if ((res = start_sap_announce(impl)) < 0)
+		goto out;
+
+	pw_impl_module_add_listener(module, &impl->module_listener, &module_events, impl);
+
+	pw_impl_module_update_properties(module, &SPA_DICT_INIT_ARRAY(module_info));
+
+	pw_log_info("successfully created rtp sink with %u samples per packet",
+			impl->psamples);
+
+	return 0;
+out:
+	impl_destroy(impl);
+	return res;
+}
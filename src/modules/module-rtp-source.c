@@ -0,0 +1,1208 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <ctype.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "config.h"
+
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/list.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/utils/dll.h>
+#include <spa/pod/builder.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/audio/raw.h>
+#include <spa/node/io.h>
+
+#include <pipewire/impl.h>
+
+#include "module-rtp/rtp.h"
+#include "module-rtp/sap.h"
+
+/** \page page_module_rtp_source PipeWire Module: RTP source
+ *
+ * The `rtp-source` module listens for SAP announcements of RTP sessions,
+ * such as the ones made by \ref page_module_rtp_sink, and creates a
+ * PipeWire source for each of them.
+ *
+ * The received packets are placed in a jitter buffer at the position
+ * given by their RTP timestamp. The fill level of the buffer is kept at
+ * the configured latency by adjusting the resampler of the stream, which
+ * makes the source follow the clock of the sender.
+ *
+ * ## Module Options
+ *
+ * Options specific to the behavior of this module
+ *
+ * - `sap.ip = <str>`: the SAP address to listen on, default 224.0.0.56
+ * - `sap.port = <int>`: the SAP port to listen on, default 9875
+ * - `sess.latency.msec = <int>`: target network latency in milliseconds, default 100
+ * - `sess.name = <str>`: only receive sessions with this name
+ * - `sess.max-sessions = <int>`: the maximum number of sessions, default 16
+ * - `stream.props = {}`: properties to be passed to all the streams
+ *
+ * ## General options
+ *
+ * Options with well-known behavior:
+ *
+ * - \ref PW_KEY_NODE_NAME
+ * - \ref PW_KEY_NODE_DESCRIPTION
+ * - \ref PW_KEY_MEDIA_NAME
+ *
+ * ## Example configuration
+ *\code{.unparsed}
+ * context.modules = [
+ * {   name = libpipewire-module-rtp-source
+ *     args = {
+ *         #sap.ip = 224.0.0.56
+ *         #sap.port = 9875
+ *         #sess.latency.msec = 100
+ *         #sess.max-sessions = 16
+ *         stream.props = {
+ *             media.class = "Audio/Source"
+ *         }
+ *     }
+ * }
+ * ]
+ *\endcode
+ *
+ * \since 0.3.44
+ */
+
+#define NAME "rtp-source"
+
+PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
+#define PW_LOG_TOPIC_DEFAULT mod_topic
+
+#define SAP_DEFAULT_IP		"224.0.0.56"
+#define SAP_DEFAULT_PORT	9875
+#define SAP_CLEANUP_SEC		5
+#define SAP_TIMEOUT_SEC		60
+
+#define BUFFER_FRAMES		(1u<<18)
+#define BUFFER_MASK		(BUFFER_FRAMES-1)
+#define MAX_PACKET		65536
+
+#define DEFAULT_SESS_LATENCY	100
+#define DEFAULT_MAX_SESSIONS	16
+#define DEFAULT_MAX_ERROR	128
+
+#define MODULE_USAGE	"[ sap.ip=<SAP IP address to listen on, default:"SAP_DEFAULT_IP"> ] "	\
+			"[ sap.port=<SAP port to listen on, default:"SPA_STRINGIFY(SAP_DEFAULT_PORT)"> ] " \
+			"[ sess.latency.msec=<target network latency, default:"SPA_STRINGIFY(DEFAULT_SESS_LATENCY)"> ] " \
+			"[ sess.name=<only receive sessions with this name> ] "			\
+			"[ sess.max-sessions=<maximum number of sessions, default:"SPA_STRINGIFY(DEFAULT_MAX_SESSIONS)"> ] " \
+			"[ stream.props=<properties> ] "
+
+static const struct spa_dict_item module_info[] = {
+	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
+	{ PW_KEY_MODULE_DESCRIPTION, "RTP Source" },
+	{ PW_KEY_MODULE_USAGE, MODULE_USAGE },
+	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
+};
+
+struct format_info {
+	uint32_t format;
+	uint32_t size;
+	const char *mime;
+};
+
+static const struct format_info format_info[] = {
+	{ SPA_AUDIO_FORMAT_S16_BE, 2, "L16" },
+	{ SPA_AUDIO_FORMAT_S24_BE, 3, "L24" },
+	{ SPA_AUDIO_FORMAT_F32_BE, 4, "L32F" },
+};
+
+struct impl {
+	struct pw_context *context;
+
+	struct pw_impl_module *module;
+	struct spa_hook module_listener;
+	struct pw_properties *props;
+
+	struct pw_loop *loop;
+	struct spa_loop *data_loop;
+	struct pw_work_queue *work;
+
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	struct spa_hook core_proxy_listener;
+
+	struct spa_source *timer;
+	struct spa_source *sap_source;
+
+	struct pw_properties *stream_props;
+
+	unsigned int do_disconnect:1;
+	unsigned int unloading:1;
+
+	char *session_name;
+	uint32_t sess_latency_msec;
+	uint32_t max_sessions;
+
+	struct sockaddr_storage sap_addr;
+	socklen_t sap_len;
+
+	struct spa_list sessions;
+	uint32_t n_sessions;
+
+	/* SAP packets, received on the main loop */
+	uint8_t packet[MAX_PACKET];
+	/* RTP packets, received on the data loop */
+	uint8_t rtp_packet[MAX_PACKET];
+};
+
+struct sdp_info {
+	uint16_t hash;
+	char origin[128];
+	char session[256];
+
+	struct sockaddr_storage sa;
+	socklen_t salen;
+
+	uint16_t port;
+	uint8_t payload;
+
+	const struct format_info *format_info;
+	struct spa_audio_info_raw info;
+	uint32_t stride;
+};
+
+struct session {
+	struct impl *impl;
+	struct spa_list link;
+
+	uint64_t timestamp;
+
+	struct sdp_info info;
+
+	/* the RTP socket, added to the data loop where the stream consumes
+	 * the ringbuffer so that only one thread uses it */
+	struct spa_source source;
+
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+	struct spa_io_rate_match *rate_match;
+
+	uint32_t expected_ssrc;
+	uint16_t expected_seq;
+	unsigned have_ssrc:1;
+	unsigned have_seq:1;
+	unsigned have_sync:1;
+
+	struct spa_ringbuffer ring;
+	uint8_t *buffer;
+
+	struct spa_dll dll;
+	uint32_t target_buffer;
+	float max_error;
+};
+
+static void do_unload_module(void *obj, void *data, int res, uint32_t id)
+{
+	struct impl *impl = data;
+	pw_impl_module_destroy(impl->module);
+}
+
+static void unload_module(struct impl *impl)
+{
+	if (!impl->unloading) {
+		impl->unloading = true;
+		pw_work_queue_add(impl->work, impl, 0, do_unload_module, impl);
+	}
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void stream_destroy(void *d)
+{
+	struct session *sess = d;
+	spa_hook_remove(&sess->stream_listener);
+	sess->stream = NULL;
+}
+
+static void stream_process(void *data)
+{
+	struct session *sess = data;
+	struct pw_buffer *buf;
+	struct spa_data *d;
+	uint32_t index, stride = sess->info.stride;
+	uint32_t wanted, maxsize;
+	int32_t avail;
+
+	if ((buf = pw_stream_dequeue_buffer(sess->stream)) == NULL) {
+		pw_log_debug("Out of stream buffers: %m");
+		return;
+	}
+	d = buf->buffer->datas;
+	if (d[0].data == NULL)
+		return;
+
+	maxsize = d[0].maxsize / stride;
+	wanted = sess->rate_match ? SPA_MIN(sess->rate_match->size, maxsize) : maxsize;
+
+	avail = spa_ringbuffer_get_read_index(&sess->ring, &index);
+
+	if (!sess->have_sync || avail < (int32_t)wanted) {
+		pw_log_trace("underrun %d < %u", avail, wanted);
+		memset(d[0].data, 0, wanted * stride);
+	} else {
+		double error, corr;
+
+		if (avail > (int32_t)BUFFER_FRAMES) {
+			pw_log_debug("overrun %d > %u", avail, BUFFER_FRAMES);
+			index += avail - sess->target_buffer;
+		} else {
+			/* keep the fill level at the target, this makes us
+			 * consume the data at the rate of the sender */
+			error = (double)sess->target_buffer - (double)avail;
+			error = SPA_CLAMP(error, -sess->max_error, sess->max_error);
+
+			corr = spa_dll_update(&sess->dll, error);
+
+			pw_log_trace("avail:%d target:%u error:%f corr:%f",
+					avail, sess->target_buffer, error, corr);
+
+			if (sess->rate_match) {
+				SPA_FLAG_SET(sess->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+				sess->rate_match->rate = 1.0 / corr;
+			}
+		}
+		spa_ringbuffer_read_data(&sess->ring,
+				sess->buffer, BUFFER_FRAMES * stride,
+				(index & BUFFER_MASK) * stride,
+				d[0].data, wanted * stride);
+		index += wanted;
+		spa_ringbuffer_read_update(&sess->ring, index);
+	}
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = wanted * stride;
+	d[0].chunk->stride = stride;
+
+	pw_stream_queue_buffer(sess->stream, buf);
+}
+
+static void stream_io_changed(void *data, uint32_t id, void *area, uint32_t size)
+{
+	struct session *sess = data;
+
+	switch (id) {
+	case SPA_IO_RateMatch:
+		sess->rate_match = area;
+		break;
+	}
+}
+
+static void on_stream_state_changed(void *d, enum pw_stream_state old,
+		enum pw_stream_state state, const char *error)
+{
+	struct session *sess = d;
+
+	switch (state) {
+	case PW_STREAM_STATE_UNCONNECTED:
+		pw_log_info("session %s stream disconnected", sess->info.session);
+		break;
+	case PW_STREAM_STATE_ERROR:
+		pw_log_error("stream error: %s", error);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_stream_events out_stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.destroy = stream_destroy,
+	.state_changed = on_stream_state_changed,
+	.io_changed = stream_io_changed,
+	.process = stream_process
+};
+
+static void on_rtp_io(struct spa_source *source)
+{
+	struct session *sess = source->data;
+	struct impl *impl = sess->impl;
+	struct rtp_header *hdr;
+	ssize_t len, hlen;
+	uint8_t *packet = impl->rtp_packet;
+	uint32_t stride = sess->info.stride;
+	uint32_t index, timestamp, samples;
+	uint16_t seq;
+	int32_t filled;
+
+	if (!(source->rmask & SPA_IO_IN))
+		return;
+
+	if ((len = recv(source->fd, packet, MAX_PACKET, 0)) < 0)
+		goto receive_error;
+
+	if (len < (ssize_t)sizeof(*hdr))
+		goto short_packet;
+
+	hdr = (struct rtp_header*)packet;
+	if (hdr->v != 2)
+		goto invalid_version;
+
+	hlen = sizeof(*hdr) + hdr->cc * 4;
+	if (hlen > len)
+		goto invalid_len;
+
+	if (hdr->x) {
+		/* skip the header extension, 16 bits profile and 16 bits
+		 * length in 32 bit words, excluding this header */
+		uint16_t ext_len;
+
+		if (hlen + 4 > len)
+			goto invalid_len;
+		memcpy(&ext_len, &packet[hlen + 2], sizeof(ext_len));
+		hlen += 4 + ntohs(ext_len) * 4;
+		if (hlen > len)
+			goto invalid_len;
+	}
+	if (hdr->p) {
+		/* the last byte has the padding size, including itself */
+		uint8_t padding = packet[len - 1];
+
+		if (padding == 0 || hlen + padding > len)
+			goto invalid_len;
+		len -= padding;
+	}
+
+	if (sess->have_ssrc && sess->expected_ssrc != hdr->ssrc)
+		goto unexpected_ssrc;
+	sess->expected_ssrc = hdr->ssrc;
+	sess->have_ssrc = true;
+
+	if (hdr->pt != sess->info.payload)
+		goto unexpected_pt;
+
+	seq = ntohs(hdr->sequence_number);
+	if (sess->have_seq && sess->expected_seq != seq)
+		pw_log_info("unexpected seq (%d != %d)", seq, sess->expected_seq);
+	sess->expected_seq = seq + 1;
+	sess->have_seq = true;
+
+	samples = (len - hlen) / stride;
+	len = samples * stride;
+	timestamp = ntohl(hdr->timestamp);
+
+	filled = spa_ringbuffer_get_write_index(&sess->ring, &index);
+
+	if (!sess->have_sync) {
+		pw_log_info("sync to timestamp %u", timestamp);
+		index = timestamp;
+		sess->ring.readindex = timestamp - sess->target_buffer;
+		memset(sess->buffer, 0, BUFFER_FRAMES * stride);
+		filled = sess->target_buffer;
+
+		spa_dll_init(&sess->dll);
+		spa_dll_set_bw(&sess->dll, SPA_DLL_BW_MIN, 128, sess->info.info.rate);
+		sess->have_sync = true;
+	} else if (index != timestamp) {
+		pw_log_debug("unexpected timestamp (%u != %u)", timestamp, index);
+	}
+
+	if (filled + samples > BUFFER_FRAMES) {
+		pw_log_debug("receive overrun %d + %u > %u", filled, samples, BUFFER_FRAMES);
+		sess->have_sync = false;
+	} else {
+		/* place the packet at its timestamp, this handles reordered
+		 * packets, the write index only moves forward */
+		spa_ringbuffer_write_data(&sess->ring,
+				sess->buffer, BUFFER_FRAMES * stride,
+				(timestamp & BUFFER_MASK) * stride,
+				&packet[hlen], len);
+		if ((int32_t)(timestamp + samples - index) > 0)
+			index = timestamp + samples;
+		spa_ringbuffer_write_update(&sess->ring, index);
+	}
+	return;
+
+receive_error:
+	pw_log_warn("recv error: %m");
+	return;
+short_packet:
+	pw_log_warn("short packet received");
+	return;
+invalid_version:
+	pw_log_warn("invalid RTP version");
+	return;
+invalid_len:
+	pw_log_warn("invalid RTP length");
+	return;
+unexpected_ssrc:
+	pw_log_warn("unexpected SSRC (expected %u != %u)",
+			sess->expected_ssrc, hdr->ssrc);
+	return;
+unexpected_pt:
+	pw_log_warn("unexpected payload type %u != %u", hdr->pt, sess->info.payload);
+	return;
+}
+
+static int make_socket(const struct sockaddr_storage *sa, socklen_t salen)
+{
+	int af, fd, val, res;
+	struct sockaddr_storage ba = *sa;
+
+	af = sa->ss_family;
+	if ((fd = socket(af, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0) {
+		pw_log_error("socket failed: %m");
+		return -errno;
+	}
+	val = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) < 0) {
+		res = -errno;
+		pw_log_error("setsockopt failed: %m");
+		goto error;
+	}
+	if (af == AF_INET) {
+		static const uint32_t ipv4_mcast_mask = 0xe0000000;
+		struct sockaddr_in *sa4 = (struct sockaddr_in*)&ba;
+		if ((ntohl(sa4->sin_addr.s_addr) & ipv4_mcast_mask) == ipv4_mcast_mask) {
+			struct ip_mreqn mr4;
+			spa_zero(mr4);
+			mr4.imr_multiaddr = sa4->sin_addr;
+			res = setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mr4, sizeof(mr4));
+		} else {
+			sa4->sin_addr.s_addr = INADDR_ANY;
+			res = 0;
+		}
+	} else if (af == AF_INET6) {
+		struct sockaddr_in6 *sa6 = (struct sockaddr_in6*)&ba;
+		if (sa6->sin6_addr.s6_addr[0] == 0xff) {
+			struct ipv6_mreq mr6;
+			spa_zero(mr6);
+			mr6.ipv6mr_multiaddr = sa6->sin6_addr;
+			res = setsockopt(fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mr6, sizeof(mr6));
+		} else {
+			sa6->sin6_addr = in6addr_any;
+			res = 0;
+		}
+	} else {
+		res = -EINVAL;
+		goto error;
+	}
+	if (res < 0) {
+		res = -errno;
+		pw_log_error("join mcast failed: %m");
+		goto error;
+	}
+	if (bind(fd, (struct sockaddr*)&ba, salen) < 0) {
+		res = -errno;
+		pw_log_error("bind() failed: %m");
+		goto error;
+	}
+	return fd;
+error:
+	close(fd);
+	return res;
+}
+
+static int do_add_source(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct session *sess = user_data;
+	return spa_loop_add_source(loop, &sess->source);
+}
+
+static int do_remove_source(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct session *sess = user_data;
+	return spa_loop_remove_source(loop, &sess->source);
+}
+
+static void session_free(struct session *sess)
+{
+	struct impl *impl = sess->impl;
+
+	if (impl) {
+		pw_log_info("free session %s %s", sess->info.origin, sess->info.session);
+		impl->n_sessions--;
+		spa_list_remove(&sess->link);
+	}
+	if (sess->source.loop)
+		spa_loop_invoke(impl->data_loop, do_remove_source, 0, NULL, 0, true, sess);
+	if (sess->source.fd >= 0)
+		close(sess->source.fd);
+	if (sess->stream)
+		pw_stream_destroy(sess->stream);
+	free(sess->buffer);
+	free(sess);
+}
+
+static int session_new(struct impl *impl, struct sdp_info *info)
+{
+	struct session *session;
+	const struct spa_pod *params[1];
+	struct spa_pod_builder b;
+	uint32_t n_params;
+	uint8_t buffer[1024];
+	struct pw_properties *props;
+	int res, fd;
+
+	session = calloc(1, sizeof(struct session));
+	if (session == NULL)
+		return -errno;
+
+	session->info = *info;
+	session->timestamp = get_time_ns();
+	session->source.fd = -1;
+
+	session->target_buffer = SPA_MIN(impl->sess_latency_msec * info->info.rate / 1000,
+			BUFFER_FRAMES / 2);
+	session->max_error = DEFAULT_MAX_ERROR;
+
+	session->buffer = calloc(BUFFER_FRAMES, info->stride);
+	if (session->buffer == NULL) {
+		res = -errno;
+		goto error;
+	}
+
+	props = pw_properties_copy(impl->stream_props);
+	if (props == NULL) {
+		res = -errno;
+		goto error;
+	}
+	if (pw_properties_get(props, PW_KEY_NODE_NAME) == NULL)
+		pw_properties_setf(props, PW_KEY_NODE_NAME, "rtp-source-%u-%u",
+				info->hash, info->port);
+	if (pw_properties_get(props, PW_KEY_NODE_DESCRIPTION) == NULL)
+		pw_properties_set(props, PW_KEY_NODE_DESCRIPTION, info->session);
+	if (pw_properties_get(props, PW_KEY_MEDIA_NAME) == NULL)
+		pw_properties_set(props, PW_KEY_MEDIA_NAME, info->session);
+	pw_properties_set(props, "rtp.session", info->session);
+	pw_properties_set(props, "rtp.origin", info->origin);
+	pw_properties_setf(props, "rtp.payload", "%u", info->payload);
+	pw_properties_set(props, "rtp.mime", info->format_info->mime);
+	pw_properties_setf(props, "rtp.rate", "%u", info->info.rate);
+	pw_properties_setf(props, "rtp.channels", "%u", info->info.channels);
+	pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%u", info->info.rate);
+	/* the stream needs to run on the data loop of the socket */
+	pw_properties_set(props, PW_KEY_NODE_DATA_LOOP, NULL);
+
+	session->stream = pw_stream_new(impl->core,
+			"rtp-source playback", props);
+	if (session->stream == NULL) {
+		res = -errno;
+		pw_log_error("can't create stream: %m");
+		goto error;
+	}
+
+	pw_stream_add_listener(session->stream,
+			&session->stream_listener,
+			&out_stream_events, session);
+
+	n_params = 0;
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	params[n_params++] = spa_format_audio_raw_build(&b,
+			SPA_PARAM_EnumFormat, &info->info);
+
+	if ((res = pw_stream_connect(session->stream,
+			PW_DIRECTION_OUTPUT,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, n_params)) < 0)
+		goto error;
+
+	if ((fd = make_socket(&info->sa, info->salen)) < 0) {
+		res = fd;
+		goto error;
+	}
+	session->source.func = on_rtp_io;
+	session->source.data = session;
+	session->source.fd = fd;
+	session->source.mask = SPA_IO_IN;
+
+	pw_log_info("new session %s %s", info->origin, info->session);
+
+	session->impl = impl;
+	spa_list_append(&impl->sessions, &session->link);
+	impl->n_sessions++;
+
+	if ((res = spa_loop_invoke(impl->data_loop, do_add_source, 0,
+					NULL, 0, true, session)) < 0) {
+		pw_log_error("can't add io source: %s", spa_strerror(res));
+		goto error;
+	}
+
+	return 0;
+error:
+	session_free(session);
+	return res;
+}
+
+static struct session *session_find(struct impl *impl, struct sdp_info *info)
+{
+	struct session *sess;
+	spa_list_for_each(sess, &impl->sessions, link) {
+		if (info->hash == sess->info.hash &&
+		    spa_streq(info->origin, sess->info.origin))
+			return sess;
+	}
+	return NULL;
+}
+
+static int parse_sdp_c(struct impl *impl, char *c, struct sdp_info *info)
+{
+	c[strcspn(c, "/")] = 0;
+	if (spa_strstartswith(c, "c=IN IP4 ")) {
+		struct sockaddr_in *sa = (struct sockaddr_in*) &info->sa;
+
+		c += strlen("c=IN IP4 ");
+		if (inet_pton(AF_INET, c, &sa->sin_addr) <= 0)
+			return -EINVAL;
+
+		sa->sin_family = AF_INET;
+		info->salen = sizeof(*sa);
+	}
+	else if (spa_strstartswith(c, "c=IN IP6 ")) {
+		struct sockaddr_in6 *sa = (struct sockaddr_in6*) &info->sa;
+
+		c += strlen("c=IN IP6 ");
+		if (inet_pton(AF_INET6, c, &sa->sin6_addr) <= 0)
+			return -EINVAL;
+
+		sa->sin6_family = AF_INET6;
+		info->salen = sizeof(*sa);
+	} else
+		return -EINVAL;
+
+	return 0;
+}
+
+static int parse_sdp_m(struct impl *impl, char *c, struct sdp_info *info)
+{
+	int port, payload;
+
+	if (!spa_strstartswith(c, "m=audio "))
+		return -EINVAL;
+
+	c += strlen("m=audio ");
+	if (sscanf(c, "%i RTP/AVP %i", &port, &payload) != 2)
+		return -EINVAL;
+
+	if (port <= 0 || port > 0xFFFF)
+		return -EINVAL;
+
+	if (payload < 0 || payload > 127)
+		return -EINVAL;
+
+	info->port = (uint16_t) port;
+	info->payload = (uint8_t) payload;
+
+	return 0;
+}
+
+static int parse_sdp_a_rtpmap(struct impl *impl, char *c, struct sdp_info *info)
+{
+	int payload, len;
+	unsigned int rate, channels;
+	uint32_t i;
+
+	if (!spa_strstartswith(c, "a=rtpmap:"))
+		return 0;
+
+	c += strlen("a=rtpmap:");
+
+	if (sscanf(c, "%i %n", &payload, &len) != 1)
+		return -EINVAL;
+
+	if (payload < 0 || payload > 127)
+		return -EINVAL;
+
+	if (payload != info->payload)
+		return 0;
+
+	c += len;
+	c[strcspn(c, "/")] = 0;
+
+	for (i = 0; i < SPA_N_ELEMENTS(format_info); i++) {
+		if (spa_streq(c, format_info[i].mime))
+			info->format_info = &format_info[i];
+	}
+	if (info->format_info == NULL)
+		return -EINVAL;
+
+	info->info.format = info->format_info->format;
+
+	c += strlen(c) + 1;
+
+	if (sscanf(c, "%u/%u", &rate, &channels) == 2) {
+		info->info.rate = rate;
+		info->info.channels = channels;
+		if (channels == 2) {
+			info->info.position[0] = SPA_AUDIO_CHANNEL_FL;
+			info->info.position[1] = SPA_AUDIO_CHANNEL_FR;
+		} else {
+			info->info.flags |= SPA_AUDIO_FLAG_UNPOSITIONED;
+		}
+	} else if (sscanf(c, "%u", &rate) == 1) {
+		info->info.rate = rate;
+		info->info.channels = 1;
+		info->info.position[0] = SPA_AUDIO_CHANNEL_MONO;
+	} else
+		return -EINVAL;
+
+	if (info->info.rate == 0 || info->info.channels == 0 ||
+	    info->info.channels > SPA_AUDIO_MAX_CHANNELS)
+		return -EINVAL;
+
+	info->stride = info->format_info->size * info->info.channels;
+
+	return 0;
+}
+
+static int parse_sdp(struct impl *impl, char *sdp, struct sdp_info *info)
+{
+	char *s = sdp;
+	int count = 0, res = 0;
+	size_t l;
+
+	while (*s) {
+		if ((l = strcspn(s, "\r\n")) < 2)
+			goto too_short;
+
+		s[l] = 0;
+		pw_log_debug("%d: %s", count, s);
+
+		if (count++ == 0 && strcmp(s, "v=0") != 0)
+			goto invalid_version;
+
+		if (spa_strstartswith(s, "o="))
+			snprintf(info->origin, sizeof(info->origin), "%s", &s[2]);
+		else if (spa_strstartswith(s, "s="))
+			snprintf(info->session, sizeof(info->session), "%s", &s[2]);
+		else if (spa_strstartswith(s, "c="))
+			res = parse_sdp_c(impl, s, info);
+		else if (spa_strstartswith(s, "m="))
+			res = parse_sdp_m(impl, s, info);
+		else if (spa_strstartswith(s, "a="))
+			res = parse_sdp_a_rtpmap(impl, s, info);
+
+		if (res < 0)
+			goto error;
+		s += l + 1;
+		while (isspace(*s))
+			s++;
+	}
+	if (info->format_info == NULL || info->salen == 0 || info->port == 0)
+		goto incomplete;
+
+	if (((struct sockaddr*)&info->sa)->sa_family == AF_INET)
+		((struct sockaddr_in*) &info->sa)->sin_port = htons(info->port);
+	else
+		((struct sockaddr_in6*) &info->sa)->sin6_port = htons(info->port);
+
+	return 0;
+too_short:
+	pw_log_warn("SDP: line starting with `%.6s...' too short", s);
+	return -EINVAL;
+invalid_version:
+	pw_log_warn("SDP: invalid first version line `%*s'", (int)l, s);
+	return -EINVAL;
+incomplete:
+	pw_log_warn("SDP: no supported audio stream found");
+	return -EINVAL;
+error:
+	pw_log_warn("SDP: error: %s", spa_strerror(res));
+	return res;
+}
+
+static int parse_sap(struct impl *impl, void *data, size_t len)
+{
+	struct sap_header *header;
+	char *mime, *sdp;
+	struct sdp_info info;
+	struct session *sess;
+	int res;
+	size_t offs;
+	bool bye;
+
+	if (len < 8)
+		return -EINVAL;
+
+	header = (struct sap_header*) data;
+	if (header->v != 1)
+		return -EINVAL;
+
+	if (header->e)
+		return -ENOTSUP;
+	if (header->c)
+		return -ENOTSUP;
+
+	/* header and the IPv4 or IPv6 originating source */
+	offs = header->a ? 20 : 8;
+	offs += header->auth_len * 4;
+	if (len <= offs)
+		return -EINVAL;
+
+	/* the data is 0 terminated at len */
+	mime = SPA_PTROFF(data, offs, char);
+	if (spa_strstartswith(mime, "v=0")) {
+		sdp = mime;
+		mime = SAP_MIME_TYPE;
+	} else {
+		/* the mime type is followed by a 0 and the SDP */
+		size_t l = strnlen(mime, len - offs);
+		if (offs + l + 1 >= len || !spa_streq(mime, SAP_MIME_TYPE))
+			return -EINVAL;
+		sdp = SPA_PTROFF(mime, l + 1, char);
+	}
+
+	pw_log_debug("got sap: %s %s", mime, sdp);
+
+	spa_zero(info);
+	if ((res = parse_sdp(impl, sdp, &info)) < 0)
+		return res;
+
+	bye = header->t;
+	info.hash = header->msg_id_hash;
+
+	sess = session_find(impl, &info);
+	if (sess == NULL) {
+		if (bye || (impl->session_name != NULL &&
+		    !spa_streq(impl->session_name, info.session)))
+			return 0;
+		if (impl->n_sessions >= impl->max_sessions) {
+			pw_log_warn("too many sessions (%u), ignoring session %s %s",
+					impl->n_sessions, info.origin, info.session);
+			return -ENOSPC;
+		}
+		session_new(impl, &info);
+	} else {
+		if (bye)
+			session_free(sess);
+		else
+			sess->timestamp = get_time_ns();
+	}
+	return res;
+}
+
+static void on_sap_io(void *data, int fd, uint32_t mask)
+{
+	struct impl *impl = data;
+
+	if (mask & SPA_IO_IN) {
+		ssize_t len;
+
+		if ((len = recv(fd, impl->packet, MAX_PACKET - 1, 0)) < 0) {
+			pw_log_warn("recv error: %m");
+			return;
+		}
+		/* the SDP is a string, make sure it is terminated */
+		impl->packet[len] = 0;
+		parse_sap(impl, impl->packet, len);
+	}
+}
+
+static int start_sap_listener(struct impl *impl)
+{
+	int fd;
+
+	if ((fd = make_socket(&impl->sap_addr, impl->sap_len)) < 0)
+		return fd;
+
+	pw_log_info("starting SAP listener");
+	impl->sap_source = pw_loop_add_io(impl->loop, fd,
+				SPA_IO_IN, true, on_sap_io, impl);
+	if (impl->sap_source == NULL) {
+		close(fd);
+		return -errno;
+	}
+	return 0;
+}
+
+static void on_timer_event(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	uint64_t timestamp, interval;
+	struct session *sess, *tmp;
+
+	timestamp = get_time_ns();
+	interval = SAP_TIMEOUT_SEC * SPA_NSEC_PER_SEC;
+
+	spa_list_for_each_safe(sess, tmp, &impl->sessions, link) {
+		if (sess->timestamp + interval < timestamp) {
+			pw_log_info("session %s timed out", sess->info.session);
+			session_free(sess);
+		}
+	}
+}
+
+static void core_error(void *data, uint32_t id, int seq, int res, const char *message)
+{
+	struct impl *impl = data;
+
+	pw_log_error("error id:%u seq:%d res:%d (%s): %s",
+			id, seq, res, spa_strerror(res), message);
+
+	if (id == PW_ID_CORE && res == -EPIPE)
+		unload_module(impl);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.error = core_error,
+};
+
+static void core_destroy(void *d)
+{
+	struct impl *impl = d;
+	spa_hook_remove(&impl->core_listener);
+	impl->core = NULL;
+	unload_module(impl);
+}
+
+static const struct pw_proxy_events core_proxy_events = {
+	.destroy = core_destroy,
+};
+
+static void impl_destroy(struct impl *impl)
+{
+	struct session *sess;
+
+	spa_list_consume(sess, &impl->sessions, link)
+		session_free(sess);
+
+	if (impl->sap_source)
+		pw_loop_destroy_source(impl->loop, impl->sap_source);
+	if (impl->timer)
+		pw_loop_destroy_source(impl->loop, impl->timer);
+
+	if (impl->core && impl->do_disconnect)
+		pw_core_disconnect(impl->core);
+
+	pw_properties_free(impl->stream_props);
+	pw_properties_free(impl->props);
+
+	if (impl->work)
+		pw_work_queue_cancel(impl->work, impl, SPA_ID_INVALID);
+
+	free(impl->session_name);
+	free(impl);
+}
+
+static void module_destroy(void *data)
+{
+	struct impl *impl = data;
+	impl->unloading = true;
+	spa_hook_remove(&impl->module_listener);
+	impl_destroy(impl);
+}
+
+static const struct pw_impl_module_events module_events = {
+	PW_VERSION_IMPL_MODULE_EVENTS,
+	.destroy = module_destroy,
+};
+
+static int parse_address(const char *address, uint16_t port,
+		struct sockaddr_storage *addr, socklen_t *len)
+{
+	struct sockaddr_in *sa4 = (struct sockaddr_in*)addr;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6*)addr;
+
+	if (inet_pton(AF_INET, address, &sa4->sin_addr) > 0) {
+		sa4->sin_family = AF_INET;
+		sa4->sin_port = htons(port);
+		*len = sizeof(*sa4);
+	} else if (inet_pton(AF_INET6, address, &sa6->sin6_addr) > 0) {
+		sa6->sin6_family = AF_INET6;
+		sa6->sin6_port = htons(port);
+		*len = sizeof(*sa6);
+	} else
+		return -EINVAL;
+
+	return 0;
+}
+
+static void copy_props(struct impl *impl, struct pw_properties *props, const char *key)
+{
+	const char *str;
+	if ((str = pw_properties_get(props, key)) != NULL) {
+		if (pw_properties_get(impl->stream_props, key) == NULL)
+			pw_properties_set(impl->stream_props, key, str);
+	}
+}
+
+SPA_EXPORT
+int pipewire__module_init(struct pw_impl_module *module, const char *args)
+{
+	struct pw_context *context = pw_impl_module_get_context(module);
+	struct pw_properties *props = NULL;
+	struct impl *impl;
+	const struct spa_support *support;
+	uint32_t n_support;
+	struct timespec value, interval;
+	const char *str;
+	uint32_t port;
+	int res;
+
+	PW_LOG_TOPIC_INIT(mod_topic);
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		return -errno;
+
+	spa_list_init(&impl->sessions);
+
+	if (args == NULL)
+		args = "";
+
+	props = pw_properties_new_string(args);
+	if (props == NULL) {
+		res = -errno;
+		pw_log_error( "can't create properties: %m");
+		goto out;
+	}
+	impl->props = props;
+
+	impl->stream_props = pw_properties_new(NULL, NULL);
+	if (impl->stream_props == NULL) {
+		res = -errno;
+		pw_log_error( "can't create properties: %m");
+		goto out;
+	}
+
+	impl->module = module;
+	impl->context = context;
+	impl->loop = pw_context_get_main_loop(context);
+	support = pw_context_get_support(context, &n_support);
+	impl->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
+	if (impl->data_loop == NULL) {
+		res = -ENOTSUP;
+		pw_log_error("can't get data loop");
+		goto out;
+	}
+	impl->work = pw_context_get_work_queue(context);
+	if (impl->work == NULL) {
+		res = -errno;
+		pw_log_error( "can't get work queue: %m");
+		goto out;
+	}
+
+	if (pw_properties_get(props, PW_KEY_NODE_GROUP) == NULL)
+		pw_properties_set(props, PW_KEY_NODE_GROUP, "pipewire.dummy");
+	if (pw_properties_get(props, PW_KEY_NODE_VIRTUAL) == NULL)
+		pw_properties_set(props, PW_KEY_NODE_VIRTUAL, "true");
+	if (pw_properties_get(props, PW_KEY_NODE_NETWORK) == NULL)
+		pw_properties_set(props, PW_KEY_NODE_NETWORK, "true");
+	if (pw_properties_get(props, PW_KEY_MEDIA_CLASS) == NULL)
+		pw_properties_set(props, PW_KEY_MEDIA_CLASS, "Audio/Source");
+
+	if ((str = pw_properties_get(props, "stream.props")) != NULL)
+		pw_properties_update_string(impl->stream_props, str, strlen(str));
+
+	copy_props(impl, props, PW_KEY_NODE_NAME);
+	copy_props(impl, props, PW_KEY_NODE_DESCRIPTION);
+	copy_props(impl, props, PW_KEY_NODE_GROUP);
+	copy_props(impl, props, PW_KEY_NODE_LATENCY);
+	copy_props(impl, props, PW_KEY_NODE_VIRTUAL);
+	copy_props(impl, props, PW_KEY_NODE_NETWORK);
+	copy_props(impl, props, PW_KEY_MEDIA_NAME);
+	copy_props(impl, props, PW_KEY_MEDIA_CLASS);
+
+	impl->sess_latency_msec = pw_properties_get_uint32(props,
+			"sess.latency.msec", DEFAULT_SESS_LATENCY);
+	impl->max_sessions = pw_properties_get_uint32(props,
+			"sess.max-sessions", DEFAULT_MAX_SESSIONS);
+
+	if ((str = pw_properties_get(props, "sess.name")) != NULL)
+		impl->session_name = strdup(str);
+
+	port = pw_properties_get_uint32(props, "sap.port", SAP_DEFAULT_PORT);
+	if ((str = pw_properties_get(props, "sap.ip")) == NULL)
+		str = SAP_DEFAULT_IP;
+	if ((res = parse_address(str, port, &impl->sap_addr, &impl->sap_len)) < 0) {
+		pw_log_error("invalid sap.ip %s: %s", str, spa_strerror(res));
+		goto out;
+	}
+
+	impl->core = pw_context_get_object(impl->context, PW_TYPE_INTERFACE_Core);
+	if (impl->core == NULL) {
+		str = pw_properties_get(props, PW_KEY_REMOTE_NAME);
+		impl->core = pw_context_connect(impl->context,
+				pw_properties_new(
+					PW_KEY_REMOTE_NAME, str,
+					NULL),
+				0);
+		impl->do_disconnect = true;
+	}
+	if (impl->core == NULL) {
+		res = -errno;
+		pw_log_error("can't connect: %m");
+		goto out;
+	}
+
+	pw_proxy_add_listener((struct pw_proxy*)impl->core,
+			&impl->core_proxy_listener,
+			&core_proxy_events, impl);
+	pw_core_add_listener(impl->core,
+			&impl->core_listener,
+			&core_events, impl);
+
+	impl->timer = pw_loop_add_timer(impl->loop, on_timer_event, impl);
+	if (impl->timer == NULL) {
+		res = -errno;
+		pw_log_error("can't create timer source: %m");
+		goto out;
+	}
+	value.tv_sec = SAP_CLEANUP_SEC;
+	value.tv_nsec = 0;
+	interval.tv_sec = SAP_CLEANUP_SEC;
+	interval.tv_nsec = 0;
+	pw_loop_update_timer(impl->loop, impl->timer, &value, &interval, false);
+
+	if ((res = start_sap_listener(impl)) < 0)
+		goto out;
+
+	pw_impl_module_add_listener(module, &impl->module_listener, &module_events, impl);
+
+	pw_impl_module_update_properties(module, &SPA_DICT_INIT_ARRAY(module_info));
+
+	pw_log_info("successfully created rtp source");
+
+	return 0;
+out:
+	impl_destroy(impl);
+	return res;
+}
@@ -35,6 +35,8 @@
 #include <spa/pod/iter.h>
 #include <spa/debug/types.h>
 
+#include "pipewire/private.h"
+
 #include "spa-node.h"
 
 struct impl {
@@ -248,6 +250,7 @@ struct pw_impl_node *pw_spa_node_load(struct pw_context *context,
 		p = pw_context_get_properties(context);
 		pw_properties_set(properties, "clock.quantum-limit",
 				pw_properties_get(p, "default.clock.quantum-limit"));
+		pw_context_assign_data_loop(context, properties);
 	}
 
 	handle = pw_context_load_spa_handle(context,
@@ -51,6 +51,8 @@
 PW_LOG_TOPIC_EXTERN(log_context);
 #define PW_LOG_TOPIC_DEFAULT log_context
 
+#define MAX_DATA_LOOPS	64u
+
 /** \cond */
 struct impl {
 	struct pw_context this;
@@ -124,27 +126,157 @@ static int try_load_conf(struct pw_context *this, const char *conf_prefix,
 static int context_set_freewheel(struct pw_context *context, bool freewheel)
 {
 	struct spa_thread *thr;
-	int res;
-
-	if ((thr = pw_data_loop_get_thread(context->data_loop_impl)) == NULL)
-		return -EIO;
+	uint32_t i;
+	int res = 0;
 
-	if (freewheel) {
+	if (freewheel)
 		pw_log_info("%p: enter freewheel", context);
-		res = pw_thread_utils_drop_rt(thr);
-	} else {
+	else
 		pw_log_info("%p: exit freewheel", context);
-		// Use the priority as configured within the realtime module
-		res = pw_thread_utils_acquire_rt(thr, -1);
+
+	for (i = 0; i < context->n_data_loops; i++) {
+		if ((thr = pw_data_loop_get_thread(context->data_loops[i])) == NULL)
+			return -EIO;
+
+		if (freewheel) {
+			res = pw_thread_utils_drop_rt(thr);
+		} else {
+			// Use the priority as configured within the realtime module
+			res = pw_thread_utils_acquire_rt(thr, -1);
+		}
+		if (res < 0)
+			pw_log_info("%p: data-loop %u freewheel error:%s", context,
+					i, spa_strerror(res));
 	}
-	if (res < 0)
-		pw_log_info("%p: freewheel error:%s", context, spa_strerror(res));
 
 	context->freewheeling = freewheel;
 
 	return res;
 }
 
+static int create_data_loops(struct pw_context *this, struct pw_properties *properties)
+{
+	struct pw_properties *pr;
+	const char *str;
+	uint32_t i, n_loops;
+	int res = 0;
+
+	n_loops = pw_properties_get_uint32(properties, "context.data-loops", 1);
+	n_loops = SPA_CLAMP(n_loops, 1u, MAX_DATA_LOOPS);
+
+	this->data_loops = calloc(n_loops, sizeof(struct pw_data_loop *));
+	if (this->data_loops == NULL)
+		return -errno;
+	this->driver_listener_lists = calloc(n_loops, sizeof(struct spa_hook_list));
+	if (this->driver_listener_lists == NULL)
+		return -errno;
+	for (i = 0; i < n_loops; i++)
+		spa_hook_list_init(&this->driver_listener_lists[i]);
+	this->data_loop_groups = pw_properties_new(NULL, NULL);
+	if (this->data_loop_groups == NULL)
+		return -errno;
+
+	pr = pw_properties_copy(properties);
+	if (pr == NULL)
+		return -errno;
+
+	if ((str = pw_properties_get(pr, "context.data-loop." PW_KEY_LIBRARY_NAME_SYSTEM)))
+		pw_properties_set(pr, PW_KEY_LIBRARY_NAME_SYSTEM, str);
+
+	for (i = 0; i < n_loops; i++) {
+		this->data_loops[i] = pw_data_loop_new(&pr->dict);
+		if (this->data_loops[i] == NULL) {
+			res = -errno;
+			pw_log_error("%p: can't create data-loop %u: %m", this, i);
+			break;
+		}
+		this->n_data_loops++;
+	}
+	pw_properties_free(pr);
+
+	if (res < 0)
+		return res;
+
+	this->data_loop_impl = this->data_loops[0];
+
+	pw_log_info("%p: created %u data-loops", this, this->n_data_loops);
+	return 0;
+}
+
+static int start_data_loops(struct pw_context *this)
+{
+	uint32_t i;
+	int res;
+
+	for (i = 0; i < this->n_data_loops; i++) {
+		if ((res = pw_data_loop_start(this->data_loops[i])) < 0)
+			return res;
+	}
+	return 0;
+}
+
+static void destroy_data_loops(struct pw_context *this)
+{
+	uint32_t i;
+
+	for (i = 0; i < this->n_data_loops; i++) {
+		pw_data_loop_destroy(this->data_loops[i]);
+		spa_hook_list_clean(&this->driver_listener_lists[i]);
+	}
+	free(this->data_loops);
+	this->data_loops = NULL;
+	free(this->driver_listener_lists);
+	this->driver_listener_lists = NULL;
+	pw_properties_free(this->data_loop_groups);
+	this->data_loop_groups = NULL;
+	this->n_data_loops = 0;
+	this->data_loop_impl = NULL;
+}
+
+SPA_EXPORT
+struct pw_data_loop *pw_context_find_data_loop(struct pw_context *context,
+		const struct spa_dict *props)
+{
+	const char *str;
+	uint32_t index;
+
+	if (props == NULL ||
+	    (str = spa_dict_lookup(props, PW_KEY_NODE_DATA_LOOP)) == NULL ||
+	    !spa_atou32(str, &index, 0))
+		return context->data_loop_impl;
+
+	if (index >= context->n_data_loops) {
+		pw_log_warn("%p: invalid data-loop %u, using default", context, index);
+		return context->data_loop_impl;
+	}
+	return context->data_loops[index];
+}
+
+SPA_EXPORT
+int pw_context_assign_data_loop(struct pw_context *context, struct pw_properties *props)
+{
+	const char *group, *str;
+	uint32_t index;
+
+	if (context->n_data_loops <= 1 ||
+	    pw_properties_get(props, PW_KEY_NODE_DATA_LOOP) != NULL)
+		return 0;
+
+	/* nodes that are scheduled together share a data loop, see also
+	 * pw_impl_node_set_driver() where followers move to the data loop
+	 * of their driver */
+	group = pw_properties_get(props, PW_KEY_NODE_GROUP);
+	if (group != NULL &&
+	    (str = pw_properties_get(context->data_loop_groups, group)) != NULL)
+		return pw_properties_set(props, PW_KEY_NODE_DATA_LOOP, str);
+
+	index = context->data_loop_next++ % context->n_data_loops;
+	if (group != NULL)
+		pw_properties_setf(context->data_loop_groups, group, "%u", index);
+
+	return pw_properties_setf(props, PW_KEY_NODE_DATA_LOOP, "%u", index);
+}
+
 static struct spa_handle *impl_plugin_loader_load(void *object, const char *factory_name, const struct spa_dict *info)
 {
 	struct impl *impl = object;
@@ -196,7 +328,7 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	const char *lib, *str, *conf_prefix, *conf_name;
 	void *dbus_iface = NULL;
 	uint32_t n_support;
-	struct pw_properties *pr, *conf;
+	struct pw_properties *conf;
 	struct spa_cpu *cpu;
 	int res = 0;
 
@@ -234,7 +366,6 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	spa_list_init(&this->export_list);
 	spa_list_init(&this->driver_list);
 	spa_hook_list_init(&this->listener_list);
-	spa_hook_list_init(&this->driver_listener_list);
 
 	this->sc_pagesize = sysconf(_SC_PAGESIZE);
 
@@ -311,16 +442,8 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	pw_settings_init(this);
 	this->settings = this->defaults;
 
-	pr = pw_properties_copy(properties);
-	if ((str = pw_properties_get(pr, "context.data-loop." PW_KEY_LIBRARY_NAME_SYSTEM)))
-		pw_properties_set(pr, PW_KEY_LIBRARY_NAME_SYSTEM, str);
-
-	this->data_loop_impl = pw_data_loop_new(&pr->dict);
-	pw_properties_free(pr);
-	if (this->data_loop_impl == NULL)  {
-		res = -errno;
+	if ((res = create_data_loops(this, properties)) < 0)
 		goto error_free;
-	}
 
 	this->pool = pw_mempool_new(NULL);
 	if (this->pool == NULL) {
@@ -388,7 +511,7 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 		goto error_free;
 	pw_log_info("%p: parsed %d context.exec items", this, res);
 
-	if ((res = pw_data_loop_start(this->data_loop_impl)) < 0)
+	if ((res = start_data_loops(this)) < 0)
 		goto error_free;
 
 	context_set_freewheel(this, false);
@@ -443,8 +566,7 @@ void pw_context_destroy(struct pw_context *context)
 	spa_list_consume(resource, &context->registry_resource_list, link)
 		pw_resource_destroy(resource);
 
-	if (context->data_loop_impl)
-		pw_data_loop_destroy(context->data_loop_impl);
+	destroy_data_loops(context);
 
 	spa_list_consume(module, &context->module_list, link)
 		pw_impl_module_destroy(module);
@@ -486,7 +608,6 @@ void pw_context_destroy(struct pw_context *context)
 	pw_map_clear(&context->globals);
 
 	spa_hook_list_clean(&context->listener_list);
-	spa_hook_list_clean(&context->driver_listener_list);
 
 	free(context);
 }
@@ -1327,6 +1448,7 @@ struct spa_handle *pw_context_load_spa_handle(struct pw_context *context,
 {
 	const char *lib;
 	const struct spa_support *support;
+	struct spa_support s[SPA_N_ELEMENTS(context->support)];
 	uint32_t n_support;
 	struct spa_handle *handle;
 
@@ -1344,6 +1466,22 @@ struct spa_handle *pw_context_load_spa_handle(struct pw_context *context,
 
 	support = pw_context_get_support(context, &n_support);
 
+	if (context->n_data_loops > 1) {
+		struct pw_data_loop *data_loop = pw_context_find_data_loop(context, info);
+		struct pw_loop *loop = pw_data_loop_get_loop(data_loop);
+		uint32_t i;
+
+		/* give the plugin the data loop it was assigned to */
+		for (i = 0; i < n_support; i++) {
+			s[i] = support[i];
+			if (spa_streq(s[i].type, SPA_TYPE_INTERFACE_DataLoop))
+				s[i].data = loop->loop;
+			else if (spa_streq(s[i].type, SPA_TYPE_INTERFACE_DataSystem))
+				s[i].data = loop->system;
+		}
+		support = s;
+	}
+
 	handle = pw_load_spa_handle(lib, factory_name,
 			info, n_support, support);
 
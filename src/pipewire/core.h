@@ -229,7 +229,7 @@ struct pw_core_events {
  * also used for internal features.
  */
 struct pw_core_methods {
-#define PW_VERSION_CORE_METHODS	0
+#define PW_VERSION_CORE_METHODS	1
 	uint32_t version;
 
 	int (*add_listener) (void *object,
@@ -313,8 +313,36 @@ struct pw_core_methods {
 	 * \param obj the proxy to destroy
 	 */
 	int (*destroy) (void *object, void *proxy);
+
+	/**
+	 * Get the registry object with a filter
+	 *
+	 * Like get_registry but the server only emits the globals that
+	 * match \a filter, also in the initial enumeration.
+	 *
+	 * Each key of \a filter is matched against the properties of a
+	 * global, \ref PW_REGISTRY_FILTER_TYPE matches the interface type.
+	 * The value is a list of glob patterns separated with '|' and one
+	 * of them must match. All keys must match for the global to be
+	 * emitted. The properties of a global don't change after it is
+	 * registered, permission changes are evaluated again.
+	 *
+	 * Older servers ignore the filter and emit all globals, clients
+	 * should still check the type of the globals they receive.
+	 *
+	 * Since version 0.3.44:1
+	 *
+	 * \param version the client version
+	 * \param filter the filter or NULL to receive all globals
+	 * \param user_data_size extra size
+	 */
+	struct pw_registry * (*get_registry_filter) (void *object, uint32_t version,
+			const struct spa_dict *filter, size_t user_data_size);
 };
 
+/** Filter key that matches the interface type of a global */
+#define PW_REGISTRY_FILTER_TYPE		"type"
+
 #define pw_core_method(o,method,version,...)			\
 ({									\
 	int _res = -ENOTSUP;						\
@@ -365,6 +393,19 @@ pw_core_get_registry(struct pw_core *core, uint32_t version, size_t user_data_si
 	return res;
 }
 
+static inline struct pw_registry *
+pw_core_get_registry_filter(struct pw_core *core, uint32_t version,
+		const struct spa_dict *filter, size_t user_data_size)
+{
+	struct pw_registry *res = NULL;
+	if (filter == NULL || filter->n_items == 0)
+		return pw_core_get_registry(core, version, user_data_size);
+	spa_interface_call_res((struct spa_interface*)core,
+			struct pw_core_methods, res,
+			get_registry_filter, 1, version, filter, user_data_size);
+	return res;
+}
+
 static inline void *
 pw_core_create_object(struct pw_core *core,
 			    const char *factory_name,
@@ -151,7 +151,8 @@ int pw_global_register(struct pw_global *global)
 		uint32_t permissions = pw_global_get_permissions(global, registry->client);
 		pw_log_debug("registry %p: global %d %08x serial:%"PRIu64,
 				registry, global->id, permissions, global->serial);
-		if (PW_PERM_IS_R(permissions))
+		if (PW_PERM_IS_R(permissions) &&
+		    pw_registry_resource_match(registry, global))
 			pw_registry_resource_global(registry,
 						    global->id,
 						    permissions,
@@ -177,7 +178,8 @@ static int global_unregister(struct pw_global *global)
 	spa_list_for_each(resource, &context->registry_resource_list, link) {
 		uint32_t permissions = pw_global_get_permissions(global, resource->client);
 		pw_log_debug("registry %p: global %d %08x", resource, global->id, permissions);
-		if (PW_PERM_IS_R(permissions))
+		if (PW_PERM_IS_R(permissions) &&
+		    pw_registry_resource_match(resource, global))
 			pw_registry_resource_global_remove(resource, global->id);
 	}
 
@@ -343,7 +345,8 @@ int pw_global_update_permissions(struct pw_global *global, struct pw_impl_client
 	pw_global_emit_permissions_changed(global, client, old_permissions, new_permissions);
 
 	spa_list_for_each(resource, &context->registry_resource_list, link) {
-		if (resource->client != client)
+		if (resource->client != client ||
+		    !pw_registry_resource_match(resource, global))
 			continue;
 
 		if (do_hide) {
@@ -39,6 +39,9 @@ struct impl {
 	struct spa_hook context_listener;
 	struct pw_array permissions;
 	struct spa_hook pool_listener;
+	struct spa_list deferred_list;
+	struct spa_source *deferred_source;
+	uint32_t deferred_interval;
 	unsigned int registered:1;
 };
 
@@ -440,6 +443,7 @@ struct pw_impl_client *pw_context_create_client(struct pw_impl_core *core,
 	spa_hook_list_init(&this->listener_list);
 
 	pw_map_init(&this->objects, 0, 32);
+	spa_list_init(&impl->deferred_list);
 
 	pw_context_add_listener(this->context, &impl->context_listener, &context_events, impl);
 
@@ -597,6 +601,9 @@ void pw_impl_client_destroy(struct pw_impl_client *client)
 		pw_global_destroy(client->global);
 	}
 
+	if (impl->deferred_source)
+		pw_loop_destroy_source(client->context->main_loop, impl->deferred_source);
+
 	pw_log_debug("%p: free", impl);
 	pw_impl_client_emit_free(client);
 
@@ -716,6 +723,77 @@ int pw_impl_client_update_permissions(struct pw_impl_client *client,
 	return 0;
 }
 
+static void on_deferred(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	pw_impl_client_flush_deferred(&impl->this);
+}
+
+/** Queue events of a resource to be sent later
+ *
+ * The flush function of \a deferred is called in the next iteration of the
+ * main loop, or after the update-interval setting. It is also called before
+ * a done event is sent to the client so that all events sent before a
+ * sync are received before the done.
+ */
+void pw_impl_client_defer(struct pw_impl_client *client, struct pw_resource_deferred *deferred)
+{
+	struct impl *impl = SPA_CONTAINER_OF(client, struct impl, this);
+	struct pw_context *context = client->context;
+	struct timespec value;
+
+	if (deferred->queued)
+		return;
+
+	if (impl->deferred_source == NULL) {
+		impl->deferred_interval = context->settings.update_interval;
+		if (impl->deferred_interval > 0)
+			impl->deferred_source = pw_loop_add_timer(context->main_loop,
+					on_deferred, impl);
+		else
+			impl->deferred_source = pw_loop_add_event(context->main_loop,
+					on_deferred, impl);
+		if (impl->deferred_source == NULL) {
+			pw_log_warn("%p: can't create deferred source: %m", client);
+			deferred->flush(deferred);
+			return;
+		}
+	}
+	if (spa_list_is_empty(&impl->deferred_list)) {
+		if (impl->deferred_interval > 0) {
+			value.tv_sec = impl->deferred_interval / SPA_MSEC_PER_SEC;
+			value.tv_nsec = (impl->deferred_interval % SPA_MSEC_PER_SEC) * SPA_NSEC_PER_MSEC;
+			pw_loop_update_timer(context->main_loop, impl->deferred_source,
+					&value, NULL, false);
+		} else {
+			pw_loop_signal_event(context->main_loop, impl->deferred_source);
+		}
+	}
+	spa_list_append(&impl->deferred_list, &deferred->link);
+	deferred->queued = true;
+}
+
+void pw_impl_client_cancel_deferred(struct pw_resource_deferred *deferred)
+{
+	if (deferred->queued) {
+		spa_list_remove(&deferred->link);
+		deferred->queued = false;
+	}
+}
+
+void pw_impl_client_flush_deferred(struct pw_impl_client *client)
+{
+	struct impl *impl = SPA_CONTAINER_OF(client, struct impl, this);
+	struct pw_resource_deferred *deferred;
+
+	while (!spa_list_is_empty(&impl->deferred_list)) {
+		deferred = spa_list_first(&impl->deferred_list,
+				struct pw_resource_deferred, link);
+		pw_impl_client_cancel_deferred(deferred);
+		deferred->flush(deferred);
+	}
+}
+
 SPA_EXPORT
 void pw_impl_client_set_busy(struct pw_impl_client *client, bool busy)
 {
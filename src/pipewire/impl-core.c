@@ -25,6 +25,7 @@
 #include "config.h"
 
 #include <unistd.h>
+#include <fnmatch.h>
 #ifndef ENODATA
 #define ENODATA 9919
 #endif
@@ -44,8 +45,51 @@ struct resource_data {
 	struct pw_resource *resource;
 	struct spa_hook resource_listener;
 	struct spa_hook object_listener;
+	struct pw_properties *filter;
 };
 
+static bool match_patterns(const char *patterns, const char *value)
+{
+	size_t len;
+
+	if (value == NULL)
+		return false;
+
+	while (true) {
+		len = strcspn(patterns, "|");
+		if (fnmatch(strndupa(patterns, len), value, 0) == 0)
+			return true;
+		if (patterns[len] == '\0')
+			return false;
+		patterns += len + 1;
+	}
+}
+
+static bool filter_match(const struct pw_properties *filter, struct pw_global *global)
+{
+	const struct spa_dict_item *it;
+	const char *value;
+
+	if (filter == NULL)
+		return true;
+
+	spa_dict_for_each(it, &filter->dict) {
+		if (spa_streq(it->key, PW_REGISTRY_FILTER_TYPE))
+			value = global->type;
+		else
+			value = pw_properties_get(global->properties, it->key);
+		if (!match_patterns(it->value, value))
+			return false;
+	}
+	return true;
+}
+
+bool pw_registry_resource_match(struct pw_resource *registry, struct pw_global *global)
+{
+	struct resource_data *data = pw_resource_get_user_data(registry);
+	return filter_match(data->filter, global);
+}
+
 static void * registry_bind(void *object, uint32_t id,
 		const char *type, uint32_t version, size_t user_data_size)
 {
@@ -145,6 +189,7 @@ static void destroy_registry_resource(void *object)
 	spa_list_remove(&resource->link);
 	spa_hook_remove(&data->resource_listener);
 	spa_hook_remove(&data->object_listener);
+	pw_properties_free(data->filter);
 }
 
 static const struct pw_resource_events resource_events = {
@@ -193,6 +238,8 @@ static int core_sync(void *object, uint32_t id, int seq)
 {
 	struct pw_resource *resource = object;
 	pw_log_trace("%p: sync %d for resource %d", resource->context, seq, id);
+	/* send the merged updates before the done */
+	pw_impl_client_flush_deferred(resource->client);
 	pw_core_resource_done(resource, id, seq);
 	return 0;
 }
@@ -227,7 +274,8 @@ static int core_error(void *object, uint32_t id, int seq, int res, const char *m
 	return 0;
 }
 
-static struct pw_registry *core_get_registry(void *object, uint32_t version, size_t user_data_size)
+static struct pw_registry *core_get_registry_filter(void *object, uint32_t version,
+		const struct spa_dict *filter, size_t user_data_size)
 {
 	struct pw_resource *resource = object;
 	struct pw_impl_client *client = resource->client;
@@ -235,9 +283,19 @@ static struct pw_registry *core_get_registry(void *object, uint32_t version, siz
 	struct pw_global *global;
 	struct pw_resource *registry_resource;
 	struct resource_data *data;
+	struct pw_properties *props = NULL;
 	uint32_t new_id = user_data_size;
 	int res;
 
+	if (filter != NULL && filter->n_items > 0) {
+		if ((props = pw_properties_new_dict(filter)) == NULL) {
+			res = -errno;
+			goto error_resource;
+		}
+		pw_log_debug("%p: registry filter with %d items", context,
+				filter->n_items);
+	}
+
 	registry_resource = pw_resource_new(client,
 					    new_id,
 					    PW_PERM_ALL,
@@ -251,6 +309,9 @@ static struct pw_registry *core_get_registry(void *object, uint32_t version, siz
 
 	data = pw_resource_get_user_data(registry_resource);
 	data->resource = registry_resource;
+	/* set before the enumeration so that the client only ever sees the
+	 * matching globals */
+	data->filter = props;
 	pw_resource_add_listener(registry_resource,
 				&data->resource_listener,
 				&resource_events,
@@ -264,7 +325,8 @@ static struct pw_registry *core_get_registry(void *object, uint32_t version, siz
 
 	spa_list_for_each(global, &context->global_list, link) {
 		uint32_t permissions = pw_global_get_permissions(global, client);
-		if (PW_PERM_IS_R(permissions)) {
+		if (PW_PERM_IS_R(permissions) &&
+		    filter_match(data->filter, global)) {
 			pw_registry_resource_global(registry_resource,
 						    global->id,
 						    permissions,
@@ -277,6 +339,7 @@ static struct pw_registry *core_get_registry(void *object, uint32_t version, siz
 	return (struct pw_registry *)registry_resource;
 
 error_resource:
+	pw_properties_free(props);
 	pw_core_resource_errorf(client->core_resource, new_id,
 			client->recv_seq, res,
 			"can't create registry resource: %d (%s)",
@@ -287,6 +350,11 @@ error_resource:
 	return NULL;
 }
 
+static struct pw_registry *core_get_registry(void *object, uint32_t version, size_t user_data_size)
+{
+	return core_get_registry_filter(object, version, NULL, user_data_size);
+}
+
 static void *
 core_create_object(void *object,
 		   const char *factory_name,
@@ -379,6 +447,7 @@ static const struct pw_core_methods core_methods = {
 	.get_registry = core_get_registry,
 	.create_object = core_create_object,
 	.destroy = core_destroy,
+	.get_registry_filter = core_get_registry_filter,
 };
 
 SPA_EXPORT
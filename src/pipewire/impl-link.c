@@ -588,18 +588,24 @@ do_activate_link(struct spa_loop *loop,
 
 	pw_log_trace("%p: activate", this);
 
-	spa_list_append(&this->output->rt.mix_list, &this->rt.out_mix.rt_link);
-	spa_list_append(&this->input->rt.mix_list, &this->rt.in_mix.rt_link);
-
-	if (impl->inode != impl->onode) {
+	/* the input and output node can run on different data loops, only
+	 * touch what is owned by the loop we run in */
+	if (loop == this->output->node->data_loop->loop)
+		spa_list_append(&this->output->rt.mix_list, &this->rt.out_mix.rt_link);
+	if (loop == this->input->node->data_loop->loop)
+		spa_list_append(&this->input->rt.mix_list, &this->rt.in_mix.rt_link);
+
+	if (impl->inode != impl->onode && loop == impl->onode->data_loop->loop) {
 		struct pw_node_activation_state *state;
 
 		this->rt.target.activation = impl->inode->rt.activation;
+		this->rt.target.has_stats = impl->inode->rt.activation_stats;
 		spa_list_append(&impl->onode->rt.target_list, &this->rt.target.link);
 
+		/* the input node can be on another data loop */
 		state = &this->rt.target.activation->state[0];
 		if (!this->rt.target.active && impl->onode->rt.driver_target.node != NULL) {
-			state->required++;
+			ATOMIC_INC(state->required);
 			this->rt.target.active = true;
 		}
 
@@ -630,8 +636,14 @@ int pw_impl_link_activate(struct pw_impl_link *this)
 			return res;
 		impl->io_set = true;
 	}
+	/* the nodes can have moved to another data loop since the link was made */
+	pw_impl_node_init_target(impl->inode, impl->onode->data_loop, &this->rt.target);
+
 	pw_loop_invoke(this->output->node->data_loop,
 	       do_activate_link, SPA_ID_INVALID, NULL, 0, false, this);
+	if (this->input->node->data_loop != this->output->node->data_loop)
+		pw_loop_invoke(this->input->node->data_loop,
+		       do_activate_link, SPA_ID_INVALID, NULL, 0, false, this);
 
 	impl->activated = true;
 	pw_log_info("(%s) activated", this->name);
@@ -803,16 +815,19 @@ do_deactivate_link(struct spa_loop *loop,
 
 	pw_log_trace("%p: disable %p and %p", this, &this->rt.in_mix, &this->rt.out_mix);
 
-	spa_list_remove(&this->rt.out_mix.rt_link);
-	spa_list_remove(&this->rt.in_mix.rt_link);
+	if (loop == this->output->node->data_loop->loop)
+		spa_list_remove(&this->rt.out_mix.rt_link);
+	if (loop == this->input->node->data_loop->loop)
+		spa_list_remove(&this->rt.in_mix.rt_link);
 
-	if (this->input->node != this->output->node) {
+	if (this->input->node != this->output->node &&
+	    loop == impl->onode->data_loop->loop) {
 		struct pw_node_activation_state *state;
 
 		spa_list_remove(&this->rt.target.link);
 		state = &this->rt.target.activation->state[0];
 		if (this->rt.target.active) {
-			state->required--;
+			ATOMIC_DEC(state->required);
 			this->rt.target.active = false;
 		}
 
@@ -834,6 +849,9 @@ int pw_impl_link_deactivate(struct pw_impl_link *this)
 
 	pw_loop_invoke(this->output->node->data_loop,
 		       do_deactivate_link, SPA_ID_INVALID, NULL, 0, true, this);
+	if (this->input->node->data_loop != this->output->node->data_loop)
+		pw_loop_invoke(this->input->node->data_loop,
+			       do_deactivate_link, SPA_ID_INVALID, NULL, 0, true, this);
 
 	port_set_io(this, this->output, SPA_IO_Buffers, NULL, 0,
 			&this->rt.out_mix);
@@ -1264,8 +1282,7 @@ struct pw_impl_link *pw_context_create_link(struct pw_context *context,
 		impl->inode = input_node;
 	}
 
-	this->rt.target.signal = impl->inode->rt.target.signal;
-	this->rt.target.data = impl->inode->rt.target.data;
+	pw_impl_node_init_target(impl->inode, impl->onode->data_loop, &this->rt.target);
 
 	pw_log_debug("%p: constructed out:%p:%d.%d -> in:%p:%d.%d", impl,
 		     output_node, output->port_id, this->rt.out_mix.port.port_id,
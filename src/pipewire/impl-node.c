@@ -82,15 +82,129 @@ struct resource_data {
 	int seq;
 	int end;
 	struct spa_hook listener;
+
+	/* merged updates */
+	struct pw_resource_deferred deferred;
+	uint64_t pending_info;
+	uint64_t pending_params;
+	uint32_t pending_param_info;		/* index of the changed param info */
+	uint32_t n_sent_params;
+	uint32_t sent_param_flags[MAX_PARAMS];	/* param flags the resource has seen */
 };
 
 /** \endcond */
 
-static void add_node(struct pw_impl_node *this, struct pw_impl_node *driver)
+static inline int process_node(void *data);
+
+static int node_signal_func(void *data)
 {
-	struct pw_node_activation_state *dstate, *nstate;
+	struct pw_impl_node *this = data;
+	struct spa_system *data_system = this->data_loop->system;
+
+	if (SPA_UNLIKELY(spa_system_eventfd_write(data_system, this->source.fd, 1) < 0))
+		pw_log_warn("%p: write failed %m", this);
+
+	return 0;
+}
+
+void pw_impl_node_init_target(struct pw_impl_node *node, struct pw_loop *loop,
+		struct pw_node_target *target)
+{
+	/* nodes on the same data loop are processed directly, nodes on another
+	 * data loop are woken up on their own loop */
+	target->signal = loop == node->data_loop ? process_node : node_signal_func;
+	target->data = node;
+}
+
+/* our target is added to the target list of the driver and the nodes we
+ * signal start to wait for us in the same invoke on the data loop of the
+ * driver, the driver never waits for a node that it does not trigger */
+static int
+do_add_target(struct spa_loop *loop,
+	    bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_impl_node *this = user_data;
+	struct pw_impl_node *driver = *(struct pw_impl_node **)data;
+	struct pw_node_target *t;
+
+	spa_list_append(&driver->rt.target_list, &this->rt.target.link);
+
+	/* the activations can be shared with nodes on other data loops */
+	spa_list_for_each(t, &this->rt.target_list, link) {
+		struct pw_node_activation_state *dstate = &t->activation->state[0];
+		if (!t->active) {
+			ATOMIC_INC(dstate->required);
+			t->active = true;
+		}
+		pw_log_trace("%p: driver %p state:%p pending:%d/%d", this, driver,
+				dstate, dstate->pending, dstate->required);
+	}
+	return 0;
+}
+
+static int
+do_remove_target(struct spa_loop *loop,
+	    bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_impl_node *this = user_data;
 	struct pw_node_target *t;
 
+	spa_list_for_each(t, &this->rt.target_list, link) {
+		if (t->active) {
+			ATOMIC_DEC(t->activation->state[0].required);
+			t->active = false;
+		}
+	}
+	spa_list_remove(&this->rt.target.link);
+	return 0;
+}
+
+/* the target list of a driver is only used from the data loop of the driver.
+ * The target of a node is added to and removed from it from the main thread
+ * with a blocking invoke, a remove from the old driver is complete before the
+ * add to the new driver. The link activations that change our target list
+ * are also done from the main thread, on our data loop, and can't run at the
+ * same time. */
+static void add_driver_target(struct pw_impl_node *this)
+{
+	struct pw_impl_node *driver = this->driver_node;
+
+	if (this->exported || this->target_driver != NULL || this->source.loop == NULL)
+		return;
+
+	pw_loop_invoke(driver->data_loop, do_add_target, SPA_ID_INVALID,
+			&driver, sizeof(struct pw_impl_node *), true, this);
+	this->target_driver = driver;
+}
+
+static void remove_driver_target(struct pw_impl_node *this)
+{
+	struct pw_impl_node *driver = this->target_driver;
+
+	if (driver == NULL)
+		return;
+
+	pw_loop_invoke(driver->data_loop, do_remove_target, SPA_ID_INVALID,
+			NULL, 0, true, this);
+	this->target_driver = NULL;
+}
+
+static void sync_data_loops(struct pw_impl_node *this)
+{
+	struct pw_context *context = this->context;
+	uint32_t i;
+
+	for (i = 0; i < context->n_data_loops; i++) {
+		struct pw_loop *loop = pw_data_loop_get_loop(context->data_loops[i]);
+		if (loop != this->data_loop)
+			pw_loop_invoke(loop, NULL, SPA_ID_INVALID, NULL, 0, true, NULL);
+	}
+}
+
+static void add_node(struct pw_impl_node *this, struct pw_impl_node *driver)
+{
+	struct pw_node_activation_state *nstate;
+
 	if (this->exported)
 		return;
 
@@ -99,53 +213,50 @@ static void add_node(struct pw_impl_node *this, struct pw_impl_node *driver)
 
 	/* signal the driver */
 	this->rt.driver_target.activation = driver->rt.activation;
+	this->rt.driver_target.has_stats = driver->rt.activation_stats;
 	this->rt.driver_target.node = driver;
-	this->rt.driver_target.data = driver;
+	pw_impl_node_init_target(driver, this->data_loop, &this->rt.driver_target);
 	spa_list_append(&this->rt.target_list, &this->rt.driver_target.link);
 
-	spa_list_append(&driver->rt.target_list, &this->rt.target.link);
+	/* our target is added to the target list of the driver and the
+	 * targets we signal are activated from the main thread, see
+	 * add_driver_target() */
+	pw_impl_node_init_target(this, driver->data_loop, &this->rt.target);
+
 	nstate = &this->rt.activation->state[0];
 	if (!this->rt.target.active) {
-		nstate->required++;
+		ATOMIC_INC(nstate->required);
 		this->rt.target.active = true;
 	}
-
-	spa_list_for_each(t, &this->rt.target_list, link) {
-		dstate = &t->activation->state[0];
-		if (!t->active) {
-			dstate->required++;
-			t->active = true;
-		}
-		pw_log_trace("%p: driver state:%p pending:%d/%d, node state:%p pending:%d/%d",
-				this, dstate, dstate->pending, dstate->required,
-				nstate, nstate->pending, nstate->required);
-	}
+	pw_log_trace("%p: node state:%p pending:%d/%d", this,
+			nstate, nstate->pending, nstate->required);
 }
 
 static void remove_node(struct pw_impl_node *this)
 {
 	struct pw_node_activation_state *dstate, *nstate;
 	struct pw_node_target *t;
+	struct pw_impl_node *driver = this->rt.driver_target.node;
 
 	if (this->exported)
 		return;
 
 	pw_log_trace("%p: remove from driver %p %p %p",
-			this, this->rt.driver_target.data,
-			this->rt.driver_target.activation, this->rt.activation);
-
-	spa_list_remove(&this->rt.target.link);
+			this, driver, this->rt.driver_target.activation,
+			this->rt.activation);
 
 	nstate = &this->rt.activation->state[0];
 	if (this->rt.target.active) {
-		nstate->required--;
+		ATOMIC_DEC(nstate->required);
 		this->rt.target.active = false;
 	}
 
+	/* the targets are normally already deactivated when our target was
+	 * removed from the driver, see do_remove_target() */
 	spa_list_for_each(t, &this->rt.target_list, link) {
 		dstate = &t->activation->state[0];
 		if (t->active) {
-			dstate->required--;
+			ATOMIC_DEC(dstate->required);
 			t->active = false;
 		}
 		pw_log_trace("%p: driver state:%p pending:%d/%d, node state:%p pending:%d/%d",
@@ -183,6 +294,7 @@ static void node_deactivate(struct pw_impl_node *this)
 		spa_list_for_each(link, &port->links, output_link)
 			pw_impl_link_deactivate(link);
 	}
+	remove_driver_target(this);
 	pw_loop_invoke(this->data_loop, do_node_remove, 1, NULL, 0, true, this);
 }
 
@@ -251,6 +363,37 @@ static int start_node(struct pw_impl_node *this)
 	return res;
 }
 
+static void resource_sent_params(struct resource_data *d, const struct pw_node_info *info)
+{
+	uint32_t i;
+
+	d->n_sent_params = info->n_params;
+	for (i = 0; i < info->n_params; i++)
+		d->sent_param_flags[i] = info->params[i].flags;
+}
+
+/* The param info of the node can change several times before it is sent, when
+ * the SERIAL flag toggled an even number of times the flags look the same as
+ * the ones that were last sent. Toggle the SERIAL flag of those params so that
+ * the resource still sees the change. The params that did not change are
+ * sent as they were sent last. */
+static void merge_param_info(struct resource_data *d, struct spa_param_info *params)
+{
+	struct pw_impl_node *node = d->node;
+	uint32_t i;
+
+	for (i = 0; i < node->info.n_params; i++) {
+		params[i] = node->info.params[i];
+		if (i >= d->n_sent_params)
+			continue;
+		if (!(d->pending_param_info & (1u << i)))
+			params[i].flags = d->sent_param_flags[i];
+		else if (params[i].flags == d->sent_param_flags[i])
+			params[i].flags ^= SPA_PARAM_INFO_SERIAL;
+	}
+	d->pending_param_info = 0;
+}
+
 static void emit_info_changed(struct pw_impl_node *node, bool flags_changed)
 {
 	if (node->info.change_mask == 0 && !flags_changed)
@@ -260,8 +403,17 @@ static void emit_info_changed(struct pw_impl_node *node, bool flags_changed)
 
 	if (node->global && node->info.change_mask != 0) {
 		struct pw_resource *resource;
-		spa_list_for_each(resource, &node->global->resource_list, link)
-			pw_node_resource_info(resource, &node->info);
+		spa_list_for_each(resource, &node->global->resource_list, link) {
+			struct resource_data *data = pw_resource_get_user_data(resource);
+
+			if (node->context->settings.coalesce_updates) {
+				data->pending_info |= node->info.change_mask;
+				pw_impl_client_defer(resource->client, &data->deferred);
+			} else {
+				pw_node_resource_info(resource, &node->info);
+				resource_sent_params(data, &node->info);
+			}
+		}
 	}
 
 	node->info.change_mask = 0;
@@ -279,6 +431,40 @@ static int resource_is_subscribed(struct pw_resource *resource, uint32_t id)
 	return 0;
 }
 
+static int reply_param(void *data, int seq, uint32_t id,
+		uint32_t index, uint32_t next, struct spa_pod *param);
+
+/* send the latest info and params of all the updates that were merged */
+static void resource_flush_deferred(struct pw_resource_deferred *deferred)
+{
+	struct resource_data *d = SPA_CONTAINER_OF(deferred, struct resource_data, deferred);
+	struct pw_impl_node *node = d->node;
+	uint64_t params = d->pending_params;
+	uint32_t id;
+	int res;
+
+	if (d->pending_info != 0) {
+		struct pw_node_info info = node->info;
+		struct spa_param_info param_info[MAX_PARAMS];
+
+		merge_param_info(d, param_info);
+		info.params = param_info;
+		info.change_mask = d->pending_info;
+		d->pending_info = 0;
+		pw_node_resource_info(d->resource, &info);
+		resource_sent_params(d, &info);
+	}
+
+	d->pending_params = 0;
+	for (id = 0; params != 0; id++, params >>= 1) {
+		if (!(params & 1) || !resource_is_subscribed(d->resource, id))
+			continue;
+		if ((res = pw_impl_node_for_each_param(node, 1, id, 0, UINT32_MAX,
+					NULL, reply_param, d)) < 0)
+			pw_log_error("%p: error %d (%s)", node, res, spa_strerror(res));
+	}
+}
+
 static int notify_param(void *data, int seq, uint32_t id,
 		uint32_t index, uint32_t next, struct spa_pod *param)
 {
@@ -309,6 +495,19 @@ static void emit_params(struct pw_impl_node *node, uint32_t *changed_ids, uint32
 		struct pw_resource *resource;
 		int subscribed = 0;
 
+		if (node->context->settings.coalesce_updates && changed_ids[i] < 64) {
+			spa_list_for_each(resource, &node->global->resource_list, link) {
+				struct resource_data *data = pw_resource_get_user_data(resource);
+
+				if (!resource_is_subscribed(resource, changed_ids[i]))
+					continue;
+
+				data->pending_params |= 1ULL << changed_ids[i];
+				pw_impl_client_defer(resource->client, &data->deferred);
+			}
+			continue;
+		}
+
 		/* first check if anyone is subscribed */
 		spa_list_for_each(resource, &node->global->resource_list, link) {
 			if ((subscribed = resource_is_subscribed(resource, changed_ids[i])))
@@ -324,6 +523,55 @@ static void emit_params(struct pw_impl_node *node, uint32_t *changed_ids, uint32
 	}
 }
 
+SPA_EXPORT
+int pw_impl_node_add_wakeup_source(struct spa_system *system, struct spa_loop *loop,
+		struct spa_source *source)
+{
+	uint64_t count;
+	int res;
+
+	/* clear old wakeups, an edge triggered source would otherwise
+	 * be dispatched right away */
+	spa_system_eventfd_read(system, source->fd, &count);
+
+	if ((res = spa_loop_add_source(loop, source)) >= 0 ||
+	    !SPA_FLAG_IS_SET(source->mask, SPA_IO_ET))
+		return res;
+
+	pw_log_info("edge triggered wakeups not supported: %s, reading eventfd",
+			spa_strerror(res));
+	SPA_FLAG_CLEAR(source->mask, SPA_IO_ET);
+	return spa_loop_add_source(loop, source);
+}
+
+SPA_EXPORT
+int pw_impl_node_read_wakeups(struct spa_system *system, struct spa_source *source,
+		uint32_t *wakeups, uint64_t *missed)
+{
+	uint64_t count;
+	uint32_t n_wakeups = 1;
+	int res;
+
+	*missed = 0;
+
+	/* In edge triggered mode every write wakes us up and the eventfd
+	 * doesn't need to be read. The counter keeps the number of writes,
+	 * read it once in a while to find the writes that were merged into
+	 * one wakeup. */
+	if (SPA_LIKELY(source->mask & SPA_IO_ET)) {
+		if (SPA_LIKELY(++(*wakeups) < PW_NODE_WAKEUP_CHECK))
+			return 0;
+		n_wakeups = *wakeups;
+		*wakeups = 0;
+	}
+	if (SPA_UNLIKELY((res = spa_system_eventfd_read(system, source->fd, &count)) < 0))
+		return res;
+
+	if (SPA_UNLIKELY(count > n_wakeups))
+		*missed = count - n_wakeups;
+	return 0;
+}
+
 static int
 do_node_add(struct spa_loop *loop,
 	    bool async, uint32_t seq, const void *data, size_t size, void *user_data)
@@ -332,7 +580,8 @@ do_node_add(struct spa_loop *loop,
 	struct pw_impl_node *driver = this->driver_node;
 
 	if (this->source.loop == NULL) {
-		spa_loop_add_source(loop, &this->source);
+		this->rt.wakeups = 0;
+		pw_impl_node_add_wakeup_source(this->data_loop->system, loop, &this->source);
 		add_node(this, driver);
 	}
 	return 0;
@@ -353,8 +602,10 @@ static void node_update_state(struct pw_impl_node *node, enum pw_node_state stat
 				error = spa_aprintf("Start error: %s", spa_strerror(res));
 			}
 		}
-		if (res >= 0)
+		if (res >= 0) {
 			pw_loop_invoke(node->data_loop, do_node_add, 1, NULL, 0, true, node);
+			add_driver_target(node);
+		}
 		break;
 	default:
 		break;
@@ -572,6 +823,7 @@ static void resource_destroy(void *data)
 {
 	struct resource_data *d = data;
 	remove_busy_resource(d);
+	pw_impl_client_cancel_deferred(&d->deferred);
 	spa_hook_remove(&d->resource_listener);
 	spa_hook_remove(&d->object_listener);
 }
@@ -607,6 +859,7 @@ global_bind(void *_data, struct pw_impl_client *client, uint32_t permissions,
 	data->node = this;
 	data->resource = resource;
 	data->end = -1;
+	data->deferred.flush = resource_flush_deferred;
 
 	pw_resource_add_listener(resource,
 			&data->resource_listener,
@@ -620,6 +873,7 @@ global_bind(void *_data, struct pw_impl_client *client, uint32_t permissions,
 
 	this->info.change_mask = PW_NODE_CHANGE_MASK_ALL;
 	pw_node_resource_info(resource, &this->info);
+	resource_sent_params(data, &this->info);
 	this->info.change_mask = 0;
 
 	return 0;
@@ -805,6 +1059,44 @@ static void remove_segment_owner(struct pw_impl_node *driver, uint32_t node_id)
 	ATOMIC_CAS(a->segment_owner[1], node_id, 0);
 }
 
+static bool has_active_links(struct pw_impl_node *node)
+{
+	struct pw_impl_port *port;
+	struct pw_impl_link *link;
+
+	spa_list_for_each(port, &node->input_ports, link) {
+		spa_list_for_each(link, &port->links, input_link)
+			if (link->info.state == PW_LINK_STATE_ACTIVE)
+				return true;
+	}
+	spa_list_for_each(port, &node->output_ports, link) {
+		spa_list_for_each(link, &port->links, output_link)
+			if (link->info.state == PW_LINK_STATE_ACTIVE)
+				return true;
+	}
+	return false;
+}
+
+/* run a follower on the data loop of its driver so that the driver can process
+ * it directly. The node is only moved when it is not added to its data loop and
+ * has no active links, nothing of it is used on the old data loop then. */
+static void move_data_loop(struct pw_impl_node *node, struct pw_impl_node *driver)
+{
+	if (!node->follow_driver_loop || node == driver ||
+	    node->data_loop == driver->data_loop ||
+	    node->source.loop != NULL || has_active_links(node))
+		return;
+
+	pw_log_debug("%p: move to data loop %p of driver %p", node,
+			driver->data_loop, driver);
+
+	/* complete the updates that were queued on the old data loop */
+	pw_loop_invoke(node->data_loop, NULL, SPA_ID_INVALID, NULL, 0, true, NULL);
+
+	node->data_loop = driver->data_loop;
+	node->rt.driver_listener_list = driver->rt.driver_listener_list;
+}
+
 SPA_EXPORT
 int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driver)
 {
@@ -842,10 +1134,15 @@ int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driv
 
 	node->driver_node = driver;
 
+	remove_driver_target(node);
+	move_data_loop(node, driver);
+
 	pw_loop_invoke(node->data_loop,
 		       do_move_nodes, SPA_ID_INVALID, &driver, sizeof(struct pw_impl_node *),
 		       true, impl);
 
+	add_driver_target(node);
+
 	pw_impl_node_emit_driver_changed(node, old, driver);
 
 	return 0;
@@ -1006,7 +1303,7 @@ static inline int resume_node(struct pw_impl_node *this, int status)
 	struct pw_node_target *t;
 	struct timespec ts;
 	struct pw_node_activation *activation = this->rt.activation;
-	struct spa_system *data_system = this->context->data_system;
+	struct spa_system *data_system = this->data_loop->system;
 	uint64_t nsec;
 
 	spa_system_clock_gettime(data_system, CLOCK_MONOTONIC, &ts);
@@ -1044,13 +1341,29 @@ static inline void calculate_stats(struct pw_impl_node *this,  struct pw_node_ac
 	}
 }
 
+static inline void update_histogram(uint32_t *histogram, uint64_t *max, uint64_t nsec)
+{
+	histogram[spa_profiler_histogram_bucket(nsec)]++;
+	if (nsec > *max)
+		*max = nsec;
+}
+
+static inline void update_node_stats(struct pw_node_activation *a)
+{
+	if (SPA_UNLIKELY(a->awake_time < a->signal_time ||
+	    a->finish_time < a->awake_time))
+		return;
+	update_histogram(a->wait_histogram, &a->wait_max, a->awake_time - a->signal_time);
+	update_histogram(a->busy_histogram, &a->busy_max, a->finish_time - a->awake_time);
+}
+
 static inline int process_node(void *data)
 {
 	struct pw_impl_node *this = data;
 	struct timespec ts;
         struct pw_impl_port *p;
 	struct pw_node_activation *a = this->rt.activation;
-	struct spa_system *data_system = this->context->data_system;
+	struct spa_system *data_system = this->data_loop->system;
 	int status;
 
 	spa_system_clock_gettime(data_system, CLOCK_MONOTONIC, &ts);
@@ -1107,7 +1420,7 @@ static inline int process_node(void *data)
 static void node_on_fd_events(struct spa_source *source)
 {
 	struct pw_impl_node *this = source->data;
-	struct spa_system *data_system = this->context->data_system;
+	struct spa_system *data_system = this->data_loop->system;
 
 	if (SPA_UNLIKELY(source->rmask & (SPA_IO_ERR | SPA_IO_HUP))) {
 		pw_log_warn("%p: got socket error %08x", this, source->rmask);
@@ -1115,16 +1428,17 @@ static void node_on_fd_events(struct spa_source *source)
 	}
 
 	if (SPA_LIKELY(source->rmask & SPA_IO_IN)) {
-		uint64_t cmd;
+		uint64_t missed;
 
-		if (SPA_UNLIKELY(spa_system_eventfd_read(data_system, this->source.fd, &cmd) < 0))
+		if (SPA_UNLIKELY(pw_impl_node_read_wakeups(data_system, source,
+					&this->rt.wakeups, &missed) < 0))
 			pw_log_warn("%p: read failed %m", this);
-		else if (SPA_UNLIKELY(cmd > 1))
+		else if (SPA_UNLIKELY(missed > 0))
 			pw_log_info("(%s-%u) client missed %"PRIu64" wakeups",
-				this->name, this->info.id, cmd - 1);
+				this->name, this->info.id, missed);
 
 		pw_log_trace_fp("%p: got process", this);
-		this->rt.target.signal(this->rt.target.data);
+		process_node(this);
 	}
 }
 
@@ -1164,8 +1478,10 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 {
 	struct impl *impl;
 	struct pw_impl_node *this;
+	struct pw_data_loop *data_loop;
 	size_t size;
-	struct spa_system *data_system = context->data_system;
+	struct spa_system *data_system;
+	uint32_t i;
 	int res;
 
 	impl = calloc(1, sizeof(struct impl) + user_data_size);
@@ -1180,6 +1496,7 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 	this = &impl->this;
 	this->context = context;
 	this->name = strdup("node");
+	this->source.fd = -1;
 
 	if (user_data_size > 0)
                 this->user_data = SPA_PTROFF(impl, sizeof(struct impl), void);
@@ -1193,6 +1510,14 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 
 	this->properties = properties;
 
+	data_loop = pw_context_find_data_loop(context, &properties->dict);
+	this->data_loop = pw_data_loop_get_loop(data_loop);
+	for (i = 0; i < context->n_data_loops; i++) {
+		if (context->data_loops[i] == data_loop)
+			this->rt.driver_listener_list = &context->driver_listener_lists[i];
+	}
+	data_system = this->data_loop->system;
+
 	if ((res = spa_system_eventfd_create(data_system, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
 		goto error_clean;
 
@@ -1201,7 +1526,7 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 	this->source.fd = res;
 	this->source.func = node_on_fd_events;
 	this->source.data = this;
-	this->source.mask = SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP;
+	this->source.mask = SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP | SPA_IO_ET;
 	this->source.rmask = 0;
 
 	size = sizeof(struct pw_node_activation);
@@ -1223,8 +1548,6 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 	}
 	impl->pending_id = SPA_ID_INVALID;
 
-	this->data_loop = context->data_loop;
-
 	spa_list_init(&this->follower_list);
 
 	spa_hook_list_init(&this->listener_list);
@@ -1243,11 +1566,12 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 	spa_list_init(&this->rt.target_list);
 
 	this->rt.activation = this->activation->map->ptr;
+	this->rt.activation_stats = true;
 	this->rt.target.activation = this->rt.activation;
+	this->rt.target.has_stats = true;
 	this->rt.target.node = this;
-	this->rt.target.signal = process_node;
-	this->rt.target.data = this;
-	this->rt.driver_target.signal = process_node;
+	pw_impl_node_init_target(this, this->data_loop, &this->rt.target);
+	pw_impl_node_init_target(this, this->data_loop, &this->rt.driver_target);
 
 	reset_position(this, &this->rt.activation->position);
 	this->rt.activation->sync_timeout = DEFAULT_SYNC_TIMEOUT;
@@ -1268,7 +1592,7 @@ error_clean:
 	if (this->activation)
 		pw_memblock_unref(this->activation);
 	if (this->source.fd != -1)
-		spa_system_close(this->context->data_system, this->source.fd);
+		spa_system_close(this->data_loop->system, this->source.fd);
 	free(impl);
 error_exit:
 	pw_properties_free(properties);
@@ -1339,10 +1663,24 @@ int pw_impl_node_update_properties(struct pw_impl_node *node, const struct spa_d
 	return changed;
 }
 
+static void defer_param_info(struct pw_impl_node *node, uint32_t changed)
+{
+	struct pw_resource *resource;
+
+	if (!node->context->settings.coalesce_updates || node->global == NULL)
+		return;
+
+	spa_list_for_each(resource, &node->global->resource_list, link) {
+		struct resource_data *data = pw_resource_get_user_data(resource);
+		data->pending_param_info |= changed;
+	}
+}
+
 static void node_info(void *data, const struct spa_node_info *info)
 {
 	struct pw_impl_node *node = data;
 	uint32_t changed_ids[MAX_PARAMS], n_changed_ids = 0;
+	uint32_t changed_param_info = 0;
 	bool flags_changed = false;
 
 	node->info.max_input_ports = info->max_input_ports;
@@ -1382,10 +1720,12 @@ static void node_info(void *data, const struct spa_node_info *info)
 			pw_log_debug("%p: update param %d", node, id);
 			node->info.params[i] = info->params[i];
 			node->info.params[i].user = 0;
+			changed_param_info |= 1u << i;
 
 			if (info->params[i].flags & SPA_PARAM_INFO_READ)
 				changed_ids[n_changed_ids++] = id;
 		}
+		defer_param_info(node, changed_param_info);
 	}
 	emit_info_changed(node, flags_changed);
 
@@ -1583,8 +1923,9 @@ static int node_ready(void *data, int status)
 	if (SPA_UNLIKELY(node == driver)) {
 		struct pw_node_activation *a = node->rt.activation;
 		struct pw_node_activation_state *state = &a->state[0];
+		struct pw_node_target *pending = NULL;
 		int sync_type, all_ready, update_sync, target_sync;
-		uint32_t owner[2], reposition_owner;
+		uint32_t owner[2], reposition_owner, pending_status = 0;
 		uint64_t min_timeout = UINT64_MAX;
 
 		if (SPA_UNLIKELY(state->pending > 0)) {
@@ -1616,6 +1957,25 @@ again:
 		spa_list_for_each(t, &driver->rt.target_list, link) {
 			struct pw_node_activation *ta = t->activation;
 
+			switch (ta->status) {
+			case PW_NODE_ACTIVATION_FINISHED:
+				if (SPA_LIKELY(t->has_stats))
+					update_node_stats(ta);
+				break;
+			case PW_NODE_ACTIVATION_TRIGGERED:
+			case PW_NODE_ACTIVATION_AWAKE:
+				if (t->node == NULL || t->node == node)
+					break;
+				/* still busy, remember the one that was triggered first */
+				if (SPA_LIKELY(t->has_stats))
+					ta->pending_count++;
+				if (pending == NULL ||
+				    ta->signal_time < pending->activation->signal_time) {
+					pending = t;
+					pending_status = ta->status;
+				}
+				break;
+			}
 			ta->status = PW_NODE_ACTIVATION_NOT_TRIGGERED;
 			pw_node_activation_state_reset(&ta->state[0]);
 
@@ -1642,6 +2002,15 @@ again:
 				all_ready &= ta->pending_sync == false;
 			}
 		}
+		if (SPA_UNLIKELY(pending != NULL)) {
+			if (SPA_LIKELY(node->rt.activation_stats)) {
+				a->incomplete_count++;
+				a->pending_id = pending->node->info.id;
+				a->pending_status = pending_status;
+				a->pending_time = a->signal_time;
+			}
+			pending = NULL;
+		}
 		a->prev_signal_time = a->signal_time;
 		a->sync_timeout = SPA_MIN(min_timeout, DEFAULT_SYNC_TIMEOUT);
 
@@ -1663,7 +2032,7 @@ again:
 	if (!node->driver) {
 		struct timespec ts;
 		struct pw_node_activation *a = node->rt.activation;
-		struct spa_system *data_system = node->context->data_system;
+		struct spa_system *data_system = node->data_loop->system;
 
 		spa_system_clock_gettime(data_system, CLOCK_MONOTONIC, &ts);
 		a->status = PW_NODE_ACTIVATION_AWAKE;
@@ -1839,6 +2208,10 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 		pw_context_recalc_graph(node->context,
 				"active node destroy");
 
+	/* link activations on other data loops are queued, make sure they
+	 * are done before the node is freed */
+	sync_data_loops(node);
+
 	pw_log_debug("%p: free", node);
 	pw_impl_node_emit_free(node);
 
@@ -1858,7 +2231,7 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 
 	clear_info(node);
 
-	spa_system_close(node->context->data_system, node->source.fd);
+	spa_system_close(node->data_loop->system, node->source.fd);
 	free(impl);
 }
 
@@ -188,6 +188,8 @@ extern "C" {
 #define PW_KEY_NODE_TRIGGER		"node.trigger"		/**< the node is not scheduled automatically
 								  *   based on the dependencies in the graph
 								  *   but it will be triggered explicitly. */
+#define PW_KEY_NODE_DATA_LOOP		"node.data-loop"	/**< the index of the data loop of the
+								  *  context that runs the node */
 
 /** Port keys */
 #define PW_KEY_PORT_ID			"port.id"		/**< port id */
@@ -37,6 +37,7 @@
 #include <spa/utils/list.h>
 #include <spa/buffer/buffer.h>
 
+#include <pipewire/array.h>
 #include <pipewire/log.h>
 #include <pipewire/map.h>
 #include <pipewire/mem.h>
@@ -96,6 +97,22 @@ static inline int memfd_create(const char *name, unsigned int flags)
 #define pw_mempool_emit_added(p,b)	pw_mempool_emit(p, added, 0, b)
 #define pw_mempool_emit_removed(p,b)	pw_mempool_emit(p, removed, 0, b)
 
+/* an entry in a hash index, embedded in the indexed object */
+struct index_entry {
+	struct spa_list link;
+	uint32_t key;
+};
+
+/* a chained hash table on a uint32_t key. Keys don't need to be
+ * unique, lookups iterate all entries with the same key. */
+struct index {
+	struct spa_list *buckets;
+	uint32_t mask;
+	uint32_t count;
+};
+
+#define INDEX_MIN_BUCKETS	64
+
 struct mempool {
 	struct pw_mempool this;
 
@@ -104,6 +121,10 @@ struct mempool {
 	struct pw_map map;		/* map memblock to id */
 	struct spa_list blocks;		/* list of memblock */
 	uint32_t pagesize;
+
+	struct index fd_index;		/* memblock by fd */
+	struct index tag_index;		/* memmap by tag[0] */
+	struct pw_array mappings;	/* mapping pointers sorted by ptr */
 };
 
 struct memblock {
@@ -111,6 +132,7 @@ struct memblock {
 	struct spa_list link;		/* link in mempool */
 	struct spa_list mappings;	/* list of struct mapping */
 	struct spa_list memmaps;	/* list of struct memmap */
+	struct index_entry fd_entry;	/* entry in mempool fd_index */
 };
 
 /* a mapped region of a block */
@@ -129,8 +151,143 @@ struct memmap {
 	struct pw_memmap this;
 	struct mapping *mapping;
 	struct spa_list link;
+	struct index_entry tag_entry;	/* entry in mempool tag_index */
 };
 
+static inline uint32_t index_bucket(struct index *idx, uint32_t key)
+{
+	key *= 0x9e3779b1u;
+	return (key ^ (key >> 16)) & idx->mask;
+}
+
+static int index_init(struct index *idx, uint32_t n_buckets)
+{
+	uint32_t i;
+
+	idx->buckets = malloc(n_buckets * sizeof(struct spa_list));
+	if (idx->buckets == NULL)
+		return -errno;
+	for (i = 0; i < n_buckets; i++)
+		spa_list_init(&idx->buckets[i]);
+	idx->mask = n_buckets - 1;
+	idx->count = 0;
+	return 0;
+}
+
+static void index_clear(struct index *idx)
+{
+	free(idx->buckets);
+	spa_zero(*idx);
+}
+
+static void index_grow(struct index *idx)
+{
+	struct index tmp;
+	struct index_entry *e;
+	uint32_t i;
+
+	/* when this fails we keep the old table with longer chains */
+	if (index_init(&tmp, (idx->mask + 1) * 2) < 0)
+		return;
+
+	for (i = 0; i <= idx->mask; i++) {
+		spa_list_consume(e, &idx->buckets[i], link) {
+			spa_list_remove(&e->link);
+			spa_list_append(&tmp.buckets[index_bucket(&tmp, e->key)], &e->link);
+		}
+	}
+	tmp.count = idx->count;
+	free(idx->buckets);
+	*idx = tmp;
+}
+
+static void index_insert(struct index *idx, struct index_entry *e, uint32_t key)
+{
+	if (idx->count > idx->mask)
+		index_grow(idx);
+	e->key = key;
+	spa_list_append(&idx->buckets[index_bucket(idx, key)], &e->link);
+	idx->count++;
+}
+
+static void index_remove(struct index *idx, struct index_entry *e)
+{
+	spa_list_remove(&e->link);
+	idx->count--;
+}
+
+#define index_for_each_key(pos, idx, k)						\
+	spa_list_for_each(pos, &(idx)->buckets[index_bucket(idx, k)], link)	\
+		if ((pos)->key == (k))
+
+/* Mappings of a pool never overlap so we can keep them sorted on their
+ * start address and find the mapping for a pointer with a binary search. */
+static uint32_t mappings_lower_bound(struct mempool *impl, const void *ptr)
+{
+	struct mapping **m = impl->mappings.data;
+	uint32_t lo = 0, hi = pw_array_get_len(&impl->mappings, struct mapping*);
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if ((const void*)m[mid]->ptr < ptr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int mappings_insert(struct mempool *impl, struct mapping *m)
+{
+	uint32_t pos, len;
+	struct mapping **data;
+
+	pos = mappings_lower_bound(impl, m->ptr);
+	if (pw_array_add(&impl->mappings, sizeof(struct mapping*)) == NULL)
+		return -errno;
+
+	data = impl->mappings.data;
+	len = pw_array_get_len(&impl->mappings, struct mapping*);
+	memmove(&data[pos + 1], &data[pos], (len - pos - 1) * sizeof(struct mapping*));
+	data[pos] = m;
+	return 0;
+}
+
+static void mappings_remove(struct mempool *impl, struct mapping *m)
+{
+	uint32_t pos, len;
+	struct mapping **data = impl->mappings.data;
+
+	len = pw_array_get_len(&impl->mappings, struct mapping*);
+	for (pos = mappings_lower_bound(impl, m->ptr); pos < len; pos++) {
+		if (data[pos] == m) {
+			memmove(&data[pos], &data[pos + 1], (len - pos - 1) * sizeof(struct mapping*));
+			impl->mappings.size -= sizeof(struct mapping*);
+			return;
+		}
+		if (data[pos]->ptr != m->ptr)
+			break;
+	}
+}
+
+static struct mapping *mappings_find(struct mempool *impl, const void *ptr)
+{
+	struct mapping **data = impl->mappings.data, *m;
+	uint32_t pos, len;
+
+	len = pw_array_get_len(&impl->mappings, struct mapping*);
+	pos = mappings_lower_bound(impl, ptr);
+	/* the mapping starting at ptr, or else the one before it */
+	if (pos < len && data[pos]->ptr == ptr)
+		return data[pos];
+	if (pos == 0)
+		return NULL;
+	m = data[pos - 1];
+	if (ptr < SPA_PTROFF(m->ptr, m->size, void))
+		return m;
+	return NULL;
+}
+
 SPA_EXPORT
 struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 {
@@ -148,11 +305,23 @@ struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 
 	pw_log_debug("%p: new", this);
 
+	if (index_init(&impl->fd_index, INDEX_MIN_BUCKETS) < 0)
+		goto error_free;
+	if (index_init(&impl->tag_index, INDEX_MIN_BUCKETS) < 0)
+		goto error_free;
+
 	spa_hook_list_init(&impl->listener_list);
 	pw_map_init(&impl->map, 64, 64);
 	spa_list_init(&impl->blocks);
+	pw_array_init(&impl->mappings, 64 * sizeof(struct mapping*));
 
 	return this;
+
+error_free:
+	index_clear(&impl->fd_index);
+	index_clear(&impl->tag_index);
+	free(impl);
+	return NULL;
 }
 
 SPA_EXPORT
@@ -182,6 +351,9 @@ void pw_mempool_destroy(struct pw_mempool *pool)
 	spa_hook_list_clean(&impl->listener_list);
 
 	pw_map_clear(&impl->map);
+	pw_array_clear(&impl->mappings);
+	index_clear(&impl->fd_index);
+	index_clear(&impl->tag_index);
 	pw_properties_free(pool->props);
 	free(impl);
 }
@@ -321,6 +493,11 @@ static struct mapping * memblock_map(struct memblock *b,
 	m->block = b;
 	m->offset = offset;
 	m->size = size;
+	if (mappings_insert(p, m) < 0) {
+		free(m);
+		munmap(ptr, size);
+		return NULL;
+	}
 	b->this.ref++;
 	spa_list_append(&b->mappings, &m->link);
 
@@ -340,6 +517,7 @@ static void mapping_free(struct mapping *m)
 
 	if (m->do_unmap)
 		munmap(m->ptr, m->size);
+	mappings_remove(p, m);
 	spa_list_remove(&m->link);
 	free(m);
 }
@@ -397,6 +575,7 @@ struct pw_memmap * pw_memblock_map(struct pw_memblock *block,
 	}
 
 	spa_list_append(&b->memmaps, &mm->link);
+	index_insert(&p->tag_index, &mm->tag_entry, mm->this.tag[0]);
 
 	return &mm->this;
 }
@@ -436,6 +615,7 @@ int pw_memmap_free(struct pw_memmap *map)
 			&mm->this, b, b->this.fd, mm->this.ptr, m, m->ref);
 
 	spa_list_remove(&mm->link);
+	index_remove(&p->tag_index, &mm->tag_entry);
 
 	if (--m->ref == 0)
 		mapping_unmap(m);
@@ -535,6 +715,7 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 
 	b->this.id = pw_map_insert_new(&impl->map, b);
 	spa_list_append(&impl->blocks, &b->link);
+	index_insert(&impl->fd_index, &b->fd_entry, b->this.fd);
 	pw_log_debug("%p: block:%p id:%d type:%u size:%zu", pool, &b->this, b->this.id, type, size);
 
 	if (!SPA_FLAG_IS_SET(flags, PW_MEMBLOCK_FLAG_DONT_NOTIFY))
@@ -553,14 +734,13 @@ error_free:
 static struct memblock * mempool_find_fd(struct pw_mempool *pool, int fd)
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
-	struct memblock *b;
+	struct index_entry *e;
 
-	spa_list_for_each(b, &impl->blocks, link) {
-		if (fd == b->this.fd) {
-			pw_log_debug("%p: found %p id:%u fd:%d ref:%d",
-					pool, &b->this, b->this.id, fd, b->this.ref);
-			return b;
-		}
+	index_for_each_key(e, &impl->fd_index, (uint32_t)fd) {
+		struct memblock *b = SPA_CONTAINER_OF(e, struct memblock, fd_entry);
+		pw_log_debug("%p: found %p id:%u fd:%d ref:%d",
+				pool, &b->this, b->this.id, fd, b->this.ref);
+		return b;
 	}
 	return NULL;
 }
@@ -592,6 +772,7 @@ struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
 	b->this.flags = flags;
 	b->this.id = pw_map_insert_new(&impl->map, b);
 	spa_list_append(&impl->blocks, &b->link);
+	index_insert(&impl->fd_index, &b->fd_entry, b->this.fd);
 
 	pw_log_debug("%p: block:%p id:%u flags:%08x type:%u fd:%d",
 			pool, b, b->this.id, flags, type, fd);
@@ -633,6 +814,7 @@ struct pw_memmap * pw_mempool_import_map(struct pw_mempool *pool,
 		return NULL;
 
 	if (block->ref == 1) {
+		struct mempool *p = SPA_CONTAINER_OF(pool, struct mempool, this);
 		struct mapping *m;
 
 		b = SPA_CONTAINER_OF(block, struct memblock, this);
@@ -646,6 +828,11 @@ struct pw_memmap * pw_mempool_import_map(struct pw_mempool *pool,
 		m->block = b;
 		m->offset = old->map->offset;
 		m->size = old->map->size;
+		if (mappings_insert(p, m) < 0) {
+			free(m);
+			pw_memblock_unref(block);
+			return NULL;
+		}
 		spa_list_append(&b->mappings, &m->link);
 		pw_log_debug("%p: mapping:%p block:%p offset:%u size:%u ref:%u",
 				pool, m, block, m->offset, m->size, block->ref);
@@ -710,6 +897,7 @@ void pw_memblock_free(struct pw_memblock *block)
 	if (block->id != SPA_ID_INVALID)
 		pw_map_remove(&impl->map, block->id);
 	spa_list_remove(&b->link);
+	index_remove(&impl->fd_index, &b->fd_entry);
 
 	if (!SPA_FLAG_IS_SET(block->flags, PW_MEMBLOCK_FLAG_DONT_NOTIFY))
 		pw_mempool_emit_removed(impl, block);
@@ -733,19 +921,15 @@ SPA_EXPORT
 struct pw_memblock * pw_mempool_find_ptr(struct pw_mempool *pool, const void *ptr)
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
-	struct memblock *b;
 	struct mapping *m;
 
-	spa_list_for_each(b, &impl->blocks, link) {
-		spa_list_for_each(m, &b->mappings, link) {
-			if (ptr >= m->ptr && ptr < SPA_PTROFF(m->ptr, m->size, void)) {
-				pw_log_debug("%p: block:%p id:%u for %p", pool,
-						b, b->this.id, ptr);
-				return &b->this;
-			}
-		}
-	}
-	return NULL;
+	m = mappings_find(impl, ptr);
+	if (m == NULL)
+		return NULL;
+
+	pw_log_debug("%p: block:%p id:%u for %p", pool,
+			m->block, m->block->this.id, ptr);
+	return &m->block->this;
 }
 
 SPA_EXPORT
@@ -784,6 +968,19 @@ struct pw_memmap * pw_mempool_find_tag(struct pw_mempool *pool, uint32_t tag[5],
 	pw_log_debug("%p: find tag %u:%u:%u:%u:%u size:%zu", pool,
 			tag[0], tag[1], tag[2], tag[3], tag[4], size);
 
+	if (size >= sizeof(uint32_t)) {
+		struct index_entry *e;
+
+		index_for_each_key(e, &impl->tag_index, tag[0]) {
+			mm = SPA_CONTAINER_OF(e, struct memmap, tag_entry);
+			if (memcmp(tag, mm->this.tag, size) == 0) {
+				pw_log_debug("%p: found %p", pool, mm);
+				return &mm->this;
+			}
+		}
+		return NULL;
+	}
+
 	spa_list_for_each(b, &impl->blocks, link) {
 		spa_list_for_each(mm, &b->memmaps, link) {
 			if (memcmp(tag, mm->this.tag, size) == 0) {
@@ -37,6 +37,7 @@ extern "C" {
 #include <spa/support/plugin.h>
 #include <spa/pod/builder.h>
 #include <spa/param/latency-utils.h>
+#include <spa/param/profiler.h>
 #include <spa/utils/result.h>
 #include <spa/utils/type-info.h>
 
@@ -70,6 +71,8 @@ struct settings {
 	unsigned int clock_power_of_two_quantum:1;
 	unsigned int check_quantum:1;
 	unsigned int check_rate:1;
+	unsigned int coalesce_updates:1;	/* merge info and param updates */
+	uint32_t update_interval;		/* flush interval of merged updates in ms */
 #define CLOCK_RATE_UPDATE_MODE_HARD 0
 #define CLOCK_RATE_UPDATE_MODE_SOFT 1
 	int clock_rate_update_mode;
@@ -311,6 +314,13 @@ struct pw_impl_client {
 	void *compat_v2;
 };
 
+/** Events of a resource that are sent later, see pw_impl_client_defer() */
+struct pw_resource_deferred {
+	struct spa_list link;		/**< link in the client deferred list */
+	void (*flush) (struct pw_resource_deferred *deferred);
+	unsigned int queued:1;
+};
+
 #define pw_global_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_global_events, m, v, ##__VA_ARGS__)
 
 #define pw_global_emit_registering(g)	pw_global_emit(g, registering, 0)
@@ -373,13 +383,14 @@ pw_core_resource_errorf(struct pw_resource *resource, uint32_t id, int seq,
 	va_end(args);
 }
 
-#define pw_context_driver_emit(c,m,v,...) spa_hook_list_call_simple(&c->driver_listener_list, struct pw_context_driver_events, m, v, ##__VA_ARGS__)
-#define pw_context_driver_emit_start(c,n)	pw_context_driver_emit(c, start, 0, n)
-#define pw_context_driver_emit_xrun(c,n)	pw_context_driver_emit(c, xrun, 0, n)
-#define pw_context_driver_emit_incomplete(c,n)	pw_context_driver_emit(c, incomplete, 0, n)
-#define pw_context_driver_emit_timeout(c,n)	pw_context_driver_emit(c, timeout, 0, n)
-#define pw_context_driver_emit_drained(c,n)	pw_context_driver_emit(c, drained, 0, n)
-#define pw_context_driver_emit_complete(c,n)	pw_context_driver_emit(c, complete, 0, n)
+/* the driver events are emitted on the listener list of the data loop of the node */
+#define pw_context_driver_emit(n,m,v,...) spa_hook_list_call_simple((n)->rt.driver_listener_list, struct pw_context_driver_events, m, v, ##__VA_ARGS__)
+#define pw_context_driver_emit_start(c,n)	pw_context_driver_emit(n, start, 0, n)
+#define pw_context_driver_emit_xrun(c,n)	pw_context_driver_emit(n, xrun, 0, n)
+#define pw_context_driver_emit_incomplete(c,n)	pw_context_driver_emit(n, incomplete, 0, n)
+#define pw_context_driver_emit_timeout(c,n)	pw_context_driver_emit(n, timeout, 0, n)
+#define pw_context_driver_emit_drained(c,n)	pw_context_driver_emit(n, drained, 0, n)
+#define pw_context_driver_emit_complete(c,n)	pw_context_driver_emit(n, complete, 0, n)
 
 struct pw_context_driver_events {
 #define PW_VERSION_CONTEXT_DRIVER_EVENTS	0
@@ -442,12 +453,17 @@ struct pw_context {
 	struct spa_list export_list;		/**< list of export types */
 	struct spa_list driver_list;		/**< list of driver nodes */
 
-	struct spa_hook_list driver_listener_list;
 	struct spa_hook_list listener_list;
 
 	struct pw_loop *main_loop;		/**< main loop for control */
 	struct pw_loop *data_loop;		/**< data loop for data passing */
 	struct pw_data_loop *data_loop_impl;
+	struct pw_data_loop **data_loops;	/**< pool of data loops, the first one is data_loop_impl */
+	struct spa_hook_list *driver_listener_lists;	/**< driver listeners, one list for each data
+							  *  loop, only used from that data loop */
+	uint32_t n_data_loops;			/**< number of data loops in the pool */
+	uint32_t data_loop_next;		/**< next data loop to assign to a node */
+	struct pw_properties *data_loop_groups;	/**< data loop of each node.group */
 	struct spa_system *data_system;		/**< data system for data passing */
 	struct pw_work_queue *work_queue;	/**< work queue */
 
@@ -561,6 +577,7 @@ struct pw_node_target {
 	int (*signal) (void *data);
 	void *data;
 	unsigned int active:1;
+	unsigned int has_stats:1;			/* the activation has the stats fields */
 };
 
 struct pw_node_activation {
@@ -613,8 +630,33 @@ struct pw_node_activation {
 	uint32_t command;				/* next command */
 	uint32_t reposition_owner;			/* owner id with new reposition info, last one
 							 * to update wins */
+
+	/* updated by the driver at the start of each cycle */
+	uint32_t wait_histogram[SPA_PROFILER_HISTOGRAM_BUCKETS];	/* signal to awake time */
+	uint32_t busy_histogram[SPA_PROFILER_HISTOGRAM_BUCKETS];	/* awake to finish time */
+	uint64_t wait_max;				/* max signal to awake time in nanoseconds */
+	uint64_t busy_max;				/* max awake to finish time in nanoseconds */
+	uint32_t pending_count;				/* number of cycles where the node was still
+							 * pending when the driver started a new cycle */
+
+	/* for drivers, the node that was pending when the driver started a
+	 * new cycle */
+	uint32_t incomplete_count;			/* number of incomplete cycles */
+	uint32_t pending_id;				/* id of the node */
+	uint32_t pending_status;			/* status of the node */
+	uint64_t pending_time;				/* signal time of the incomplete cycle */
 };
 
+/* The stats fields were added at the end of the activation. Peers with an
+ * older version share a smaller activation, check the size that was mapped
+ * before using the stats. */
+#define PW_NODE_ACTIVATION_STATS_SIZE	(offsetof(struct pw_node_activation, pending_time) + sizeof(uint64_t))
+
+static inline bool pw_node_activation_has_stats(size_t size)
+{
+	return size >= PW_NODE_ACTIVATION_STATS_SIZE;
+}
+
 #define ATOMIC_CAS(v,ov,nv)						\
 ({									\
 	__typeof__(v) __ov = (ov);					\
@@ -688,6 +730,7 @@ struct pw_impl_node {
 	unsigned int lock_rate:1;	/**< don't change graph rate */
 	unsigned int transport_sync:1;	/**< supports transport sync */
 	unsigned int current_pending:1;	/**< a quantum/rate update is pending */
+	unsigned int follow_driver_loop:1;	/**< move to the data loop of the driver */
 
 	uint32_t port_user_data_size;	/**< extra size for port user data */
 
@@ -709,6 +752,7 @@ struct pw_impl_node {
 	struct spa_hook_list listener_list;
 
 	struct pw_loop *data_loop;		/**< the data loop for this node */
+	struct pw_impl_node *target_driver;	/**< driver with our target in its target list */
 
 	struct spa_fraction latency;		/**< requested latency */
 	struct spa_fraction max_latency;	/**< maximum latency */
@@ -730,7 +774,13 @@ struct pw_impl_node {
 							   driver */
 		struct spa_list driver_link;		/* our link in driver */
 
+		struct spa_hook_list *driver_listener_list;	/* driver listeners of our data loop */
+
 		struct ratelimit rate_limit;
+		uint32_t wakeups;			/* wakeups since the last eventfd read */
+		uint32_t histogram_countdown;		/* profiled cycles of this driver before
+							 * the histograms are sent again */
+		unsigned int activation_stats:1;	/* our activation has the stats fields */
 	} rt;
 	struct spa_fraction current_rate;
 	uint64_t current_quantum;
@@ -1153,6 +1203,15 @@ void pw_proxy_remove(struct pw_proxy *proxy);
 
 int pw_context_recalc_graph(struct pw_context *context, const char *reason);
 
+/** Get the data loop selected by the node.data-loop key in \a props, the
+ * default data loop is returned when there is no (valid) selection */
+struct pw_data_loop *pw_context_find_data_loop(struct pw_context *context,
+		const struct spa_dict *props);
+
+/** Assign a data loop from the pool to \a props when it does not select one,
+ * nodes in the same node.group get the same data loop */
+int pw_context_assign_data_loop(struct pw_context *context, struct pw_properties *props);
+
 void pw_impl_port_update_info(struct pw_impl_port *port, const struct spa_port_info *info);
 
 int pw_impl_port_register(struct pw_impl_port *port,
@@ -1226,6 +1285,33 @@ int pw_impl_node_update_ports(struct pw_impl_node *node);
 
 int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driver);
 
+/** Make \a target signal \a node from a node running on \a loop. When the
+ * loops differ, the node is woken up on its own data loop */
+void pw_impl_node_init_target(struct pw_impl_node *node, struct pw_loop *loop,
+		struct pw_node_target *target);
+
+/** Add the eventfd \a source used to wake up a node to \a loop. The source is
+ * added edge triggered when \a source mask has SPA_IO_ET and the system supports
+ * it, the eventfd then does not need to be read after a wakeup. */
+int pw_impl_node_add_wakeup_source(struct spa_system *system, struct spa_loop *loop,
+		struct spa_source *source);
+
+/** Account for a wakeup of the eventfd \a source. Without SPA_IO_ET, the eventfd
+ * is read on each wakeup. With SPA_IO_ET, the wakeups are counted in \a wakeups
+ * and the eventfd is only read every PW_NODE_WAKEUP_CHECK wakeups, to save the
+ * syscall. \a missed is set to the number of writes that did not cause a
+ * wakeup since the last read. */
+#define PW_NODE_WAKEUP_CHECK	64u
+int pw_impl_node_read_wakeups(struct spa_system *system, struct spa_source *source,
+		uint32_t *wakeups, uint64_t *missed);
+
+/** Check if \a global matches the filter of \a registry */
+bool pw_registry_resource_match(struct pw_resource *registry, struct pw_global *global);
+
+void pw_impl_client_defer(struct pw_impl_client *client, struct pw_resource_deferred *deferred);
+void pw_impl_client_cancel_deferred(struct pw_resource_deferred *deferred);
+void pw_impl_client_flush_deferred(struct pw_impl_client *client);
+
 /** Prepare a link
   * Starts the negotiation of formats and buffers on \a link */
 int pw_impl_link_prepare(struct pw_impl_link *link);
@@ -35,14 +35,117 @@
 PW_LOG_TOPIC_EXTERN(log_properties);
 #define PW_LOG_TOPIC_DEFAULT log_properties
 
+/* below this many items, a linear scan is as fast as the hash index */
+#define INDEX_MIN_ITEMS	16
+
 /** \cond */
+struct slot {
+	uint32_t hash;
+	uint32_t index;		/* item index + 1, 0 when unused */
+};
+
 struct properties {
 	struct pw_properties this;
 
 	struct pw_array items;
+
+	/* open addressing hash index on the item keys, only made when
+	 * there are enough items */
+	struct slot *slots;
+	uint32_t mask;
+	unsigned int has_dups:1;
 };
 /** \endcond */
 
+static inline uint32_t hash_key(const char *key)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261u;
+	while (*key)
+		h = (h ^ (uint8_t)*key++) * 16777619u;
+	return h;
+}
+
+static const char *slot_key(struct properties *impl, struct slot *s)
+{
+	return pw_array_get_unchecked(&impl->items, s->index - 1, struct spa_dict_item)->key;
+}
+
+static struct slot *index_find(struct properties *impl, const char *key, uint32_t hash)
+{
+	uint32_t pos;
+
+	for (pos = hash & impl->mask; impl->slots[pos].index != 0; pos = (pos + 1) & impl->mask) {
+		struct slot *s = &impl->slots[pos];
+		if (s->hash == hash && spa_streq(slot_key(impl, s), key))
+			return s;
+	}
+	return NULL;
+}
+
+static void index_add(struct properties *impl, uint32_t index)
+{
+	const char *key = pw_array_get_unchecked(&impl->items, index,
+			struct spa_dict_item)->key;
+	uint32_t hash = hash_key(key), pos;
+
+	for (pos = hash & impl->mask; impl->slots[pos].index != 0; pos = (pos + 1) & impl->mask) {
+		struct slot *s = &impl->slots[pos];
+		if (s->hash == hash && spa_streq(slot_key(impl, s), key)) {
+			/* lookups return the first item with a key */
+			impl->has_dups = true;
+			return;
+		}
+	}
+	impl->slots[pos].hash = hash;
+	impl->slots[pos].index = index + 1;
+}
+
+static void index_remove(struct properties *impl, struct slot *s)
+{
+	uint32_t pos = s - impl->slots, next, home;
+
+	/* shift the following entries of the cluster back so that lookups
+	 * don't stop at the hole */
+	for (next = (pos + 1) & impl->mask; impl->slots[next].index != 0;
+	     next = (next + 1) & impl->mask) {
+		home = impl->slots[next].hash & impl->mask;
+		if (((next - home) & impl->mask) >= ((next - pos) & impl->mask)) {
+			impl->slots[pos] = impl->slots[next];
+			pos = next;
+		}
+	}
+	impl->slots[pos].index = 0;
+}
+
+static void index_free(struct properties *impl)
+{
+	free(impl->slots);
+	impl->slots = NULL;
+	impl->mask = 0;
+	impl->has_dups = false;
+}
+
+static void index_rebuild(struct properties *impl)
+{
+	uint32_t i, n_items = impl->this.dict.n_items, size = 64;
+
+	index_free(impl);
+	if (n_items < INDEX_MIN_ITEMS)
+		return;
+
+	while (size < n_items * 2)
+		size <<= 1;
+
+	/* when this fails, we do linear lookups */
+	if ((impl->slots = calloc(size, sizeof(struct slot))) == NULL)
+		return;
+	impl->mask = size - 1;
+
+	for (i = 0; i < n_items; i++)
+		index_add(impl, i);
+}
+
 static int add_func(struct pw_properties *this, char *key, char *value)
 {
 	struct spa_dict_item *item;
@@ -60,6 +163,13 @@ static int add_func(struct pw_properties *this, char *key, char *value)
 
 	this->dict.items = impl->items.data;
 	this->dict.n_items++;
+
+	if (impl->slots == NULL || this->dict.n_items * 2 > impl->mask + 1) {
+		if (this->dict.n_items >= INDEX_MIN_ITEMS)
+			index_rebuild(impl);
+	} else {
+		index_add(impl, this->dict.n_items - 1);
+	}
 	return 0;
 }
 
@@ -71,7 +181,13 @@ static void clear_item(struct spa_dict_item *item)
 
 static int find_index(const struct pw_properties *this, const char *key)
 {
+	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
 	const struct spa_dict_item *item;
+
+	if (impl->slots != NULL) {
+		struct slot *s = index_find(impl, key, hash_key(key));
+		return s ? (int)s->index - 1 : -1;
+	}
 	item = spa_dict_lookup_item(&this->dict, key);
 	if (item == NULL)
 		return -1;
@@ -287,6 +403,7 @@ void pw_properties_clear(struct pw_properties *properties)
 		clear_item(item);
 	pw_array_reset(&impl->items);
 	properties->dict.n_items = 0;
+	index_free(impl);
 }
 
 /** Update properties
@@ -401,15 +518,25 @@ static int do_replace(struct pw_properties *properties, const char *key, char *v
 			goto exit_noupdate;
 
 		if (value == NULL) {
+			uint32_t last_index = pw_array_get_len(&impl->items, struct spa_dict_item) - 1;
 			struct spa_dict_item *last = pw_array_get_unchecked(&impl->items,
-						     pw_array_get_len(&impl->items, struct spa_dict_item) - 1,
-						     struct spa_dict_item);
+						     last_index, struct spa_dict_item);
+
+			if (impl->slots != NULL && !impl->has_dups) {
+				struct slot *s;
+				index_remove(impl, index_find(impl, key, hash_key(key)));
+				if ((uint32_t)index != last_index &&
+				    (s = index_find(impl, last->key, hash_key(last->key))) != NULL)
+					s->index = index + 1;
+			}
 			clear_item(item);
 			item->key = last->key;
 			item->value = last->value;
 			impl->items.size -= sizeof(struct spa_dict_item);
 			properties->dict.n_items--;
 			SPA_FLAG_CLEAR(properties->dict.flags, SPA_DICT_FLAG_SORTED);
+			if (impl->has_dups)
+				index_rebuild(impl);
 		} else {
 			free((char *) item->value);
 			item->value = copy ? strdup(value) : value;
@@ -55,6 +55,8 @@
 #define DEFAULT_MEM_ALLOW_MLOCK			true
 #define DEFAULT_CHECK_QUANTUM			false
 #define DEFAULT_CHECK_RATE			false
+#define DEFAULT_COALESCE_UPDATES		false
+#define DEFAULT_UPDATE_INTERVAL			0u
 
 struct impl {
 	struct pw_context *context;
@@ -242,6 +244,8 @@ void pw_settings_init(struct pw_context *this)
 
 	d->check_quantum = get_default_bool(p, "settings.check-quantum", DEFAULT_CHECK_QUANTUM);
 	d->check_rate = get_default_bool(p, "settings.check-rate", DEFAULT_CHECK_RATE);
+	d->coalesce_updates = get_default_bool(p, "settings.coalesce-updates", DEFAULT_COALESCE_UPDATES);
+	d->update_interval = get_default_int(p, "settings.update-interval", DEFAULT_UPDATE_INTERVAL);
 
 	d->clock_quantum_limit = SPA_CLAMP(d->clock_quantum_limit,
 			CLOCK_MIN_QUANTUM, CLOCK_MAX_QUANTUM);
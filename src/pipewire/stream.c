@@ -1389,9 +1389,6 @@ stream_new(struct pw_context *context, const char *name,
 	impl->allow_mlock = context->settings.mem_allow_mlock;
 	impl->warn_mlock = context->settings.mem_warn_mlock;
 
-	spa_hook_list_append(&impl->context->driver_listener_list,
-			&impl->context_listener,
-			&context_events, impl);
 	return impl;
 
 error_properties:
@@ -1523,8 +1520,6 @@ void pw_stream_destroy(struct pw_stream *stream)
 	spa_hook_list_clean(&impl->hooks);
 	spa_hook_list_clean(&stream->listener_list);
 
-	spa_hook_remove(&impl->context_listener);
-
 	if (impl->data.context)
 		pw_context_destroy(impl->data.context);
 
@@ -1859,6 +1854,11 @@ pw_stream_connect(struct pw_stream *stream,
 		pw_properties_free(props);
 		props = NULL;
 	}
+	/* the driver events are emitted on the data loop of the node */
+	spa_hook_list_append(impl->node->rt.driver_listener_list,
+			&impl->context_listener,
+			&context_events, impl);
+
 	pw_impl_node_set_active(impl->node,
 			!SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_INACTIVE));
 
@@ -1918,6 +1918,7 @@ int pw_stream_disconnect(struct pw_stream *stream)
 	}
 
 	if (impl->node) {
+		spa_hook_remove(&impl->context_listener);
 		pw_impl_node_destroy(impl->node);
 		impl->node = NULL;
 	}
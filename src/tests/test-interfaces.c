@@ -51,6 +51,9 @@ static void test_core_abi(void)
 				       const struct spa_dict *props,
 				       size_t user_data_size);
 		int (*destroy) (void *object, void *proxy);
+		struct pw_registry * (*get_registry_filter) (void *object,
+				uint32_t version, const struct spa_dict *filter,
+				size_t user_data_size);
 	} methods = { PW_VERSION_CORE_METHODS, };
 	static const struct {
 		uint32_t version;
@@ -76,7 +79,8 @@ static void test_core_abi(void)
 	TEST_FUNC(m, methods, get_registry);
 	TEST_FUNC(m, methods, create_object);
 	TEST_FUNC(m, methods, destroy);
-	spa_assert_se(PW_VERSION_CORE_METHODS == 0);
+	TEST_FUNC(m, methods, get_registry_filter);
+	spa_assert_se(PW_VERSION_CORE_METHODS == 1);
 	spa_assert_se(sizeof(m) == sizeof(methods));
 
 	TEST_FUNC(e, events, version);
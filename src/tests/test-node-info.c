@@ -0,0 +1,200 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+
+/* a node that only has info, the param info is changed by the test */
+struct test_node {
+	struct spa_node node;
+	struct spa_hook_list hooks;
+	struct spa_param_info params[1];
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	int pending;
+
+	struct pw_registry *registry;
+	struct pw_node *node;
+	struct spa_hook node_listener;
+	uint32_t n_param_info;
+	uint32_t param_flags;
+};
+
+static void emit_node_info(struct test_node *n)
+{
+	struct spa_node_info info = SPA_NODE_INFO_INIT();
+
+	info.change_mask = SPA_NODE_CHANGE_MASK_PARAMS;
+	info.params = n->params;
+	info.n_params = SPA_N_ELEMENTS(n->params);
+	spa_node_emit_info(&n->hooks, &info);
+}
+
+static int test_node_add_listener(void *object, struct spa_hook *listener,
+		const struct spa_node_events *events, void *data)
+{
+	struct test_node *n = object;
+	struct spa_hook_list save;
+
+	spa_hook_list_isolate(&n->hooks, &save, listener, events, data);
+	emit_node_info(n);
+	spa_hook_list_join(&n->hooks, &save);
+	return 0;
+}
+
+static const struct spa_node_methods test_node_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = test_node_add_listener,
+};
+
+static void test_node_toggle_serial(struct test_node *n)
+{
+	n->params[0].flags ^= SPA_PARAM_INFO_SERIAL;
+	emit_node_info(n);
+}
+
+static void node_info(void *data, const struct pw_node_info *info)
+{
+	struct data *d = data;
+
+	if (!(info->change_mask & PW_NODE_CHANGE_MASK_PARAMS))
+		return;
+	spa_assert_se(info->n_params == 1);
+	d->n_param_info++;
+	d->param_flags = info->params[0].flags;
+}
+
+static const struct pw_node_events node_events = {
+	PW_VERSION_NODE_EVENTS,
+	.info = node_info,
+};
+
+static void core_done(void *data, uint32_t id, int seq)
+{
+	struct data *d = data;
+	if (id == PW_ID_CORE && seq == d->pending)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = core_done,
+};
+
+static void roundtrip(struct data *d)
+{
+	d->pending = pw_core_sync(d->core, PW_ID_CORE, 0);
+	pw_main_loop_run(d->loop);
+}
+
+static void test_coalesce_serial(void)
+{
+	struct data d;
+	struct test_node n;
+	struct pw_impl_node *node;
+	uint32_t flags;
+
+	spa_zero(d);
+	d.loop = pw_main_loop_new(NULL);
+	d.context = pw_context_new(pw_main_loop_get_loop(d.loop),
+			pw_properties_new("settings.coalesce-updates", "true", NULL), 0);
+	spa_assert_se(d.context != NULL);
+
+	spa_zero(n);
+	n.node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node, SPA_VERSION_NODE,
+			&test_node_methods, &n);
+	spa_hook_list_init(&n.hooks);
+	n.params[0] = SPA_PARAM_INFO(SPA_PARAM_Props, SPA_PARAM_INFO_READWRITE);
+
+	node = pw_context_create_node(d.context, NULL, 0);
+	spa_assert_se(node != NULL);
+	spa_assert_se(pw_impl_node_set_implementation(node, &n.node) >= 0);
+	spa_assert_se(pw_impl_node_register(node, NULL) >= 0);
+
+	d.core = pw_context_connect_self(d.context, NULL, 0);
+	spa_assert_se(d.core != NULL);
+	pw_core_add_listener(d.core, &d.core_listener, &core_events, &d);
+
+	d.registry = pw_core_get_registry(d.core, PW_VERSION_REGISTRY, 0);
+	spa_assert_se(d.registry != NULL);
+	d.node = pw_registry_bind(d.registry,
+			pw_global_get_id(pw_impl_node_get_global(node)),
+			PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, 0);
+	spa_assert_se(d.node != NULL);
+	pw_node_add_listener(d.node, &d.node_listener, &node_events, &d);
+	roundtrip(&d);
+
+	spa_assert_se(d.n_param_info == 1);
+	flags = d.param_flags;
+
+	/* one change is sent as it is */
+	test_node_toggle_serial(&n);
+	roundtrip(&d);
+	spa_assert_se(d.n_param_info == 2);
+	spa_assert_se(d.param_flags != flags);
+	flags = d.param_flags;
+
+	/* two changes are merged into one event, the flags must still be
+	 * different from the ones that were sent last */
+	test_node_toggle_serial(&n);
+	test_node_toggle_serial(&n);
+	roundtrip(&d);
+	spa_assert_se(d.n_param_info == 3);
+	spa_assert_se(d.param_flags != flags);
+	flags = d.param_flags;
+
+	/* and the next single change after that is also seen */
+	test_node_toggle_serial(&n);
+	roundtrip(&d);
+	spa_assert_se(d.n_param_info == 4);
+	spa_assert_se(d.param_flags != flags);
+
+	spa_hook_remove(&d.node_listener);
+	pw_proxy_destroy((struct pw_proxy*)d.node);
+	pw_proxy_destroy((struct pw_proxy*)d.registry);
+	spa_hook_remove(&d.core_listener);
+	pw_impl_node_destroy(node);
+	pw_context_destroy(d.context);
+	pw_main_loop_destroy(d.loop);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	alarm(5); /* watchdog; terminate after 5 seconds */
+	test_coalesce_serial();
+
+	return 0;
+}
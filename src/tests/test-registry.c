@@ -0,0 +1,187 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+#include <spa/utils/string.h>
+
+#define MODULE_NAME	"libpipewire-module-link-factory"
+
+struct registry_data {
+	struct pw_registry *registry;
+	struct spa_hook registry_listener;
+	uint32_t n_globals;
+	uint32_t n_modules;
+	uint32_t n_removed;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	int pending;
+};
+
+static void registry_global(void *data, uint32_t id,
+		uint32_t permissions, const char *type, uint32_t version,
+		const struct spa_dict *props)
+{
+	struct registry_data *r = data;
+	r->n_globals++;
+	if (spa_streq(type, PW_TYPE_INTERFACE_Module))
+		r->n_modules++;
+}
+
+static void registry_global_remove(void *data, uint32_t id)
+{
+	struct registry_data *r = data;
+	r->n_removed++;
+}
+
+static const struct pw_registry_events registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = registry_global,
+	.global_remove = registry_global_remove,
+};
+
+static void core_done(void *data, uint32_t id, int seq)
+{
+	struct data *d = data;
+	if (id == PW_ID_CORE && seq == d->pending)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = core_done,
+};
+
+static void roundtrip(struct data *d)
+{
+	d->pending = pw_core_sync(d->core, PW_ID_CORE, 0);
+	pw_main_loop_run(d->loop);
+}
+
+static void registry_init(struct data *d, struct registry_data *r,
+		const struct spa_dict *filter)
+{
+	spa_zero(*r);
+	r->registry = pw_core_get_registry_filter(d->core, PW_VERSION_REGISTRY, filter, 0);
+	spa_assert_se(r->registry != NULL);
+	pw_registry_add_listener(r->registry, &r->registry_listener,
+			&registry_events, r);
+}
+
+static void registry_clear(struct registry_data *r)
+{
+	spa_hook_remove(&r->registry_listener);
+	pw_proxy_destroy((struct pw_proxy*)r->registry);
+}
+
+static void test_registry_filter(void)
+{
+	struct data d;
+	struct registry_data all, modules, named, none;
+	static const struct spa_dict_item modules_items[] = {
+		{ PW_REGISTRY_FILTER_TYPE, "*:Factory:Nothing|" PW_TYPE_INTERFACE_Module },
+	};
+	static const struct spa_dict_item named_items[] = {
+		{ PW_REGISTRY_FILTER_TYPE, "PipeWire:Interface:*" },
+		{ PW_KEY_MODULE_NAME, "*-protocol-native" },
+	};
+	static const struct spa_dict_item none_items[] = {
+		{ "test.not-a-key", "*" },
+	};
+	struct pw_impl_module *module;
+	uint32_t n_all, n_modules;
+
+	spa_zero(d);
+	d.loop = pw_main_loop_new(NULL);
+	d.context = pw_context_new(pw_main_loop_get_loop(d.loop), NULL, 0);
+	spa_assert_se(d.context != NULL);
+
+	d.core = pw_context_connect_self(d.context, NULL, 0);
+	spa_assert_se(d.core != NULL);
+	pw_core_add_listener(d.core, &d.core_listener, &core_events, &d);
+
+	/* the filter is applied to the initial enumeration */
+	registry_init(&d, &all, NULL);
+	registry_init(&d, &modules, &SPA_DICT_INIT_ARRAY(modules_items));
+	registry_init(&d, &named, &SPA_DICT_INIT_ARRAY(named_items));
+	registry_init(&d, &none, &SPA_DICT_INIT_ARRAY(none_items));
+	roundtrip(&d);
+
+	spa_assert_se(all.n_modules > 1);
+	spa_assert_se(all.n_globals > all.n_modules);
+	spa_assert_se(modules.n_globals == all.n_modules);
+	spa_assert_se(modules.n_modules == all.n_modules);
+	spa_assert_se(named.n_globals == 1);
+	spa_assert_se(named.n_modules == 1);
+	spa_assert_se(none.n_globals == 0);
+
+	/* new globals are only emitted when they match, the module also
+	 * creates a factory */
+	n_all = all.n_globals;
+	n_modules = modules.n_globals;
+	module = pw_context_load_module(d.context, MODULE_NAME, NULL, NULL);
+	spa_assert_se(module != NULL);
+	roundtrip(&d);
+
+	spa_assert_se(all.n_globals == n_all + 2);
+	spa_assert_se(modules.n_globals == n_modules + 1);
+	spa_assert_se(modules.n_globals == all.n_modules);
+	spa_assert_se(named.n_globals == 1);
+	spa_assert_se(none.n_globals == 0);
+
+	/* only the matching globals are removed */
+	pw_impl_module_destroy(module);
+	roundtrip(&d);
+
+	spa_assert_se(all.n_removed == 2);
+	spa_assert_se(modules.n_removed == 1);
+	spa_assert_se(named.n_removed == 0);
+	spa_assert_se(none.n_removed == 0);
+
+	registry_clear(&all);
+	registry_clear(&modules);
+	registry_clear(&named);
+	registry_clear(&none);
+	spa_hook_remove(&d.core_listener);
+	pw_context_destroy(d.context);
+	pw_main_loop_destroy(d.loop);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	alarm(5); /* watchdog; terminate after 5 seconds */
+	test_registry_filter();
+
+	return 0;
+}
@@ -45,6 +45,21 @@ struct driver {
 	uint32_t xrun_count;
 };
 
+struct pending {
+	uint32_t incomplete_count;
+	int64_t time;
+	uint32_t id;
+	char name[MAX_NAME];
+	int32_t status;
+};
+
+struct histogram {
+	bool valid;
+	int64_t max;
+	uint32_t base[SPA_PROFILER_HISTOGRAM_BUCKETS];	/* counts when we started */
+	uint32_t counts[SPA_PROFILER_HISTOGRAM_BUCKETS];
+};
+
 struct measurement {
 	int32_t index;
 	int32_t status;
@@ -65,6 +80,10 @@ struct node {
 	struct node *driver;
 	uint32_t errors;
 	int32_t last_error_status;
+	struct pending pending;
+	uint32_t pending_count;
+	struct histogram wait;
+	struct histogram busy;
 };
 
 struct data {
@@ -86,6 +105,8 @@ struct data {
 	int n_nodes;
 	struct spa_list node_list;
 
+	bool show_wait;
+
 	WINDOW *win;
 };
 
@@ -224,6 +245,82 @@ static int process_follower_block(struct data *d, const struct spa_pod *pod, str
 	return 0;
 }
 
+static int process_driver_xrun(struct data *d, const struct spa_pod *pod, struct point *point)
+{
+	struct pending p;
+	const char *name = NULL;
+	int res;
+
+	spa_zero(p);
+	if ((res = spa_pod_parse_struct(pod,
+			SPA_POD_Int(&p.incomplete_count),
+			SPA_POD_Long(&p.time),
+			SPA_POD_Int(&p.id),
+			SPA_POD_OPT_String(&name),
+			SPA_POD_Int(&p.status))) < 0)
+		return res;
+
+	if (point->driver == NULL)
+		return -ENOENT;
+
+	if (name)
+		strncpy(p.name, name, MAX_NAME-1);
+	else
+		snprintf(p.name, sizeof(p.name), "%u", p.id);
+	point->driver->pending = p;
+	return 0;
+}
+
+static void update_histogram(struct histogram *h, int64_t max, const uint32_t *counts, uint32_t n_counts)
+{
+	uint32_t i;
+
+	n_counts = SPA_MIN(n_counts, (uint32_t)SPA_PROFILER_HISTOGRAM_BUCKETS);
+	for (i = 0; i < n_counts; i++) {
+		/* take the first values as the base or restart when the
+		 * node was recreated */
+		if (!h->valid || counts[i] < h->counts[i]) {
+			memcpy(h->base, counts, n_counts * sizeof(uint32_t));
+			break;
+		}
+	}
+	memcpy(h->counts, counts, n_counts * sizeof(uint32_t));
+	h->max = max;
+	h->valid = true;
+}
+
+static int process_follower_histogram(struct data *d, const struct spa_pod *pod, struct point *point)
+{
+	uint32_t id = 0, pending_count = 0;
+	uint32_t *wait = NULL, *busy = NULL, n_wait = 0, n_busy = 0;
+	int64_t wait_max = 0, busy_max = 0;
+	struct spa_pod *wait_pod = NULL, *busy_pod = NULL;
+	struct node *n;
+	int res;
+
+	if ((res = spa_pod_parse_struct(pod,
+			SPA_POD_Int(&id),
+			SPA_POD_Int(&pending_count),
+			SPA_POD_Long(&wait_max),
+			SPA_POD_Long(&busy_max),
+			SPA_POD_Pod(&wait_pod),
+			SPA_POD_Pod(&busy_pod))) < 0)
+		return res;
+
+	if ((n = find_node(d, id)) == NULL)
+		return -ENOENT;
+
+	wait = spa_pod_get_array(wait_pod, &n_wait);
+	busy = spa_pod_get_array(busy_pod, &n_busy);
+	if (wait == NULL || busy == NULL)
+		return -EINVAL;
+
+	n->pending_count = pending_count;
+	update_histogram(&n->wait, wait_max, wait, n_wait);
+	update_histogram(&n->busy, busy_max, busy, n_busy);
+	return 0;
+}
+
 static const char *print_time(char *buf, size_t len, uint64_t val)
 {
 	if (val < 1000000llu)
@@ -241,6 +338,40 @@ static const char *print_perc(char *buf, size_t len, float val, float quantum)
 	return buf;
 }
 
+static uint64_t histogram_percentile(const struct histogram *h, uint32_t perc)
+{
+	uint64_t total = 0, count = 0, target;
+	uint32_t i;
+
+	for (i = 0; i < SPA_PROFILER_HISTOGRAM_BUCKETS; i++)
+		total += h->counts[i] - h->base[i];
+	if (total == 0)
+		return 0;
+
+	target = (total * perc + 99) / 100;
+	for (i = 0; i < SPA_PROFILER_HISTOGRAM_BUCKETS; i++) {
+		count += h->counts[i] - h->base[i];
+		if (count >= target)
+			break;
+	}
+	return SPA_MIN(spa_profiler_histogram_bucket_max(i), (uint64_t)h->max);
+}
+
+static const char *print_histogram(char *buf, size_t len, const struct histogram *h)
+{
+	char b1[16], b2[16], b3[16];
+
+	if (!h->valid) {
+		snprintf(buf, len, "%8s %8s %8s", "--", "--", "--");
+		return buf;
+	}
+	snprintf(buf, len, "%s %s %s",
+			print_time(b1, sizeof(b1), histogram_percentile(h, 50)),
+			print_time(b2, sizeof(b2), histogram_percentile(h, 99)),
+			print_time(b3, sizeof(b3), h->max));
+	return buf;
+}
+
 static void print_node(struct data *d, struct driver *i, struct node *n)
 {
 	char line[1024];
@@ -248,6 +379,7 @@ static void print_node(struct data *d, struct driver *i, struct node *n)
 	char buf2[64];
 	char buf3[64];
 	char buf4[64];
+	char buf5[64];
 	float waiting, busy, quantum;
 	struct spa_fraction frac;
 
@@ -264,7 +396,7 @@ static void print_node(struct data *d, struct driver *i, struct node *n)
 	waiting = (n->measurement.awake - n->measurement.signal) / 1000000000.f,
 	busy = (n->measurement.finish - n->measurement.awake) / 1000000000.f,
 
-	snprintf(line, sizeof(line), "%s %4.1u %6.1u %6.1u %s %s %s %s  %3.1u  %s%s",
+	snprintf(line, sizeof(line), "%s %4.1u %6.1u %6.1u %s %s %s %s %s  %3.1u  %s%s",
 			n->measurement.status != 3 ? "!" : " ",
 			n->id,
 			frac.num, frac.denom,
@@ -272,6 +404,7 @@ static void print_node(struct data *d, struct driver *i, struct node *n)
 			print_time(buf2, 64, n->measurement.finish - n->measurement.awake),
 			print_perc(buf3, 64, waiting, quantum),
 			print_perc(buf4, 64, busy, quantum),
+			print_histogram(buf5, 64, d->show_wait ? &n->wait : &n->busy),
 			i->xrun_count + n->errors,
 			n->driver == n ? "" : " + ",
 			n->name);
@@ -285,7 +418,9 @@ static void do_refresh(struct data *d)
 
 	wclear(d->win);
 	wattron(d->win, A_REVERSE);
-	wprintw(d->win, "%-*.*s", COLS, COLS, "S   ID  QUANT   RATE    WAIT    BUSY   W/Q   B/Q  ERR  NAME ");
+	wprintw(d->win, "%-*.*s", COLS, COLS, d->show_wait ?
+			"S   ID  QUANT   RATE    WAIT    BUSY   W/Q   B/Q   W-P50    W-P99    W-MAX  ERR  NAME " :
+			"S   ID  QUANT   RATE    WAIT    BUSY   W/Q   B/Q   B-P50    B-P99    B-MAX  ERR  NAME ");
 	wattroff(d->win, A_REVERSE);
 	wprintw(d->win, "\n");
 
@@ -302,6 +437,23 @@ static void do_refresh(struct data *d)
 			print_node(d, &n->info, f);
 		}
 	}
+
+	wprintw(d->win, "\n");
+	spa_list_for_each(n, &d->node_list, link) {
+		struct node *p;
+		char line[1024];
+
+		if (n->driver != n || n->pending.incomplete_count == 0)
+			continue;
+
+		p = find_node(d, n->pending.id);
+		snprintf(line, sizeof(line), "%s: %u incomplete cycles, last pending: %s (%u) %s, pending %u times",
+				n->name, n->pending.incomplete_count,
+				n->pending.name, n->pending.id,
+				n->pending.status == 1 ? "triggered" : "awake",
+				p ? p->pending_count : 0);
+		wprintw(d->win, "%.*s\n", COLS-1, line);
+	}
 	wrefresh(d->win);
 }
 
@@ -335,9 +487,15 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 			case SPA_PROFILER_driverBlock:
 				res = process_driver_block(d, &p->value, &point);
 				break;
+			case SPA_PROFILER_driverXrun:
+				process_driver_xrun(d, &p->value, &point);
+				break;
 			case SPA_PROFILER_followerBlock:
 				process_follower_block(d, &p->value, &point);
 				break;
+			case SPA_PROFILER_followerHistogram:
+				process_follower_histogram(d, &p->value, &point);
+				break;
 			default:
 				break;
 			}
@@ -476,6 +634,10 @@ static void do_handle_io(void *data, int fd, uint32_t mask)
 		case 'q':
 			pw_main_loop_quit(d->loop);
 			break;
+		case 'w':
+			d->show_wait = !d->show_wait;
+			do_refresh(d);
+			break;
 		default:
 			do_refresh(d);
 			break;
@@ -494,6 +656,9 @@ int main(int argc, char *argv[])
 		{ "remote",	required_argument,	NULL, 'r' },
 		{ NULL, 0, NULL, 0}
 	};
+	static const struct spa_dict_item registry_filter[] = {
+		{ PW_REGISTRY_FILTER_TYPE, PW_TYPE_INTERFACE_Node "|" PW_TYPE_INTERFACE_Profiler },
+	};
 	int c;
 	struct timespec value, interval;
 	struct node *n;
@@ -556,8 +721,9 @@ int main(int argc, char *argv[])
 	pw_core_add_listener(data.core,
 				   &data.core_listener,
 				   &core_events, &data);
-	data.registry = pw_core_get_registry(data.core,
-					  PW_VERSION_REGISTRY, 0);
+	data.registry = pw_core_get_registry_filter(data.core,
+					  PW_VERSION_REGISTRY,
+					  &SPA_DICT_INIT_ARRAY(registry_filter), 0);
 	pw_registry_add_listener(data.registry,
 				       &data.registry_listener,
 				       &registry_events, &data);
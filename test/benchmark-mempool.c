@@ -0,0 +1,156 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <spa/buffer/buffer.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/mem.h>
+
+#define MAX_COUNT 1000000
+
+/* Measures the lookup functions of a mempool with many blocks, like a client
+ * with many ports and buffers has. Every block is mapped and has a tagged
+ * memmap so that pointer, fd and tag lookups all have work to do. */
+
+struct block {
+	struct pw_memblock *mem;
+	struct pw_memmap *map;
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void test_lookup(uint32_t n_blocks)
+{
+	struct pw_mempool *pool;
+	struct block *blocks;
+	uint64_t t1, t2;
+	uint32_t i, j;
+
+	pool = pw_mempool_new(NULL);
+	spa_assert_se(pool != NULL);
+
+	blocks = calloc(n_blocks, sizeof(struct block));
+	spa_assert_se(blocks != NULL);
+
+	for (i = 0; i < n_blocks; i++) {
+		uint32_t tag[5] = { i / 8 + 1, i % 8, SPA_ID_INVALID, 0, 0 };
+
+		blocks[i].mem = pw_mempool_alloc(pool,
+				PW_MEMBLOCK_FLAG_READWRITE |
+				PW_MEMBLOCK_FLAG_SEAL |
+				PW_MEMBLOCK_FLAG_MAP,
+				SPA_DATA_MemFd, 4096);
+		spa_assert_se(blocks[i].mem != NULL);
+		blocks[i].map = pw_mempool_map_id(pool, blocks[i].mem->id,
+				PW_MEMMAP_FLAG_READWRITE, 1024, 1024, tag);
+		spa_assert_se(blocks[i].map != NULL);
+	}
+
+	t1 = get_time_ns();
+	for (i = 0, j = 0; i < MAX_COUNT; i++, j = (j + 7919) % n_blocks) {
+		struct block *b = &blocks[j];
+		void *ptr = SPA_PTROFF(b->map->ptr, i % 1024, void);
+		spa_assert_se(pw_mempool_find_ptr(pool, ptr) == b->mem);
+	}
+	t2 = get_time_ns();
+	fprintf(stderr, "%5u blocks: find_ptr %7.1f nsec/lookup\n",
+			n_blocks, (double)(t2 - t1) / MAX_COUNT);
+
+	t1 = get_time_ns();
+	for (i = 0, j = 0; i < MAX_COUNT; i++, j = (j + 7919) % n_blocks) {
+		struct block *b = &blocks[j];
+		spa_assert_se(pw_mempool_find_fd(pool, b->mem->fd) == b->mem);
+	}
+	t2 = get_time_ns();
+	fprintf(stderr, "%5u blocks: find_fd  %7.1f nsec/lookup\n",
+			n_blocks, (double)(t2 - t1) / MAX_COUNT);
+
+	t1 = get_time_ns();
+	for (i = 0, j = 0; i < MAX_COUNT; i++, j = (j + 7919) % n_blocks) {
+		struct block *b = &blocks[j];
+		uint32_t tag[5] = { j / 8 + 1, j % 8, SPA_ID_INVALID, 0, 0 };
+		spa_assert_se(pw_mempool_find_tag(pool, tag, sizeof(tag)) == b->map);
+	}
+	t2 = get_time_ns();
+	fprintf(stderr, "%5u blocks: find_tag %7.1f nsec/lookup\n",
+			n_blocks, (double)(t2 - t1) / MAX_COUNT);
+
+	/* remove all memmaps by the first tag word, like when a node
+	 * clears its buffers */
+	t1 = get_time_ns();
+	for (i = 0; i < (n_blocks + 7) / 8; i++) {
+		uint32_t tag[5] = { i + 1, 0, 0, 0, 0 };
+		struct pw_memmap *mm;
+
+		while ((mm = pw_mempool_find_tag(pool, tag, sizeof(uint32_t))) != NULL)
+			pw_memmap_free(mm);
+	}
+	t2 = get_time_ns();
+	fprintf(stderr, "%5u blocks: clear tags %7.1f usec\n",
+			n_blocks, (double)(t2 - t1) / 1000.0);
+
+	for (i = 0; i < n_blocks; i++) {
+		struct block *b = &blocks[i];
+		spa_assert_se(pw_mempool_find_ptr(pool, b->mem->map->ptr) == b->mem);
+		pw_memblock_unref(b->mem);
+	}
+
+	free(blocks);
+	pw_mempool_destroy(pool);
+}
+
+int main(int argc, char *argv[])
+{
+	struct rlimit rl;
+	uint32_t max_blocks = 4096;
+
+	pw_init(&argc, &argv);
+
+	/* every block has an fd */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		if (rl.rlim_cur < max_blocks + 64)
+			max_blocks = rl.rlim_cur - 64;
+	}
+
+	test_lookup(SPA_MIN(256u, max_blocks));
+	test_lookup(SPA_MIN(1024u, max_blocks));
+	test_lookup(max_blocks);
+
+	pw_deinit();
+
+	return 0;
+}
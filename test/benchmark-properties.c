@@ -0,0 +1,130 @@
+/* PipeWire
+ *
+ * Copyright © 2022 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <spa/utils/dict.h>
+#include <spa/utils/string.h>
+
+#include <pipewire/properties.h>
+
+#define MAX_COUNT 1000000
+#define MAX_ITEMS 1000
+
+/* Measures pw_properties lookups and updates at the sizes session managers
+ * see when matching rules on objects, against a linear spa_dict lookup on
+ * the same items. */
+
+static char keys[MAX_ITEMS][32];
+
+static const char * const prefixes[] = {
+	"node.", "media.", "audio.", "device.", "object.", "api.alsa.", "factory.",
+};
+
+static void gen_keys(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < MAX_ITEMS; i++)
+		snprintf(keys[i], sizeof(keys[i]), "%s%u.name",
+				prefixes[i % SPA_N_ELEMENTS(prefixes)], i);
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void test_properties(uint32_t n_items)
+{
+	struct pw_properties *props;
+	uint64_t t1, t2, t3, t4;
+	uint32_t i, idx;
+
+	props = pw_properties_new(NULL, NULL);
+	spa_assert_se(props != NULL);
+
+	for (i = 0; i < n_items; i++)
+		pw_properties_set(props, keys[i], keys[i]);
+
+	t1 = get_time_ns();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_items;
+		spa_assert_se(spa_streq(spa_dict_lookup(&props->dict, keys[idx]), keys[idx]));
+	}
+	t2 = get_time_ns();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_items;
+		spa_assert_se(spa_streq(pw_properties_get(props, keys[idx]), keys[idx]));
+	}
+	t3 = get_time_ns();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_items;
+		pw_properties_set(props, keys[idx], (i & 1) ? "1" : "0");
+	}
+	t4 = get_time_ns();
+
+	fprintf(stderr, "%4u items: dict lookup %6.1f, get %6.1f, set %6.1f nsec/op\n",
+			n_items, (double)(t2 - t1) / MAX_COUNT,
+			(double)(t3 - t2) / MAX_COUNT,
+			(double)(t4 - t3) / MAX_COUNT);
+
+	/* remove and add back half of the keys */
+	t1 = get_time_ns();
+	for (i = 0; i < n_items; i += 2)
+		spa_assert_se(pw_properties_set(props, keys[i], NULL) == 1);
+	for (i = 0; i < n_items; i += 2)
+		spa_assert_se(pw_properties_set(props, keys[i], keys[i]) == 1);
+	t2 = get_time_ns();
+
+	for (i = 0; i < n_items; i++)
+		spa_assert_se(pw_properties_get(props, keys[i]) != NULL);
+	spa_assert_se(props->dict.n_items == n_items);
+
+	fprintf(stderr, "%4u items: remove/add %6.1f nsec/op\n",
+			n_items, (double)(t2 - t1) / n_items);
+
+	pw_properties_free(props);
+}
+
+int main(int argc, char *argv[])
+{
+	gen_keys();
+
+	/* warmup */
+	test_properties(100);
+
+	test_properties(10);
+	test_properties(20);
+	test_properties(50);
+	test_properties(100);
+	test_properties(1000);
+
+	return 0;
+}
@@ -30,6 +30,7 @@
 
 #include <pipewire/pipewire.h>
 #include <pipewire/global.h>
+#include <pipewire/private.h>
 
 #define TEST_FUNC(a,b,func)	\
 do {				\
@@ -266,12 +267,50 @@ PWTEST(context_support)
 	return PWTEST_PASS;
 }
 
+PWTEST(context_node_activation)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_impl_node *node;
+	size_t old_size;
+
+	/* the stats come after the fields of older versions, an activation of
+	 * an older version doesn't have them */
+	old_size = SPA_ROUND_UP_N(offsetof(struct pw_node_activation, reposition_owner) +
+			sizeof(uint32_t), sizeof(uint64_t));
+	pwtest_int_le(old_size, offsetof(struct pw_node_activation, wait_histogram));
+	pwtest_bool_false(pw_node_activation_has_stats(old_size));
+	pwtest_bool_false(pw_node_activation_has_stats(PW_NODE_ACTIVATION_STATS_SIZE - 1));
+	pwtest_bool_true(pw_node_activation_has_stats(sizeof(struct pw_node_activation)));
+
+	pw_init(0, NULL);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop), NULL, 0);
+	pwtest_ptr_notnull(context);
+
+	/* the activation of a local node is complete */
+	node = pw_context_create_node(context, NULL, 0);
+	pwtest_ptr_notnull(node);
+	pwtest_bool_true(node->rt.activation_stats);
+	pwtest_bool_true(node->rt.target.has_stats);
+	pw_impl_node_destroy(node);
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(context)
 {
 	pwtest_add(context_abi, PWTEST_NOARG);
 	pwtest_add(context_create, PWTEST_NOARG);
 	pwtest_add(context_properties, PWTEST_NOARG);
 	pwtest_add(context_support, PWTEST_NOARG);
+	pwtest_add(context_node_activation, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
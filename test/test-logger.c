@@ -26,6 +26,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <spa/utils/ansi.h>
@@ -38,6 +39,8 @@
 #include <systemd/sd-journal.h>
 #endif
 
+#include "../spa/plugins/support/log-trace.h"
+
 PWTEST(logger_truncate_long_lines)
 {
 	struct pwtest_spa_plugin *plugin;
@@ -627,6 +630,220 @@ cleanup:
 	return result;
 }
 
+static int trace_encode(void *buffer, size_t size, const char *fmt, ...)
+{
+	va_list args;
+	int res;
+
+	va_start(args, fmt);
+	res = support_log_trace_encode(buffer, size, fmt, args);
+	va_end(args);
+	return res;
+}
+
+static SPA_PRINTF_FUNC(1,2) void
+check_trace_encoding(const char *fmt, ...)
+{
+	uint8_t buffer[1024];
+	char msg[1024], expected[1024];
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	vsnprintf(expected, sizeof(expected), fmt, args);
+	va_end(args);
+
+	va_start(args, fmt);
+	len = support_log_trace_encode(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+	pwtest_int_ge(len, 0);
+
+	pwtest_int_ge(support_log_trace_format(msg, sizeof(msg), fmt, buffer, len), 0);
+	pwtest_str_eq(msg, expected);
+}
+
+PWTEST(logger_trace_encoding)
+{
+	const char *str = "string";
+	uint8_t buffer[64];
+
+	check_trace_encoding("no arguments");
+	check_trace_encoding("%d %i %5d %-5d| %+d %05d", -12, 34, 5, 6, 7, -8);
+	check_trace_encoding("%u %o %x %X %#x %#o", 1u, 8u, 0xabu, 0xCDu, 0x1fu, 9u);
+	check_trace_encoding("%hhd %hhu %hd %hu", (signed char)-3, (unsigned char)250,
+			(short)-300, (unsigned short)65000);
+	check_trace_encoding("%ld %lu %lld %llu %lx", -1234567890L, 4000000000UL,
+			-9000000000000LL, 18000000000000000000ULL, 0xdeadbeefUL);
+	check_trace_encoding("%zd %zu %jd %ju %td", (ssize_t)-5, (size_t)6,
+			(intmax_t)-7, (uintmax_t)8, (ptrdiff_t)-9);
+	check_trace_encoding("%c%c%c", 'a', 'b', 'c');
+	check_trace_encoding("%f %.3f %e %E %g %G %a", 1.5, 2.25, 31415.9, 0.001, 1e10, 2e-5, 1.0);
+	check_trace_encoding("%Lf", (long double)1.25);
+	check_trace_encoding("%p %p", (void *)0x1234, NULL);
+	check_trace_encoding("%s|%10s|%-10s|%.3s", str, str, str, str);
+	check_trace_encoding("%*d|%-*d|%.*f|%*.*s", 6, 42, 6, 42, 2, 3.14159, 8, 3, str);
+	check_trace_encoding("100%% %d%%", 50);
+	errno = EINVAL;
+	check_trace_encoding("error: %m");
+
+	/* strings are copied */
+	check_trace_encoding("%s", (char[]){ "a copied string" });
+
+	/* wide strings and %n can't be encoded, the logger formats those
+	 * messages in place */
+	pwtest_neg_errno_check(trace_encode(buffer, sizeof(buffer), "%ls", L"wide"), -ENOTSUP);
+	pwtest_neg_errno_check(trace_encode(buffer, sizeof(buffer), "%d %n", 1, NULL), -ENOTSUP);
+	pwtest_neg_errno_check(trace_encode(buffer, 8, "%d %d", 1, 2), -ENOSPC);
+
+	return PWTEST_PASS;
+}
+
+/* The strings of a binary trace message are copied, they can be gone
+ * when the message is formatted */
+PWTEST(logger_binary_trace)
+{
+	struct pwtest_spa_plugin *plugin;
+	void *iface;
+	char fname[PATH_MAX];
+	struct spa_dict_item items[4];
+	struct spa_dict info;
+	char buffer[1024];
+	char topic_name[] = "test.topic", file[] = "test-file.c";
+	char func[] = "test_func", fmt[] = "MARK %d %s";
+	struct spa_log_topic topic = SPA_LOG_TOPIC(0, topic_name);
+	FILE *fp;
+	bool mark_line_found = false;
+
+	pw_init(0, NULL);
+
+	pwtest_mkstemp(fname);
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_FILE, fname);
+	items[1] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LEVEL, "5");
+	items[2] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_BINARY_TRACE, "true");
+	items[3] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LINE, "true");
+	info = SPA_DICT_INIT(items, 4);
+	plugin = pwtest_spa_plugin_new();
+	iface = pwtest_spa_plugin_load_interface(plugin, "support/libspa-support",
+						 SPA_NAME_SUPPORT_LOG, SPA_TYPE_INTERFACE_Log,
+						 &info);
+	pwtest_ptr_notnull(iface);
+
+	spa_log_logt((struct spa_log *)iface, SPA_LOG_LEVEL_TRACE, &topic,
+			file, 123, func, fmt, 42, "arg");
+	memset(topic_name, 'x', sizeof(topic_name) - 1);
+	memset(file, 'x', sizeof(file) - 1);
+	memset(func, 'x', sizeof(func) - 1);
+	memset(fmt, 'x', sizeof(fmt) - 1);
+
+	/* clearing the handle formats the pending messages */
+	spa_handle_clear(plugin->handles[0]);
+
+	fp = fopen(fname, "r");
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		if (strstr(buffer, "MARK 42 arg")) {
+			pwtest_ptr_notnull(strstr(buffer, "*T*"));
+			pwtest_ptr_notnull(strstr(buffer, "test.topic"));
+			pwtest_ptr_notnull(strstr(buffer, "test-file.c"));
+			pwtest_ptr_notnull(strstr(buffer, "test_func()"));
+			mark_line_found = true;
+		}
+	}
+	fclose(fp);
+
+	pwtest_bool_true(mark_line_found);
+	pwtest_spa_plugin_destroy(plugin);
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+#define N_TRACE_THREADS	16
+
+struct trace_thread {
+	struct spa_log *log;
+	pthread_barrier_t *barrier;
+	int index;
+};
+
+static void *trace_thread_func(void *data)
+{
+	struct trace_thread *t = data;
+
+	pthread_barrier_wait(t->barrier);
+	spa_log_trace(t->log, "THREAD %d", t->index);
+	return NULL;
+}
+
+/* With the expected number of threads, each thread has a ring when it logs
+ * its first message and no message is lost */
+PWTEST(logger_binary_trace_threads)
+{
+	struct pwtest_spa_plugin *plugin;
+	void *iface;
+	char fname[PATH_MAX];
+	char threads[16];
+	struct spa_dict_item items[4];
+	struct spa_dict info;
+	char buffer[1024];
+	pthread_barrier_t barrier;
+	pthread_t thread_ids[N_TRACE_THREADS];
+	struct trace_thread thread_data[N_TRACE_THREADS];
+	bool found[N_TRACE_THREADS] = { false, };
+	FILE *fp;
+	int i;
+
+	pw_init(0, NULL);
+
+	pwtest_mkstemp(fname);
+	spa_scnprintf(threads, sizeof(threads), "%d", N_TRACE_THREADS);
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_FILE, fname);
+	items[1] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LEVEL, "5");
+	items[2] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_BINARY_TRACE, "true");
+	items[3] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_BINARY_TRACE_THREADS, threads);
+	info = SPA_DICT_INIT(items, 4);
+	plugin = pwtest_spa_plugin_new();
+	iface = pwtest_spa_plugin_load_interface(plugin, "support/libspa-support",
+						 SPA_NAME_SUPPORT_LOG, SPA_TYPE_INTERFACE_Log,
+						 &info);
+	pwtest_ptr_notnull(iface);
+
+	/* all threads log at the same time, before the trace thread can make
+	 * more rings */
+	pthread_barrier_init(&barrier, NULL, N_TRACE_THREADS);
+	for (i = 0; i < N_TRACE_THREADS; i++) {
+		thread_data[i].log = iface;
+		thread_data[i].barrier = &barrier;
+		thread_data[i].index = i;
+		pwtest_int_eq(pthread_create(&thread_ids[i], NULL,
+					trace_thread_func, &thread_data[i]), 0);
+	}
+	for (i = 0; i < N_TRACE_THREADS; i++)
+		pthread_join(thread_ids[i], NULL);
+	pthread_barrier_destroy(&barrier);
+
+	spa_handle_clear(plugin->handles[0]);
+
+	fp = fopen(fname, "r");
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		const char *str = strstr(buffer, "THREAD ");
+		if (str == NULL)
+			continue;
+		i = atoi(str + strlen("THREAD "));
+		pwtest_int_ge(i, 0);
+		pwtest_int_lt(i, N_TRACE_THREADS);
+		found[i] = true;
+	}
+	fclose(fp);
+
+	for (i = 0; i < N_TRACE_THREADS; i++)
+		pwtest_bool_true(found[i]);
+
+	pwtest_spa_plugin_destroy(plugin);
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(logger)
 {
 	pwtest_add(logger_truncate_long_lines, PWTEST_NOARG);
@@ -647,6 +864,9 @@ PWTEST_SUITE(logger)
 		   PWTEST_ARG_RANGE, 0, 5, /* see the test */
 		   PWTEST_NOARG);
 	pwtest_add(logger_topics, PWTEST_NOARG);
+	pwtest_add(logger_trace_encoding, PWTEST_NOARG);
+	pwtest_add(logger_binary_trace, PWTEST_NOARG);
+	pwtest_add(logger_binary_trace_threads, PWTEST_NOARG);
 	pwtest_add(logger_journal, PWTEST_NOARG);
 	pwtest_add(logger_journal_chain, PWTEST_NOARG);
 
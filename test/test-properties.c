@@ -605,6 +605,133 @@ PWTEST(properties_update)
 	return PWTEST_PASS;
 }
 
+/* every item must be found with the index, like with a linear lookup, which
+ * returns the first item when a key is in the dict more than once */
+static void check_lookups(struct pw_properties *props)
+{
+	const struct spa_dict_item *item;
+
+	spa_dict_for_each(item, &props->dict)
+		pwtest_str_eq(pw_properties_get(props, item->key),
+				spa_dict_lookup(&props->dict, item->key));
+}
+
+PWTEST(properties_index)
+{
+	struct pw_properties *props, *copy;
+	struct spa_dict_item items[20];
+	char key[32], value[32];
+	int i;
+
+	props = pw_properties_new(NULL, NULL);
+	pwtest_ptr_notnull(props);
+
+	/* enough items to make the index, it grows a few times */
+	for (i = 0; i < 200; i++) {
+		spa_scnprintf(key, sizeof(key), "key.%d", i);
+		spa_scnprintf(value, sizeof(value), "value.%d", i);
+		pwtest_int_eq(pw_properties_set(props, key, value), 1);
+	}
+	pwtest_int_eq(props->dict.n_items, 200U);
+	for (i = 0; i < 200; i++) {
+		spa_scnprintf(key, sizeof(key), "key.%d", i);
+		spa_scnprintf(value, sizeof(value), "value.%d", i);
+		pwtest_str_eq(props->dict.items[i].key, key);
+		pwtest_str_eq(pw_properties_get(props, key), value);
+	}
+	pwtest_ptr_null(pw_properties_get(props, "key.200"));
+	pwtest_ptr_null(pw_properties_get(props, "key"));
+	check_lookups(props);
+
+	/* changing a value keeps the item */
+	pwtest_int_eq(pw_properties_set(props, "key.7", "changed"), 1);
+	pwtest_str_eq(pw_properties_get(props, "key.7"), "changed");
+	pwtest_str_eq(props->dict.items[7].value, "changed");
+
+	/* remove items, the last item is moved in their place */
+	for (i = 0; i < 200; i += 3) {
+		spa_scnprintf(key, sizeof(key), "key.%d", i);
+		pwtest_int_eq(pw_properties_set(props, key, NULL), 1);
+		pwtest_int_eq(pw_properties_set(props, key, NULL), 0);
+	}
+	pwtest_int_eq(props->dict.n_items, 133U);
+	for (i = 0; i < 200; i++) {
+		spa_scnprintf(key, sizeof(key), "key.%d", i);
+		spa_scnprintf(value, sizeof(value), "value.%d", i);
+		if (i % 3 == 0)
+			pwtest_ptr_null(pw_properties_get(props, key));
+		else if (i != 7)
+			pwtest_str_eq(pw_properties_get(props, key), value);
+	}
+	check_lookups(props);
+
+	/* the copy gets its own index */
+	copy = pw_properties_copy(props);
+	pwtest_ptr_notnull(copy);
+	pwtest_int_eq(copy->dict.n_items, 133U);
+	pwtest_str_eq(pw_properties_get(copy, "key.7"), "changed");
+	pwtest_ptr_null(pw_properties_get(copy, "key.9"));
+	check_lookups(copy);
+	pw_properties_free(copy);
+
+	/* remove until there are too few items for the index and add
+	 * them again */
+	for (i = 0; i < 190; i++) {
+		spa_scnprintf(key, sizeof(key), "key.%d", i);
+		pw_properties_set(props, key, NULL);
+	}
+	pwtest_int_eq(props->dict.n_items, 7U);
+	check_lookups(props);
+	for (i = 0; i < 30; i++) {
+		spa_scnprintf(key, sizeof(key), "key.%d", i);
+		pw_properties_set(props, key, "again");
+	}
+	pwtest_int_eq(props->dict.n_items, 37U);
+	pwtest_str_eq(pw_properties_get(props, "key.29"), "again");
+	pwtest_str_eq(pw_properties_get(props, "key.199"), "value.199");
+	check_lookups(props);
+
+	pw_properties_clear(props);
+	pwtest_int_eq(props->dict.n_items, 0U);
+	pwtest_ptr_null(pw_properties_get(props, "key.199"));
+	pw_properties_free(props);
+
+	/* a dict with duplicate keys, the first item is found */
+	for (i = 0; i < 20; i++) {
+		spa_scnprintf(key, sizeof(key), "key.%d", i);
+		items[i] = SPA_DICT_ITEM_INIT(strdup(key), "value");
+	}
+	items[3] = SPA_DICT_ITEM_INIT("dup", "first");
+	items[17] = SPA_DICT_ITEM_INIT("dup", "second");
+	props = pw_properties_new_dict(&SPA_DICT_INIT_ARRAY(items));
+	pwtest_ptr_notnull(props);
+	pwtest_int_eq(props->dict.n_items, 20U);
+	pwtest_str_eq(pw_properties_get(props, "dup"), "first");
+	check_lookups(props);
+
+	/* removing a duplicate key makes the next one visible */
+	pwtest_int_eq(pw_properties_set(props, "dup", NULL), 1);
+	pwtest_int_eq(props->dict.n_items, 19U);
+	pwtest_str_eq(pw_properties_get(props, "dup"), "second");
+	check_lookups(props);
+	pwtest_int_eq(pw_properties_set(props, "key.5", NULL), 1);
+	pwtest_ptr_null(pw_properties_get(props, "key.5"));
+	pwtest_str_eq(pw_properties_get(props, "key.19"), "value");
+	check_lookups(props);
+	pwtest_int_eq(pw_properties_set(props, "dup", NULL), 1);
+	pwtest_ptr_null(pw_properties_get(props, "dup"));
+	pwtest_int_eq(props->dict.n_items, 17U);
+	check_lookups(props);
+	pw_properties_free(props);
+
+	for (i = 0; i < 20; i++) {
+		if (i != 3 && i != 17)
+			free((char *)items[i].key);
+	}
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(properties)
 {
 	pwtest_add(properties_abi, PWTEST_NOARG);
@@ -624,6 +751,7 @@ PWTEST_SUITE(properties)
 	pwtest_add(properties_new_dict, PWTEST_NOARG);
 	pwtest_add(properties_new_json, PWTEST_NOARG);
 	pwtest_add(properties_update, PWTEST_NOARG);
+	pwtest_add(properties_index, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }